@@ -69,8 +69,9 @@ trap 'rm -f "$TEMP_FILE" "$TEMP_FILE.peers"' EXIT
             continue
         fi
 
-        # Enforce proper URI format - must be tls://, tcp:// or quic:// followed by host and port.
-        if ! echo "$line" | grep -qE '^(tls|tcp|quic)://(\[[A-Fa-f0-9:.]+\]|[A-Za-z0-9.-]+):[0-9]+$'; then
+        # Enforce proper URI format - must be tls://, tcp:// or quic:// followed by host and port,
+        # optionally with the SNI to use for an IP address literal.
+        if ! echo "$line" | grep -qE '^(tls|tcp|quic)://(\[[A-Fa-f0-9:.]+\]|[A-Za-z0-9.-]+):[0-9]+(\?sni=[A-Za-z0-9.-]+)?$'; then
             [ "$VERBOSE_MODE" = "1" ] && echo "Debug: Skipping invalid peer URI format: $line" >&2
             continue
         fi
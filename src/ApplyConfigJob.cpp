@@ -0,0 +1,483 @@
+/**
+ * @file ApplyConfigJob.cpp
+ * @brief Implementation file for the ApplyConfigJob class.
+ *
+ * Contains the asynchronous implementation of applying selected peers to
+ * the Yggdrasil configuration.
+ */
+
+#include <QDebug>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include "ApplyConfigJob.h"
+
+static const QString SCRIPT_PATH = "/tmp/yggtray-update-peers.sh";
+static const QString POLICY_PATH = "/tmp/org.yggtray.updatepeers.policy";
+
+/**
+ * @brief Constructor for ApplyConfigJob
+ * @param peers Peers selected by the user.
+ * @param debugMode Whether to run the update script in verbose mode.
+ * @param serviceName Name of the Yggdrasil systemd service.
+ * @param socketPaths Yggdrasil admin socket path candidates.
+ * @param parent Optional QObject parent.
+ */
+ApplyConfigJob::ApplyConfigJob(const QList<PeerData>& peers,
+                               bool debugMode,
+                               const QString& serviceName,
+                               const QStringList& socketPaths,
+                               QObject *parent)
+    : QObject(parent)
+    , selectedPeers(peers)
+    , debugMode(debugMode)
+    , serviceName(serviceName)
+    , socketPaths(socketPaths)
+    , currentStage(NotStarted)
+    , cancellable(true)
+    , canceled(false)
+    , process(nullptr)
+    , socket(new QLocalSocket(this))
+    , pollTimer(new QTimer(this)) {
+    qRegisterMetaType<ApplyConfigJob::Stage>("ApplyConfigJob::Stage");
+
+    pollTimer->setInterval(PEER_POLL_INTERVAL_MS);
+    connect(pollTimer, &QTimer::timeout, this, &ApplyConfigJob::pollPeers);
+    connect(socket, &QLocalSocket::connected,
+            this, &ApplyConfigJob::onSocketConnected);
+    connect(socket, &QLocalSocket::readyRead,
+            this, &ApplyConfigJob::onSocketReadyRead);
+}
+
+/**
+ * @brief Destructor for ApplyConfigJob
+ */
+ApplyConfigJob::~ApplyConfigJob() {
+    if (process && (process->state() != QProcess::NotRunning)) {
+        // Don't leave a half-finished privileged command behind.
+        qDebug() << "[ApplyConfigJob::~ApplyConfigJob]"
+                 << "Waiting for" << process->program() << "to finish";
+        process->waitForFinished(-1);
+    }
+    removeExtractedFiles();
+}
+
+/**
+ * @brief Get a human-readable description of a stage.
+ * @param stage The stage to describe.
+ */
+QString ApplyConfigJob::stageDescription(Stage stage) {
+    switch (stage) {
+    case NotStarted:
+        return tr("Not started");
+    case WritingPeerList:
+        return tr("Writing peer list...");
+    case ValidatingPeerList:
+        return tr("Validating peer list...");
+    case UpdatingConfig:
+        return tr("Updating configuration (authentication required)...");
+    case RestartingService:
+        return tr("Restarting Yggdrasil...");
+    case WaitingForPeers:
+        return tr("Waiting for peers to connect...");
+    case Finished:
+        return tr("Finished");
+    }
+    return QString();
+}
+
+/**
+ * @brief Start the job.  Stages are run from the event loop.
+ */
+void ApplyConfigJob::start() {
+    if (currentStage != NotStarted) {
+        return;
+    }
+    setStage(WritingPeerList);
+    QTimer::singleShot(0, this, &ApplyConfigJob::writePeerList);
+}
+
+/**
+ * @brief Cancel the job.
+ * @return true if the job was canceled (or stopped waiting for peers),
+ * false if it is in a stage that cannot be interrupted.
+ */
+bool ApplyConfigJob::cancel() {
+    if (! isCancellable()) {
+        qDebug() << "[ApplyConfigJob::cancel] Cannot cancel at stage"
+                 << currentStage;
+        return false;
+    }
+
+    if (currentStage == WaitingForPeers) {
+        succeed(tr("Configuration updated successfully"));
+    } else {
+        canceled = true;
+        fail(tr("Apply canceled"));
+    }
+    return true;
+}
+
+/**
+ * @brief Check whether cancel() would currently succeed.
+ */
+bool ApplyConfigJob::isCancellable() const {
+    return cancellable && (currentStage != Finished);
+}
+
+/**
+ * @brief Select peers and write them into a temporary file.
+ */
+void ApplyConfigJob::writePeerList() {
+    if (currentStage != WritingPeerList) {
+        return; // Canceled
+    }
+
+    configPeers = PeerManager::selectConfigPeers(selectedPeers);
+    const QList<PeerData>& peers = configPeers;
+    for (const auto& peer : peers) {
+        qDebug() << "[ApplyConfigJob::writePeerList]"
+                 << "Using peer:"
+                 << peer.host();
+    }
+
+    peersFile.reset(new QTemporaryFile());
+    if (! peersFile->open()) {
+        fail(tr("Failed to create temporary peers file: %1")
+             .arg(peersFile->errorString()));
+        return;
+    }
+
+    QTextStream stream(peersFile.get());
+    writePeers(stream, peers);
+    stream.flush();
+    qDebug() << "[ApplyConfigJob::writePeerList] Wrote"
+             << peers.count() << "peers";
+
+    setStage(ValidatingPeerList);
+    QTimer::singleShot(0, this, &ApplyConfigJob::validatePeerList);
+}
+
+/**
+ * @brief Check the written peer list and prepare the update script.
+ */
+void ApplyConfigJob::validatePeerList() {
+    if (currentStage != ValidatingPeerList) {
+        return; // Canceled
+    }
+
+    // Read back the file to verify that it contains usable peers.
+    peersFile->seek(0);
+    int validPeers = 0;
+    QTextStream stream(peersFile.get());
+    while (! stream.atEnd()) {
+        QString line = stream.readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        if (isPeerUriValid(line)) {
+            ++validPeers;
+        }
+    }
+    peersFile->seek(0);  // Reset position for the script to read
+    qDebug() << "[ApplyConfigJob::validatePeerList] Valid peers in file:"
+             << validPeers;
+
+    if (validPeers == 0) {
+        fail(tr("No valid peers to apply"));
+        return;
+    }
+
+    // Extract update script to /tmp
+    if (! PeerManager::extractResource(":/scripts/update-peers.sh",
+                                       SCRIPT_PATH)) {
+        fail(tr("Failed to extract update script"));
+        return;
+    }
+
+    if (! PeerManager::extractResource(
+            ":/polkit/org.yggtray.updatepeers.policy",
+            POLICY_PATH)) {
+        fail(tr("Failed to extract policy file"));
+        return;
+    }
+
+    QTimer::singleShot(0, this, &ApplyConfigJob::updateConfig);
+}
+
+/**
+ * @brief Run the update script with elevated privileges.
+ */
+void ApplyConfigJob::updateConfig() {
+    if (currentStage != ValidatingPeerList) {
+        return; // Canceled
+    }
+
+    // From here on the job cannot be canceled.
+    setCancellable(false);
+    setStage(UpdatingConfig);
+
+    QStringList args;
+    if (debugMode) {
+        args << "sh" << SCRIPT_PATH << "--verbose" << peersFile->fileName();
+    } else {
+        args << "sh" << SCRIPT_PATH << peersFile->fileName();
+    }
+
+    qDebug() << "[ApplyConfigJob::updateConfig]"
+             << "Executing update script - command: pkexec" << args;
+    startProcess("pkexec", args, &ApplyConfigJob::onUpdateScriptFinished);
+}
+
+/**
+ * @brief Handle the update script result.
+ * @param exitCode Exit code of the script.
+ * @param status Exit status of the script.
+ */
+void ApplyConfigJob::onUpdateScriptFinished(int exitCode,
+                                            QProcess::ExitStatus status) {
+    removeExtractedFiles();
+
+    QString stdErr = QString::fromUtf8(process->readAllStandardError());
+    QString stdOut = QString::fromUtf8(process->readAllStandardOutput());
+
+    if ((status != QProcess::NormalExit) || (exitCode != 0)) {
+        // Special case: If the output contains "updated successfully" but
+        // exit code is non-zero, consider it a success and ignore the exit
+        // code
+        bool reportedSuccess = stdOut.contains("updated successfully")
+            || stdErr.contains("updated successfully");
+        if (! ((status == QProcess::NormalExit) && (exitCode == 1)
+               && reportedSuccess)) {
+            QString errorMsg = tr("Update script failed with exit code %1")
+                .arg(exitCode);
+            if (! stdErr.trimmed().isEmpty()) {
+                errorMsg += ": " + stdErr.trimmed();
+            } else if (! stdOut.trimmed().isEmpty()) {
+                errorMsg += ": " + stdOut.trimmed();
+            }
+            fail(errorMsg);
+            return;
+        }
+        qDebug() << "[ApplyConfigJob::onUpdateScriptFinished]"
+                 << "Script exited with code 1 but reported success,"
+                 << "treating as successful";
+    }
+
+    if (! stdOut.trimmed().isEmpty()) {
+        qDebug() << "[ApplyConfigJob::onUpdateScriptFinished]"
+                 << "Script output:" << stdOut.trimmed();
+    }
+
+    setStage(RestartingService);
+    checkServiceActive();
+}
+
+/**
+ * @brief Check whether the service runs and so needs a restart.
+ */
+void ApplyConfigJob::checkServiceActive() {
+    startProcess("systemctl",
+                 QStringList() << "is-active" << serviceName,
+                 &ApplyConfigJob::onServiceCheckFinished);
+}
+
+/**
+ * @brief Restart the service if it is running.
+ * @param exitCode Exit code of "systemctl is-active".
+ * @param status Exit status of "systemctl is-active".
+ */
+void ApplyConfigJob::onServiceCheckFinished(int exitCode,
+                                            QProcess::ExitStatus status) {
+    QString output = QString::fromUtf8(process->readAllStandardOutput());
+    bool isActive = (status == QProcess::NormalExit) && (exitCode == 0)
+        && (output.trimmed() == "active");
+    if (! isActive) {
+        qDebug() << "[ApplyConfigJob::onServiceCheckFinished]"
+                 << serviceName << "is not running, skipping restart";
+        succeed(tr("Configuration updated successfully"));
+        return;
+    }
+
+    startProcess("pkexec",
+                 QStringList() << "systemctl" << "restart" << serviceName,
+                 &ApplyConfigJob::onRestartFinished);
+}
+
+/**
+ * @brief Handle the service restart result.
+ * @param exitCode Exit code of "systemctl restart".
+ * @param status Exit status of "systemctl restart".
+ */
+void ApplyConfigJob::onRestartFinished(int exitCode,
+                                       QProcess::ExitStatus status) {
+    if ((status != QProcess::NormalExit) || (exitCode != 0)) {
+        QString stdErr
+            = QString::fromUtf8(process->readAllStandardError()).trimmed();
+        fail(tr("Configuration updated, but restarting %1 failed: %2")
+             .arg(serviceName, stdErr));
+        return;
+    }
+
+    setStage(WaitingForPeers);
+    // Waiting can be skipped by the user.
+    setCancellable(true);
+    waitTimer.start();
+    pollTimer->start();
+    pollPeers();
+}
+
+/**
+ * @brief Ask the admin socket for the connected peers.
+ */
+void ApplyConfigJob::pollPeers() {
+    if (currentStage != WaitingForPeers) {
+        return;
+    }
+
+    if (waitTimer.elapsed() > PEER_WAIT_TIMEOUT_MS) {
+        succeed(tr("Configuration updated, but no peers connected within"
+                   " %1 seconds").arg(PEER_WAIT_TIMEOUT_MS / 1000));
+        return;
+    }
+
+    if (socket->state() != QLocalSocket::UnconnectedState) {
+        return; // Previous request is still in flight.
+    }
+
+    // The socket may appear only after the service is restarted, so look
+    // for it on every poll.
+    for (const QString& path : socketPaths) {
+        if (QFile::exists(path)) {
+            socketBuffer.clear();
+            socket->connectToServer(path);
+            return;
+        }
+    }
+    qDebug() << "[ApplyConfigJob::pollPeers] Admin socket not found yet";
+}
+
+/**
+ * @brief Send the "getpeers" request once the socket is connected.
+ */
+void ApplyConfigJob::onSocketConnected() {
+    QJsonObject request {{"request", "getpeers"}};
+    socket->write(QJsonDocument(request).toJson(QJsonDocument::Compact)
+                  + "\n");
+}
+
+/**
+ * @brief Collect the "getpeers" response and check for connected peers.
+ */
+void ApplyConfigJob::onSocketReadyRead() {
+    socketBuffer += socket->readAll();
+    QJsonDocument doc = QJsonDocument::fromJson(socketBuffer);
+    if (! doc.isObject()) {
+        return; // Response is not complete yet.
+    }
+    socket->abort();
+
+    int connected = SocketManager::countConnectedPeers(doc.object());
+    qDebug() << "[ApplyConfigJob::onSocketReadyRead] Connected peers:"
+             << connected;
+    if (connected > 0) {
+        succeed(tr("Configuration updated successfully, %n peer(s)"
+                   " connected", "", connected));
+    }
+}
+
+/**
+ * @brief Set the current stage and report it.
+ * @param stage The new stage.
+ */
+void ApplyConfigJob::setStage(Stage stage) {
+    currentStage = stage;
+    qDebug() << "[ApplyConfigJob::setStage]" << stageDescription(stage);
+    emit stageChanged(stage, stageDescription(stage));
+}
+
+/**
+ * @brief Set whether the job can be canceled and report it.
+ * @param value Whether cancel() should succeed.
+ */
+void ApplyConfigJob::setCancellable(bool value) {
+    if (cancellable != value) {
+        cancellable = value;
+        emit cancellableChanged(value);
+    }
+}
+
+/**
+ * @brief Start a process asynchronously.
+ * @param program Program to run.
+ * @param arguments Program arguments.
+ * @param onFinished Slot to call when the process finishes.
+ */
+void ApplyConfigJob::startProcess(
+    const QString& program,
+    const QStringList& arguments,
+    void (ApplyConfigJob::*onFinished)(int, QProcess::ExitStatus)) {
+    if (process) {
+        process->deleteLater();
+    }
+    process = new QProcess(this);
+    connect(process,
+            static_cast<void (QProcess::*)(int, QProcess::ExitStatus)>(
+                &QProcess::finished),
+            this,
+            onFinished);
+    connect(process, &QProcess::errorOccurred,
+            this, [this, program](QProcess::ProcessError processError) {
+                if (processError == QProcess::FailedToStart) {
+                    fail(tr("Failed to start %1").arg(program));
+                }
+            });
+    process->start(program, arguments);
+}
+
+/**
+ * @brief Remove the update script and the policy file from /tmp.
+ */
+void ApplyConfigJob::removeExtractedFiles() {
+    if (QFile::exists(SCRIPT_PATH)) {
+        QFile::remove(SCRIPT_PATH);
+    }
+    if (QFile::exists(POLICY_PATH)) {
+        QFile::remove(POLICY_PATH);
+    }
+}
+
+/**
+ * @brief Finish the job successfully.
+ * @param message Result message.
+ */
+void ApplyConfigJob::succeed(const QString& message) {
+    if (currentStage == Finished) {
+        return;
+    }
+    pollTimer->stop();
+    socket->abort();
+    setCancellable(false);
+    setStage(Finished);
+    qDebug() << "[ApplyConfigJob::succeed]" << message;
+    emit finished(true, message);
+}
+
+/**
+ * @brief Finish the job with an error.
+ * @param message Error message.
+ */
+void ApplyConfigJob::fail(const QString& message) {
+    if (currentStage == Finished) {
+        return;
+    }
+    pollTimer->stop();
+    socket->abort();
+    removeExtractedFiles();
+    setCancellable(false);
+    setStage(Finished);
+    qDebug() << "[ApplyConfigJob::fail] Error:" << message;
+    emit finished(false, message);
+}
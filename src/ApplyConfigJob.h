@@ -0,0 +1,187 @@
+/**
+ * @file ApplyConfigJob.h
+ * @brief Header file for the ApplyConfigJob class.
+ *
+ * Applies a peer selection to the Yggdrasil configuration asynchronously.
+ */
+
+#ifndef APPLYCONFIGJOB_H
+#define APPLYCONFIGJOB_H
+
+#include <memory>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QLocalSocket>
+#include <QObject>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+#include <QTemporaryFile>
+#include <QTimer>
+
+#include "PeerManager.h"
+#include "SocketManager.h"
+
+/**
+ * @class ApplyConfigJob
+ * @brief Asynchronous "Apply" of selected peers.
+ *
+ * @details The job runs entirely on the event loop of the thread it lives
+ *          in, so the GUI stays responsive while pkexec waits for a
+ *          password or the service restarts.  It goes through the
+ *          following stages, reporting each via stageChanged():
+ *
+ *          1. WritingPeerList    - select peers and write them to a
+ *                                  temporary file;
+ *          2. ValidatingPeerList - check the written list and extract the
+ *                                  update script;
+ *          3. UpdatingConfig     - run the update script via pkexec
+ *                                  (privileged);
+ *          4. RestartingService  - restart the Yggdrasil service if it is
+ *                                  running (privileged);
+ *          5. WaitingForPeers    - poll the admin socket until at least one
+ *                                  peer is connected.
+ *
+ *          The job can be canceled before the first privileged stage.  While
+ *          waiting for peers, cancel() stops waiting and finishes the job
+ *          successfully, since the configuration is applied already.
+ */
+class ApplyConfigJob : public QObject {
+    Q_OBJECT
+
+public:
+    enum Stage {
+        NotStarted,
+        WritingPeerList,
+        ValidatingPeerList,
+        UpdatingConfig,
+        RestartingService,
+        WaitingForPeers,
+        Finished
+    };
+    Q_ENUM(Stage)
+
+    // Interval between admin socket polls while waiting for peers
+    static constexpr int PEER_POLL_INTERVAL_MS = 1000;
+    // How long to wait for the first connected peer
+    static constexpr int PEER_WAIT_TIMEOUT_MS = 30000;
+
+    /**
+     * @brief Constructor for ApplyConfigJob
+     * @param peers Peers selected by the user.
+     * @param debugMode Whether to run the update script in verbose mode.
+     * @param serviceName Name of the Yggdrasil systemd service.
+     * @param socketPaths Yggdrasil admin socket path candidates.
+     * @param parent Optional QObject parent.
+     */
+    explicit ApplyConfigJob(
+        const QList<PeerData>& peers,
+        bool debugMode = false,
+        const QString& serviceName = "yggdrasil",
+        const QStringList& socketPaths = SocketManager::defaultSocketPaths(),
+        QObject *parent = nullptr);
+    ~ApplyConfigJob();
+
+    /**
+     * @brief Start the job.  Stages are run from the event loop.
+     */
+    void start();
+
+    /**
+     * @brief Cancel the job.
+     * @return true if the job was canceled (or stopped waiting for peers),
+     * false if it is in a stage that cannot be interrupted.
+     */
+    bool cancel();
+
+    /**
+     * @brief Check whether cancel() would currently succeed.
+     */
+    bool isCancellable() const;
+
+    /**
+     * @brief Check whether the job was canceled before the configuration
+     * was updated.
+     */
+    bool wasCanceled() const { return canceled; }
+
+    /**
+     * @brief Get the current stage.
+     */
+    Stage stage() const { return currentStage; }
+
+    /**
+     * @brief Get the peers written to the configuration; empty before the
+     * list is written.
+     */
+    QList<PeerData> configuredPeers() const { return configPeers; }
+
+    /**
+     * @brief Get a human-readable description of a stage.
+     * @param stage The stage to describe.
+     */
+    static QString stageDescription(Stage stage);
+
+signals:
+    /**
+     * @brief Emitted when the job enters a new stage.
+     * @param stage The new stage.
+     * @param description Human-readable description of the stage.
+     */
+    void stageChanged(ApplyConfigJob::Stage stage, const QString& description);
+
+    /**
+     * @brief Emitted when the job becomes (non-)cancellable.
+     * @param cancellable Whether cancel() would succeed now.
+     */
+    void cancellableChanged(bool cancellable);
+
+    /**
+     * @brief Emitted exactly once when the job is done.
+     * @param success Whether the configuration was applied.
+     * @param message Human-readable result or error message.
+     */
+    void finished(bool success, const QString& message);
+
+private slots:
+    void writePeerList();
+    void validatePeerList();
+    void updateConfig();
+    void onUpdateScriptFinished(int exitCode, QProcess::ExitStatus status);
+    void checkServiceActive();
+    void onServiceCheckFinished(int exitCode, QProcess::ExitStatus status);
+    void onRestartFinished(int exitCode, QProcess::ExitStatus status);
+    void pollPeers();
+    void onSocketConnected();
+    void onSocketReadyRead();
+
+private:
+    void setStage(Stage stage);
+    void setCancellable(bool cancellable);
+    void startProcess(const QString& program,
+                      const QStringList& arguments,
+                      void (ApplyConfigJob::*onFinished)(int,
+                                                         QProcess::ExitStatus));
+    void removeExtractedFiles();
+    void succeed(const QString& message);
+    void fail(const QString& message);
+
+    QList<PeerData> selectedPeers;
+    QList<PeerData> configPeers;
+    bool debugMode;
+    QString serviceName;
+    QStringList socketPaths;
+
+    Stage currentStage;
+    bool cancellable;
+    bool canceled;
+    std::unique_ptr<QTemporaryFile> peersFile;
+    QProcess* process;
+    QLocalSocket* socket;
+    QByteArray socketBuffer;
+    QTimer* pollTimer;
+    QElapsedTimer waitTimer;
+};
+
+#endif // APPLYCONFIGJOB_H
@@ -0,0 +1,736 @@
+/**
+ * @file AsnDatabase.cpp
+ * @brief Implementation file for the AsnDatabase class.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtAlgorithms>
+
+#include "AsnDatabase.h"
+
+constexpr quint32 AsnDatabase::FORMAT_VERSION;
+
+// Message context of the import errors
+static const char* TR_CONTEXT = "AsnDatabase";
+// First bytes of a compiled database
+static const char MAGIC[8] = { 'Y', 'G', 'G', 'A', 'S', 'N', 'D', 'B' };
+// Files are written in host byte order; files of another order are rejected
+static const quint32 BYTE_ORDER_MARK = 0x01020304;
+// Child index of a missing child; the root is nobody's child
+static const quint32 NO_CHILD = 0;
+// Bits of an IPv4-mapped IPv6 address before the IPv4 address
+static const int IPV4_MAPPED_BITS = 96;
+
+/**
+ * @brief Header of a compiled database.
+ */
+struct FileHeader {
+    char magic[8];
+    quint32 version;
+    quint32 byteOrder;
+    quint32 nodeCount;
+    quint32 nameCount;
+    quint32 nameBytes;
+    quint32 prefixCount;
+};
+
+/**
+ * @brief A trie node in a compiled database.
+ */
+struct AsnDatabase::Node {
+    // Prefix bits from the most significant one; bits past length are zero
+    quint64 hi;
+    quint64 lo;
+    // Subtrees of the prefixes continuing with a 0 and with a 1 bit
+    quint32 child[2];
+    // Origin AS of the prefix, or 0 for a node that only branches
+    quint32 asn;
+    quint8 length;
+    quint8 reserved[3];
+};
+
+/**
+ * @brief An AS name in a compiled database, sorted by AS.
+ */
+struct AsnDatabase::NameEntry {
+    quint32 asn;
+    // Offset of the NUL-terminated UTF-8 name in the name data
+    quint32 offset;
+};
+
+namespace {
+
+/**
+ * @brief A 128-bit address or prefix, most significant bits first.
+ */
+struct Key {
+    quint64 hi = 0;
+    quint64 lo = 0;
+};
+
+// Get bit i of a key, counting from the most significant one.
+inline int keyBit(quint64 hi, quint64 lo, int i) {
+    return (i < 64) ? ((hi >> (63 - i)) & 1) : ((lo >> (127 - i)) & 1);
+}
+
+// Get the length of the common prefix of two keys, at most limit.
+inline int commonLength(quint64 aHi, quint64 aLo,
+                        quint64 bHi, quint64 bLo,
+                        int limit) {
+    int common;
+    if (aHi != bHi) {
+        common = qCountLeadingZeroBits(aHi ^ bHi);
+    } else if (aLo != bLo) {
+        common = 64 + qCountLeadingZeroBits(aLo ^ bLo);
+    } else {
+        common = 128;
+    }
+    return std::min(common, limit);
+}
+
+// Clear the bits of a key past a prefix length.
+Key maskKey(const Key& key, int length) {
+    Key masked;
+    if (length <= 0) {
+        return masked;
+    }
+    if (length < 64) {
+        masked.hi = key.hi & ~(~0ULL >> length);
+    } else if (length < 128) {
+        masked.hi = key.hi;
+        masked.lo = key.lo & ~(~0ULL >> (length - 64));
+    } else {
+        masked = key;
+    }
+    return masked;
+}
+
+// Set the bits of a key past a prefix length.
+Key fillKey(const Key& key, int length) {
+    Key filled = key;
+    if (length < 64) {
+        filled.hi |= ~0ULL >> length;
+        filled.lo = ~0ULL;
+    } else if (length < 128) {
+        filled.lo |= ~0ULL >> (length - 64);
+    }
+    return filled;
+}
+
+bool keyLessOrEqual(const Key& a, const Key& b) {
+    return (a.hi < b.hi) || ((a.hi == b.hi) && (a.lo <= b.lo));
+}
+
+// Get the number of trailing zero bits of a key.
+int trailingZeros(const Key& key) {
+    if (key.lo != 0) {
+        return qCountTrailingZeroBits(key.lo);
+    }
+    return (key.hi != 0) ? 64 + qCountTrailingZeroBits(key.hi) : 128;
+}
+
+// Add 2^bits to a key; false if that wraps around the address space.
+bool addPowerOfTwo(Key* key, int bits) {
+    if (bits >= 128) {
+        return false;
+    }
+    if (bits >= 64) {
+        quint64 hi = key->hi + (1ULL << (bits - 64));
+        bool wrapped = (hi < key->hi);
+        key->hi = hi;
+        return ! wrapped;
+    }
+    quint64 lo = key->lo + (1ULL << bits);
+    if (lo < key->lo) {
+        if (++key->hi == 0) {
+            return false;
+        }
+    }
+    key->lo = lo;
+    return true;
+}
+
+bool toKey(const QHostAddress& address, Key* key) {
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        key->hi = 0;
+        key->lo = 0x0000ffff00000000ULL | address.toIPv4Address();
+        return true;
+    }
+    if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        Q_IPV6ADDR bytes = address.toIPv6Address();
+        key->hi = 0;
+        key->lo = 0;
+        for (int i = 0; i < 8; ++i) {
+            key->hi = (key->hi << 8) | bytes[i];
+            key->lo = (key->lo << 8) | bytes[i + 8];
+        }
+        return true;
+    }
+    return false;
+}
+
+// Convert a prefix back to an address; IPv4-mapped prefixes become IPv4.
+QHostAddress fromKey(const Key& key, int length, int* displayLength) {
+    if ((key.hi == 0) && ((key.lo >> 32) == 0xffff)
+        && (length >= IPV4_MAPPED_BITS)) {
+        *displayLength = length - IPV4_MAPPED_BITS;
+        return QHostAddress(static_cast<quint32>(key.lo));
+    }
+    Q_IPV6ADDR bytes;
+    for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<quint8>(key.hi >> (56 - 8 * i));
+        bytes[i + 8] = static_cast<quint8>(key.lo >> (56 - 8 * i));
+    }
+    *displayLength = length;
+    return QHostAddress(bytes);
+}
+
+// Split an address range into the fewest prefixes that cover it.
+void appendRange(Key first,
+                 const Key& last,
+                 quint32 asn,
+                 QVector<AsnDatabase::Prefix>* prefixes) {
+    while (keyLessOrEqual(first, last)) {
+        int bits = trailingZeros(first);
+        while ((bits > 0)
+               && (! keyLessOrEqual(fillKey(first, 128 - bits), last))) {
+            --bits;
+        }
+        AsnDatabase::Prefix prefix;
+        prefix.address = fromKey(first, 128 - bits, &prefix.length);
+        prefix.asn = asn;
+        prefixes->append(prefix);
+        if (! addPowerOfTwo(&first, bits)) {
+            break;
+        }
+    }
+}
+
+/**
+ * @brief A trie node while the trie is built.
+ */
+struct BuildNode {
+    Key key;
+    quint32 child[2] = { NO_CHILD, NO_CHILD };
+    quint32 asn = 0;
+    int length = 0;
+};
+
+// Insert a prefix into a path-compressed trie.
+// Returns whether the prefix is new.
+bool insertPrefix(std::vector<BuildNode>& trie,
+                  const Key& key,
+                  int length,
+                  quint32 asn) {
+    quint32 parent = 0;
+    int side = 0;
+    quint32 index = 0;
+    for (;;) {
+        const int nodeLength = trie[index].length;
+        int common = commonLength(key.hi, key.lo,
+                                  trie[index].key.hi, trie[index].key.lo,
+                                  std::min(length, nodeLength));
+        if (common < nodeLength) {
+            // The prefix leaves the path of this node early: a new node
+            // takes its place and branches to it and to the prefix.
+            BuildNode branch;
+            branch.key = maskKey(key, common);
+            branch.length = common;
+            const Key& nodeKey = trie[index].key;
+            branch.child[keyBit(nodeKey.hi, nodeKey.lo, common)] = index;
+            quint32 branchIndex = static_cast<quint32>(trie.size());
+            if (common == length) {
+                branch.asn = asn;
+            } else {
+                BuildNode leaf;
+                leaf.key = key;
+                leaf.length = length;
+                leaf.asn = asn;
+                branch.child[keyBit(key.hi, key.lo, common)] = branchIndex + 1;
+                trie.push_back(branch);
+                trie.push_back(leaf);
+                trie[parent].child[side] = branchIndex;
+                return true;
+            }
+            trie.push_back(branch);
+            trie[parent].child[side] = branchIndex;
+            return true;
+        }
+
+        if (length == nodeLength) {
+            bool isNew = (trie[index].asn == 0);
+            trie[index].asn = asn;
+            return isNew;
+        }
+
+        int bit = keyBit(key.hi, key.lo, nodeLength);
+        quint32 next = trie[index].child[bit];
+        if (next == NO_CHILD) {
+            BuildNode leaf;
+            leaf.key = key;
+            leaf.length = length;
+            leaf.asn = asn;
+            trie[index].child[bit] = static_cast<quint32>(trie.size());
+            trie.push_back(leaf);
+            return true;
+        }
+        parent = index;
+        side = bit;
+        index = next;
+    }
+}
+
+// Parse an AS field such as "64496", "AS64496" or "64496_64497"; the
+// first AS of a multi-origin prefix counts.
+bool parseAsn(QByteArray field, quint32* asn) {
+    if (field.startsWith("AS") || field.startsWith("as")) {
+        field = field.mid(2);
+    }
+    int end = 0;
+    while ((end < field.size()) && (field[end] >= '0') && (field[end] <= '9')) {
+        ++end;
+    }
+    bool ok = false;
+    *asn = field.left(end).toUInt(&ok);
+    return ok;
+}
+
+} // namespace
+
+/**
+ * @brief Constructor for AsnDatabase
+ */
+AsnDatabase::AsnDatabase()
+    : mapping(nullptr)
+    , nodes(nullptr)
+    , nodeCount(0)
+    , nameEntries(nullptr)
+    , nameCount(0)
+    , nameData(nullptr)
+    , nameBytes(0)
+    , prefixes(0) {
+}
+
+/**
+ * @brief Destructor for AsnDatabase
+ */
+AsnDatabase::~AsnDatabase() {
+    close();
+}
+
+/**
+ * @brief Map a compiled database file.
+ * @param path Path of the file.
+ * @return false if the file is missing or malformed.
+ */
+bool AsnDatabase::open(const QString& path) {
+    static_assert(sizeof(FileHeader) == 32, "Unexpected header layout");
+    static_assert(sizeof(Node) == 32, "Unexpected node layout");
+    static_assert(sizeof(NameEntry) == 8, "Unexpected name entry layout");
+
+    close();
+    file.setFileName(path);
+    if (! file.open(QIODevice::ReadOnly)) {
+        qDebug() << "[AsnDatabase::open] Cannot open" << path
+                 << "-" << file.errorString();
+        return false;
+    }
+    qint64 size = file.size();
+    if (size < static_cast<qint64>(sizeof(FileHeader))) {
+        qDebug() << "[AsnDatabase::open] Truncated database" << path;
+        close();
+        return false;
+    }
+    mapping = file.map(0, size);
+    if (! mapping) {
+        qDebug() << "[AsnDatabase::open] Cannot map" << path
+                 << "-" << file.errorString();
+        close();
+        return false;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, mapping, sizeof(header));
+    qint64 expectedSize = static_cast<qint64>(sizeof(FileHeader))
+        + static_cast<qint64>(header.nodeCount) * sizeof(Node)
+        + static_cast<qint64>(header.nameCount) * sizeof(NameEntry)
+        + header.nameBytes;
+    if ((std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0)
+        || (header.version != FORMAT_VERSION)
+        || (header.byteOrder != BYTE_ORDER_MARK)
+        || (header.nodeCount == 0)
+        || (expectedSize != size)) {
+        qDebug() << "[AsnDatabase::open] Unsupported database" << path;
+        close();
+        return false;
+    }
+
+    // Check the links once so that lookups need no bounds checks.  Children
+    // have longer prefixes than their parents, so every walk ends.
+    const Node* mappedNodes
+        = reinterpret_cast<const Node*>(mapping + sizeof(FileHeader));
+    for (quint32 i = 0; i < header.nodeCount; ++i) {
+        const Node& node = mappedNodes[i];
+        bool valid = (node.length <= 128);
+        for (quint32 child : node.child) {
+            if ((child != NO_CHILD)
+                && ((child >= header.nodeCount)
+                    || (mappedNodes[child].length <= node.length))) {
+                valid = false;
+            }
+        }
+        if (! valid) {
+            qDebug() << "[AsnDatabase::open] Corrupt node" << i << "in" << path;
+            close();
+            return false;
+        }
+    }
+
+    const NameEntry* mappedNames = reinterpret_cast<const NameEntry*>(
+        mappedNodes + header.nodeCount);
+    const char* mappedNameData
+        = reinterpret_cast<const char*>(mappedNames + header.nameCount);
+    bool namesValid = (header.nameCount == 0)
+        || ((header.nameBytes > 0)
+            && (mappedNameData[header.nameBytes - 1] == '\0'));
+    for (quint32 i = 0; namesValid && (i < header.nameCount); ++i) {
+        namesValid = (mappedNames[i].offset < header.nameBytes)
+            && ((i == 0) || (mappedNames[i - 1].asn < mappedNames[i].asn));
+    }
+    if (! namesValid) {
+        qDebug() << "[AsnDatabase::open] Corrupt names in" << path;
+        close();
+        return false;
+    }
+
+    nodes = mappedNodes;
+    nodeCount = header.nodeCount;
+    nameEntries = mappedNames;
+    nameCount = header.nameCount;
+    nameData = mappedNameData;
+    nameBytes = header.nameBytes;
+    prefixes = static_cast<int>(header.prefixCount);
+    qDebug() << "[AsnDatabase::open] Mapped" << prefixes << "prefixes from"
+             << path;
+    return true;
+}
+
+/**
+ * @brief Unmap the database.
+ */
+void AsnDatabase::close() {
+    if (mapping) {
+        file.unmap(mapping);
+        mapping = nullptr;
+    }
+    file.close();
+    nodes = nullptr;
+    nodeCount = 0;
+    nameEntries = nullptr;
+    nameCount = 0;
+    nameData = nullptr;
+    nameBytes = 0;
+    prefixes = 0;
+}
+
+/**
+ * @brief Find the origin AS of an address.
+ * @param hi Upper 64 bits of the IPv6 (or IPv4-mapped) address.
+ * @param lo Lower 64 bits of the address.
+ * @param prefixLength Receives the length of the matching prefix.
+ * @return The AS, or 0 if no prefix contains the address.
+ */
+quint32 AsnDatabase::lookup(quint64 hi, quint64 lo, int* prefixLength) const {
+    if (! nodes) {
+        return 0;
+    }
+    quint32 asn = 0;
+    int length = 0;
+    quint32 index = 0;
+    for (;;) {
+        const Node& node = nodes[index];
+        if (commonLength(hi, lo, node.hi, node.lo, node.length)
+            < node.length) {
+            break;
+        }
+        if (node.asn != 0) {
+            asn = node.asn;
+            length = node.length;
+        }
+        if (node.length >= 128) {
+            break;
+        }
+        quint32 next = node.child[keyBit(hi, lo, node.length)];
+        if (next == NO_CHILD) {
+            break;
+        }
+        index = next;
+    }
+    if (prefixLength) {
+        *prefixLength = length;
+    }
+    return asn;
+}
+
+/**
+ * @brief Find the longest prefix that contains an address.
+ * @param address IPv4 or IPv6 address.
+ */
+AsnDatabase::Match AsnDatabase::lookup(const QHostAddress& address) const {
+    Match match;
+    Key key;
+    if (! toKey(address, &key)) {
+        return match;
+    }
+    int length = 0;
+    match.asn = lookup(key.hi, key.lo, &length);
+    if (match.isValid()) {
+        match.prefix = fromKey(maskKey(key, length), length,
+                               &match.prefixLength);
+    }
+    return match;
+}
+
+/**
+ * @brief Get the name of an AS.
+ * @param asn The AS number.
+ */
+QString AsnDatabase::asName(quint32 asn) const {
+    if (! nameEntries) {
+        return QString();
+    }
+    const NameEntry* end = nameEntries + nameCount;
+    const NameEntry* it = std::lower_bound(
+        nameEntries, end, asn,
+        [](const NameEntry& entry, quint32 value) {
+            return entry.asn < value;
+        });
+    if ((it == end) || (it->asn != asn)) {
+        return QString();
+    }
+    return QString::fromUtf8(nameData + it->offset);
+}
+
+/**
+ * @brief Describe an AS for display.
+ * @param asn The AS number.
+ */
+QString AsnDatabase::describe(quint32 asn) const {
+    if (asn == 0) {
+        return QString();
+    }
+    QString name = asName(asn);
+    return name.isEmpty()
+        ? QString("AS%1").arg(asn)
+        : QString("AS%1 %2").arg(asn).arg(name);
+}
+
+/**
+ * @brief Parse a prefix-to-AS or range-to-AS dump.
+ * @param device The dump, open for reading.
+ * @param prefixes Receives the routed prefixes.
+ * @param names Receives the AS names found in the dump.
+ * @return Number of lines that could not be parsed, or -1 if no line could.
+ */
+int AsnDatabase::parseDump(QIODevice* device,
+                           QVector<Prefix>* prefixes,
+                           QHash<quint32, QString>* names) {
+    int parsed = 0;
+    int failed = 0;
+    while (! device->atEnd()) {
+        QByteArray line = device->readLine().trimmed();
+        if (line.isEmpty() || line.startsWith('#')) {
+            continue;
+        }
+        QList<QByteArray> fields = line.split('\t');
+        if (fields.size() < 3) {
+            fields = line.simplified().split(' ');
+        }
+        quint32 asn = 0;
+        QHostAddress first;
+        if ((fields.size() < 3)
+            || (! first.setAddress(QString::fromLatin1(fields[0])))
+            || (! parseAsn(fields[2], &asn))) {
+            ++failed;
+            continue;
+        }
+
+        bool isLength = false;
+        int length = fields[1].toInt(&isLength);
+        if (isLength) {
+            // "prefix length ASN"
+            int maxLength
+                = (first.protocol() == QAbstractSocket::IPv4Protocol)
+                ? 32 : 128;
+            if ((length < 0) || (length > maxLength)) {
+                ++failed;
+                continue;
+            }
+            if (asn != 0) {
+                prefixes->append({ first, length, asn });
+            }
+        } else {
+            // "first last ASN country description"; AS 0 is not routed.
+            QHostAddress last;
+            Key firstKey;
+            Key lastKey;
+            if ((! last.setAddress(QString::fromLatin1(fields[1])))
+                || (last.protocol() != first.protocol())
+                || (! toKey(first, &firstKey))
+                || (! toKey(last, &lastKey))) {
+                ++failed;
+                continue;
+            }
+            if (asn != 0) {
+                appendRange(firstKey, lastKey, asn, prefixes);
+                if ((fields.size() >= 5) && (! names->contains(asn))) {
+                    names->insert(asn,
+                                  QString::fromUtf8(fields[4]).trimmed());
+                }
+            }
+        }
+        ++parsed;
+    }
+    return (parsed > 0) ? failed : -1;
+}
+
+/**
+ * @brief Compile prefixes into the memory-mappable file format.
+ * @param prefixes The routed prefixes.
+ * @param names AS names.
+ */
+QByteArray AsnDatabase::compile(const QVector<Prefix>& prefixes,
+                                const QHash<quint32, QString>& names) {
+    std::vector<BuildNode> trie(1);
+    trie.reserve(2 * prefixes.size() + 1);
+    quint32 prefixCount = 0;
+    for (const Prefix& prefix : prefixes) {
+        Key key;
+        if ((prefix.asn == 0) || (! toKey(prefix.address, &key))) {
+            continue;
+        }
+        int length = prefix.length;
+        if (prefix.address.protocol() == QAbstractSocket::IPv4Protocol) {
+            length += IPV4_MAPPED_BITS;
+        }
+        length = std::max(0, std::min(length, 128));
+        if (insertPrefix(trie, maskKey(key, length), length, prefix.asn)) {
+            ++prefixCount;
+        }
+    }
+
+    std::vector<quint32> namedAsns;
+    for (auto it = names.constBegin(); it != names.constEnd(); ++it) {
+        if ((it.key() != 0) && (! it.value().isEmpty())) {
+            namedAsns.push_back(it.key());
+        }
+    }
+    std::sort(namedAsns.begin(), namedAsns.end());
+    std::vector<NameEntry> nameTable;
+    QByteArray nameBlob;
+    for (quint32 asn : namedAsns) {
+        nameTable.push_back({ asn, static_cast<quint32>(nameBlob.size()) });
+        nameBlob += names.value(asn).toUtf8();
+        nameBlob += '\0';
+    }
+
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = FORMAT_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.nodeCount = static_cast<quint32>(trie.size());
+    header.nameCount = static_cast<quint32>(nameTable.size());
+    header.nameBytes = static_cast<quint32>(nameBlob.size());
+    header.prefixCount = prefixCount;
+
+    QByteArray data;
+    data.reserve(static_cast<int>(sizeof(header)
+                                  + trie.size() * sizeof(Node)
+                                  + nameTable.size() * sizeof(NameEntry))
+                 + nameBlob.size());
+    data.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const BuildNode& built : trie) {
+        Node node;
+        std::memset(&node, 0, sizeof(node));
+        node.hi = built.key.hi;
+        node.lo = built.key.lo;
+        node.child[0] = built.child[0];
+        node.child[1] = built.child[1];
+        node.asn = built.asn;
+        node.length = static_cast<quint8>(built.length);
+        data.append(reinterpret_cast<const char*>(&node), sizeof(node));
+    }
+    if (! nameTable.empty()) {
+        data.append(reinterpret_cast<const char*>(nameTable.data()),
+                    static_cast<int>(nameTable.size() * sizeof(NameEntry)));
+    }
+    data.append(nameBlob);
+    return data;
+}
+
+/**
+ * @brief Compile a dump into a database file.
+ * @param dumpPath Path of the dump.
+ * @param databasePath Path of the database file to write.
+ * @param error Receives a description of the failure.
+ */
+bool AsnDatabase::import(const QString& dumpPath,
+                         const QString& databasePath,
+                         QString* error) {
+    QString message;
+    QFile dump(dumpPath);
+    QVector<Prefix> prefixes;
+    QHash<quint32, QString> names;
+    int failed = -1;
+    if (! dump.open(QIODevice::ReadOnly)) {
+        message = QCoreApplication::translate(
+            TR_CONTEXT, "Cannot read %1: %2")
+            .arg(dumpPath, dump.errorString());
+    } else if ((failed = parseDump(&dump, &prefixes, &names)) < 0) {
+        message = QCoreApplication::translate(
+            TR_CONTEXT, "%1 is not a prefix-to-AS or range-to-AS table")
+            .arg(dumpPath);
+    }
+    if (! message.isEmpty()) {
+        qDebug() << "[AsnDatabase::import]" << message;
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+    qDebug() << "[AsnDatabase::import] Parsed" << prefixes.size()
+             << "prefixes," << failed << "lines skipped";
+
+    QDir().mkpath(QFileInfo(databasePath).absolutePath());
+    QSaveFile database(databasePath);
+    if ((! database.open(QIODevice::WriteOnly))
+        || (database.write(compile(prefixes, names)) < 0)
+        || (! database.commit())) {
+        message = QCoreApplication::translate(
+            TR_CONTEXT, "Cannot write %1: %2")
+            .arg(databasePath, database.errorString());
+        qDebug() << "[AsnDatabase::import]" << message;
+        if (error) {
+            *error = message;
+        }
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Get the path the database is kept at by default.
+ */
+QString AsnDatabase::defaultPath() {
+    return QStandardPaths::writableLocation(
+               QStandardPaths::GenericDataLocation)
+        + "/yggtray/asn.db";
+}
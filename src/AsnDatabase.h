@@ -0,0 +1,175 @@
+/**
+ * @file AsnDatabase.h
+ * @brief Header file for the AsnDatabase class.
+ *
+ * Offline lookup of the origin AS and the routed prefix of an IP address.
+ */
+
+#ifndef ASNDATABASE_H
+#define ASNDATABASE_H
+
+#include <QFile>
+#include <QHash>
+#include <QHostAddress>
+#include <QIODevice>
+#include <QString>
+#include <QVector>
+
+/**
+ * @class AsnDatabase
+ * @brief Longest-prefix match of IPv4 and IPv6 addresses to their origin AS.
+ *
+ * @details The prefix table is imported from a public dump, either a
+ *          routeviews prefix-to-AS file ("prefix length ASN" per line) or an
+ *          iptoasn range file ("first last ASN country description" per
+ *          line), and compiled into a path-compressed binary radix trie.
+ *          IPv4 prefixes are stored as IPv4-mapped IPv6 prefixes, so that
+ *          one trie serves both families.
+ *
+ *          The compiled file is the trie itself: fixed-size nodes that refer
+ *          to their children by index, followed by the AS names.  It is
+ *          memory-mapped rather than read, so opening costs a validation
+ *          pass and no allocations, and a lookup is a walk of at most one
+ *          node per distinct prefix length on the path.
+ *
+ *          A database is immutable once opened, so lookups may run on any
+ *          thread.
+ */
+class AsnDatabase {
+public:
+    // Version of the compiled file format
+    static constexpr quint32 FORMAT_VERSION = 1;
+
+    /**
+     * @brief A routed prefix and its origin AS.
+     */
+    struct Prefix {
+        QHostAddress address;
+        int length = 0;
+        quint32 asn = 0;
+    };
+
+    /**
+     * @brief Result of a lookup.
+     */
+    struct Match {
+        // Origin AS, or 0 if the address is not routed
+        quint32 asn = 0;
+        // The longest matching prefix
+        QHostAddress prefix;
+        int prefixLength = 0;
+
+        bool isValid() const { return asn != 0; }
+    };
+
+    AsnDatabase();
+    ~AsnDatabase();
+
+    /**
+     * @brief Map a compiled database file.
+     * @param path Path of a file in the format compile() produces.
+     * @return false if the file is missing or malformed; the database is
+     * empty then.
+     */
+    bool open(const QString& path);
+
+    /**
+     * @brief Unmap the database.
+     */
+    void close();
+
+    /**
+     * @brief Check whether a database is mapped.
+     */
+    bool isOpen() const { return nodes != nullptr; }
+
+    /**
+     * @brief Get the number of prefixes in the database.
+     */
+    int prefixCount() const { return prefixes; }
+
+    /**
+     * @brief Find the longest prefix that contains an address.
+     * @param address IPv4 or IPv6 address.
+     * @return The match; not valid if no prefix contains the address.
+     */
+    Match lookup(const QHostAddress& address) const;
+
+    /**
+     * @brief Find the origin AS of an address.
+     * @param hi Upper 64 bits of the IPv6 (or IPv4-mapped) address.
+     * @param lo Lower 64 bits of the address.
+     * @param prefixLength Receives the length of the matching prefix.
+     * @return The AS, or 0 if no prefix contains the address.
+     */
+    quint32 lookup(quint64 hi, quint64 lo, int* prefixLength = nullptr) const;
+
+    /**
+     * @brief Get the name of an AS.
+     * @param asn The AS number.
+     * @return The name from the dump, or an empty string if there is none.
+     */
+    QString asName(quint32 asn) const;
+
+    /**
+     * @brief Describe an AS for display, e.g. "AS64496 EXAMPLE-NET".
+     * @param asn The AS number.
+     */
+    QString describe(quint32 asn) const;
+
+    /**
+     * @brief Parse a prefix-to-AS or range-to-AS dump.
+     * @param device The dump, open for reading.
+     * @param prefixes Receives the routed prefixes; ranges are split into
+     * prefixes.
+     * @param names Receives the AS names found in the dump.
+     * @return Number of lines that could not be parsed, or -1 if no line
+     * could.
+     */
+    static int parseDump(QIODevice* device,
+                         QVector<Prefix>* prefixes,
+                         QHash<quint32, QString>* names);
+
+    /**
+     * @brief Compile prefixes into the memory-mappable file format.
+     * @param prefixes The routed prefixes; of duplicates, the last counts.
+     * @param names AS names.
+     */
+    static QByteArray compile(const QVector<Prefix>& prefixes,
+                              const QHash<quint32, QString>& names);
+
+    /**
+     * @brief Compile a dump into a database file.
+     * @param dumpPath Path of the dump.
+     * @param databasePath Path of the database file to write.
+     * @param error Receives a description of the failure.
+     * @return false if the dump could not be read or the file written.
+     */
+    static bool import(const QString& dumpPath,
+                       const QString& databasePath,
+                       QString* error = nullptr);
+
+    /**
+     * @brief Get the path the database is kept at by default.
+     */
+    static QString defaultPath();
+
+private:
+    struct Node;
+    struct NameEntry;
+
+    AsnDatabase(const AsnDatabase&) = delete;
+    AsnDatabase& operator=(const AsnDatabase&) = delete;
+
+    QFile file;
+    uchar* mapping;
+    const Node* nodes;
+    quint32 nodeCount;
+    const NameEntry* nameEntries;
+    quint32 nameCount;
+    const char* nameData;
+    quint32 nameBytes;
+    int prefixes;
+};
+
+#endif // ASNDATABASE_H
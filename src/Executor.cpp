@@ -0,0 +1,308 @@
+/**
+ * @file Executor.cpp
+ * @brief Implementation file for the Executor class.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <QDebug>
+
+#include "Executor.h"
+
+constexpr int Executor::RESERVED_INTERACTIVE_THREADS;
+constexpr int Executor::MAX_BACKGROUND_THREADS;
+
+/**
+ * @brief Runs a queued task on a pool thread and reports its end.
+ */
+class Executor::Worker : public QRunnable {
+public:
+    Worker(Executor* executor, Lane lane, const Task& task)
+        : executor(executor)
+        , lane(lane)
+        , task(task) {
+        setAutoDelete(true);
+    }
+
+    void run() override {
+        QElapsedTimer timer;
+        timer.start();
+        task.runnable->run();
+        qint64 runNs = timer.nsecsElapsed();
+        Executor::release(task.runnable);
+        executor->taskDone(lane, task.owner, runNs);
+    }
+
+private:
+    Executor* executor;
+    Lane lane;
+    Task task;
+};
+
+/**
+ * @brief Runs a function as a runnable.
+ */
+class FunctionRunnable : public QRunnable {
+public:
+    explicit FunctionRunnable(const std::function<void()>& task)
+        : task(task) {
+        setAutoDelete(true);
+    }
+
+    void run() override {
+        task();
+    }
+
+private:
+    std::function<void()> task;
+};
+
+/**
+ * @brief Constructor for Executor
+ * @param maxThreads Maximum number of worker threads.
+ */
+Executor::Executor(int maxThreads)
+    : threadLimit(std::max(RESERVED_INTERACTIVE_THREADS + 1, maxThreads))
+    , running(0) {
+    pool.setMaxThreadCount(threadLimit);
+    clock.start();
+    for (int i = 0; i < LANE_COUNT; ++i) {
+        queueLimits[i] = DEFAULT_QUEUE_LIMIT;
+    }
+}
+
+/**
+ * @brief Destructor; drops the queued tasks and waits for the running ones.
+ */
+Executor::~Executor() {
+    {
+        QMutexLocker locker(&mutex);
+        for (std::deque<Task>& queue : queues) {
+            for (const Task& task : queue) {
+                release(task.runnable);
+            }
+            queue.clear();
+        }
+    }
+    pool.waitForDone(-1);
+}
+
+/**
+ * @brief Get the executor shared by the whole application.
+ */
+Executor& Executor::instance() {
+    static Executor executor;
+    return executor;
+}
+
+/**
+ * @brief Get the name of a lane, for the log.
+ * @param lane The lane.
+ */
+QString Executor::laneName(Lane lane) {
+    switch (lane) {
+    case Interactive:
+        return "interactive";
+    case Normal:
+        return "normal";
+    case Background:
+        return "background";
+    }
+    return QString();
+}
+
+/**
+ * @brief Submit a runnable.
+ * @param lane Lane to run it in.
+ * @param runnable The runnable.
+ * @param owner Owner of the task.
+ * @return false if the queue of the lane is full.
+ */
+bool Executor::submit(Lane lane, QRunnable* runnable, const void* owner) {
+    QMutexLocker locker(&mutex);
+    std::deque<Task>& queue = queues[lane];
+    LaneStats& stats = laneStats[lane];
+    if (static_cast<int>(queue.size()) >= queueLimits[lane]) {
+        ++stats.rejected;
+        locker.unlock();
+        qDebug() << "[Executor::submit] Queue of the" << laneName(lane)
+                 << "lane is full, rejecting a task";
+        release(runnable);
+        return false;
+    }
+
+    queue.push_back({runnable, owner, clock.nsecsElapsed()});
+    ++stats.submitted;
+    stats.queued = static_cast<int>(queue.size());
+    stats.peakQueued = std::max(stats.peakQueued, stats.queued);
+    ++ownerTasks[owner];
+    dispatch();
+    return true;
+}
+
+/**
+ * @brief Submit a function.
+ * @param lane Lane to run it in.
+ * @param task The function.
+ * @param owner Owner of the task.
+ * @return false if the queue of the lane is full.
+ */
+bool Executor::submit(Lane lane,
+                      const std::function<void()>& task,
+                      const void* owner) {
+    return submit(lane, new FunctionRunnable(task), owner);
+}
+
+/**
+ * @brief Drop the queued tasks of an owner.
+ * @param owner The owner.
+ * @return Number of dropped tasks.
+ */
+int Executor::clear(const void* owner) {
+    std::vector<QRunnable*> dropped;
+    {
+        QMutexLocker locker(&mutex);
+        for (int lane = 0; lane < LANE_COUNT; ++lane) {
+            std::deque<Task>& queue = queues[lane];
+            std::deque<Task> kept;
+            for (const Task& task : queue) {
+                if (task.owner == owner) {
+                    dropped.push_back(task.runnable);
+                    ++laneStats[lane].dropped;
+                } else {
+                    kept.push_back(task);
+                }
+            }
+            queue.swap(kept);
+            laneStats[lane].queued = static_cast<int>(queue.size());
+        }
+        if (! dropped.empty()) {
+            int& remaining = ownerTasks[owner];
+            remaining -= static_cast<int>(dropped.size());
+            if (remaining <= 0) {
+                ownerTasks.remove(owner);
+                ownerDone.wakeAll();
+            }
+        }
+    }
+    // Runnables may have destructors that take time; do not hold the lock.
+    for (QRunnable* runnable : dropped) {
+        release(runnable);
+    }
+    return static_cast<int>(dropped.size());
+}
+
+/**
+ * @brief Wait until an owner has no queued or running tasks.
+ * @param owner The owner.
+ * @param msecs Timeout, or -1 to wait without a timeout.
+ * @return false on timeout.
+ */
+bool Executor::waitForDone(const void* owner, int msecs) {
+    QElapsedTimer timer;
+    timer.start();
+    QMutexLocker locker(&mutex);
+    while (ownerTasks.contains(owner)) {
+        if (msecs < 0) {
+            ownerDone.wait(&mutex);
+            continue;
+        }
+        qint64 remainingMs = msecs - timer.elapsed();
+        if ((remainingMs <= 0)
+            || (! ownerDone.wait(&mutex,
+                                 static_cast<unsigned long>(remainingMs)))) {
+            return ! ownerTasks.contains(owner);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Set the maximum number of queued tasks of a lane.
+ * @param lane The lane.
+ * @param limit Maximum number of queued tasks.
+ */
+void Executor::setQueueLimit(Lane lane, int limit) {
+    QMutexLocker locker(&mutex);
+    queueLimits[lane] = std::max(1, limit);
+}
+
+/**
+ * @brief Get the metrics of a lane.
+ * @param lane The lane.
+ */
+Executor::LaneStats Executor::stats(Lane lane) const {
+    QMutexLocker locker(&mutex);
+    return laneStats[lane];
+}
+
+/**
+ * @brief Check whether a task of a lane may start now.  Called locked.
+ * @param lane The lane.
+ */
+bool Executor::canStart(Lane lane) const {
+    if (running >= threadLimit) {
+        return false;
+    }
+    if (lane == Interactive) {
+        return true;
+    }
+    if (running >= threadLimit - RESERVED_INTERACTIVE_THREADS) {
+        return false;
+    }
+    return (lane != Background)
+        || (laneStats[Background].running < MAX_BACKGROUND_THREADS);
+}
+
+/**
+ * @brief Start queued tasks, highest lane first, while threads are free.
+ * Called locked.
+ */
+void Executor::dispatch() {
+    for (int i = 0; i < LANE_COUNT; ++i) {
+        Lane lane = static_cast<Lane>(i);
+        std::deque<Task>& queue = queues[lane];
+        LaneStats& stats = laneStats[lane];
+        while ((! queue.empty()) && canStart(lane)) {
+            Task task = queue.front();
+            queue.pop_front();
+            qint64 waitUs = (clock.nsecsElapsed() - task.queuedNs) / 1000;
+            stats.totalWaitUs += waitUs;
+            stats.maxWaitUs = std::max(stats.maxWaitUs, waitUs);
+            stats.queued = static_cast<int>(queue.size());
+            ++stats.running;
+            ++running;
+            pool.start(new Worker(this, lane, task));
+        }
+    }
+}
+
+/**
+ * @brief Record the end of a task and start the next ones.
+ * @param lane Lane of the task.
+ * @param owner Owner of the task.
+ * @param runNs Run time of the task.
+ */
+void Executor::taskDone(Lane lane, const void* owner, qint64 runNs) {
+    QMutexLocker locker(&mutex);
+    LaneStats& stats = laneStats[lane];
+    --stats.running;
+    ++stats.completed;
+    stats.totalRunUs += runNs / 1000;
+    --running;
+    if (--ownerTasks[owner] <= 0) {
+        ownerTasks.remove(owner);
+        ownerDone.wakeAll();
+    }
+    dispatch();
+}
+
+/**
+ * @brief Delete a runnable if it deletes itself after running.
+ * @param runnable The runnable.
+ */
+void Executor::release(QRunnable* runnable) {
+    if (runnable->autoDelete()) {
+        delete runnable;
+    }
+}
@@ -0,0 +1,194 @@
+/**
+ * @file Executor.h
+ * @brief Header file for the Executor class.
+ *
+ * Runs the background work of all subsystems on one bounded thread pool.
+ */
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <deque>
+#include <functional>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMutex>
+#include <QRunnable>
+#include <QString>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+/**
+ * @class Executor
+ * @brief Application-wide executor with priority lanes.
+ *
+ * @details Work is submitted to one of three lanes: interactive for actions
+ *          the user waits for (service status after a click, applying a
+ *          configuration, overlay tests), normal for peer sweeps, and
+ *          background for periodic monitoring and prefetching.  Queued work
+ *          is started highest lane first, in submission order within a
+ *          lane.
+ *
+ *          The normal and background lanes never occupy the last
+ *          RESERVED_INTERACTIVE_THREADS threads, so an interactive task
+ *          starts at once even while a sweep and monitoring run; background
+ *          work is further limited to MAX_BACKGROUND_THREADS.  Every lane
+ *          has a bounded queue, and a task submitted to a full lane is
+ *          rejected.
+ *
+ *          Tasks are submitted on behalf of an owner, so that an owner can
+ *          drop its queued tasks and wait for its running ones without
+ *          affecting the other subsystems.  The executor is thread-safe.
+ */
+class Executor {
+public:
+    enum Lane {
+        Interactive, ///< Work the user is waiting for
+        Normal,      ///< Peer sweeps
+        Background   ///< Monitoring and prefetching
+    };
+    // Number of lanes
+    static constexpr int LANE_COUNT = 3;
+    // Default number of worker threads of the application
+    static constexpr int DEFAULT_MAX_THREADS = 6;
+    // Threads the normal and background lanes leave to interactive work
+    static constexpr int RESERVED_INTERACTIVE_THREADS = 1;
+    // Threads background work may occupy at most
+    static constexpr int MAX_BACKGROUND_THREADS = 2;
+    // Default number of queued tasks per lane
+    static constexpr int DEFAULT_QUEUE_LIMIT = 256;
+
+    /**
+     * @brief Metrics of a lane.
+     */
+    struct LaneStats {
+        int queued = 0;
+        int running = 0;
+        // Highest number of queued tasks so far
+        int peakQueued = 0;
+        qint64 submitted = 0;
+        qint64 completed = 0;
+        // Tasks refused because the queue was full
+        qint64 rejected = 0;
+        // Tasks dropped from the queue by clear()
+        qint64 dropped = 0;
+        // Time between submission and start
+        qint64 totalWaitUs = 0;
+        qint64 maxWaitUs = 0;
+        qint64 totalRunUs = 0;
+
+        /**
+         * @brief Average time between submission and start.
+         */
+        qint64 averageWaitUs() const {
+            qint64 started = completed + running;
+            return (started > 0) ? totalWaitUs / started : 0;
+        }
+    };
+
+    /**
+     * @brief Constructor for Executor
+     * @param maxThreads Maximum number of worker threads.
+     */
+    explicit Executor(int maxThreads = DEFAULT_MAX_THREADS);
+
+    /**
+     * @brief Destructor; drops the queued tasks and waits for the running
+     * ones.
+     */
+    ~Executor();
+
+    /**
+     * @brief Get the executor shared by the whole application.
+     */
+    static Executor& instance();
+
+    /**
+     * @brief Get the name of a lane, for the log.
+     * @param lane The lane.
+     */
+    static QString laneName(Lane lane);
+
+    /**
+     * @brief Submit a runnable.
+     * @param lane Lane to run it in.
+     * @param runnable The runnable; deleted after it ran, or when it is
+     * rejected or dropped, if its autoDelete() is set.
+     * @param owner Owner of the task, for clear() and waitForDone().
+     * @return false if the queue of the lane is full.
+     */
+    bool submit(Lane lane, QRunnable* runnable, const void* owner = nullptr);
+
+    /**
+     * @brief Submit a function.
+     * @param lane Lane to run it in.
+     * @param task The function.
+     * @param owner Owner of the task, for clear() and waitForDone().
+     * @return false if the queue of the lane is full.
+     */
+    bool submit(Lane lane,
+                const std::function<void()>& task,
+                const void* owner = nullptr);
+
+    /**
+     * @brief Drop the queued tasks of an owner; running tasks continue.
+     * @param owner The owner.
+     * @return Number of dropped tasks.
+     */
+    int clear(const void* owner);
+
+    /**
+     * @brief Wait until an owner has no queued or running tasks.
+     * @param owner The owner.
+     * @param msecs Timeout, or -1 to wait without a timeout.
+     * @return false on timeout.
+     * @note Must not be called from a task of the same owner.
+     */
+    bool waitForDone(const void* owner, int msecs = -1);
+
+    /**
+     * @brief Set the maximum number of queued tasks of a lane.
+     * @param lane The lane.
+     * @param limit Maximum number of queued tasks.
+     */
+    void setQueueLimit(Lane lane, int limit);
+
+    /**
+     * @brief Get the maximum number of worker threads.
+     */
+    int maxThreads() const { return threadLimit; }
+
+    /**
+     * @brief Get the metrics of a lane.
+     * @param lane The lane.
+     */
+    LaneStats stats(Lane lane) const;
+
+private:
+    class Worker;
+
+    struct Task {
+        QRunnable* runnable;
+        const void* owner;
+        qint64 queuedNs;
+    };
+
+    bool canStart(Lane lane) const;
+    void dispatch();
+    void taskDone(Lane lane, const void* owner, qint64 runNs);
+    static void release(QRunnable* runnable);
+
+    mutable QMutex mutex;
+    QWaitCondition ownerDone;
+    QThreadPool pool;
+    QElapsedTimer clock;
+    int threadLimit;
+    int running;
+    std::deque<Task> queues[LANE_COUNT];
+    int queueLimits[LANE_COUNT];
+    LaneStats laneStats[LANE_COUNT];
+    // Queued and running tasks per owner
+    QHash<const void*, int> ownerTasks;
+};
+
+#endif // EXECUTOR_H
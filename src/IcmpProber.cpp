@@ -0,0 +1,795 @@
+/**
+ * @file IcmpProber.cpp
+ * @brief Implementation file for the IcmpProber class.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <QDebug>
+#include <QtEndian>
+
+#include "IcmpProber.h"
+
+#ifdef Q_OS_LINUX
+#include <net/if.h>
+#include <netinet/icmp6.h>
+#include <netinet/in.h>
+#include <netinet/ip_icmp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/errqueue.h>
+#include <linux/net_tstamp.h>
+#endif
+
+// Receive buffer of a socket, for the replies and send timestamps of
+// a round of requests
+static const int RECEIVE_BUFFER_SIZE = 1024 * 1024;
+
+// Kernel send timestamps further from the user-space send time are taken
+// for a mismatch and ignored
+static const qint64 MAX_SEND_STAMP_SKEW_NS = 1000000000LL;
+
+#ifdef Q_OS_LINUX
+
+/**
+ * @brief Header of an ICMP or ICMPv6 echo message.
+ */
+struct EchoHeader {
+    quint8 type;
+    quint8 code;
+    quint16 checksum;
+    quint16 identifier;
+    quint16 sequence;
+};
+
+/**
+ * @brief Read the clock the kernel software timestamps are taken with.
+ * @return Nanoseconds since the epoch.
+ */
+static qint64 realtimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/**
+ * @brief Fill a socket address.
+ * @param address The IP address.
+ * @param storage Receives the socket address, with port 0.
+ * @return Size of the socket address.
+ */
+static socklen_t toSockaddr(const QHostAddress& address,
+                            sockaddr_storage* storage) {
+    std::memset(storage, 0, sizeof(*storage));
+    if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        sockaddr_in6* sin6 = reinterpret_cast<sockaddr_in6*>(storage);
+        sin6->sin6_family = AF_INET6;
+        Q_IPV6ADDR ip = address.toIPv6Address();
+        std::memcpy(&sin6->sin6_addr, &ip, sizeof(ip));
+        QString scope = address.scopeId();
+        if (! scope.isEmpty()) {
+            bool ok;
+            sin6->sin6_scope_id = scope.toUInt(&ok);
+            if (! ok) {
+                sin6->sin6_scope_id = if_nametoindex(scope.toLocal8Bit());
+            }
+        }
+        return sizeof(sockaddr_in6);
+    }
+    sockaddr_in* sin = reinterpret_cast<sockaddr_in*>(storage);
+    sin->sin_family = AF_INET;
+    sin->sin_addr.s_addr = qToBigEndian(address.toIPv4Address());
+    return sizeof(sockaddr_in);
+}
+
+/**
+ * @brief Convert a kernel timestamp.
+ * @return Nanoseconds since the epoch, or -1 if the kernel gave none.
+ */
+static qint64 timespecNs(const struct timespec& ts) {
+    qint64 ns = ts.tv_sec * 1000000000LL + ts.tv_nsec;
+    return (ns > 0) ? ns : -1;
+}
+
+/**
+ * @brief Get the software timestamp of a received message.
+ * @param msg The message with its control data.
+ * @return Nanoseconds since the epoch, or -1 if there is none.
+ */
+static qint64 softwareTimestamp(msghdr& msg) {
+    for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+         cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level != SOL_SOCKET) {
+            continue;
+        }
+        if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+            scm_timestamping stamps;
+            std::memcpy(&stamps, CMSG_DATA(cmsg), sizeof(stamps));
+            return timespecNs(stamps.ts[0]);
+        }
+        if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec ts;
+            std::memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return timespecNs(ts);
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Preallocated messages for sendmmsg() and recvmmsg().
+ */
+struct IcmpProber::Buffers {
+    // Room for an echo message with some slack for larger replies
+    static constexpr int PACKET_SIZE = sizeof(EchoHeader) + PAYLOAD_SIZE + 64;
+    // Room for the timestamp and extended error control messages
+    static constexpr int CONTROL_SIZE = 512;
+
+    char packets[BATCH_SIZE][PACKET_SIZE];
+    char controls[BATCH_SIZE][CONTROL_SIZE];
+    sockaddr_storage names[BATCH_SIZE];
+    iovec iovecs[BATCH_SIZE];
+    mmsghdr messages[BATCH_SIZE];
+    // Targets of the socket a round is sent on
+    std::vector<int> round;
+
+    /**
+     * @brief Point the first messages at their buffers for receiving.
+     * @param count Number of messages.
+     */
+    void prepareReceive(int count) {
+        for (int i = 0; i < count; ++i) {
+            iovecs[i].iov_base = packets[i];
+            iovecs[i].iov_len = PACKET_SIZE;
+            msghdr& msg = messages[i].msg_hdr;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_name = &names[i];
+            msg.msg_namelen = sizeof(names[i]);
+            msg.msg_iov = &iovecs[i];
+            msg.msg_iovlen = 1;
+            msg.msg_control = controls[i];
+            msg.msg_controllen = CONTROL_SIZE;
+            messages[i].msg_len = 0;
+        }
+    }
+};
+
+#else
+
+struct IcmpProber::Buffers {
+};
+
+#endif // Q_OS_LINUX
+
+/**
+ * @brief Constructs a prober.
+ * @param echoCount Number of echo requests per target.
+ * @param intervalMs Interval between the requests to one target.
+ */
+IcmpProber::IcmpProber(int echoCount, int intervalMs)
+    : echoCount(std::max(1, echoCount))
+    , intervalMs(std::max(0, intervalMs))
+    , sendSlotMs(0)
+    , replies(0)
+    , maxRttNs(0)
+    , batching(true)
+    , syscalls(0)
+    , buffers(new Buffers) {
+    clock.start();
+}
+
+IcmpProber::~IcmpProber() {
+#ifdef Q_OS_LINUX
+    for (const Socket& socket : sockets) {
+        ::close(socket.fd);
+    }
+#endif
+}
+
+/**
+ * @brief Add an address to probe.
+ * @param address The IPv4 or IPv6 address.
+ * @param uplink Interface name or source address to probe from, or an empty
+ * string for the default route.
+ * @return Index of the target, or -1 if no socket could be opened or bound.
+ */
+int IcmpProber::addTarget(const QHostAddress& address, const QString& uplink) {
+#ifdef Q_OS_LINUX
+    int family;
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        family = AF_INET;
+    } else if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        family = AF_INET6;
+    } else {
+        return -1;
+    }
+    int socket = openSocket(family, uplink);
+    if (socket < 0) {
+        return -1;
+    }
+    Target target;
+    target.address = address;
+    target.socket = socket;
+    target.echoes.reserve(echoCount);
+    target.startMs = clock.elapsed();
+    if (sendSlotMs > 0) {
+        target.startMs = (target.startMs + sendSlotMs - 1)
+            / sendSlotMs * sendSlotMs;
+    }
+    target.rounds = 0;
+    target.lastSendMs = -1;
+    target.replies = 0;
+    target.released = false;
+    targets.push_back(target);
+    return static_cast<int>(targets.size()) - 1;
+#else
+    Q_UNUSED(address);
+    Q_UNUSED(uplink);
+    return -1;
+#endif
+}
+
+/**
+ * @brief Open the socket for a family and uplink, or reuse an open one.
+ * @return Index of the socket, or -1 on failure.
+ */
+int IcmpProber::openSocket(int family, const QString& uplink) {
+#ifdef Q_OS_LINUX
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        if ((sockets[i].family == family) && (sockets[i].uplink == uplink)) {
+            return static_cast<int>(i);
+        }
+    }
+
+    int protocol = IPPROTO_ICMPV6;
+    if (family == AF_INET) {
+        protocol = IPPROTO_ICMP;
+    }
+    int fd = ::socket(family, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                      protocol);
+    if (fd < 0) {
+        qDebug() << "[IcmpProber::openSocket] No ICMP datagram socket:"
+                 << std::strerror(errno);
+        return -1;
+    }
+
+    if (! uplink.isEmpty()) {
+        QHostAddress source;
+        int result;
+        if (source.setAddress(uplink)) {
+            sockaddr_storage storage;
+            socklen_t length = toSockaddr(source, &storage);
+            result = (storage.ss_family == family)
+                ? ::bind(fd, reinterpret_cast<sockaddr*>(&storage), length)
+                : -1;
+        } else {
+            QByteArray name = uplink.toLocal8Bit();
+            result = ::setsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE,
+                                  name.constData(), name.size());
+        }
+        if (result != 0) {
+            qDebug() << "[IcmpProber::openSocket] Cannot bind to uplink"
+                     << uplink << "-" << std::strerror(errno);
+            ::close(fd);
+            return -1;
+        }
+    }
+
+    Socket socket;
+    socket.fd = fd;
+    socket.family = family;
+    socket.uplink = uplink;
+    socket.kernelSendTimestamps = false;
+    socket.kernelReceiveTimestamps = false;
+    socket.identifier = 0;
+    socket.nextSequence = 0;
+    socket.nextPacketId = 0;
+
+    // Replies and send timestamps of a whole round queue up at once; the
+    // kernel caps the size at net.core.rmem_max.
+    int bufferSize = RECEIVE_BUFFER_SIZE;
+    ::setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &bufferSize, sizeof(bufferSize));
+
+    // Software timestamps of requests (through the error queue, identified
+    // by a packet counter) and of replies.  Older kernels have neither the
+    // packet counter nor SO_TIMESTAMPING; SO_TIMESTAMPNS still gives the
+    // time of the replies.
+    int flags = SOF_TIMESTAMPING_SOFTWARE
+        | SOF_TIMESTAMPING_RX_SOFTWARE
+        | SOF_TIMESTAMPING_TX_SOFTWARE
+        | SOF_TIMESTAMPING_OPT_ID
+        | SOF_TIMESTAMPING_OPT_TSONLY;
+    int on = 1;
+    if (::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPING,
+                     &flags, sizeof(flags)) == 0) {
+        socket.kernelSendTimestamps = true;
+        socket.kernelReceiveTimestamps = true;
+    } else if (::setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS,
+                            &on, sizeof(on)) == 0) {
+        socket.kernelReceiveTimestamps = true;
+    }
+    qDebug() << "[IcmpProber::openSocket] Opened"
+             << ((family == AF_INET) ? "ICMP" : "ICMPv6")
+             << "socket, uplink:" << uplink
+             << "kernel send timestamps:" << socket.kernelSendTimestamps
+             << "kernel receive timestamps:" << socket.kernelReceiveTimestamps;
+
+    sockets.push_back(socket);
+    return static_cast<int>(sockets.size()) - 1;
+#else
+    Q_UNUSED(family);
+    Q_UNUSED(uplink);
+    return -1;
+#endif
+}
+
+/**
+ * @brief Send the requests that are due and read the replies.
+ * @param timeoutMs Maximum time to wait for replies.
+ */
+void IcmpProber::poll(int timeoutMs) {
+#ifdef Q_OS_LINUX
+    sendDueEchoes(clock.elapsed());
+
+    // Wait for replies until the next request is due.
+    int waitMs = std::max(0, timeoutMs);
+    for (const Target& target : targets) {
+        qint64 dueMs = nextSendMs(target);
+        if (dueMs >= 0) {
+            waitMs = static_cast<int>(std::min<qint64>(
+                waitMs, std::max<qint64>(0, dueMs - clock.elapsed())));
+        }
+    }
+
+    std::vector<pollfd> fds(sockets.size());
+    for (size_t i = 0; i < sockets.size(); ++i) {
+        fds[i].fd = sockets[i].fd;
+        fds[i].events = POLLIN;
+        fds[i].revents = 0;
+    }
+    ++syscalls;
+    if (::poll(fds.data(), fds.size(), waitMs) > 0) {
+        for (size_t i = 0; i < sockets.size(); ++i) {
+            // Send timestamps wait in the error queue.
+            if (fds[i].revents & POLLERR) {
+                readSendTimestamps(sockets[i]);
+            }
+            if (fds[i].revents & POLLIN) {
+                readReplies(sockets[i]);
+            }
+        }
+    }
+
+    sendDueEchoes(clock.elapsed());
+#else
+    Q_UNUSED(timeoutMs);
+#endif
+}
+
+/**
+ * @brief Get the time the next request to a target is due.
+ * @param target The target.
+ * @return Milliseconds since the prober was constructed, or -1 if all
+ * requests were sent.
+ */
+qint64 IcmpProber::nextSendMs(const Target& target) const {
+    if (target.released || (target.rounds >= echoCount)) {
+        return -1;
+    }
+    return target.startMs + static_cast<qint64>(target.rounds) * intervalMs;
+}
+
+/**
+ * @brief Send the requests that are due.
+ * @param nowMs Time since the prober was constructed in milliseconds.
+ */
+void IcmpProber::sendDueEchoes(qint64 nowMs) {
+    // A target that fell behind catches up one round per pass.
+    bool sent = true;
+    while (sent) {
+        sent = false;
+        for (size_t i = 0; i < sockets.size(); ++i) {
+            sent = sendRound(static_cast<int>(i), nowMs) || sent;
+        }
+    }
+}
+
+/**
+ * @brief Send an echo request to every target of a socket that is due.
+ * @param socketIndex Index of the socket.
+ * @param nowMs Time since the prober was constructed in milliseconds.
+ * @return Whether any target was due.
+ */
+bool IcmpProber::sendRound(int socketIndex, qint64 nowMs) {
+#ifdef Q_OS_LINUX
+    Socket& socket = sockets[socketIndex];
+    std::vector<int>& round = buffers->round;
+    round.clear();
+    for (size_t i = 0; i < targets.size(); ++i) {
+        Target& target = targets[i];
+        qint64 dueMs = nextSendMs(target);
+        if ((target.socket == socketIndex) && (dueMs >= 0)
+            && (nowMs >= dueMs)) {
+            // A request that fails to go out still uses up its round.
+            ++target.rounds;
+            target.lastSendMs = nowMs;
+            round.push_back(static_cast<int>(i));
+        }
+    }
+    if (round.empty()) {
+        return false;
+    }
+
+    size_t done = 0;
+    while (done < round.size()) {
+        int count = batching
+            ? static_cast<int>(std::min<size_t>(BATCH_SIZE,
+                                                round.size() - done))
+            : 1;
+        for (int i = 0; i < count; ++i) {
+            EchoHeader header;
+            std::memset(&header, 0, sizeof(header));
+            header.type = (socket.family == AF_INET)
+                ? ICMP_ECHO : ICMP6_ECHO_REQUEST;
+            // The kernel fills in the identifier and the checksum.
+            header.sequence = qToBigEndian(
+                static_cast<quint16>(socket.nextSequence + i));
+            char* packet = buffers->packets[i];
+            std::memset(packet, 0, sizeof(header) + PAYLOAD_SIZE);
+            std::memcpy(packet, &header, sizeof(header));
+
+            buffers->iovecs[i].iov_base = packet;
+            buffers->iovecs[i].iov_len = sizeof(header) + PAYLOAD_SIZE;
+            msghdr& msg = buffers->messages[i].msg_hdr;
+            std::memset(&msg, 0, sizeof(msg));
+            msg.msg_name = &buffers->names[i];
+            msg.msg_namelen = toSockaddr(targets[round[done + i]].address,
+                                         &buffers->names[i]);
+            msg.msg_iov = &buffers->iovecs[i];
+            msg.msg_iovlen = 1;
+        }
+
+        // One clock reading serves the whole batch; the kernel send
+        // timestamps tell the requests apart where available.
+        qint64 sentNs = realtimeNs();
+        int sent;
+        ++syscalls;
+        if (batching) {
+            sent = ::sendmmsg(socket.fd, buffers->messages, count, 0);
+        } else {
+            sent = (::sendmsg(socket.fd, &buffers->messages[0].msg_hdr, 0)
+                    < 0) ? -1 : 1;
+        }
+
+        if (sent <= 0) {
+            // The first message failed; skip its target in this round.
+            qDebug() << "[IcmpProber::sendRound] Failed to send to"
+                     << targets[round[done]].address.toString()
+                     << "-" << std::strerror(errno);
+            ++socket.nextSequence;
+            ++done;
+            continue;
+        }
+        for (int i = 0; i < sent; ++i) {
+            addEcho(round[done + i], socket.nextSequence++, sentNs);
+        }
+        done += sent;
+    }
+
+    if (socket.identifier == 0) {
+        // The first request binds the socket to the identifier.
+        sockaddr_storage local;
+        socklen_t length = sizeof(local);
+        if (::getsockname(socket.fd, reinterpret_cast<sockaddr*>(&local),
+                          &length) == 0) {
+            socket.identifier = (local.ss_family == AF_INET)
+                ? reinterpret_cast<sockaddr_in*>(&local)->sin_port
+                : reinterpret_cast<sockaddr_in6*>(&local)->sin6_port;
+        }
+    }
+    return true;
+#else
+    Q_UNUSED(socketIndex);
+    Q_UNUSED(nowMs);
+    return false;
+#endif
+}
+
+/**
+ * @brief Record a sent echo request.
+ * @param target Index of the target.
+ * @param sequence Sequence number of the request.
+ * @param sentNs User-space send time.
+ */
+void IcmpProber::addEcho(int target, quint16 sequence, qint64 sentNs) {
+    Target& t = targets[target];
+    Socket& socket = sockets[t.socket];
+
+    Echo echo;
+    echo.target = target;
+    echo.sequence = sequence;
+    echo.packetId = socket.nextPacketId;
+    echo.sentNs = sentNs;
+    echo.kernelSent = false;
+    echo.receivedNs = -1;
+    echo.kernelReceived = false;
+
+    int index = static_cast<int>(echoes.size());
+    echoes.push_back(echo);
+    t.echoes.push_back(index);
+    socket.echoBySequence.insert(sequence, index);
+    if (socket.kernelSendTimestamps) {
+        socket.echoByPacketId.insert(socket.nextPacketId, index);
+    }
+    ++socket.nextPacketId;
+}
+
+/**
+ * @brief Read the echo replies waiting on a socket.
+ * @param socket The socket.
+ */
+void IcmpProber::readReplies(Socket& socket) {
+#ifdef Q_OS_LINUX
+    int batchSize = batching ? BATCH_SIZE : 1;
+    for (;;) {
+        buffers->prepareReceive(batchSize);
+        int count;
+        ++syscalls;
+        if (batching) {
+            count = ::recvmmsg(socket.fd, buffers->messages, batchSize,
+                               MSG_DONTWAIT, nullptr);
+        } else {
+            ssize_t size = ::recvmsg(socket.fd, &buffers->messages[0].msg_hdr,
+                                     MSG_DONTWAIT);
+            buffers->messages[0].msg_len = static_cast<unsigned int>(
+                std::max<ssize_t>(0, size));
+            count = (size < 0) ? -1 : 1;
+        }
+        if (count <= 0) {
+            break;
+        }
+
+        qint64 nowNs = realtimeNs();
+        for (int i = 0; i < count; ++i) {
+            msghdr& msg = buffers->messages[i].msg_hdr;
+            qint64 kernelNs = socket.kernelReceiveTimestamps
+                ? softwareTimestamp(msg) : -1;
+            QHostAddress source(
+                reinterpret_cast<sockaddr*>(&buffers->names[i]));
+            handleReply(socket,
+                        buffers->packets[i],
+                        buffers->messages[i].msg_len,
+                        source,
+                        (kernelNs > 0) ? kernelNs : nowNs,
+                        kernelNs > 0);
+        }
+        if (count < batchSize) {
+            break;
+        }
+    }
+#else
+    Q_UNUSED(socket);
+#endif
+}
+
+/**
+ * @brief Match an echo reply to its request.
+ * @param socket The socket the reply arrived on.
+ * @param data The ICMP message.
+ * @param size Size of the message.
+ * @param source Address the reply came from.
+ * @param receivedNs Time the reply arrived.
+ * @param kernelReceived Whether the kernel took that time.
+ */
+void IcmpProber::handleReply(Socket& socket,
+                             const char* data,
+                             qint64 size,
+                             const QHostAddress& source,
+                             qint64 receivedNs,
+                             bool kernelReceived) {
+#ifdef Q_OS_LINUX
+    if (size < static_cast<qint64>(sizeof(EchoHeader))) {
+        return;
+    }
+    EchoHeader header;
+    std::memcpy(&header, data, sizeof(header));
+    quint8 replyType = (socket.family == AF_INET)
+        ? ICMP_ECHOREPLY : ICMP6_ECHO_REPLY;
+    if ((header.type != replyType)
+        || ((socket.identifier != 0)
+            && (header.identifier != socket.identifier))) {
+        return;
+    }
+
+    auto it = socket.echoBySequence.constFind(
+        qFromBigEndian(header.sequence));
+    if (it == socket.echoBySequence.constEnd()) {
+        return;
+    }
+    Echo& echo = echoes[it.value()];
+    Target& target = targets[echo.target];
+    if ((echo.receivedNs >= 0)
+        || (! source.isEqual(target.address,
+                             QHostAddress::ConvertV4MappedToIPv4))) {
+        return;
+    }
+
+    echo.receivedNs = receivedNs;
+    echo.kernelReceived = kernelReceived;
+    maxRttNs = std::max(maxRttNs, echo.receivedNs - echo.sentNs);
+    ++target.replies;
+    ++replies;
+#else
+    Q_UNUSED(socket);
+    Q_UNUSED(data);
+    Q_UNUSED(size);
+    Q_UNUSED(source);
+    Q_UNUSED(receivedNs);
+    Q_UNUSED(kernelReceived);
+#endif
+}
+
+/**
+ * @brief Read the send timestamps from the error queue of a socket.
+ * @param socket The socket.
+ */
+void IcmpProber::readSendTimestamps(Socket& socket) {
+#ifdef Q_OS_LINUX
+    int batchSize = batching ? BATCH_SIZE : 1;
+    for (;;) {
+        buffers->prepareReceive(batchSize);
+        int count;
+        ++syscalls;
+        if (batching) {
+            count = ::recvmmsg(socket.fd, buffers->messages, batchSize,
+                               MSG_ERRQUEUE | MSG_DONTWAIT, nullptr);
+        } else {
+            count = (::recvmsg(socket.fd, &buffers->messages[0].msg_hdr,
+                               MSG_ERRQUEUE | MSG_DONTWAIT) < 0) ? -1 : 1;
+        }
+        if (count <= 0) {
+            break;
+        }
+
+        for (int i = 0; i < count; ++i) {
+            msghdr& msg = buffers->messages[i].msg_hdr;
+            qint64 stampNs = softwareTimestamp(msg);
+            bool haveError = false;
+            sock_extended_err error;
+            for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg;
+                 cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+                if (((cmsg->cmsg_level == SOL_IP)
+                     && (cmsg->cmsg_type == IP_RECVERR))
+                    || ((cmsg->cmsg_level == SOL_IPV6)
+                        && (cmsg->cmsg_type == IPV6_RECVERR))) {
+                    std::memcpy(&error, CMSG_DATA(cmsg), sizeof(error));
+                    haveError = true;
+                }
+            }
+            if (haveError && (stampNs > 0)
+                && (error.ee_origin == SO_EE_ORIGIN_TIMESTAMPING)
+                && (error.ee_info == SCM_TSTAMP_SND)) {
+                handleSendTimestamp(socket, error.ee_data, stampNs);
+            }
+        }
+        if (count < batchSize) {
+            break;
+        }
+    }
+#else
+    Q_UNUSED(socket);
+#endif
+}
+
+/**
+ * @brief Replace the user-space send time of a request by the kernel one.
+ * @param socket The socket the request was sent on.
+ * @param packetId Counter value of the request.
+ * @param sentNs Kernel send time.
+ */
+void IcmpProber::handleSendTimestamp(Socket& socket,
+                                     quint32 packetId,
+                                     qint64 sentNs) {
+    auto it = socket.echoByPacketId.find(packetId);
+    if (it == socket.echoByPacketId.end()) {
+        return;
+    }
+    Echo& echo = echoes[it.value()];
+    socket.echoByPacketId.erase(it);
+    if ((sentNs >= echo.sentNs)
+        && (sentNs - echo.sentNs < MAX_SEND_STAMP_SKEW_NS)) {
+        echo.sentNs = sentNs;
+        echo.kernelSent = true;
+    }
+}
+
+/**
+ * @brief Check whether all requests were sent and answered, or the replies
+ * that are missing are not expected any more.
+ */
+bool IcmpProber::isFinished() const {
+    for (size_t i = 0; i < targets.size(); ++i) {
+        if (! isFinished(static_cast<int>(i))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Check whether the requests to one target are finished.
+ * @param target Index returned by addTarget().
+ */
+bool IcmpProber::isFinished(int target) const {
+    const Target& t = targets[target];
+    if (t.released) {
+        return true;
+    }
+    if (t.rounds < echoCount) {
+        return false;
+    }
+    if (t.replies >= static_cast<int>(t.echoes.size())) {
+        return true;
+    }
+    qint64 lingerMs = std::max<qint64>(LINGER_MS, 2 * maxRttNs / 1000000);
+    return clock.elapsed() - t.lastSendMs >= lingerMs;
+}
+
+/**
+ * @brief Stop probing a target and forget its requests.
+ * @param target Index returned by addTarget().
+ */
+void IcmpProber::releaseTarget(int target) {
+    Target& t = targets[target];
+    if (t.released) {
+        return;
+    }
+    t.released = true;
+    Socket& socket = sockets[t.socket];
+    for (int index : t.echoes) {
+        const Echo& echo = echoes[index];
+        // Sequence numbers wrap; a later request may own the entry.
+        auto it = socket.echoBySequence.find(echo.sequence);
+        if ((it != socket.echoBySequence.end()) && (it.value() == index)) {
+            socket.echoBySequence.erase(it);
+        }
+        socket.echoByPacketId.remove(echo.packetId);
+    }
+}
+
+/**
+ * @brief Get the result of a target.
+ * @param target Index returned by addTarget().
+ */
+IcmpProber::Result IcmpProber::result(int target) const {
+    Result result;
+    const Target& t = targets[target];
+    result.sent = static_cast<int>(t.echoes.size());
+
+    qint64 totalNs = 0;
+    bool kernelSent = true;
+    bool kernelReceived = true;
+    for (int index : t.echoes) {
+        const Echo& echo = echoes[index];
+        if (echo.receivedNs < 0) {
+            continue;
+        }
+        ++result.received;
+        totalNs += std::max<qint64>(0, echo.receivedNs - echo.sentNs);
+        kernelSent = kernelSent && echo.kernelSent;
+        kernelReceived = kernelReceived && echo.kernelReceived;
+    }
+
+    if (result.received > 0) {
+        result.averageRttUs = totalNs / result.received / 1000;
+        if (kernelSent && kernelReceived) {
+            result.timestamps = KernelTimestamps;
+        } else if (kernelReceived) {
+            result.timestamps = KernelReceiveTimestamps;
+        }
+    }
+    return result;
+}
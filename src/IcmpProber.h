@@ -0,0 +1,241 @@
+/**
+ * @file IcmpProber.h
+ * @brief Header file for the IcmpProber class.
+ *
+ * Measures round-trip times with ICMP echo requests sent from unprivileged
+ * datagram sockets, timestamped by the kernel where it supports that.
+ */
+
+#ifndef ICMPPROBER_H
+#define ICMPPROBER_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * @class IcmpProber
+ * @brief Sends echo requests to a set of addresses and times the replies.
+ *
+ * @details The prober uses ICMP datagram ("ping") sockets, which Linux
+ *          allows to the groups in net.ipv4.ping_group_range without any
+ *          privileges.  When the sockets cannot be opened, addTarget()
+ *          fails and the caller falls back to the ping command.
+ *
+ *          Round-trip times measured in user space include the scheduling
+ *          delay of the probing thread, which grows when the machine is busy
+ *          or many probes run at once.  The prober therefore asks the kernel
+ *          for software timestamps: SO_TIMESTAMPING for the time a request
+ *          left and a reply arrived, or SO_TIMESTAMPNS for the replies only.
+ *          Each result tells which timestamps it is based on.
+ *
+ *          Targets of the same address family and uplink share a socket.
+ *          The requests that are due at the same time go out with one
+ *          sendmmsg() per socket, and replies and send timestamps are
+ *          drained with recvmmsg() into preallocated buffers, so that a
+ *          sweep over many addresses does not cost a system call per
+ *          packet.  Replies are matched to their request by the echo
+ *          identifier and sequence number.
+ *
+ *          Targets may be added while others are probed; each has its own
+ *          schedule, starting when it is added.  With a send slot set, the
+ *          schedules start on the slot boundaries so that the requests of
+ *          targets added at about the same time share a batch.
+ *
+ *          The prober is not thread-safe; it is meant to be driven by one
+ *          worker thread calling poll() until isFinished(), or shared
+ *          through SharedIcmpProber.
+ */
+class IcmpProber {
+public:
+    /**
+     * @brief What the round-trip times are measured with.
+     */
+    enum TimestampSource {
+        UserTimestamps,          ///< Clock read by the prober
+        KernelReceiveTimestamps, ///< Kernel time of the reply only
+        KernelTimestamps         ///< Kernel times of request and reply
+    };
+
+    /**
+     * @brief Result of the echo requests sent to one target.
+     */
+    struct Result {
+        int sent = 0;
+        int received = 0;
+        // Average round-trip time, or -1 without replies
+        qint64 averageRttUs = -1;
+        TimestampSource timestamps = UserTimestamps;
+    };
+
+    // How long to wait for replies after the last request, at least
+    static constexpr int LINGER_MS = 1000;
+    // Size of the echo payload, like the ping default
+    static constexpr int PAYLOAD_SIZE = 56;
+    // Maximum number of messages sent or received with one system call
+    static constexpr int BATCH_SIZE = 64;
+
+    /**
+     * @brief Constructs a prober.
+     * @param echoCount Number of echo requests per target.
+     * @param intervalMs Interval between the requests to one target.
+     */
+    IcmpProber(int echoCount, int intervalMs);
+    ~IcmpProber();
+
+    IcmpProber(const IcmpProber&) = delete;
+    IcmpProber& operator=(const IcmpProber&) = delete;
+
+    /**
+     * @brief Add an address to probe.
+     * @param address The IPv4 or IPv6 address.
+     * @param uplink Interface name or source address to probe from, or an
+     * empty string for the default route.
+     * @return Index of the target, or -1 if no socket could be opened or
+     * bound for it.
+     */
+    int addTarget(const QHostAddress& address,
+                  const QString& uplink = QString());
+
+    /**
+     * @brief Send the requests that are due and read the replies.
+     * @param timeoutMs Maximum time to wait for replies.
+     */
+    void poll(int timeoutMs);
+
+    /**
+     * @brief Check whether all requests were sent and answered, or the
+     * replies that are missing are not expected any more.
+     */
+    bool isFinished() const;
+
+    /**
+     * @brief Check whether the requests to one target are finished.
+     * @param target Index returned by addTarget().
+     */
+    bool isFinished(int target) const;
+
+    /**
+     * @brief Stop probing a target and forget its requests.
+     * @param target Index returned by addTarget().
+     * @details Late replies to the target are ignored; its result stays
+     * readable.
+     */
+    void releaseTarget(int target);
+
+    /**
+     * @brief Check whether any target replied.
+     */
+    bool hasReply() const { return replies > 0; }
+
+    /**
+     * @brief Get the result of a target.
+     * @param target Index returned by addTarget().
+     */
+    Result result(int target) const;
+
+    /**
+     * @brief Choose between batched and per-packet socket I/O.
+     * @param batching Whether to use sendmmsg() and recvmmsg(); on by
+     * default.
+     */
+    void setBatching(bool batching) { this->batching = batching; }
+
+    /**
+     * @brief Align the schedules of new targets.
+     * @param slotMs Length of the send slots, or 0 to start probing a
+     * target right away, the default.
+     */
+    void setSendSlot(int slotMs) { sendSlotMs = std::max(0, slotMs); }
+
+    /**
+     * @brief Get the number of socket system calls made so far.
+     */
+    quint64 syscallCount() const { return syscalls; }
+
+private:
+    /**
+     * @brief A socket shared by the targets of one family and uplink.
+     */
+    struct Socket {
+        int fd;
+        int family;
+        QString uplink;
+        bool kernelSendTimestamps;
+        bool kernelReceiveTimestamps;
+        // Echo identifier the kernel chose, in network byte order; 0 until
+        // the first request is sent
+        quint16 identifier;
+        quint16 nextSequence;
+        // Counter of sent packets, which identifies send timestamps
+        quint32 nextPacketId;
+        QHash<quint16, int> echoBySequence;
+        QHash<quint32, int> echoByPacketId;
+    };
+
+    /**
+     * @brief A single echo request.
+     */
+    struct Echo {
+        int target;
+        quint16 sequence;
+        quint32 packetId;
+        qint64 sentNs;
+        bool kernelSent;
+        qint64 receivedNs;
+        bool kernelReceived;
+    };
+
+    /**
+     * @brief An address to probe.
+     */
+    struct Target {
+        QHostAddress address;
+        int socket;
+        std::vector<int> echoes;
+        // Time of the first request since the prober was constructed
+        qint64 startMs;
+        // Number of rounds of requests sent to the target
+        int rounds;
+        qint64 lastSendMs;
+        int replies;
+        bool released;
+    };
+
+    struct Buffers;
+
+    int openSocket(int family, const QString& uplink);
+    qint64 nextSendMs(const Target& target) const;
+    void sendDueEchoes(qint64 nowMs);
+    bool sendRound(int socket, qint64 nowMs);
+    void addEcho(int target, quint16 sequence, qint64 sentNs);
+    void readReplies(Socket& socket);
+    void readSendTimestamps(Socket& socket);
+    void handleReply(Socket& socket,
+                     const char* data,
+                     qint64 size,
+                     const QHostAddress& source,
+                     qint64 receivedNs,
+                     bool kernelReceived);
+    void handleSendTimestamp(Socket& socket, quint32 packetId, qint64 sentNs);
+
+    int echoCount;
+    int intervalMs;
+    int sendSlotMs;
+    QElapsedTimer clock;
+    int replies;
+    qint64 maxRttNs;
+    std::vector<Socket> sockets;
+    std::vector<Target> targets;
+    std::vector<Echo> echoes;
+    bool batching;
+    quint64 syscalls;
+    std::unique_ptr<Buffers> buffers;
+};
+
+#endif // ICMPPROBER_H
@@ -0,0 +1,641 @@
+/**
+ * @file LanDiscovery.cpp
+ * @brief Implementation file for the LanDiscovery class.
+ */
+
+#include <cerrno>
+#include <cstring>
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QNetworkDatagram>
+#include <QNetworkInterface>
+#include <QNetworkProxy>
+#include <QRegularExpression>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QtEndian>
+
+#include "Executor.h"
+#include "LanDiscovery.h"
+#include "SocketManager.h"
+
+#ifdef Q_OS_LINUX
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+constexpr quint16 LanDiscovery::MULTICAST_PORT;
+constexpr const char* LanDiscovery::MULTICAST_GROUP;
+constexpr int LanDiscovery::PUBLIC_KEY_SIZE;
+constexpr int LanDiscovery::DAEMON_POLL_MS;
+
+// Protocol version of the beacons with a version header
+static const int VERSIONED_MAJOR = 0;
+static const int VERSIONED_MINOR = 5;
+// Size of the version header, port and hash length of a versioned beacon
+static const int VERSIONED_HEADER_SIZE = 8;
+
+/**
+ * @brief Check whether an address is an IPv6 link-local address.
+ * @param address The address.
+ */
+static bool isLinkLocal(const QHostAddress& address) {
+    return (address.protocol() == QAbstractSocket::IPv6Protocol)
+        && address.isInSubnet(QHostAddress("fe80::"), 10);
+}
+
+/**
+ * @brief Constructor for LanDiscovery
+ * @param parent Optional QObject parent.
+ */
+LanDiscovery::LanDiscovery(QObject *parent)
+    : QObject(parent)
+    , socket(nullptr)
+    , lastError(NoError)
+    , expiryTimer(new QTimer(this))
+    , daemonTimer(new QTimer(this))
+    , daemonPollPending(false) {
+    expiryTimer->setInterval(EXPIRY_MS / 2);
+    connect(expiryTimer, &QTimer::timeout,
+            this, &LanDiscovery::onExpiryTimeout);
+    daemonTimer->setInterval(DAEMON_POLL_MS);
+    connect(daemonTimer, &QTimer::timeout,
+            this, &LanDiscovery::pollDaemon);
+    connect(this, &LanDiscovery::daemonPeersRead,
+            this, &LanDiscovery::onDaemonPeersRead,
+            Qt::QueuedConnection);
+    clock.start();
+}
+
+/**
+ * @brief Destructor for LanDiscovery
+ */
+LanDiscovery::~LanDiscovery() {
+    // The admin socket request emits from a worker thread.
+    Executor::instance().clear(this);
+    Executor::instance().waitForDone(this);
+    stop();
+}
+
+/**
+ * @brief Listen for beacons on some interfaces.
+ * @param interfaceNames Names of the interfaces; a running discovery is
+ * restarted with them.
+ * @return false if the multicast group could not be joined on any of them.
+ * @details The neighbours found so far are forgotten; those of a watched
+ * daemon are read again right away.  Without interfaces, only the daemon
+ * is watched.
+ */
+bool LanDiscovery::start(const QStringList& interfaceNames) {
+    closeSocket();
+    forgetNeighbours();
+    pollDaemon();
+    if (interfaceNames.isEmpty()) {
+        lastError = NoInterface;
+        return false;
+    }
+
+    QUdpSocket* udp = openSocket();
+    if (! udp) {
+        return false;
+    }
+
+    QHostAddress group(MULTICAST_GROUP);
+    QStringList joined;
+    for (const QString& name : interfaceNames) {
+        QNetworkInterface networkInterface
+            = QNetworkInterface::interfaceFromName(name);
+        if (networkInterface.isValid()
+            && udp->joinMulticastGroup(group, networkInterface)) {
+            joined << name;
+        } else {
+            qDebug() << "[LanDiscovery::start] Cannot join" << group
+                     << "on" << name;
+        }
+    }
+    if (joined.isEmpty()) {
+        lastError = NoInterface;
+        delete udp;
+        return false;
+    }
+
+    lastError = NoError;
+    socket = udp;
+    connect(socket, &QUdpSocket::readyRead,
+            this, &LanDiscovery::onReadyRead);
+    ownAddresses.clear();
+    for (QHostAddress address : QNetworkInterface::allAddresses()) {
+        address.setScopeId(QString());
+        ownAddresses << address;
+    }
+    expiryTimer->start();
+    qDebug() << "[LanDiscovery::start] Listening on" << joined;
+    return true;
+}
+
+/**
+ * @brief Bind a socket to the multicast port, shared with the local daemon.
+ * @return The socket, or nullptr with lastError set.
+ * @details QUdpSocket::ShareAddress sets SO_REUSEADDR only, while the
+ * daemon may rely on SO_REUSEPORT, so the socket is opened by hand and
+ * handed over to Qt.
+ */
+QUdpSocket* LanDiscovery::openSocket() {
+    QUdpSocket* udp = new QUdpSocket(this);
+#ifdef Q_OS_LINUX
+    int fd = ::socket(AF_INET6, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        qDebug() << "[LanDiscovery::openSocket] Cannot open a socket:"
+                 << std::strerror(errno);
+        lastError = SocketError;
+        delete udp;
+        return nullptr;
+    }
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+#ifdef SO_REUSEPORT
+    ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+#endif
+
+    sockaddr_in6 address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(MULTICAST_PORT);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address),
+               sizeof(address)) != 0) {
+        int bindError = errno;
+        qDebug() << "[LanDiscovery::openSocket] Cannot bind to port"
+                 << MULTICAST_PORT << "-" << std::strerror(bindError);
+        ::close(fd);
+        lastError = (bindError == EADDRINUSE) ? PortInUse : SocketError;
+        delete udp;
+        return nullptr;
+    }
+    if (! udp->setSocketDescriptor(fd, QUdpSocket::BoundState)) {
+        qDebug() << "[LanDiscovery::openSocket] Cannot use the socket -"
+                 << udp->errorString();
+        ::close(fd);
+        lastError = SocketError;
+        delete udp;
+        return nullptr;
+    }
+#else
+    if (! udp->bind(QHostAddress::AnyIPv6,
+                    MULTICAST_PORT,
+                    QUdpSocket::ShareAddress
+                        | QUdpSocket::ReuseAddressHint)) {
+        qDebug() << "[LanDiscovery::openSocket] Cannot bind to port"
+                 << MULTICAST_PORT << "-" << udp->errorString();
+        lastError = (udp->error() == QAbstractSocket::AddressInUseError)
+            ? PortInUse : SocketError;
+        delete udp;
+        return nullptr;
+    }
+#endif
+    return udp;
+}
+
+/**
+ * @brief Stop listening, stop watching the daemon and forget all
+ * neighbours.
+ */
+void LanDiscovery::stop() {
+    closeSocket();
+    daemonTimer->stop();
+    daemonSocketPaths.clear();
+    expiryTimer->stop();
+    forgetNeighbours();
+}
+
+/**
+ * @brief Stop listening for beacons.
+ */
+void LanDiscovery::closeSocket() {
+    if (socket) {
+        disconnect(socket, nullptr, this, nullptr);
+        socket->close();
+        socket->deleteLater();
+        socket = nullptr;
+    }
+    if (! isWatchingDaemon()) {
+        expiryTimer->stop();
+    }
+}
+
+/**
+ * @brief Forget all neighbours without reporting them lost.
+ */
+void LanDiscovery::forgetNeighbours() {
+    for (Entry* entry : entries) {
+        releaseEntry(entry);
+    }
+    entries.clear();
+}
+
+/**
+ * @brief Read the link-local peers of the local daemon from the admin
+ * socket every DAEMON_POLL_MS, until stop().
+ * @param socketPaths Admin socket path candidates.
+ */
+void LanDiscovery::watchDaemon(const QStringList& socketPaths) {
+    daemonSocketPaths = socketPaths;
+    if (socketPaths.isEmpty()) {
+        daemonTimer->stop();
+        return;
+    }
+    daemonTimer->start();
+    expiryTimer->start();
+    pollDaemon();
+}
+
+/**
+ * @brief Ask the admin socket for the peers of the daemon in the
+ * background; daemonPeersRead() is emitted with the response.
+ */
+void LanDiscovery::pollDaemon() {
+    if ((! isWatchingDaemon()) || daemonPollPending) {
+        return;
+    }
+    QStringList socketPaths = daemonSocketPaths;
+    daemonPollPending = Executor::instance().submit(
+        Executor::Interactive,
+        [this, socketPaths]() {
+            SocketManager socketManager(socketPaths);
+            emit daemonPeersRead(socketManager.sendRequest(
+                {{"request", "getpeers"}}));
+        },
+        this);
+}
+
+/**
+ * @brief Take over the link-local peers of the daemon.
+ * @param response The "getpeers" response.
+ */
+void LanDiscovery::onDaemonPeersRead(const QJsonObject& response) {
+    daemonPollPending = false;
+    if (! isWatchingDaemon()) {
+        return;
+    }
+    for (const Neighbour& found : daemonNeighbours(response)) {
+        Entry* entry = touch(found);
+        if (found.rttUs >= 0) {
+            // The daemon measures its peers all the time.
+            entry->measuredMs = clock.elapsed();
+            if (entry->neighbour.rttUs != found.rttUs) {
+                entry->neighbour.rttUs = found.rttUs;
+                emit neighbourChanged(entry->neighbour);
+            }
+        } else if (isMeasurementDue(entry)) {
+            measure(entry);
+        }
+    }
+}
+
+/**
+ * @brief Find the neighbours in a "getpeers" admin socket response.
+ * @param response The full JSON response.
+ * @return The peers that are up, that the daemon connected to and that
+ * have a link-local address and a public key.
+ */
+QList<LanDiscovery::Neighbour> LanDiscovery::daemonNeighbours(
+    const QJsonObject& response) {
+    QList<Neighbour> result;
+    QJsonValue peers = response["response"].toObject()["peers"];
+    if (! peers.isArray()) {
+        return result;
+    }
+    // The zone is written as "%25" in URIs, but older daemons use "%".
+    static const QRegularExpression remote(
+        "^[a-z]+://\\[([0-9A-Fa-f:.]+)%(?:25)?([^\\]]+)\\]:(\\d+)");
+    for (const QJsonValue& value : peers.toArray()) {
+        QJsonObject peer = value.toObject();
+        if (peer["inbound"].toBool(false) || (! peer["up"].toBool(true))) {
+            continue;
+        }
+        QRegularExpressionMatch match
+            = remote.match(peer["remote"].toString());
+        if (! match.hasMatch()) {
+            continue;
+        }
+        QHostAddress address(match.captured(1));
+        int port = match.captured(3).toInt();
+        QByteArray publicKey
+            = QByteArray::fromHex(peer["key"].toString().toLatin1());
+        if ((! isLinkLocal(address))
+            || (port <= 0) || (port > 65535)
+            || (publicKey.size() != PUBLIC_KEY_SIZE)) {
+            continue;
+        }
+
+        Neighbour neighbour;
+        neighbour.interfaceName = match.captured(2);
+        neighbour.port = static_cast<quint16>(port);
+        neighbour.uri = peerUri(address,
+                                neighbour.interfaceName,
+                                neighbour.port,
+                                publicKey);
+        neighbour.publicKey = QString::fromLatin1(publicKey.toHex());
+        neighbour.address = address;
+        neighbour.address.setScopeId(neighbour.interfaceName);
+        // A Go duration, in nanoseconds; missing before Yggdrasil 0.5.5
+        double latencyNs = peer["latency"].toDouble(-1);
+        neighbour.rttUs = (latencyNs > 0)
+            ? static_cast<qint64>(latencyNs / 1000) : -1;
+        result << neighbour;
+    }
+    return result;
+}
+
+/**
+ * @brief Get the neighbours found so far.
+ */
+QList<LanDiscovery::Neighbour> LanDiscovery::neighbours() const {
+    QList<Neighbour> result;
+    result.reserve(entries.size());
+    for (const Entry* entry : entries) {
+        result << entry->neighbour;
+    }
+    return result;
+}
+
+/**
+ * @brief Read the multicast interfaces of the Yggdrasil daemon from the
+ * admin socket; multicastInterfacesRead() is emitted with the result.
+ * @param socketPaths Admin socket path candidates.
+ */
+void LanDiscovery::readMulticastInterfaces(const QStringList& socketPaths) {
+    bool submitted = Executor::instance().submit(
+        Executor::Interactive,
+        [this, socketPaths]() {
+            SocketManager socketManager(socketPaths);
+            QJsonObject response = socketManager.sendRequest(
+                {{"request", "getmulticastinterfaces"}});
+            emit multicastInterfacesRead(
+                SocketManager::multicastInterfaceNames(response));
+        },
+        this);
+    if (! submitted) {
+        emit multicastInterfacesRead(QStringList());
+    }
+}
+
+/**
+ * @brief Get the interfaces beacons can be received on: running,
+ * multicast-capable interfaces with an IPv6 link-local address.
+ */
+QStringList LanDiscovery::candidateInterfaces() {
+    QStringList names;
+    for (const QNetworkInterface& networkInterface
+         : QNetworkInterface::allInterfaces()) {
+        QNetworkInterface::InterfaceFlags flags = networkInterface.flags();
+        if ((! (flags & QNetworkInterface::IsUp))
+            || (! (flags & QNetworkInterface::IsRunning))
+            || (! (flags & QNetworkInterface::CanMulticast))
+            || (flags & QNetworkInterface::IsLoopBack)) {
+            continue;
+        }
+        for (const QNetworkAddressEntry& entry
+             : networkInterface.addressEntries()) {
+            if (isLinkLocal(entry.ip())) {
+                names << networkInterface.name();
+                break;
+            }
+        }
+    }
+    return names;
+}
+
+/**
+ * @brief Parse a beacon.
+ * @param datagram The payload of the beacon.
+ * @param beacon Receives the contents.
+ * @return false if the datagram is not a beacon of a known version.
+ * @details A 0.5 beacon is the version, the public key, the port and a
+ * length-prefixed hash of the multicast password, all big-endian.  A 0.4
+ * beacon is the public key followed by the listen address as text.
+ */
+bool LanDiscovery::parseBeacon(const QByteArray& datagram, Beacon* beacon) {
+    const uchar* data = reinterpret_cast<const uchar*>(datagram.constData());
+    int size = datagram.size();
+    if (size >= PUBLIC_KEY_SIZE + VERSIONED_HEADER_SIZE) {
+        int major = qFromBigEndian<quint16>(data);
+        int minor = qFromBigEndian<quint16>(data + 2);
+        quint16 port = qFromBigEndian<quint16>(data + 4 + PUBLIC_KEY_SIZE);
+        int hashLength = qFromBigEndian<quint16>(data + 6 + PUBLIC_KEY_SIZE);
+        if ((major == VERSIONED_MAJOR)
+            && (minor >= VERSIONED_MINOR)
+            && (port != 0)
+            && (size >= PUBLIC_KEY_SIZE + VERSIONED_HEADER_SIZE + hashLength)) {
+            beacon->publicKey = datagram.mid(4, PUBLIC_KEY_SIZE);
+            beacon->port = port;
+            beacon->majorVersion = major;
+            beacon->minorVersion = minor;
+            return true;
+        }
+    }
+
+    static const QRegularExpression address("^\\[[^\\]]+\\]:(\\d+)$");
+    if (size > PUBLIC_KEY_SIZE) {
+        QString text = QString::fromLatin1(datagram.mid(PUBLIC_KEY_SIZE));
+        QRegularExpressionMatch match = address.match(text);
+        int port = match.hasMatch() ? match.captured(1).toInt() : 0;
+        if ((port > 0) && (port <= 65535)) {
+            beacon->publicKey = datagram.left(PUBLIC_KEY_SIZE);
+            beacon->port = static_cast<quint16>(port);
+            beacon->majorVersion = 0;
+            beacon->minorVersion = 4;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Build the peer URI of a neighbour.
+ * @param address Link-local address of the neighbour.
+ * @param interfaceName Interface the neighbour was found on.
+ * @param port Port of its multicast listener.
+ * @param publicKey Its public key.
+ */
+QString LanDiscovery::peerUri(const QHostAddress& address,
+                              const QString& interfaceName,
+                              quint16 port,
+                              const QByteArray& publicKey) {
+    QHostAddress host(address);
+    host.setScopeId(QString());
+    QString zone = interfaceName.isEmpty()
+        ? QString()
+        : "%25" + interfaceName;
+    return QString("tls://[%1%2]:%3?key=%4")
+        .arg(host.toString(),
+             zone,
+             QString::number(port),
+             QString::fromLatin1(publicKey.toHex()));
+}
+
+/**
+ * @brief Read the pending beacons.
+ */
+void LanDiscovery::onReadyRead() {
+    while (socket && socket->hasPendingDatagrams()) {
+        QNetworkDatagram datagram = socket->receiveDatagram();
+        QHostAddress sender = datagram.senderAddress();
+        Beacon beacon;
+        if ((! isLinkLocal(sender))
+            || isOwnAddress(sender)
+            || (! parseBeacon(datagram.data(), &beacon))) {
+            continue;
+        }
+
+        QString interfaceName = QNetworkInterface::interfaceNameFromIndex(
+            datagram.interfaceIndex());
+        if (interfaceName.isEmpty()) {
+            interfaceName = sender.scopeId();
+        }
+        Neighbour found;
+        found.uri = peerUri(sender,
+                            interfaceName,
+                            beacon.port,
+                            beacon.publicKey);
+        found.publicKey = QString::fromLatin1(beacon.publicKey.toHex());
+        found.interfaceName = interfaceName;
+        found.address = sender;
+        found.address.setScopeId(interfaceName);
+        found.port = beacon.port;
+        Entry* entry = touch(found);
+        if (isMeasurementDue(entry)) {
+            measure(entry);
+        }
+    }
+}
+
+/**
+ * @brief Record that a neighbour was seen.
+ * @param neighbour The neighbour as found; a new one is reported.
+ * @return The entry of the neighbour.
+ */
+LanDiscovery::Entry* LanDiscovery::touch(const Neighbour& neighbour) {
+    Entry*& entry = entries[neighbour.uri];
+    if (! entry) {
+        entry = new Entry();
+        entry->neighbour = neighbour;
+        qDebug() << "[LanDiscovery::touch] Found" << neighbour.uri;
+        emit neighbourChanged(entry->neighbour);
+    }
+    entry->lastSeenMs = clock.elapsed();
+    return entry;
+}
+
+/**
+ * @brief Check whether a neighbour is due for a handshake measurement.
+ * @param entry The neighbour.
+ */
+bool LanDiscovery::isMeasurementDue(const Entry* entry) const {
+    return (! entry->probe)
+        && ((entry->measuredMs < 0)
+            || (clock.elapsed() - entry->measuredMs >= MEASURE_INTERVAL_MS));
+}
+
+/**
+ * @brief Forget the neighbours that were not seen for EXPIRY_MS.
+ */
+void LanDiscovery::onExpiryTimeout() {
+    qint64 now = clock.elapsed();
+    for (auto it = entries.begin(); it != entries.end();) {
+        if (now - it.value()->lastSeenMs < EXPIRY_MS) {
+            ++it;
+            continue;
+        }
+        QString uri = it.key();
+        releaseEntry(it.value());
+        it = entries.erase(it);
+        qDebug() << "[LanDiscovery::onExpiryTimeout] Lost" << uri;
+        emit neighbourLost(uri);
+    }
+}
+
+/**
+ * @brief Check whether an address belongs to this host, whose own daemon
+ * sends beacons too.
+ * @param address The address.
+ */
+bool LanDiscovery::isOwnAddress(const QHostAddress& address) const {
+    QHostAddress unscoped(address);
+    unscoped.setScopeId(QString());
+    return ownAddresses.contains(unscoped);
+}
+
+/**
+ * @brief Time a TCP handshake with the listener of a neighbour.
+ * @param entry The neighbour.
+ */
+void LanDiscovery::measure(Entry* entry) {
+    QTcpSocket* probe = new QTcpSocket(this);
+    // A proxy cannot reach a link-local address.
+    probe->setProxy(QNetworkProxy::NoProxy);
+    entry->probe = probe;
+
+    QString uri = entry->neighbour.uri;
+    connect(probe, &QTcpSocket::connected, this, [this, uri, probe]() {
+        finishMeasurement(uri, probe, true);
+    });
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    connect(probe, &QAbstractSocket::errorOccurred,
+#else
+    connect(probe,
+            static_cast<void (QAbstractSocket::*)(
+                QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+#endif
+            this, [this, uri, probe](QAbstractSocket::SocketError) {
+        qDebug() << "[LanDiscovery::measure] Connection failed for:"
+                 << uri << "-" << probe->errorString();
+        finishMeasurement(uri, probe, false);
+    });
+    QTimer::singleShot(CONNECT_TIMEOUT_MS, probe, [this, uri, probe]() {
+        finishMeasurement(uri, probe, false);
+    });
+
+    entry->probeTimer.start();
+    probe->connectToHost(entry->neighbour.address, entry->neighbour.port);
+}
+
+/**
+ * @brief Record the result of a measurement.
+ * @param uri Peer URI of the neighbour.
+ * @param probe The socket of the measurement.
+ * @param connected Whether the handshake completed.
+ */
+void LanDiscovery::finishMeasurement(const QString& uri,
+                                     QTcpSocket* probe,
+                                     bool connected) {
+    Entry* entry = entries.value(uri);
+    if ((! entry) || (entry->probe != probe)) {
+        return;
+    }
+    qint64 rttUs = connected ? entry->probeTimer.nsecsElapsed() / 1000 : -1;
+    entry->probe = nullptr;
+    disconnect(probe, nullptr, this, nullptr);
+    probe->abort();
+    probe->deleteLater();
+
+    entry->measuredMs = clock.elapsed();
+    entry->neighbour.rttUs = rttUs;
+    emit neighbourChanged(entry->neighbour);
+}
+
+/**
+ * @brief Cancel the measurement of a neighbour and free it.
+ * @param entry The neighbour.
+ */
+void LanDiscovery::releaseEntry(Entry* entry) {
+    if (entry->probe) {
+        disconnect(entry->probe, nullptr, this, nullptr);
+        entry->probe->abort();
+        entry->probe->deleteLater();
+    }
+    delete entry;
+}
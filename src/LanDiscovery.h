@@ -0,0 +1,285 @@
+/**
+ * @file LanDiscovery.h
+ * @brief Header file for the LanDiscovery class.
+ *
+ * Finds Yggdrasil nodes on the local network through the local daemon and
+ * by their multicast beacons.
+ */
+
+#ifndef LANDISCOVERY_H
+#define LANDISCOVERY_H
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QHostAddress>
+#include <QJsonObject>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+
+class QTcpSocket;
+class QTimer;
+class QUdpSocket;
+
+/**
+ * @class LanDiscovery
+ * @brief Finds the Yggdrasil nodes on the LAN and measures the round-trip
+ * time to them.
+ *
+ * @details The main source is the local daemon, which connects to the
+ *          nodes it hears on its multicast interfaces by itself: while
+ *          watchDaemon() is on, its outbound peers on link-local addresses
+ *          are read from the admin socket every DAEMON_POLL_MS, together
+ *          with the latency the daemon measured.
+ *
+ *          Listening for the beacons is an extra that also finds nodes the
+ *          daemon does not connect to.  Yggdrasil nodes with multicast
+ *          enabled send a beacon about once
+ *          a second to [ff02::114]:9001 on each of their multicast
+ *          interfaces.  The beacon carries the public key of the node and
+ *          the port of its multicast listener; the link-local source
+ *          address of the datagram is the address of the listener.
+ *
+ *          The discovery joins the group on the selected interfaces, with
+ *          the port shared with a local Yggdrasil daemon that listens for
+ *          the same beacons: the socket is opened with SO_REUSEADDR and
+ *          SO_REUSEPORT, since the daemon may set either of them, and
+ *          Linux only shares the port if both sockets set the same one.
+ *          It also only shares it between sockets of the same user, so
+ *          the port of a daemon that runs as root, as it does as a system
+ *          service, cannot be shared by the tray; start() fails with
+ *          PortInUse then, and only the peers of the daemon are found.
+ *
+ *          A neighbour without a latency from the daemon is measured by
+ *          the time of a TCP handshake with its listener, again every
+ *          MEASURE_INTERVAL_MS while it is seen, and forgotten once it has
+ *          not been seen for EXPIRY_MS.
+ *
+ *          Neighbours are reported as peer URIs that pin the interface and
+ *          the public key, so that they can be added as private peers.
+ */
+class LanDiscovery : public QObject {
+    Q_OBJECT
+
+public:
+    // Port the beacons are sent to
+    static constexpr quint16 MULTICAST_PORT = 9001;
+    // Group the beacons are sent to
+    static constexpr const char* MULTICAST_GROUP = "ff02::114";
+    // Size of an ed25519 public key
+    static constexpr int PUBLIC_KEY_SIZE = 32;
+    // Time without beacons after which a neighbour is forgotten
+    static constexpr int EXPIRY_MS = 10000;
+    // Interval between measurements of a neighbour
+    static constexpr int MEASURE_INTERVAL_MS = 5000;
+    // Time a handshake may take before the neighbour counts as unreachable
+    static constexpr int CONNECT_TIMEOUT_MS = 1000;
+    // Interval between reads of the peers of the local daemon
+    static constexpr int DAEMON_POLL_MS = 2000;
+
+    /**
+     * @brief Reasons start() failed.
+     */
+    enum Error {
+        NoError,
+        PortInUse,   ///< Another program holds the port without sharing it
+        SocketError, ///< The socket could not be opened or bound
+        NoInterface  ///< The group could not be joined on any interface
+    };
+
+    /**
+     * @brief Contents of a beacon.
+     */
+    struct Beacon {
+        QByteArray publicKey;
+        quint16 port = 0;
+        // Protocol version; 0.4 beacons do not carry one
+        int majorVersion = 0;
+        int minorVersion = 4;
+    };
+
+    /**
+     * @brief A node found on the LAN.
+     */
+    struct Neighbour {
+        // Peer URI of the listener of the node
+        QString uri;
+        // Hex public key of the node
+        QString publicKey;
+        QString interfaceName;
+        // Link-local address of the node
+        QHostAddress address;
+        quint16 port = 0;
+        // Last measured round-trip time in microseconds, or -1 if not
+        // measured yet or unreachable
+        qint64 rttUs = -1;
+    };
+
+    /**
+     * @brief Constructor for LanDiscovery
+     * @param parent Optional QObject parent.
+     */
+    explicit LanDiscovery(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor for LanDiscovery
+     */
+    ~LanDiscovery();
+
+    /**
+     * @brief Listen for beacons on some interfaces.
+     * @param interfaceNames Names of the interfaces; a running discovery
+     * is restarted with them.
+     * @return false if the port could not be bound or the multicast group
+     * could not be joined on any of them; error() tells which.
+     */
+    bool start(const QStringList& interfaceNames);
+
+    /**
+     * @brief Get the reason the last start() failed.
+     */
+    Error error() const { return lastError; }
+
+    /**
+     * @brief Stop listening, stop watching the daemon and forget all
+     * neighbours.
+     */
+    void stop();
+
+    /**
+     * @brief Check whether the discovery listens for beacons.
+     */
+    bool isActive() const { return socket != nullptr; }
+
+    /**
+     * @brief Read the link-local peers of the local daemon from the admin
+     * socket every DAEMON_POLL_MS, until stop().
+     * @param socketPaths Admin socket path candidates.
+     */
+    void watchDaemon(const QStringList& socketPaths);
+
+    /**
+     * @brief Check whether the peers of the daemon are read.
+     */
+    bool isWatchingDaemon() const { return ! daemonSocketPaths.isEmpty(); }
+
+    /**
+     * @brief Get the neighbours found so far.
+     */
+    QList<Neighbour> neighbours() const;
+
+    /**
+     * @brief Read the multicast interfaces of the Yggdrasil daemon from the
+     * admin socket; multicastInterfacesRead() is emitted with the result.
+     * @param socketPaths Admin socket path candidates.
+     */
+    void readMulticastInterfaces(const QStringList& socketPaths);
+
+    /**
+     * @brief Get the interfaces beacons can be received on: running,
+     * multicast-capable interfaces with an IPv6 link-local address.
+     */
+    static QStringList candidateInterfaces();
+
+    /**
+     * @brief Parse a beacon.
+     * @param datagram The payload of the beacon.
+     * @param beacon Receives the contents.
+     * @return false if the datagram is not a beacon of a known version.
+     */
+    static bool parseBeacon(const QByteArray& datagram, Beacon* beacon);
+
+    /**
+     * @brief Build the peer URI of a neighbour.
+     * @param address Link-local address of the neighbour.
+     * @param interfaceName Interface the neighbour was found on.
+     * @param port Port of its multicast listener.
+     * @param publicKey Its public key.
+     */
+    static QString peerUri(const QHostAddress& address,
+                           const QString& interfaceName,
+                           quint16 port,
+                           const QByteArray& publicKey);
+
+    /**
+     * @brief Find the neighbours in a "getpeers" admin socket response.
+     * @param response The full JSON response.
+     * @return The peers that are up, that the daemon connected to and
+     * that have a link-local address and a public key.
+     * @details Inbound peers connected from an arbitrary port, not from
+     * their listener, so they cannot be pinned and are left to the
+     * beacons.
+     */
+    static QList<Neighbour> daemonNeighbours(const QJsonObject& response);
+
+signals:
+    /**
+     * @brief Emitted when a neighbour is found or measured.
+     * @param neighbour The neighbour.
+     */
+    void neighbourChanged(const LanDiscovery::Neighbour& neighbour);
+
+    /**
+     * @brief Emitted when a neighbour stopped sending beacons.
+     * @param uri Peer URI of the neighbour.
+     */
+    void neighbourLost(const QString& uri);
+
+    /**
+     * @brief Emitted when the multicast interfaces were read.
+     * @param interfaceNames Names of the interfaces; empty if the admin
+     * socket is not available.
+     */
+    void multicastInterfacesRead(const QStringList& interfaceNames);
+
+    /**
+     * @brief Emitted by the admin socket task of the daemon watch.
+     * @param response The "getpeers" response; empty if the admin socket
+     * is not available.
+     */
+    void daemonPeersRead(const QJsonObject& response);
+
+private slots:
+    void onReadyRead();
+    void onExpiryTimeout();
+    void pollDaemon();
+    void onDaemonPeersRead(const QJsonObject& response);
+
+private:
+    struct Entry {
+        Neighbour neighbour;
+        qint64 lastSeenMs = 0;
+        qint64 measuredMs = -1;
+        QTcpSocket* probe = nullptr;
+        QElapsedTimer probeTimer;
+    };
+
+    bool isOwnAddress(const QHostAddress& address) const;
+    Entry* touch(const Neighbour& neighbour);
+    bool isMeasurementDue(const Entry* entry) const;
+    void measure(Entry* entry);
+    void finishMeasurement(const QString& uri,
+                           QTcpSocket* probe,
+                           bool connected);
+    void releaseEntry(Entry* entry);
+    void forgetNeighbours();
+    void closeSocket();
+
+    QUdpSocket* openSocket();
+
+    QUdpSocket* socket;
+    Error lastError;
+    QTimer* expiryTimer;
+    QTimer* daemonTimer;
+    // Admin socket paths of the daemon watch; empty if not watching
+    QStringList daemonSocketPaths;
+    // Whether a read of the daemon peers is queued or running
+    bool daemonPollPending;
+    QElapsedTimer clock;
+    QList<QHostAddress> ownAddresses;
+    QHash<QString, Entry*> entries;
+};
+
+#endif // LANDISCOVERY_H
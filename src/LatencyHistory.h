@@ -0,0 +1,92 @@
+/**
+ * @file LatencyHistory.h
+ * @brief Fixed-size history of latency samples of a single peer.
+ */
+
+#ifndef LATENCYHISTORY_H
+#define LATENCYHISTORY_H
+
+#include <QMetaType>
+
+/**
+ * @class LatencyHistory
+ * @brief Circular buffer of the last CAPACITY latency samples of a peer.
+ *
+ * @details The buffer never allocates: it is a plain value type that is
+ *          cheap to copy into a QVariant for item views.  A negative sample
+ *          means that the test failed.
+ */
+class LatencyHistory {
+public:
+    // Number of samples to keep
+    static constexpr int CAPACITY = 16;
+
+    /**
+     * @brief Append a sample, overwriting the oldest one when full.
+     * @param latency Latency in milliseconds, or -1 if the test failed.
+     */
+    void add(int latency) {
+        samples[head] = latency;
+        head = (head + 1) % CAPACITY;
+        if (count < CAPACITY) {
+            ++count;
+        }
+    }
+
+    /**
+     * @brief Get the number of stored samples.
+     */
+    int size() const { return count; }
+
+    /**
+     * @brief Check whether there are no samples.
+     */
+    bool isEmpty() const { return count == 0; }
+
+    /**
+     * @brief Get a sample by age.
+     * @param i Sample index; 0 is the oldest stored sample.
+     * @return Latency in milliseconds, or -1 for a failed test.
+     */
+    int at(int i) const {
+        return samples[(head - count + i + CAPACITY) % CAPACITY];
+    }
+
+    /**
+     * @brief Get the most recent sample, or -1 if there are none.
+     */
+    int last() const { return count > 0 ? at(count - 1) : -1; }
+
+    /**
+     * @brief Get the range of successful samples.
+     * @param min Set to the lowest successful latency.
+     * @param max Set to the highest successful latency.
+     * @return false if there are no successful samples.
+     */
+    bool range(int& min, int& max) const {
+        bool found = false;
+        for (int i = 0; i < count; ++i) {
+            int value = at(i);
+            if (value < 0) {
+                continue;
+            }
+            if (! found || (value < min)) {
+                min = value;
+            }
+            if (! found || (value > max)) {
+                max = value;
+            }
+            found = true;
+        }
+        return found;
+    }
+
+private:
+    int samples[CAPACITY] = {};
+    int head = 0;
+    int count = 0;
+};
+
+Q_DECLARE_METATYPE(LatencyHistory)
+
+#endif // LATENCYHISTORY_H
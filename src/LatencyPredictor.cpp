@@ -0,0 +1,133 @@
+/**
+ * @file LatencyPredictor.cpp
+ * @brief Implementation file for the LatencyPredictor class.
+ */
+
+#include <algorithm>
+#include <vector>
+#include <QHostAddress>
+#include <QPair>
+
+#include "LatencyPredictor.h"
+#include "PeerManager.h"
+#include "ProbeResultCache.h"
+
+// Key prefixes of the neighbourhood kinds
+static const char* PREFIX_KEY = "prefix:";
+static const char* ASN_KEY = "asn:";
+static const char* DOMAIN_KEY = "domain:";
+
+/**
+ * @brief Get the neighbourhoods of a peer, finest first.
+ * @param peer The peer.
+ */
+QStringList LatencyPredictor::neighbourhoods(const PeerData& peer) {
+    QString name = pingHost(peer.host()).toLower();
+    QStringList keys;
+
+    QHostAddress address;
+    bool isAddress = address.setAddress(name);
+    if (isAddress) {
+        int length = (address.protocol() == QAbstractSocket::IPv6Protocol)
+            ? IPV6_PREFIX_LENGTH
+            : IPV4_PREFIX_LENGTH;
+        QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(
+            address.toString() + "/" + QString::number(length));
+        keys << PREFIX_KEY + subnet.first.toString() + "/"
+            + QString::number(subnet.second);
+    }
+    if (peer.asn() != 0) {
+        keys << ASN_KEY + QString::number(peer.asn());
+    }
+    if (isAddress) {
+        return keys;
+    }
+
+    // Hosts of one operator usually share the registered domain.
+    QStringList labels = name.split('.');
+    labels.removeAll(QString());
+    if (labels.size() >= 2) {
+        keys << DOMAIN_KEY + labels.mid(labels.size() - 2).join('.');
+    }
+    return keys;
+}
+
+/**
+ * @brief Add the result of a peer test.
+ * @param peer The tested peer.
+ */
+void LatencyPredictor::addResult(const PeerData& peer) {
+    int latency = (peer.isValid() && (peer.latency() > 0))
+        ? peer.latency()
+        : -1;
+    for (const QString& key : neighbourhoods(peer)) {
+        QHash<QString, int>& neighbours = samples[key];
+        if ((neighbours.size() >= MAX_SAMPLES)
+            && (! neighbours.contains(peer.host()))) {
+            continue;
+        }
+        neighbours.insert(peer.host(), latency);
+    }
+}
+
+/**
+ * @brief Estimate the latency of a peer from its neighbours.
+ * @param peer The peer.
+ */
+LatencyPredictor::Prediction
+LatencyPredictor::predict(const PeerData& peer) const {
+    Prediction prediction;
+    for (const QString& key : neighbourhoods(peer)) {
+        auto group = samples.constFind(key);
+        if (group == samples.constEnd()) {
+            continue;
+        }
+
+        std::vector<int> latencies;
+        int failed = 0;
+        for (auto it = group->constBegin(); it != group->constEnd(); ++it) {
+            if (it.key() == peer.host()) {
+                continue;
+            }
+            if (it.value() > 0) {
+                latencies.push_back(it.value());
+            } else {
+                ++failed;
+            }
+        }
+        int count = static_cast<int>(latencies.size()) + failed;
+        if (count == 0) {
+            continue;
+        }
+
+        prediction.level = key.startsWith(PREFIX_KEY) ? Prefix
+            : key.startsWith(ASN_KEY) ? Asn
+            : Domain;
+        prediction.samples = count;
+        if (failed * 2 > count) {
+            prediction.latency = -1;
+        } else {
+            auto middle = latencies.begin() + latencies.size() / 2;
+            std::nth_element(latencies.begin(), middle, latencies.end());
+            prediction.latency = *middle;
+        }
+        return prediction;
+    }
+    return prediction;
+}
+
+/**
+ * @brief Get the probe priority of a peer from its estimate.
+ * @param prediction The estimate.
+ * @details The priority lies between that of an unknown peer and that of
+ * a measured peer with the estimated result.
+ */
+double LatencyPredictor::priority(const Prediction& prediction) {
+    double score = ProbeResultCache::FAILED_PRIORITY;
+    if (prediction.latency > 0) {
+        score = ProbeResultCache::SLOW_LATENCY_MS
+            - std::min(prediction.latency, ProbeResultCache::SLOW_LATENCY_MS);
+    }
+    return ProbeResultCache::UNKNOWN_PRIORITY
+        + (score - ProbeResultCache::UNKNOWN_PRIORITY) * PRIORITY_WEIGHT;
+}
@@ -0,0 +1,106 @@
+/**
+ * @file LatencyPredictor.h
+ * @brief Header file for the LatencyPredictor class.
+ *
+ * Estimates the latency of untested peers from their measured neighbours.
+ */
+
+#ifndef LATENCYPREDICTOR_H
+#define LATENCYPREDICTOR_H
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+
+#include "PeerData.h"
+
+/**
+ * @class LatencyPredictor
+ * @brief Latency estimates from the peers measured in the same
+ * neighbourhood.
+ *
+ * @details Peers hosted in the same network sit behind the same paths, so
+ *          their round trip times are strongly correlated.  A peer address
+ *          belongs to the neighbourhood of its IPv4 /24 or IPv6 /48 prefix
+ *          and, once its origin AS is known (see AsnDatabase), to that of
+ *          its AS; a peer host name to the neighbourhood of its domain.  The
+ *          estimate of a peer comes from its finest neighbourhood with
+ *          measured peers: the median latency of the other measured peers,
+ *          or unreachable if most of them failed.
+ *
+ *          The estimates order the probe queue, so that a sweep finds the
+ *          fast peers early, and are shown until the peers are measured.
+ */
+class LatencyPredictor {
+public:
+    // Prefix length of an IPv4 neighbourhood
+    static constexpr int IPV4_PREFIX_LENGTH = 24;
+    // Prefix length of an IPv6 neighbourhood
+    static constexpr int IPV6_PREFIX_LENGTH = 48;
+    // Results kept per neighbourhood
+    static constexpr int MAX_SAMPLES = 16;
+    // An estimate counts this much of a measured result when ranking probes
+    static constexpr double PRIORITY_WEIGHT = 0.5;
+
+    /**
+     * @brief Kind of neighbourhood an estimate comes from.
+     */
+    enum Level {
+        NoEstimate, ///< No measured neighbours
+        Domain,     ///< Same domain of the host name
+        Asn,        ///< Same origin AS
+        Prefix      ///< Same address prefix
+    };
+
+    /**
+     * @brief A latency estimate.
+     */
+    struct Prediction {
+        Level level = NoEstimate;
+        // Estimated latency, or -1 if the peer is likely unreachable
+        int latency = -1;
+        // Number of measured neighbours the estimate is based on
+        int samples = 0;
+
+        bool isValid() const { return level != NoEstimate; }
+    };
+
+    /**
+     * @brief Get the neighbourhoods of a peer, finest first.
+     * @param peer The peer.
+     * @return Keys of the neighbourhoods; empty for a peer that has none,
+     * such as one with a single-label host name.
+     */
+    static QStringList neighbourhoods(const PeerData& peer);
+
+    /**
+     * @brief Add the result of a peer test.
+     * @param peer The tested peer; a peer that is not valid counts as
+     * unreachable.
+     */
+    void addResult(const PeerData& peer);
+
+    /**
+     * @brief Estimate the latency of a peer from its neighbours.
+     * @param peer The peer; its own result is not used.
+     */
+    Prediction predict(const PeerData& peer) const;
+
+    /**
+     * @brief Get the probe priority of a peer from its estimate, on the
+     * scale of ProbeResultCache::priority().
+     * @param prediction The estimate; must be valid.
+     */
+    static double priority(const Prediction& prediction);
+
+    /**
+     * @brief Forget all results.
+     */
+    void clear() { samples.clear(); }
+
+private:
+    // Neighbourhood key to the latency of each measured peer in it
+    QHash<QString, QHash<QString, int>> samples;
+};
+
+#endif // LATENCYPREDICTOR_H
@@ -0,0 +1,452 @@
+/**
+ * @file NetworkMonitor.cpp
+ * @brief Implementation file for the NetworkMonitor class.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QSocketNotifier>
+#include <QStringList>
+#include <QTimer>
+
+#include "NetworkMonitor.h"
+
+#ifdef Q_OS_LINUX
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#endif
+
+constexpr const char* NetworkMonitor::OFFLINE;
+
+// Receive buffer for netlink messages
+static const int NETLINK_BUFFER_SIZE = 64 * 1024;
+// Timeout of a routing table dump
+static const int DUMP_TIMEOUT_MS = 1000;
+
+#ifdef Q_OS_LINUX
+
+/**
+ * @brief Get the name of an interface.
+ * @param index Interface index.
+ */
+static QString interfaceName(int index) {
+    char name[IF_NAMESIZE] = {};
+    if (! if_indextoname(static_cast<unsigned>(index), name)) {
+        return QString::number(index);
+    }
+    return QString::fromLocal8Bit(name);
+}
+
+/**
+ * @brief Convert a netlink address attribute to a QHostAddress.
+ * @param family AF_INET or AF_INET6.
+ * @param attribute The attribute.
+ */
+static QHostAddress attributeAddress(int family,
+                                     const struct rtattr* attribute) {
+    size_t length = RTA_PAYLOAD(attribute);
+    if ((family == AF_INET) && (length >= 4)) {
+        quint32 address;
+        memcpy(&address, RTA_DATA(attribute), 4);
+        return QHostAddress(ntohl(address));
+    }
+    if ((family == AF_INET6) && (length >= 16)) {
+        return QHostAddress(static_cast<const quint8*>(RTA_DATA(attribute)));
+    }
+    return QHostAddress();
+}
+
+/**
+ * @brief Request a routing table dump and pass every answer to a handler.
+ * @param type RTM_GETROUTE or RTM_GETADDR.
+ * @param handler Called for every message of the dump.
+ * @return false if the dump failed.
+ */
+static bool netlinkDump(
+    int type,
+    const std::function<void(const struct nlmsghdr*)>& handler) {
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        qDebug() << "[NetworkMonitor::netlinkDump] socket() failed:"
+                 << strerror(errno);
+        return false;
+    }
+    struct timeval timeout;
+    timeout.tv_sec = DUMP_TIMEOUT_MS / 1000;
+    timeout.tv_usec = (DUMP_TIMEOUT_MS % 1000) * 1000;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    struct {
+        struct nlmsghdr header;
+        struct rtgenmsg message;
+    } request;
+    memset(&request, 0, sizeof(request));
+    request.header.nlmsg_len = NLMSG_LENGTH(sizeof(struct rtgenmsg));
+    request.header.nlmsg_type = static_cast<quint16>(type);
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    request.header.nlmsg_seq = 1;
+    request.message.rtgen_family = AF_UNSPEC;
+
+    struct sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(fd, &request, request.header.nlmsg_len, 0,
+               reinterpret_cast<struct sockaddr*>(&kernel),
+               sizeof(kernel)) < 0) {
+        qDebug() << "[NetworkMonitor::netlinkDump] sendto() failed:"
+                 << strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    std::vector<char> buffer(NETLINK_BUFFER_SIZE);
+    bool success = false;
+    bool done = false;
+    while (! done) {
+        ssize_t received = recv(fd, buffer.data(), buffer.size(), 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            qDebug() << "[NetworkMonitor::netlinkDump] recv() failed:"
+                     << strerror(errno);
+            break;
+        }
+        int remaining = static_cast<int>(received);
+        for (auto header = reinterpret_cast<const struct nlmsghdr*>(
+                 buffer.data());
+             NLMSG_OK(header, remaining);
+             header = NLMSG_NEXT(header, remaining)) {
+            if (header->nlmsg_type == NLMSG_DONE) {
+                success = true;
+                done = true;
+                break;
+            }
+            if (header->nlmsg_type == NLMSG_ERROR) {
+                done = true;
+                break;
+            }
+            handler(header);
+        }
+        if (received == 0) {
+            break;
+        }
+    }
+    close(fd);
+    return success;
+}
+
+/**
+ * @brief Add the default routes of a route message.
+ * @param header The RTM_NEWROUTE message.
+ * @param routes Receives the routes.
+ */
+static void parseRoute(const struct nlmsghdr* header,
+                       QList<NetworkMonitor::Route>* routes) {
+    if (header->nlmsg_type != RTM_NEWROUTE) {
+        return;
+    }
+    auto message = static_cast<const struct rtmsg*>(NLMSG_DATA(header));
+    if ((message->rtm_dst_len != 0) || (message->rtm_type != RTN_UNICAST)
+        || ((message->rtm_family != AF_INET)
+            && (message->rtm_family != AF_INET6))) {
+        return;
+    }
+
+    unsigned table = message->rtm_table;
+    int outputIndex = 0;
+    QHostAddress gateway;
+    QList<NetworkMonitor::Route> nextHops;
+    int length = static_cast<int>(RTM_PAYLOAD(header));
+    for (auto attribute = RTM_RTA(message);
+         RTA_OK(attribute, length);
+         attribute = RTA_NEXT(attribute, length)) {
+        switch (attribute->rta_type) {
+        case RTA_TABLE:
+            memcpy(&table, RTA_DATA(attribute), sizeof(table));
+            break;
+        case RTA_OIF:
+            memcpy(&outputIndex, RTA_DATA(attribute), sizeof(outputIndex));
+            break;
+        case RTA_GATEWAY:
+            gateway = attributeAddress(message->rtm_family, attribute);
+            break;
+        case RTA_MULTIPATH: {
+            int hopsLength = static_cast<int>(RTA_PAYLOAD(attribute));
+            auto hop = static_cast<const struct rtnexthop*>(
+                RTA_DATA(attribute));
+            while (RTNH_OK(hop, hopsLength)) {
+                NetworkMonitor::Route route;
+                route.interfaceName = interfaceName(hop->rtnh_ifindex);
+                int hopLength = hop->rtnh_len
+                    - static_cast<int>(RTNH_LENGTH(0));
+                for (auto hopAttribute = RTNH_DATA(hop);
+                     RTA_OK(hopAttribute, hopLength);
+                     hopAttribute = RTA_NEXT(hopAttribute, hopLength)) {
+                    if (hopAttribute->rta_type == RTA_GATEWAY) {
+                        route.gateway = attributeAddress(
+                            message->rtm_family, hopAttribute);
+                    }
+                }
+                nextHops << route;
+                hopsLength -= RTNH_ALIGN(hop->rtnh_len);
+                hop = RTNH_NEXT(hop);
+            }
+            break;
+        }
+        default:
+            break;
+        }
+    }
+    if (table != RT_TABLE_MAIN) {
+        return;
+    }
+
+    if (outputIndex > 0) {
+        NetworkMonitor::Route route;
+        route.interfaceName = interfaceName(outputIndex);
+        route.gateway = gateway;
+        *routes << route;
+    }
+    *routes << nextHops;
+}
+
+/**
+ * @brief Add the address of an address message.
+ * @param header The RTM_NEWADDR message.
+ * @param addresses Receives the address.
+ */
+static void parseAddress(const struct nlmsghdr* header,
+                         QList<NetworkMonitor::Address>* addresses) {
+    if (header->nlmsg_type != RTM_NEWADDR) {
+        return;
+    }
+    auto message = static_cast<const struct ifaddrmsg*>(NLMSG_DATA(header));
+    if ((message->ifa_family != AF_INET)
+        && (message->ifa_family != AF_INET6)) {
+        return;
+    }
+
+    NetworkMonitor::Address address;
+    address.interfaceName
+        = interfaceName(static_cast<int>(message->ifa_index));
+    address.prefixLength = message->ifa_prefixlen;
+    address.isGlobal = (message->ifa_scope == RT_SCOPE_UNIVERSE);
+    int length = static_cast<int>(IFA_PAYLOAD(header));
+    for (auto attribute = IFA_RTA(message);
+         RTA_OK(attribute, length);
+         attribute = RTA_NEXT(attribute, length)) {
+        // IFA_LOCAL is the local address of point-to-point IPv4 links,
+        // where IFA_ADDRESS is the remote end.
+        if ((attribute->rta_type == IFA_LOCAL)
+            || ((attribute->rta_type == IFA_ADDRESS)
+                && address.address.isNull())) {
+            address.address = attributeAddress(message->ifa_family,
+                                               attribute);
+        }
+    }
+    if (! address.address.isNull()) {
+        *addresses << address;
+    }
+}
+
+#endif // Q_OS_LINUX
+
+/**
+ * @brief Constructor for NetworkMonitor
+ * @param parent Optional QObject parent.
+ */
+NetworkMonitor::NetworkMonitor(QObject *parent)
+    : QObject(parent)
+    , fd(-1)
+    , notifier(nullptr)
+    , settleTimer(new QTimer(this)) {
+    settleTimer->setSingleShot(true);
+    settleTimer->setInterval(SETTLE_MS);
+    connect(settleTimer, &QTimer::timeout,
+            this, &NetworkMonitor::onSettled);
+}
+
+/**
+ * @brief Destructor for NetworkMonitor
+ */
+NetworkMonitor::~NetworkMonitor() {
+    stop();
+}
+
+/**
+ * @brief Compute the current fingerprint and watch for changes.
+ * @return false if the netlink socket could not be opened.
+ */
+bool NetworkMonitor::start() {
+    if (fd >= 0) {
+        return true;
+    }
+#ifdef Q_OS_LINUX
+    fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                NETLINK_ROUTE);
+    if (fd < 0) {
+        qDebug() << "[NetworkMonitor::start] socket() failed:"
+                 << strerror(errno);
+        return false;
+    }
+    struct sockaddr_nl local;
+    memset(&local, 0, sizeof(local));
+    local.nl_family = AF_NETLINK;
+    local.nl_groups = RTMGRP_IPV4_ROUTE | RTMGRP_IPV6_ROUTE
+        | RTMGRP_IPV4_IFADDR | RTMGRP_IPV6_IFADDR;
+    if (bind(fd, reinterpret_cast<struct sockaddr*>(&local),
+             sizeof(local)) < 0) {
+        qDebug() << "[NetworkMonitor::start] bind() failed:"
+                 << strerror(errno);
+        close(fd);
+        fd = -1;
+        return false;
+    }
+
+    notifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+    connect(notifier, &QSocketNotifier::activated,
+            this, &NetworkMonitor::onNetlinkReadable);
+    current = currentFingerprint();
+    qDebug() << "[NetworkMonitor::start] Network fingerprint:" << current;
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Stop watching for changes.
+ */
+void NetworkMonitor::stop() {
+    settleTimer->stop();
+    delete notifier;
+    notifier = nullptr;
+#ifdef Q_OS_LINUX
+    if (fd >= 0) {
+        close(fd);
+    }
+#endif
+    fd = -1;
+}
+
+/**
+ * @brief Compute a network fingerprint.
+ * @param routes The default routes.
+ * @param addresses The interface addresses.
+ * @return A short hex string, or OFFLINE without default routes.
+ */
+QString NetworkMonitor::computeFingerprint(const QList<Route>& routes,
+                                           const QList<Address>& addresses) {
+    QStringList parts;
+    QStringList uplinks;
+    for (const Route& route : routes) {
+        parts << "route " + route.interfaceName + " "
+            + route.gateway.toString();
+        uplinks << route.interfaceName;
+    }
+    if (parts.isEmpty()) {
+        return OFFLINE;
+    }
+
+    // The prefixes tell networks with the same private gateway address
+    // apart, and ignore the host part that changes with privacy addresses.
+    for (const Address& address : addresses) {
+        if ((! address.isGlobal)
+            || (! uplinks.contains(address.interfaceName))) {
+            continue;
+        }
+        QPair<QHostAddress, int> subnet = QHostAddress::parseSubnet(
+            address.address.toString() + "/"
+            + QString::number(address.prefixLength));
+        parts << "prefix " + address.interfaceName + " "
+            + subnet.first.toString() + "/" + QString::number(subnet.second);
+    }
+    parts.sort();
+    parts.removeDuplicates();
+
+    QByteArray hash = QCryptographicHash::hash(parts.join('\n').toUtf8(),
+                                               QCryptographicHash::Sha1);
+    return QString::fromLatin1(hash.toHex().left(16));
+}
+
+/**
+ * @brief Read the default routes and interface addresses from the kernel.
+ * @param routes Receives the default routes of the main table.
+ * @param addresses Receives the interface addresses.
+ * @return false if the routing table could not be read.
+ */
+bool NetworkMonitor::readNetworkState(QList<Route>* routes,
+                                      QList<Address>* addresses) {
+    routes->clear();
+    addresses->clear();
+#ifdef Q_OS_LINUX
+    if (! netlinkDump(RTM_GETROUTE, [routes](const struct nlmsghdr* header) {
+            parseRoute(header, routes);
+        })) {
+        return false;
+    }
+    return netlinkDump(RTM_GETADDR,
+                       [addresses](const struct nlmsghdr* header) {
+                           parseAddress(header, addresses);
+                       });
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief Read and fingerprint the current network.
+ * @return The fingerprint, or an empty string if it cannot be read.
+ */
+QString NetworkMonitor::currentFingerprint() {
+    QList<Route> routes;
+    QList<Address> addresses;
+    if (! readNetworkState(&routes, &addresses)) {
+        return QString();
+    }
+    return computeFingerprint(routes, addresses);
+}
+
+/**
+ * @brief Drain the netlink socket and wait for the changes to settle.
+ */
+void NetworkMonitor::onNetlinkReadable() {
+#ifdef Q_OS_LINUX
+    // The messages themselves do not matter; the state is read again
+    // once they stop.  ENOBUFS means some were lost, which is no different.
+    std::vector<char> buffer(NETLINK_BUFFER_SIZE);
+    while ((recv(fd, buffer.data(), buffer.size(), 0) >= 0)
+           || (errno == ENOBUFS)) {
+    }
+#endif
+    settleTimer->start();
+}
+
+/**
+ * @brief Compute the fingerprint again and report a change.
+ */
+void NetworkMonitor::onSettled() {
+    QString fingerprint = currentFingerprint();
+    // Losing the uplink for a moment is no move to another network; keep
+    // the fingerprint so that getting it back is no change either.
+    if (fingerprint.isEmpty() || (fingerprint == OFFLINE)
+        || (fingerprint == current)) {
+        return;
+    }
+    QString previous = current;
+    current = fingerprint;
+    qDebug() << "[NetworkMonitor::onSettled] Network changed from"
+             << previous << "to" << current;
+    emit networkChanged(current, previous);
+}
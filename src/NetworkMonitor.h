@@ -0,0 +1,146 @@
+/**
+ * @file NetworkMonitor.h
+ * @brief Header file for the NetworkMonitor class.
+ *
+ * Watches the routing table for changes of the network the host is on.
+ */
+
+#ifndef NETWORKMONITOR_H
+#define NETWORKMONITOR_H
+
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QString>
+
+class QSocketNotifier;
+class QTimer;
+
+/**
+ * @class NetworkMonitor
+ * @brief Detects when the host moves to another network.
+ *
+ * @details Peer latencies depend on the network the host is on, so results
+ *          measured on one network say little about another.  The monitor
+ *          describes the current network with a fingerprint of the default
+ *          routes (uplink interface and gateway) and of the global address
+ *          prefixes on those uplinks.  Probe results are tagged with it, and
+ *          results from another network can be told apart.
+ *
+ *          A netlink socket subscribed to route and address changes
+ *          (RTM_NEWROUTE, RTM_DELROUTE, RTM_NEWADDR, RTM_DELADDR) wakes the
+ *          monitor.  Changes come in bursts while an interface comes up, so
+ *          the fingerprint is computed again once the routing table has
+ *          been quiet for SETTLE_MS; networkChanged() is emitted if it
+ *          differs.  Going OFFLINE is not reported as a change.  Netlink
+ *          is only available on Linux; elsewhere the fingerprint stays
+ *          empty, which means unknown.
+ */
+class NetworkMonitor : public QObject {
+    Q_OBJECT
+
+public:
+    // Quiet time after the last netlink message before the fingerprint is
+    // computed again
+    static constexpr int SETTLE_MS = 1000;
+    // Fingerprint of a host without a default route
+    static constexpr const char* OFFLINE = "offline";
+
+    /**
+     * @brief A default route.
+     */
+    struct Route {
+        QString interfaceName;
+        // Empty for a point-to-point uplink
+        QHostAddress gateway;
+    };
+
+    /**
+     * @brief An address assigned to an interface.
+     */
+    struct Address {
+        QString interfaceName;
+        QHostAddress address;
+        int prefixLength = 0;
+        // Whether the address is globally routable
+        bool isGlobal = false;
+    };
+
+    /**
+     * @brief Constructor for NetworkMonitor
+     * @param parent Optional QObject parent.
+     */
+    explicit NetworkMonitor(QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor for NetworkMonitor
+     */
+    ~NetworkMonitor();
+
+    /**
+     * @brief Compute the current fingerprint and watch for changes.
+     * @return false if the netlink socket could not be opened.
+     */
+    bool start();
+
+    /**
+     * @brief Stop watching for changes.
+     */
+    void stop();
+
+    /**
+     * @brief Check whether the monitor watches for changes.
+     */
+    bool isActive() const { return fd >= 0; }
+
+    /**
+     * @brief Get the fingerprint of the current network; empty if unknown.
+     */
+    QString fingerprint() const { return current; }
+
+    /**
+     * @brief Compute a network fingerprint.
+     * @param routes The default routes.
+     * @param addresses The interface addresses; only the global addresses
+     * on the uplinks of the default routes are used.
+     * @return A short hex string, or OFFLINE without default routes.
+     */
+    static QString computeFingerprint(const QList<Route>& routes,
+                                      const QList<Address>& addresses);
+
+    /**
+     * @brief Read the default routes and interface addresses from the
+     * kernel.
+     * @param routes Receives the default routes of the main table.
+     * @param addresses Receives the interface addresses.
+     * @return false if the routing table could not be read.
+     */
+    static bool readNetworkState(QList<Route>* routes,
+                                 QList<Address>* addresses);
+
+    /**
+     * @brief Read and fingerprint the current network.
+     * @return The fingerprint, or an empty string if it cannot be read.
+     */
+    static QString currentFingerprint();
+
+signals:
+    /**
+     * @brief Emitted when the host moved to another network.
+     * @param fingerprint Fingerprint of the new network.
+     * @param previous Fingerprint of the previous network.
+     */
+    void networkChanged(const QString& fingerprint, const QString& previous);
+
+private slots:
+    void onNetlinkReadable();
+    void onSettled();
+
+private:
+    int fd;
+    QSocketNotifier* notifier;
+    QTimer* settleTimer;
+    QString current;
+};
+
+#endif // NETWORKMONITOR_H
@@ -0,0 +1,448 @@
+/**
+ * @file OverlayLatencyTest.cpp
+ * @brief Implementation file for the OverlayLatencyTest class.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QNetworkInterface>
+#include <QProcess>
+#include <QRegularExpression>
+
+#include "Executor.h"
+#include "IcmpProber.h"
+#include "OverlayLatencyTest.h"
+
+// Version of the serialized format
+static const quint32 RUNS_FORMAT_VERSION = 1;
+
+static const QString TARGETS_KEY = "peer_discovery/overlay_targets";
+static const QString RUNS_KEY = "peer_discovery/overlay_tests";
+
+// Definition of the constant that std::max() takes by reference
+constexpr int OverlayLatencyTest::MIN_PING_INTERVAL_MS;
+
+/**
+ * @brief Get the average round-trip time over the targets that replied.
+ * @return Microseconds, or -1 if no target replied.
+ */
+qint64 OverlayLatencyTest::Run::averageRttUs() const {
+    qint64 sum = 0;
+    int count = 0;
+    for (const TargetResult& result : results) {
+        if (result.averageRttUs >= 0) {
+            sum += result.averageRttUs;
+            ++count;
+        }
+    }
+    return (count > 0) ? sum / count : -1;
+}
+
+/**
+ * @brief Constructor for OverlayLatencyTest
+ * @param settings Settings to read the targets from and store runs in.
+ * @param parent Optional QObject parent.
+ */
+OverlayLatencyTest::OverlayLatencyTest(std::shared_ptr<QSettings> settings,
+                                       QObject *parent)
+    : QObject(parent)
+    , settings(settings)
+    , running(false) {
+    qRegisterMetaType<OverlayLatencyTest::Run>("OverlayLatencyTest::Run");
+}
+
+/**
+ * @brief Get the configured target addresses.
+ */
+QStringList OverlayLatencyTest::targets() const {
+    return settings->value(TARGETS_KEY).toStringList();
+}
+
+/**
+ * @brief Set the target addresses.
+ * @param addresses Yggdrasil addresses; others are dropped.
+ * @return The addresses that were kept.
+ */
+QStringList OverlayLatencyTest::setTargets(const QStringList& addresses) {
+    QStringList kept;
+    for (const QString& text : addresses) {
+        QHostAddress address;
+        if (address.setAddress(text.trimmed()) && isOverlayAddress(address)) {
+            QString normalized = address.toString();
+            if (! kept.contains(normalized)) {
+                kept << normalized;
+            }
+        } else if (! text.trimmed().isEmpty()) {
+            qDebug() << "[OverlayLatencyTest::setTargets]"
+                     << "Not a Yggdrasil address:" << text;
+        }
+    }
+    settings->setValue(TARGETS_KEY, kept);
+    return kept;
+}
+
+/**
+ * @brief Start a run in the background.
+ * @param peers URIs of the currently connected peers.
+ * @return false if a run is in progress or no targets are configured.
+ */
+bool OverlayLatencyTest::start(const QStringList& peers) {
+    if (running) {
+        return false;
+    }
+
+    QList<QHostAddress> addresses;
+    for (const QString& text : targets()) {
+        QHostAddress address(text);
+        if (isOverlayAddress(address)) {
+            addresses << address;
+        }
+    }
+    if (addresses.isEmpty()) {
+        qDebug() << "[OverlayLatencyTest::start] No targets configured";
+        return false;
+    }
+
+    Run run;
+    run.timestampMs = QDateTime::currentMSecsSinceEpoch();
+    run.peers = peers;
+    run.peers.sort();
+
+    // The route of 200::/7 leads through the TUN interface; binding to it
+    // would need CAP_NET_RAW on older kernels.
+    qDebug() << "[OverlayLatencyTest::start] Probing" << addresses.size()
+             << "targets, TUN interface:" << overlayInterface();
+
+    auto runnable = new OverlayLatencyRunnable(run, addresses);
+    connect(runnable, &OverlayLatencyRunnable::measured,
+            this, &OverlayLatencyTest::handleMeasured,
+            Qt::QueuedConnection);
+    if (! Executor::instance().submit(Executor::Interactive, runnable, this)) {
+        return false;
+    }
+    running = true;
+    return true;
+}
+
+/**
+ * @brief Store a finished run and report it.
+ * @param run The run.
+ * @param success false if the targets could not be probed.
+ */
+void OverlayLatencyTest::handleMeasured(const OverlayLatencyTest::Run& run,
+                                        bool success) {
+    running = false;
+    if (success) {
+        record(run);
+    }
+    emit finished(run, success);
+}
+
+/**
+ * @brief Append a run to the stored ones, dropping the oldest.
+ * @param run The run.
+ */
+void OverlayLatencyTest::record(const Run& run) {
+    QList<Run> runs = history();
+    runs << run;
+    while (runs.size() > MAX_RUNS) {
+        runs.removeFirst();
+    }
+    settings->setValue(RUNS_KEY, saveRuns(runs));
+}
+
+/**
+ * @brief Get the stored runs, oldest first.
+ */
+QList<OverlayLatencyTest::Run> OverlayLatencyTest::history() const {
+    QList<Run> runs;
+    loadRuns(settings->value(RUNS_KEY).toByteArray(), runs);
+    return runs;
+}
+
+/**
+ * @brief Check whether an address belongs to the Yggdrasil network.
+ * @param address The address.
+ */
+bool OverlayLatencyTest::isOverlayAddress(const QHostAddress& address) {
+    return (address.protocol() == QAbstractSocket::IPv6Protocol)
+        && address.isInSubnet(QHostAddress("200::"), 7);
+}
+
+/**
+ * @brief Find the TUN interface of Yggdrasil.
+ * @return Name of the interface with a 200::/7 address, or an empty string.
+ */
+QString OverlayLatencyTest::overlayInterface() {
+    for (const QNetworkInterface& iface : QNetworkInterface::allInterfaces()) {
+        if (! (iface.flags() & QNetworkInterface::IsUp)) {
+            continue;
+        }
+        for (const QNetworkAddressEntry& entry : iface.addressEntries()) {
+            if (isOverlayAddress(entry.ip())) {
+                return iface.name();
+            }
+        }
+    }
+    return QString();
+}
+
+/**
+ * @brief Probe a set of targets with the ping command; blocks until done.
+ * @param targets Addresses to probe.
+ * @param echoCount Number of echo requests per target.
+ * @param intervalMs Interval between the requests to one target.
+ * @param results Receives the result of every target, in order.
+ * @return false if the ping command cannot be run.
+ */
+static bool measurePingCommand(const QList<QHostAddress>& targets,
+                               int echoCount,
+                               int intervalMs,
+                               QList<OverlayLatencyTest::TargetResult>&
+                                   results) {
+    static const QRegularExpression countsRx(
+        "(\\d+) packets transmitted, (\\d+) (?:packets )?received");
+    static const QRegularExpression averageRx(
+        "min/avg/max(?:/mdev)? = [\\d.]+/([\\d.]+)/[\\d.]+");
+
+    // Shorter intervals are reserved to the superuser.
+    intervalMs = std::max(intervalMs,
+                          OverlayLatencyTest::MIN_PING_INTERVAL_MS);
+    int deadlineSeconds = (echoCount * intervalMs) / 1000 + 2;
+
+    std::vector<std::unique_ptr<QProcess>> pings;
+    for (const QHostAddress& address : targets) {
+        QStringList args;
+        if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+            args << "-6";
+        }
+        args << "-n"
+             << "-c" << QString::number(echoCount)
+             << "-i" << QString::number(intervalMs / 1000.0, 'f', 3)
+             << "-w" << QString::number(deadlineSeconds)
+             << address.toString();
+        std::unique_ptr<QProcess> process(new QProcess());
+        process->start("ping", args);
+        pings.push_back(std::move(process));
+    }
+
+    for (int i = 0; i < targets.size(); ++i) {
+        QProcess& process = *pings[i];
+        if (! process.waitForStarted()) {
+            qDebug() << "[OverlayLatencyTest::measurePingCommand]"
+                     << "Cannot run ping:" << process.errorString();
+            return false;
+        }
+        if (! process.waitForFinished((deadlineSeconds + 1) * 1000)) {
+            process.kill();
+            process.waitForFinished(100);
+        }
+        QString output
+            = QString::fromLocal8Bit(process.readAllStandardOutput());
+        auto counts = countsRx.match(output);
+        if (! counts.hasMatch()) {
+            // Not allowed to send echo requests either
+            qDebug() << "[OverlayLatencyTest::measurePingCommand]"
+                     << "No ping statistics for" << targets[i].toString()
+                     << "-" << process.readAllStandardError().trimmed();
+            return false;
+        }
+
+        OverlayLatencyTest::TargetResult result;
+        result.address = targets[i].toString();
+        result.sent = counts.captured(1).toInt();
+        result.received = counts.captured(2).toInt();
+        auto average = averageRx.match(output);
+        if ((result.received > 0) && average.hasMatch()) {
+            result.averageRttUs = std::max<qint64>(
+                1, static_cast<qint64>(
+                       average.captured(1).toDouble() * 1000.0 + 0.5));
+        }
+        results << result;
+    }
+    return true;
+}
+
+/**
+ * @brief Probe a set of targets; blocks until done.
+ * @param targets Addresses to probe.
+ * @param echoCount Number of echo requests per target.
+ * @param intervalMs Interval between the requests to one target.
+ * @param results Receives the result of every target, in order.
+ * @return false if neither ICMP datagram sockets nor the ping command
+ * could probe the targets.
+ */
+bool OverlayLatencyTest::measure(const QList<QHostAddress>& targets,
+                                 int echoCount,
+                                 int intervalMs,
+                                 QList<TargetResult>& results) {
+    results.clear();
+    IcmpProber prober(echoCount, intervalMs);
+    QList<int> indices;
+    for (const QHostAddress& address : targets) {
+        int index = prober.addTarget(address, QString());
+        if (index < 0) {
+            qDebug() << "[OverlayLatencyTest::measure]"
+                     << "ICMP sockets unavailable, using ping for"
+                     << address.toString();
+            if (! measurePingCommand(targets, echoCount, intervalMs,
+                                     results)) {
+                results.clear();
+                return false;
+            }
+            return true;
+        }
+        indices << index;
+    }
+
+    while (! prober.isFinished()) {
+        prober.poll(100);
+    }
+
+    for (int i = 0; i < targets.size(); ++i) {
+        IcmpProber::Result probed = prober.result(indices[i]);
+        TargetResult result;
+        result.address = targets[i].toString();
+        result.sent = probed.sent;
+        result.received = probed.received;
+        result.averageRttUs = probed.averageRttUs;
+        results << result;
+    }
+    return true;
+}
+
+/**
+ * @brief Serialize runs.
+ * @param runs The runs.
+ */
+QByteArray OverlayLatencyTest::saveRuns(const QList<Run>& runs) {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    stream << RUNS_FORMAT_VERSION << static_cast<quint32>(runs.size());
+    for (const Run& run : runs) {
+        stream << run.timestampMs << run.peers
+               << static_cast<quint32>(run.results.size());
+        for (const TargetResult& result : run.results) {
+            stream << result.address
+                   << static_cast<qint32>(result.sent)
+                   << static_cast<qint32>(result.received)
+                   << result.averageRttUs;
+        }
+    }
+    return data;
+}
+
+/**
+ * @brief Deserialize runs.
+ * @param data Data written by saveRuns().
+ * @param runs Receives the runs.
+ * @return false if the data is malformed; runs is empty then.
+ */
+bool OverlayLatencyTest::loadRuns(const QByteArray& data, QList<Run>& runs) {
+    runs.clear();
+    if (data.isEmpty()) {
+        return true;
+    }
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> version >> count;
+    if ((stream.status() != QDataStream::Ok)
+        || (version != RUNS_FORMAT_VERSION)) {
+        qDebug() << "[OverlayLatencyTest::loadRuns] Unsupported run data";
+        return false;
+    }
+
+    for (quint32 i = 0; i < count; ++i) {
+        Run run;
+        quint32 resultCount = 0;
+        stream >> run.timestampMs >> run.peers >> resultCount;
+        for (quint32 j = 0;
+             (j < resultCount) && (stream.status() == QDataStream::Ok);
+             ++j) {
+            TargetResult result;
+            qint32 sent;
+            qint32 received;
+            stream >> result.address >> sent >> received
+                   >> result.averageRttUs;
+            result.sent = sent;
+            result.received = received;
+            run.results << result;
+        }
+        if (stream.status() != QDataStream::Ok) {
+            qDebug() << "[OverlayLatencyTest::loadRuns] Truncated run data";
+            runs.clear();
+            return false;
+        }
+        runs << run;
+    }
+    return true;
+}
+
+/**
+ * @brief Describe a run for the user, compared to an earlier one.
+ * @param run The run.
+ * @param previous An earlier run, or nullptr.
+ */
+QString OverlayLatencyTest::describe(const Run& run, const Run* previous) {
+    QStringList lines;
+    for (const TargetResult& result : run.results) {
+        if (result.averageRttUs >= 0) {
+            lines << tr("%1: %2 ms, %3% loss")
+                .arg(result.address)
+                .arg(result.averageRttUs / 1000.0, 0, 'f', 1)
+                .arg(result.lossPercent());
+        } else {
+            lines << tr("%1: no reply").arg(result.address);
+        }
+    }
+
+    qint64 average = run.averageRttUs();
+    if (average >= 0) {
+        lines << QString() << tr("Average: %1 ms with %n peer(s)", "",
+                                 run.peers.size())
+            .arg(average / 1000.0, 0, 'f', 1);
+    }
+
+    if (previous && (previous->averageRttUs() >= 0)) {
+        QString peers = (previous->peers == run.peers)
+            ? tr("same peers") : tr("different peers");
+        lines << tr("Previous run: %1 ms (%2)")
+            .arg(previous->averageRttUs() / 1000.0, 0, 'f', 1)
+            .arg(peers);
+    }
+    return lines.join('\n');
+}
+
+/**
+ * @brief Constructor for OverlayLatencyRunnable
+ * @param run The run to fill in; the timestamp and peers are set.
+ * @param targets Addresses to probe.
+ */
+OverlayLatencyRunnable::OverlayLatencyRunnable(
+    const OverlayLatencyTest::Run& run,
+    const QList<QHostAddress>& targets)
+    : result(run)
+    , targets(targets) {
+    setAutoDelete(true);
+}
+
+/**
+ * @brief Probe the targets and report the run.
+ */
+void OverlayLatencyRunnable::run() {
+    bool success = OverlayLatencyTest::measure(
+        targets,
+        OverlayLatencyTest::ECHO_COUNT,
+        OverlayLatencyTest::ECHO_INTERVAL_MS,
+        result.results);
+    emit measured(result, success);
+}
@@ -0,0 +1,220 @@
+/**
+ * @file OverlayLatencyTest.h
+ * @brief Header file for the OverlayLatencyTest class.
+ *
+ * Measures the latency to Yggdrasil addresses through the overlay network.
+ */
+
+#ifndef OVERLAYLATENCYTEST_H
+#define OVERLAYLATENCYTEST_H
+
+#include <memory>
+#include <QByteArray>
+#include <QHostAddress>
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+#include <QRunnable>
+#include <QSettings>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @class OverlayLatencyTest
+ * @brief End-to-end latency test to Yggdrasil (200::/7) addresses.
+ *
+ * @details The peer tests rank peers by the latency of the underlay, which
+ *          does not tell how well the overlay works once the peers are
+ *          applied.  This test sends ICMPv6 echo requests to a configurable
+ *          list of Yggdrasil addresses, which the 200::/7 route sends
+ *          through the TUN interface, and records the round-trip time and
+ *          loss of every target, together with the peers that were
+ *          connected at the time.  Comparing runs
+ *          with different peer sets shows the real effect of a peer change.
+ *
+ *          The measurement runs on the global thread pool; finished() is
+ *          emitted on the thread the test lives in.  Runs are stored under
+ *          "peer_discovery/overlay_tests", the most recent MAX_RUNS of them.
+ */
+class OverlayLatencyTest : public QObject {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Result of the echo requests sent to one target.
+     */
+    struct TargetResult {
+        QString address;
+        int sent = 0;
+        int received = 0;
+        // Average round-trip time, or -1 without replies
+        qint64 averageRttUs = -1;
+
+        /**
+         * @brief Get the share of lost requests, 0 to 100.
+         */
+        int lossPercent() const {
+            return (sent > 0) ? (sent - received) * 100 / sent : 100;
+        }
+    };
+
+    /**
+     * @brief One run of the test.
+     */
+    struct Run {
+        // Start of the run, in milliseconds since the epoch
+        qint64 timestampMs = 0;
+        // URIs of the peers connected during the run
+        QStringList peers;
+        QList<TargetResult> results;
+
+        /**
+         * @brief Get the average round-trip time over the targets that
+         * replied, or -1 if none did.
+         */
+        qint64 averageRttUs() const;
+    };
+
+    // Number of echo requests per target
+    static constexpr int ECHO_COUNT = 5;
+    // Interval between the requests to one target
+    static constexpr int ECHO_INTERVAL_MS = 200;
+    // Number of runs kept in the settings
+    static constexpr int MAX_RUNS = 50;
+    // Shortest interval the ping command allows without privileges
+    static constexpr int MIN_PING_INTERVAL_MS = 200;
+
+    /**
+     * @brief Constructor for OverlayLatencyTest
+     * @param settings Settings to read the targets from and store runs in.
+     * @param parent Optional QObject parent.
+     */
+    explicit OverlayLatencyTest(std::shared_ptr<QSettings> settings,
+                                QObject *parent = nullptr);
+
+    /**
+     * @brief Get the configured target addresses.
+     */
+    QStringList targets() const;
+
+    /**
+     * @brief Set the target addresses.
+     * @param addresses Yggdrasil addresses; others are dropped.
+     * @return The addresses that were kept.
+     */
+    QStringList setTargets(const QStringList& addresses);
+
+    /**
+     * @brief Start a run in the background.
+     * @param peers URIs of the currently connected peers.
+     * @return false if a run is in progress or no targets are configured.
+     */
+    bool start(const QStringList& peers);
+
+    /**
+     * @brief Check whether a run is in progress.
+     */
+    bool isRunning() const { return running; }
+
+    /**
+     * @brief Get the stored runs, oldest first.
+     */
+    QList<Run> history() const;
+
+    /**
+     * @brief Check whether an address belongs to the Yggdrasil network.
+     * @param address The address.
+     */
+    static bool isOverlayAddress(const QHostAddress& address);
+
+    /**
+     * @brief Find the TUN interface of Yggdrasil.
+     * @return Name of the interface with a 200::/7 address, or an empty
+     * string if there is none.
+     */
+    static QString overlayInterface();
+
+    /**
+     * @brief Probe a set of targets; blocks until done.
+     * @param targets Addresses to probe.
+     * @param echoCount Number of echo requests per target.
+     * @param intervalMs Interval between the requests to one target.
+     * @param results Receives the result of every target, in order.
+     * @return false if neither ICMP datagram sockets nor the ping command
+     * could probe the targets.
+     * @details Falls back to the ping command where the system does not
+     * allow ICMP datagram sockets, like PeerTestRunnable.
+     */
+    static bool measure(const QList<QHostAddress>& targets,
+                        int echoCount,
+                        int intervalMs,
+                        QList<TargetResult>& results);
+
+    /**
+     * @brief Serialize runs.
+     * @param runs The runs.
+     */
+    static QByteArray saveRuns(const QList<Run>& runs);
+
+    /**
+     * @brief Deserialize runs.
+     * @param data Data written by saveRuns().
+     * @param runs Receives the runs.
+     * @return false if the data is malformed; runs is empty then.
+     */
+    static bool loadRuns(const QByteArray& data, QList<Run>& runs);
+
+    /**
+     * @brief Describe a run for the user, compared to an earlier one.
+     * @param run The run.
+     * @param previous An earlier run, or nullptr.
+     */
+    static QString describe(const Run& run, const Run* previous = nullptr);
+
+signals:
+    /**
+     * @brief Emitted when a run is finished and stored.
+     * @param run The run.
+     * @param success false if the targets could not be probed.
+     */
+    void finished(const OverlayLatencyTest::Run& run, bool success);
+
+private slots:
+    void handleMeasured(const OverlayLatencyTest::Run& run, bool success);
+
+private:
+    void record(const Run& run);
+
+    std::shared_ptr<QSettings> settings;
+    bool running;
+};
+
+Q_DECLARE_METATYPE(OverlayLatencyTest::Run)
+
+/**
+ * @class OverlayLatencyRunnable
+ * @brief Runs OverlayLatencyTest::measure() on a thread pool.
+ */
+class OverlayLatencyRunnable : public QObject, public QRunnable {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for OverlayLatencyRunnable
+     * @param run The run to fill in; the timestamp and peers are set.
+     * @param targets Addresses to probe.
+     */
+    OverlayLatencyRunnable(const OverlayLatencyTest::Run& run,
+                           const QList<QHostAddress>& targets);
+
+    void run() override;
+
+signals:
+    void measured(const OverlayLatencyTest::Run& run, bool success);
+
+private:
+    OverlayLatencyTest::Run result;
+    QList<QHostAddress> targets;
+};
+
+#endif // OVERLAYLATENCYTEST_H
@@ -0,0 +1,226 @@
+/**
+ * @file PeerData.h
+ * @brief Implicitly shared description of a single Yggdrasil peer.
+ */
+
+#ifndef PEERDATA_H
+#define PEERDATA_H
+
+#include <QHash>
+#include <QList>
+#include <QMetaType>
+#include <QSharedData>
+#include <QSharedDataPointer>
+#include <QString>
+#include <QStringList>
+
+/**
+ * @class PeerDataPrivate
+ * @brief Shared payload of PeerData.
+ */
+class PeerDataPrivate : public QSharedData {
+public:
+    QString host;
+    int latency = -1;      // in milliseconds
+    bool isValid = false;
+    bool isPrivate = false;
+    int latencyIPv4 = -1;
+    int latencyIPv6 = -1;
+    QString preferredAddress;
+    QHash<QString, int> uplinkLatencies;
+    qint64 latencyUs = -1;
+    int latencySource = 0;
+    quint32 asn = 0;
+    qint64 transportLatencyUs = -1;
+    QStringList probeAddresses;
+};
+
+/**
+ * @class PeerData
+ * @brief Holds information about a yggdrasil peer
+ *
+ * @details PeerData is implicitly shared: copies (into test runnables,
+ *          queued signals and peer lists) only bump a reference count, and
+ *          the payload is detached on the first write through a setter.
+ *          Being a single pointer in size and declared movable, it is also
+ *          stored inline by QList, so copying or filtering a peer list does
+ *          not allocate a node per peer.
+ */
+class PeerData {
+public:
+    /**
+     * @brief How the latency of a peer was measured.
+     */
+    enum LatencySource {
+        NotMeasured,             ///< Not tested yet, or unreachable
+        PingCommand,             ///< Parsed from the output of ping
+        ConnectTime,             ///< TCP connection time through a proxy
+        UserTimestamps,          ///< Echo requests timed in user space
+        KernelReceiveTimestamps, ///< Replies timestamped by the kernel
+        KernelTimestamps         ///< Requests and replies timestamped by
+                                 ///< the kernel
+    };
+
+    /**
+     * @brief Constructs an untested public peer with an empty host.
+     * @details All default-constructed peers share one payload.
+     */
+    PeerData() : d(sharedNull()) {}
+
+    /**
+     * @brief Constructs an untested peer.
+     * @param host The peer URI.
+     * @param isPrivate Whether the peer was added by the user.
+     */
+    explicit PeerData(const QString& host, bool isPrivate = false)
+        : d(new PeerDataPrivate) {
+        d->host = host;
+        d->isPrivate = isPrivate;
+    }
+
+    PeerData(const PeerData& other) = default;
+    PeerData(PeerData&& other) noexcept = default;
+    PeerData& operator=(const PeerData& other) = default;
+    PeerData& operator=(PeerData&& other) noexcept = default;
+
+    void swap(PeerData& other) noexcept { d.swap(other.d); }
+
+    /**
+     * @brief The peer URI.
+     */
+    QString host() const { return d->host; }
+    void setHost(const QString& host) { d->host = host; }
+
+    /**
+     * @brief Latency in milliseconds, or -1 if not tested or unreachable.
+     */
+    int latency() const { return d->latency; }
+    void setLatency(int latency) { d->latency = latency; }
+
+    /**
+     * @brief Whether the peer passed the latency test.
+     */
+    bool isValid() const { return d->isValid; }
+    void setValid(bool isValid) { d->isValid = isValid; }
+
+    /**
+     * @brief Whether the peer is private (that is, added by the user) or not.
+     */
+    bool isPrivate() const { return d->isPrivate; }
+    void setPrivate(bool isPrivate) { d->isPrivate = isPrivate; }
+
+    /**
+     * @brief Latency over IPv4 in milliseconds, or -1 if not measured or
+     * unreachable.
+     */
+    int latencyIPv4() const { return d->latencyIPv4; }
+    void setLatencyIPv4(int latency) { d->latencyIPv4 = latency; }
+
+    /**
+     * @brief Latency over IPv6 in milliseconds, or -1 if not measured or
+     * unreachable.
+     */
+    int latencyIPv6() const { return d->latencyIPv6; }
+    void setLatencyIPv6(int latency) { d->latencyIPv6 = latency; }
+
+    /**
+     * @brief IP address of the faster address family of a dual-stack
+     * hostname peer, or an empty string if the resolver may choose.
+     */
+    QString preferredAddress() const { return d->preferredAddress; }
+    void setPreferredAddress(const QString& address) {
+        d->preferredAddress = address;
+    }
+
+    /**
+     * @brief Latency through an uplink in milliseconds, or -1 if the uplink
+     * was not probed or the peer is unreachable through it.
+     * @param uplink Interface name or source address.
+     */
+    int uplinkLatency(const QString& uplink) const {
+        return d->uplinkLatencies.value(uplink, -1);
+    }
+    void setUplinkLatency(const QString& uplink, int latency) {
+        d->uplinkLatencies.insert(uplink, latency);
+    }
+    void clearUplinkLatencies() {
+        if (! d->uplinkLatencies.isEmpty()) {
+            d->uplinkLatencies.clear();
+        }
+    }
+
+    /**
+     * @brief Latency in microseconds; whole milliseconds times 1000 when the
+     * measurement was not more precise, or -1 if not tested or unreachable.
+     */
+    qint64 preciseLatencyUs() const {
+        if (d->latencyUs > 0) {
+            return d->latencyUs;
+        }
+        return (d->latency > 0) ? d->latency * 1000LL : -1;
+    }
+    void setPreciseLatencyUs(qint64 latencyUs) { d->latencyUs = latencyUs; }
+
+    /**
+     * @brief How the latency was measured.
+     */
+    LatencySource latencySource() const {
+        return static_cast<LatencySource>(d->latencySource);
+    }
+    void setLatencySource(LatencySource source) { d->latencySource = source; }
+
+    /**
+     * @brief Origin AS of the peer address, or 0 if unknown.
+     */
+    quint32 asn() const { return d->asn; }
+    void setAsn(quint32 asn) { d->asn = asn; }
+
+    /**
+     * @brief Handshake time of the peer endpoint in microseconds: the TCP
+     * handshake for tcp://, TCP and TLS for tls://, and a version
+     * negotiation round trip for quic://.  -1 if not measured or the
+     * endpoint did not answer.
+     */
+    qint64 transportLatencyUs() const { return d->transportLatencyUs; }
+    void setTransportLatencyUs(qint64 latencyUs) {
+        d->transportLatencyUs = latencyUs;
+    }
+
+    /**
+     * @brief Addresses the host resolved to ahead of its test, or an empty
+     * list if the test resolves the host itself.
+     */
+    QStringList probeAddresses() const { return d->probeAddresses; }
+    void setProbeAddresses(const QStringList& addresses) {
+        d->probeAddresses = addresses;
+    }
+
+    /**
+     * @brief Checks whether two objects share the same payload.
+     */
+    bool isSharedWith(const PeerData& other) const {
+        return d.constData() == other.d.constData();
+    }
+
+    // Define equality operator based on host
+    bool operator==(const PeerData& other) const {
+        return d->host == other.d->host;
+    }
+
+private:
+    static const QSharedDataPointer<PeerDataPrivate>& sharedNull() {
+        static const QSharedDataPointer<PeerDataPrivate> null(
+            new PeerDataPrivate);
+        return null;
+    }
+
+    QSharedDataPointer<PeerDataPrivate> d;
+};
+
+Q_DECLARE_SHARED(PeerData)
+
+// Register PeerData for use with queued connections
+Q_DECLARE_METATYPE(PeerData)
+Q_DECLARE_METATYPE(QList<PeerData>)
+
+#endif // PEERDATA_H
@@ -5,17 +5,24 @@
  * Contains implementation of dialog for discovering and managing Yggdrasil peers.
  */
 
+#include <algorithm>
 #include <memory>
+#include <numeric>
 #include <QBrush>
+#include <QCheckBox>
 #include <QClipboard>
 #include <QComboBox>
+#include <QDateTime>
 #include <QDebug>
 #include <QDialogButtonBox>
 #include <QFileDialog>
 #include <QGuiApplication>
 #include <QHBoxLayout>
 #include <QHeaderView>
+#include <QInputDialog>
 #include <QLineEdit>
+#include <QListWidget>
+#include <QLocale>
 #include <QMessageBox>
 #include <QNetworkProxy>
 #include <QPlainTextEdit>
@@ -25,11 +32,64 @@
 #include <QTimer>
 #include <QVBoxLayout>
 
+
+#include "Executor.h"
+#include "LanDiscovery.h"
+#include "OverlayLatencyTest.h"
 #include "PeerDiscoveryDialog.h"
+#include "PeerProfiles.h"
+#include "SparklineDelegate.h"
 
 // Default PeerDiscoveryDialog size.
 static const int DEFAULT_DIALOG_WIDTH  = 600;
 static const int DEFAULT_DIALOG_HEIGHT = 400;
+// Interfaces shown without scrolling in the LAN peers dialog.
+static const int LAN_INTERFACE_ROWS = 4;
+
+// SOCKS5 proxy password.  Kept for the session, across dialogs, and never
+// written to the settings file, which is plain text.
+static QString sessionProxyPassword;
+
+/**
+ * @brief Describe the per-family latencies of a tested peer.
+ * @details Families that were not reachable are left out.
+ * @param peer The tested peer.
+ * @return Tool tip text for the latency cell.
+ */
+static QString familyLatencyToolTip(const PeerData& peer) {
+    QStringList lines;
+    if (peer.latencyIPv4() > 0) {
+        lines << PeerDiscoveryDialog::tr("IPv4: %1 ms")
+                 .arg(peer.latencyIPv4());
+    }
+    if (peer.latencyIPv6() > 0) {
+        lines << PeerDiscoveryDialog::tr("IPv6: %1 ms")
+                 .arg(peer.latencyIPv6());
+    }
+    if (! peer.preferredAddress().isEmpty()) {
+        lines << PeerDiscoveryDialog::tr("Preferred address: %1")
+                 .arg(peer.preferredAddress());
+    }
+    switch (peer.latencySource()) {
+    case PeerData::KernelTimestamps:
+        lines << PeerDiscoveryDialog::tr("Measured: %1 ms (kernel timestamps)")
+                 .arg(peer.preciseLatencyUs() / 1000.0, 0, 'f', 3);
+        break;
+    case PeerData::KernelReceiveTimestamps:
+        lines << PeerDiscoveryDialog::tr(
+                     "Measured: %1 ms (kernel receive timestamps)")
+                 .arg(peer.preciseLatencyUs() / 1000.0, 0, 'f', 3);
+        break;
+    case PeerData::UserTimestamps:
+        lines << PeerDiscoveryDialog::tr(
+                     "Measured: %1 ms (user-space timestamps)")
+                 .arg(peer.preciseLatencyUs() / 1000.0, 0, 'f', 3);
+        break;
+    default:
+        break;
+    }
+    return lines.join("\n");
+}
 
 /**
  * @brief Constructor for PeerDiscoveryDialog
@@ -42,13 +102,23 @@ PeerDiscoveryDialog::PeerDiscoveryDialog(std::shared_ptr<QSettings> settings,
                                          QWidget *parent)
     : QDialog(parent)
     , peerManager(new PeerManager(settings, debugMode, this))
-    , testedPeers(0)
-    , totalPeers(0)
-    , isTesting(false)
+    , applyJob(nullptr)
+    , isExperimenting(false)
+    , uiCoalescer(new UiUpdateCoalescer(UiUpdateCoalescer::screenFlushRate(),
+                                        this))
+    , testGraph(nullptr)
+    , resolveNode(-1)
+    , probeNode(-1)
+    , resultNode(-1)
+    , selectNode(-1)
+    , sweepSize(0)
+    , debugMode(debugMode)
     , settings(settings) {
     setWindowTitle(tr("Peer Discovery"));
     setupUi();
     setupConnections();
+    applyProxySettings();
+    applyProbeSettings();
 }
 
 /**
@@ -66,22 +136,54 @@ void PeerDiscoveryDialog::setPeerFetchProxy(const QNetworkProxy& proxy) {
  * @param event Close event
  */
 void PeerDiscoveryDialog::closeEvent(QCloseEvent *event) {
-    if (isTesting) {
+    event->setAccepted(prepareClose());
+}
+
+/**
+ * @brief Close the dialog on Escape, unless that would block on or lose
+ * a running apply or experiment.
+ */
+void PeerDiscoveryDialog::reject() {
+    if (prepareClose()) {
+        QDialog::reject();
+    }
+}
+
+/**
+ * @brief Cancel what can be canceled before the dialog closes.
+ * @return false if the dialog has to stay open: the dialog owns the apply
+ * job, whose destructor waits for a privileged command (and its password
+ * prompt), and the experiment decides about the peers being tried.
+ */
+bool PeerDiscoveryDialog::prepareClose() {
+    if (applyJob) {
+        if (applyJob->isCancellable()) {
+            applyJob->cancel();
+            return true;
+        }
+        statusLabel->setText(tr("Please wait until the configuration"
+                                " is updated"));
+        return false;
+    }
+
+    if (isExperimenting) {
+        statusLabel->setText(tr("Please wait until the experiment is"
+                                " finished"));
+        return false;
+    }
+
+    if (isTesting()) {
         QMessageBox::StandardButton reply = QMessageBox::question(
             this, tr("Cancel Testing"),
             tr("Testing is in progress. Cancel and close the dialog?"),
             QMessageBox::Yes | QMessageBox::No
         );
-
-        if (reply == QMessageBox::Yes) {
-            stopTesting();
-            event->accept();
-        } else {
-            event->ignore();
+        if (reply != QMessageBox::Yes) {
+            return false;
         }
-    } else {
-        event->accept();
+        stopTesting();
     }
+    return true;
 }
 
 /**
@@ -94,29 +196,49 @@ void PeerDiscoveryDialog::setupUi() {
     refreshButton = new QPushButton(tr("Refresh"), this);
     testButton = new QPushButton(tr("Test"), this);
     applyButton = new QPushButton(tr("Apply"), this);
+    tryButton = new QPushButton(tr("Try Live"), this);
+    tryButton->setToolTip(tr("Switch to the selected peers without changing"
+                             " the configuration, and keep them only if the"
+                             " overlay gets faster"));
     exportButton = new QPushButton(tr("Export CSV"), this);
     proxyButton = new QPushButton(tr("Proxy..."), this);
     privatePeersButton = new QPushButton(tr("Private peers..."), this);
+    probeSettingsButton = new QPushButton(tr("Probing..."), this);
+    lanPeersButton = new QPushButton(tr("LAN peers..."), this);
+    lanPeersButton->setToolTip(tr("Find Yggdrasil nodes on the local network"
+                                  " and add them as private peers"));
+    profilesButton = new QPushButton(tr("Profiles..."), this);
+    profilesButton->setToolTip(tr("Save the selected peers as a profile to"
+                                  " switch to from the tray menu"));
     testButton->setEnabled(false);
     applyButton->setEnabled(false);
+    tryButton->setEnabled(false);
     exportButton->setEnabled(false);
 
     buttonLayout->addWidget(refreshButton);
     buttonLayout->addWidget(testButton);
     buttonLayout->addWidget(applyButton);
+    buttonLayout->addWidget(tryButton);
     buttonLayout->addWidget(exportButton);
     buttonLayout->addWidget(proxyButton);
     buttonLayout->addWidget(privatePeersButton);
+    buttonLayout->addWidget(lanPeersButton);
+    buttonLayout->addWidget(profilesButton);
+    buttonLayout->addWidget(probeSettingsButton);
     buttonLayout->addStretch();
 
     peerTable = new PeerDiscoveryTableWidget(this);
-    peerTable->setColumnCount(4);
+    peerTable->setColumnCount(PeerTableColumnCount);
     peerTable->setHorizontalHeaderLabels({
         tr("Host"),
         tr("Latency"),
         tr("Status"),
-        tr("Valid?")
+        tr("Valid?"),
+        tr("History"),
+        tr("Network")
     });
+    peerTable->setItemDelegateForColumn(HistoryColumn,
+                                        new SparklineDelegate(peerTable));
     peerTable->horizontalHeader()->setSectionResizeMode(
         QHeaderView::ResizeToContents);
     peerTable->horizontalHeader()->setSectionResizeMode(
@@ -150,13 +272,23 @@ void PeerDiscoveryDialog::setupConnections() {
             this, &PeerDiscoveryDialog::onTestClicked);
     connect(applyButton, &QPushButton::clicked,
             this, &PeerDiscoveryDialog::onApplyClicked);
+    connect(tryButton, &QPushButton::clicked,
+            this, &PeerDiscoveryDialog::onTryClicked);
 
     connect(peerManager, &PeerManager::peersDiscovered,
             this, &PeerDiscoveryDialog::onPeersDiscovered);
     connect(peerManager, &PeerManager::peerTested,
             this, &PeerDiscoveryDialog::onPeerTested);
+    connect(peerManager, &PeerManager::peerResolved,
+            this, &PeerDiscoveryDialog::onPeerResolved);
+    connect(uiCoalescer, &UiUpdateCoalescer::flushRequested,
+            this, &PeerDiscoveryDialog::onUiFlush);
     connect(peerManager, &PeerManager::error,
             this, &PeerDiscoveryDialog::onError);
+    connect(peerManager, &PeerManager::networkChanged,
+            this, &PeerDiscoveryDialog::onNetworkChanged);
+    connect(peerManager, &PeerManager::asnDatabaseChanged,
+            this, &PeerDiscoveryDialog::onAsnDatabaseChanged);
 
     connect(exportButton, &QPushButton::clicked,
             this, &PeerDiscoveryDialog::onExportClicked);
@@ -165,27 +297,37 @@ void PeerDiscoveryDialog::setupConnections() {
             this, &PeerDiscoveryDialog::onProxyConfigClicked);
     connect(privatePeersButton, &QPushButton::clicked,
             this, &PeerDiscoveryDialog::onPrivatePeersClicked);
+    connect(probeSettingsButton, &QPushButton::clicked,
+            this, &PeerDiscoveryDialog::onProbeSettingsClicked);
+    connect(lanPeersButton, &QPushButton::clicked,
+            this, &PeerDiscoveryDialog::onLanPeersClicked);
+    connect(profilesButton, &QPushButton::clicked,
+            this, &PeerDiscoveryDialog::onProfilesClicked);
+    connect(peerTable->selectionModel(), &QItemSelectionModel::selectionChanged,
+            this, &PeerDiscoveryDialog::onSelectionChanged);
 }
 
 /**
  * @brief Resets the table UI to its initial state before testing.
  */
 void PeerDiscoveryDialog::resetTableUI() {
+    uiCoalescer->reset();
+    measuredPeers.fill(false);
     for (int i = 0; i < peerTable->rowCount(); ++i) {
-        peerTable->setItem(i, 1, new LatencyItem());
+        peerTable->setItem(i, LatencyColumn, new LatencyItem());
 
-        QTableWidgetItem* statusItem = peerTable->item(i, 2);
+        QTableWidgetItem* statusItem = peerTable->item(i, StatusColumn);
          if (!statusItem) {
             statusItem = new QTableWidgetItem("-");
-            peerTable->setItem(i, 2, statusItem);
+            peerTable->setItem(i, StatusColumn, statusItem);
         } else {
             statusItem->setText("-");
         }
 
-        QTableWidgetItem* validityItem = peerTable->item(i, 3);
+        QTableWidgetItem* validityItem = peerTable->item(i, ValidityColumn);
         if (!validityItem) {
             validityItem = new QTableWidgetItem(tr("Not Tested"));
-            peerTable->setItem(i, 3, validityItem);
+            peerTable->setItem(i, ValidityColumn, validityItem);
         } else {
             validityItem->setText(tr("Not Tested"));
         }
@@ -198,6 +340,11 @@ void PeerDiscoveryDialog::resetTableUI() {
             }
         }
     }
+
+    // Estimates from the previous sweep until the peers are measured again
+    QVector<int> allPeers(peerList.size());
+    std::iota(allPeers.begin(), allPeers.end(), 0);
+    showPredictions(allPeers);
 }
 
 
@@ -205,19 +352,23 @@ void PeerDiscoveryDialog::resetTableUI() {
  * @brief Stop ongoing peer latency testing.
  */
 void PeerDiscoveryDialog::stopTesting() {
-    if (! isTesting) {
+    if (! isTesting()) {
         return;
     }
 
-    peerManager->cancelTests();
+    // Cancelling the graph cancels the host lookups of the resolve stage
+    // and the peer tests of the probe stage.
+    testGraph->cancel();
+    uiCoalescer->flushNow();
 
     testButton->setText(tr("Test"));
-    isTesting = false;
 
     refreshButton->setEnabled(true);
+    probeSettingsButton->setEnabled(true);
 
-    if (testedPeers > 0) {
+    if (testedPeers() > 0) {
         applyButton->setEnabled(true);
+        tryButton->setEnabled(true);
     }
 
     statusLabel->setText(tr("Testing canceled"));
@@ -230,20 +381,65 @@ void PeerDiscoveryDialog::stopTesting() {
  * @param peers List of discovered peers.
  */
 void PeerDiscoveryDialog::onPeersDiscovered(const QList<PeerData>& peers) {
+    // The last sweep tested the previous peer list; its results must not
+    // count for the new one.
+    stopTesting();
+    if (testGraph) {
+        testGraph->deleteLater();
+        testGraph = nullptr;
+    }
+    sweepSize = 0;
+    sweepPending.clear();
+    sweepUnresolved.clear();
+    sweepSelection.clear();
+
+    uiCoalescer->reset();
+    bool wasSortingEnabled = peerTable->isSortingEnabled();
+    peerTable->setSortingEnabled(false);
     peerTable->clearContents();
     peerTable->setRowCount(peers.count());
     peerList = peers;
-    testedPeers = 0;
-    totalPeers = peers.count();
+    peerIndex.clear();
+    peerIndex.reserve(peers.count());
+    hostItems.clear();
+    hostItems.reserve(peers.count());
+    measuredPeers.fill(false, peers.count());
+    neighbourIndex.clear();
+    QVector<int> allPeers;
+    allPeers.reserve(peers.count());
 
     for (int i = 0; i < peers.count(); ++i) {
         const auto& peer = peers[i];
-        peerTable->setItem(i, 0, new QTableWidgetItem(peer.host));
+        QTableWidgetItem* hostItem = new QTableWidgetItem(peer.host());
+        peerIndex.insert(peer.host(), i);
+        for (const QString& key
+                 : LatencyPredictor::neighbourhoods(peer)) {
+            neighbourIndex[key].append(i);
+        }
+        allPeers.append(i);
+        hostItems.append(hostItem);
+        peerTable->setItem(i, HostColumn, hostItem);
         // Initial latency as untested
-        peerTable->setItem(i, 1, new LatencyItem());
-        peerTable->setItem(i, 2, new QTableWidgetItem("-"));
-        peerTable->setItem(i, 3, new QTableWidgetItem(tr("Not Tested")));
+        peerTable->setItem(i, LatencyColumn, new LatencyItem());
+        peerTable->setItem(i, StatusColumn, new QTableWidgetItem("-"));
+        peerTable->setItem(i,
+                           ValidityColumn,
+                           new QTableWidgetItem(tr("Not Tested")));
+        // Keep the history of peers that were tested before the refresh.
+        QTableWidgetItem* historyItem = new QTableWidgetItem();
+        historyItem->setData(
+            SparklineDelegate::LatencyHistoryRole,
+            QVariant::fromValue(latencyHistory.value(peer.host())));
+        peerTable->setItem(i, HistoryColumn, historyItem);
+        peerTable->setItem(i, AsnColumn, new QTableWidgetItem(
+            peerManager->describeAsn(peer.asn())));
+        for (int j = 0; j < uplinkColumns.size(); ++j) {
+            peerTable->setItem(i, PeerTableColumnCount + j, new LatencyItem());
+        }
     }
+    // Neighbours of peers tested before the refresh
+    showPredictions(allPeers);
+    peerTable->setSortingEnabled(wasSortingEnabled);
 
     statusLabel->setText(tr("Found %1 peers").arg(peers.count()));
     testButton->setEnabled(true);
@@ -275,65 +471,362 @@ void PeerDiscoveryDialog::setRowColor(int row, bool isValid, bool isTested) {
 /**
  * @brief Handle peer test results
  * @param peer The tested peer with updated information
+ *
+ * Passes the result from the probe stage to the results stage of the test
+ * sweep.  Results that arrive outside of a sweep are taken over directly;
+ * results that do not belong to the running sweep are dropped.
  */
 void PeerDiscoveryDialog::onPeerTested(const PeerData& peer) {
-    testedPeers++;
-    progressBar->setValue((testedPeers * 100) / totalPeers);
-
-    for (int i = 0; i < peerList.size(); ++i) {
-        if (peerList[i].host == peer.host) {
-            peerList[i].latency = peer.latency;
-            peerList[i].isValid = peer.isValid;
-            qDebug() << "Updated peer in peerList:" << peer.host
-                     << "isValid:" << peer.isValid
-                     << "latency:" << peer.latency;
-
-            if (i < peerTable->rowCount()) {
-                // Temporarily disable sorting to prevent partial updates
-                bool wasSortingEnabled = peerTable->isSortingEnabled();
-                peerTable->setSortingEnabled(false);
-
-                // Update all cells in the row
-                peerTable->setItem(i, 0, new QTableWidgetItem(peer.host));
-                peerTable->setItem(
-                    i,
-                    1,
-                    new LatencyItem(peer.latency, peer.isValid, true));
-                peerTable->setItem(i, 2, new QTableWidgetItem("-"));
-                peerTable->setItem(i, 3, new ValidityItem(peer.isValid));
-
-                // Apply coloring to all cells
-                setRowColor(i, peer.isValid, true);
-
-                // Re-enable sorting if it was enabled
-                peerTable->setSortingEnabled(wasSortingEnabled);
-            }
-            break;
+    if (! isTesting()) {
+        showTestResult(peer);
+        return;
+    }
+    // A test of a sweep that was started over, e.g. by a network change,
+    // measured the old network.
+    if (! sweepPending.remove(peer.host())) {
+        qDebug() << "[PeerDiscoveryDialog::onPeerTested]"
+                 << "Dropping a stale result for:" << peer.host();
+        return;
+    }
+
+    passTestResult(peer);
+}
+
+/**
+ * @brief Emit a result of the probe stage.
+ * @param peer The tested peer.
+ * @details The probe stage is finished with the last result, once the
+ * resolve stage is done as well.
+ */
+void PeerDiscoveryDialog::passTestResult(const PeerData& peer) {
+    testGraph->emitItem(probeNode, QVariant::fromValue(peer));
+    if ((testGraph->stats(probeNode).itemsOut >= sweepSize)
+        && (testGraph->stats(resolveNode).state == TaskGraph::Finished)) {
+        testGraph->finishNode(probeNode);
+    }
+}
+
+/**
+ * @brief Pass a resolved peer from the resolve stage to the probe stage.
+ * @param peer The peer with the addresses to probe.
+ * @param resolved Whether its host has an address.
+ */
+void PeerDiscoveryDialog::onPeerResolved(const PeerData& peer,
+                                         bool resolved) {
+    if ((! isTesting()) || (! sweepPending.contains(peer.host()))) {
+        return;
+    }
+    if (! resolved) {
+        sweepUnresolved.insert(peer.host());
+    }
+    testGraph->emitItem(resolveNode, QVariant::fromValue(peer));
+    if (testGraph->stats(resolveNode).itemsOut >= sweepSize) {
+        testGraph->finishNode(resolveNode);
+    }
+}
+
+/**
+ * @brief Take over a peer test result.
+ * @param peer The tested peer with updated information
+ *
+ * Only the model is updated here; the table, the progress bar and the status
+ * label are refreshed in batches by onUiFlush().
+ */
+void PeerDiscoveryDialog::showTestResult(const PeerData& peer) {
+    auto it = peerIndex.constFind(peer.host());
+    if (it != peerIndex.constEnd()) {
+        int i = it.value();
+        // The result is a copy of the tested entry, so take it over as is.
+        peerList[i] = peer;
+        measuredPeers[i] = true;
+        latencyHistory[peer.host()].add(peer.isValid() ? peer.latency() : -1);
+        uiCoalescer->markDirty(i);
+    } else {
+        qDebug() << "[PeerDiscoveryDialog::showTestResult]"
+                 << "Result for unknown peer:" << peer.host();
+    }
+}
+
+/**
+ * @brief Apply the accumulated peer test results to the UI.
+ * @param dirtyPeers Indices in peerList of the peers that changed.
+ * @param resultCount Number of results received since the last flush.
+ */
+void PeerDiscoveryDialog::onUiFlush(const QList<int>& dirtyPeers,
+                                    int resultCount) {
+    // Disable sorting once for the whole batch to prevent partial updates
+    // and a re-sort per changed row.
+    bool wasSortingEnabled = peerTable->isSortingEnabled();
+    peerTable->setSortingEnabled(false);
+    peerTable->setUpdatesEnabled(false);
+
+    for (int i : dirtyPeers) {
+        if ((i < 0) || (i >= hostItems.size())) {
+            continue;
+        }
+        const PeerData& peer = peerList[i];
+        int row = hostItems[i]->row();
+        if (row < 0) {
+            continue;
+        }
+        LatencyItem* latencyItem =
+            new LatencyItem(peer.latency(), peer.isValid(), true);
+        latencyItem->setToolTip(familyLatencyToolTip(peer));
+        peerTable->setItem(row, LatencyColumn, latencyItem);
+        QTableWidgetItem* historyItem = new QTableWidgetItem();
+        historyItem->setData(SparklineDelegate::LatencyHistoryRole,
+                             QVariant::fromValue(latencyHistory[peer.host()]));
+        peerTable->setItem(row, HistoryColumn, historyItem);
+        peerTable->setItem(row, AsnColumn, new QTableWidgetItem(
+            peerManager->describeAsn(peer.asn())));
+        peerTable->setItem(row, StatusColumn, new QTableWidgetItem("-"));
+        peerTable->setItem(row, ValidityColumn,
+                           new ValidityItem(peer.isValid()));
+
+        for (int j = 0; j < uplinkColumns.size(); ++j) {
+            int latency = peer.uplinkLatency(uplinkColumns[j]);
+            peerTable->setItem(row,
+                               PeerTableColumnCount + j,
+                               new LatencyItem(latency, latency > 0, true));
+        }
+
+        // Apply coloring to all cells
+        setRowColor(row, peer.isValid(), true);
+    }
+
+    // The new results refine the estimates of their untested neighbours.
+    QVector<int> neighbours;
+    for (int i : dirtyPeers) {
+        if ((i < 0) || (i >= peerList.size())) {
+            continue;
+        }
+        for (const QString& key
+                 : LatencyPredictor::neighbourhoods(peerList[i])) {
+            neighbours += neighbourIndex.value(key);
         }
     }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()),
+                     neighbours.end());
+    showPredictions(neighbours);
 
-    statusLabel->setText(tr("Testing peers: %1/%2")
-                         .arg(testedPeers)
-                         .arg(totalPeers));
+    peerTable->setUpdatesEnabled(true);
+    peerTable->setSortingEnabled(wasSortingEnabled);
 
-    if (testedPeers == totalPeers) {
-        // Debug: Print the state of the peerList after all tests completed
-        qDebug() << "\nCurrent peerList state:";
-        // Limit to 50 to avoid flooding log
-        for (int i = 0; i < peerList.size() && i < 50; ++i) {
-            qDebug() << "Peer in list:" << peerList[i].host
-                     << "isValid:" << peerList[i].isValid
-                     << "latency:" << peerList[i].latency;
+    if (sweepSize > 0) {
+        progressBar->setValue((testedPeers() * 100) / sweepSize);
+    }
+    if (isTesting()) {
+        statusLabel->setText(tr("Testing peers: %1/%2")
+                             .arg(testedPeers())
+                             .arg(sweepSize));
+    }
+
+    qDebug() << "[PeerDiscoveryDialog::onUiFlush] Applied"
+             << resultCount << "results to"
+             << dirtyPeers.size() << "rows";
+}
+
+/**
+ * @brief Show the estimated latency of untested peers.
+ * @param peers Indices in peerList of the peers; measured peers and peers
+ * without a reachable estimate are skipped.
+ */
+void PeerDiscoveryDialog::showPredictions(const QVector<int>& peers) {
+    for (int i : peers) {
+        if ((i < 0) || (i >= hostItems.size()) || measuredPeers[i]) {
+            continue;
+        }
+        LatencyPredictor::Prediction prediction
+            = peerManager->predictLatency(peerList[i]);
+        if ((! prediction.isValid()) || (prediction.latency < 0)) {
+            continue;
         }
+        int row = hostItems[i]->row();
+        if (row < 0) {
+            continue;
+        }
+        LatencyItem* latencyItem
+            = new LatencyItem(prediction.latency, false, false, true);
+        latencyItem->setToolTip(
+            ((prediction.level == LatencyPredictor::Prefix)
+                 ? tr("Estimated from %n measured peer(s) in the same"
+                      " network", "", prediction.samples)
+                 : tr("Estimated from %n measured peer(s) in the same"
+                      " domain", "", prediction.samples))
+            + "\n" + tr("Not tested yet"));
+        peerTable->setItem(row, LatencyColumn, latencyItem);
+    }
+}
 
-        statusLabel->setText(tr("Testing complete"));
-        applyButton->setEnabled(true);
-        testButton->setText(tr("Test"));
-        testButton->setEnabled(true);
-        refreshButton->setEnabled(true);
-        exportButton->setEnabled(!peerList.isEmpty());
-        isTesting = false;
+/**
+ * @brief Update the UI after all peers have been tested.
+ */
+void PeerDiscoveryDialog::finishTesting() {
+    // Debug: Print the state of the peerList after all tests completed
+    qDebug() << "\nCurrent peerList state:";
+    // Limit to 50 to avoid flooding log
+    for (int i = 0; i < peerList.size() && i < 50; ++i) {
+        qDebug() << "Peer in list:" << peerList[i].host()
+                 << "isValid:" << peerList[i].isValid()
+                 << "latency:" << peerList[i].latency();
     }
+
+    // From the first lookup to the last result
+    TaskGraph::NodeStats probe = testGraph->stats(probeNode);
+    qint64 sweepMs = probe.startedMs + probe.elapsedMs;
+    statusLabel->setText(tr("Testing complete in %1 s, %n peer(s) to apply",
+                            "", sweepSelection.size())
+                         .arg(sweepMs / 1000.0, 0, 'f', 1));
+    applyButton->setEnabled(! sweepSelection.isEmpty());
+    tryButton->setEnabled(! sweepSelection.isEmpty());
+    testButton->setText(tr("Test"));
+    testButton->setEnabled(true);
+    refreshButton->setEnabled(true);
+    probeSettingsButton->setEnabled(true);
+    exportButton->setEnabled(!peerList.isEmpty());
+}
+
+/**
+ * @brief Check whether a peer test sweep is running.
+ */
+bool PeerDiscoveryDialog::isTesting() const {
+    return testGraph && testGraph->isRunning();
+}
+
+/**
+ * @brief Get the number of results of the last test sweep of the current
+ * peer list.
+ */
+int PeerDiscoveryDialog::testedPeers() const {
+    return testGraph ? testGraph->stats(resultNode).itemsIn : 0;
+}
+
+/**
+ * @brief Disable the controls and start a test sweep.
+ * @param peers The peers to test.
+ */
+void PeerDiscoveryDialog::startSweep(const QList<PeerData>& peers) {
+    applyProbeSettings();
+    progressBar->setValue(0);
+    statusLabel->setText(tr("Testing peers: 0/%1").arg(peers.count()));
+
+    applyButton->setEnabled(false);
+    tryButton->setEnabled(false);
+    exportButton->setEnabled(false);
+    refreshButton->setEnabled(false);
+    probeSettingsButton->setEnabled(false);
+    testButton->setText(tr("Stop"));
+
+    qDebug() << "[PeerDiscoveryDialog::startSweep]"
+             << "Starting parallel test for"
+             << peers.count() << "peers.";
+    startTestGraph(peers);
+}
+
+/**
+ * @brief Build and start the test sweep.
+ * @param peers The peers to test.
+ * @details The resolve stage looks up the hosts of the peers, and the probe
+ * stage queues the test of each peer as soon as its host is resolved, so
+ * that the lookups run ahead of the probes.  The probe stage emits the
+ * results as they arrive, and the results stage takes them over.  Once all
+ * results are in, the select stage picks the peers Apply would use.
+ * Cancelling the sweep drops the pending lookups and the queued tests.
+ */
+void PeerDiscoveryDialog::startTestGraph(const QList<PeerData>& peers) {
+    if (testGraph) {
+        testGraph->deleteLater();
+    }
+    testGraph = new TaskGraph(this);
+    sweepSize = peers.size();
+    sweepPending.clear();
+    sweepUnresolved.clear();
+    sweepSelection.clear();
+    for (const PeerData& peer : peers) {
+        sweepPending.insert(peer.host());
+    }
+
+    // Emits the peers through onPeerResolved().
+    TaskGraph::Handlers resolve;
+    resolve.onStart = [this, peers]() {
+        peerManager->resolvePeers(peers);
+    };
+    resolve.onInputsClosed = []() {};
+    resolve.onCancel = [this]() {
+        peerManager->cancelResolution();
+    };
+    resolveNode = testGraph->addNode("resolve", resolve);
+
+    TaskGraph::Handlers probe;
+    probe.onStart = [this]() {
+        peerManager->resetCancellation();
+    };
+    probe.onItem = [this](const QVariant& item) {
+        PeerData peer = item.value<PeerData>();
+        if (sweepUnresolved.remove(peer.host())) {
+            // Without an address there is nothing to probe.
+            sweepPending.remove(peer.host());
+            PeerData failed(peer.host(), peer.isPrivate());
+            failed.setAsn(peer.asn());
+            passTestResult(failed);
+            return;
+        }
+        peer.setLatency(-1);
+        peer.setValid(false);
+        peerManager->testPeer(peer);
+    };
+    // Finished by passTestResult() with the last result, or here if that
+    // arrived before the last peer was resolved.
+    probe.onInputsClosed = [this]() {
+        if (testGraph->stats(probeNode).itemsOut >= sweepSize) {
+            testGraph->finishNode(probeNode);
+        }
+    };
+    probe.onCancel = [this]() {
+        peerManager->cancelTests();
+    };
+    probeNode = testGraph->addNode("probe", probe);
+    testGraph->addEdge(resolveNode, probeNode);
+
+    TaskGraph::Handlers results;
+    results.onItem = [this](const QVariant& item) {
+        showTestResult(item.value<PeerData>());
+    };
+    resultNode = testGraph->addNode("results", results);
+    testGraph->addEdge(probeNode, resultNode);
+
+    // Picks from the whole peer list, like Apply without a selection.
+    TaskGraph::Handlers select;
+    select.onInputsClosed = [this]() {
+        PeerManager::Stickiness stickiness
+            = PeerManager::loadStickiness(*settings);
+        sweepSelection = PeerManager::selectConfigPeers(
+            peerList, PeerManager::MAX_PEERS, &stickiness,
+            transportsPerHost());
+        testGraph->finishNode(selectNode);
+    };
+    selectNode = testGraph->addNode("select", select);
+    testGraph->addEdge(resultNode, selectNode);
+
+    connect(testGraph, &TaskGraph::finished,
+            this, [this](bool success, const QString&) {
+                onTestGraphFinished(success);
+            });
+    testGraph->start();
+}
+
+/**
+ * @brief Update the UI when the test sweep is done.
+ * @param success Whether all peers were tested.
+ */
+void PeerDiscoveryDialog::onTestGraphFinished(bool success) {
+    if (! success) {
+        return; // Cancelled; stopTesting() updates the UI.
+    }
+    // Show the final results without waiting for the next frame.
+    uiCoalescer->flushNow();
+    finishTesting();
 }
 
 /**
@@ -351,6 +844,7 @@ void PeerDiscoveryDialog::onRefreshClicked() {
     statusLabel->setText(tr("Fetching peers..."));
     testButton->setEnabled(false);
     applyButton->setEnabled(false);
+    tryButton->setEnabled(false);
     exportButton->setEnabled(false);
     progressBar->setValue(0);
     peerManager->fetchPeers();
@@ -360,7 +854,7 @@ void PeerDiscoveryDialog::onRefreshClicked() {
  * @brief Handle test button click
  */
 void PeerDiscoveryDialog::onTestClicked() {
-    if (isTesting) {
+    if (isTesting()) {
         stopTesting();
         return;
     }
@@ -371,28 +865,83 @@ void PeerDiscoveryDialog::onTestClicked() {
     }
 
     resetTableUI();
-    testedPeers = 0;
-    totalPeers = peerList.count();
-    progressBar->setValue(0);
-    statusLabel->setText(tr("Testing peers: 0/%1").arg(totalPeers));
+    startSweep(peerList);
+}
 
-    applyButton->setEnabled(false);
-    exportButton->setEnabled(false);
-    refreshButton->setEnabled(false);
-    testButton->setText(tr("Stop"));
+/**
+ * @brief Test the fastest peers again on the new network.
+ * @details Latencies measured on the previous network no longer rank the
+ * peers, so a running sweep starts over, and after a sweep the
+ * RERANK_PEERS fastest peers are tested again.  Nothing is started while
+ * peers are applied or tried live.
+ */
+void PeerDiscoveryDialog::onNetworkChanged() {
+    if (! settings->value("peer_discovery/rerank_on_network_change", true)
+             .toBool()) {
+        return;
+    }
+    if (applyJob || isExperimenting || peerList.isEmpty()) {
+        return;
+    }
 
-    isTesting = true;
+    QList<PeerData> peers;
+    if (isTesting()) {
+        stopTesting();
+        resetTableUI();
+        peers = peerList;
+    } else if (testedPeers() > 0) {
+        for (const PeerData& peer : peerList) {
+            if (peer.isValid() && (peer.latency() >= 0)) {
+                peers.append(peer);
+            }
+        }
+        std::sort(peers.begin(), peers.end(),
+                  [](const PeerData& a, const PeerData& b) {
+                      return a.latency() < b.latency();
+                  });
+        peers = peers.mid(0, RERANK_PEERS);
+    }
+    if (peers.isEmpty()) {
+        return;
+    }
 
-    peerManager->resetCancellation();
+    qDebug() << "[PeerDiscoveryDialog::onNetworkChanged] Re-ranking"
+             << peers.size() << "peers on" << peerManager->networkFingerprint();
+    startSweep(peers);
+    statusLabel->setText(tr("Network changed, re-ranking %1 peers...")
+                         .arg(peers.size()));
+}
 
-    qDebug() << "[PeerDiscoveryDialog::onTestClicked]"
-             << "Starting parallel test for"
-             << totalPeers << "peers.";
-    for (const PeerData& peer : peerList) {
-        PeerData peerToTest = peer;
-        peerToTest.latency = -1;
-        peerToTest.isValid = false;
-        peerManager->testPeer(peerToTest);
+/**
+ * @brief Report the result of an ASN database import.
+ * @param success Whether the import succeeded.
+ * @param message Result description.
+ */
+void PeerDiscoveryDialog::onAsnDatabaseChanged(bool success,
+                                               const QString& message) {
+    if (! success) {
+        QMessageBox::warning(this, tr("ASN database"), message);
+        return;
+    }
+    statusLabel->setText(message);
+}
+
+/**
+ * @brief Test the peers the user selects during a sweep first.
+ * @param selected Newly selected table cells.
+ */
+void PeerDiscoveryDialog::onSelectionChanged(const QItemSelection& selected) {
+    if (! isTesting()) {
+        return;
+    }
+    for (const QModelIndex& index : selected.indexes()) {
+        if (index.column() != HostColumn) {
+            continue;
+        }
+        QTableWidgetItem* hostItem = peerTable->item(index.row(), HostColumn);
+        if (hostItem) {
+            peerManager->pinPeer(hostItem->text());
+        }
     }
 }
 
@@ -400,6 +949,53 @@ void PeerDiscoveryDialog::onTestClicked() {
  * @brief Handle apply button click
  */
 void PeerDiscoveryDialog::onApplyClicked() {
+    if (applyJob) {
+        applyJob->cancel();
+        return;
+    }
+
+    QList<PeerData> selectedPeers = collectSelectedPeers();
+    if (selectedPeers.isEmpty()) {
+        qDebug() << "No peers selected, aborting";
+        QMessageBox::warning(this, tr("Warning"),
+                           tr("No peers selected"));
+        return;
+    }
+
+    qDebug() << "Total peers to apply:" << selectedPeers.count()
+             << "Valid peers:"
+             << std::count_if(selectedPeers.begin(),
+                              selectedPeers.end(),
+                   [](const PeerData& p) { return p.isValid(); });
+
+    // Configured peers are only replaced by materially faster ones, so
+    // that a new sweep does not restart Yggdrasil over jitter.
+    PeerManager::Stickiness stickiness
+        = PeerManager::loadStickiness(*settings);
+    QList<PeerData> configPeers = PeerManager::selectConfigPeers(
+        selectedPeers, PeerManager::MAX_PEERS, &stickiness,
+        transportsPerHost());
+    if (stickiness.isApplied(configPeers)) {
+        QMessageBox::StandardButton reply = QMessageBox::question(
+            this, tr("Apply"),
+            tr("No peer is faster than a configured one by more than the"
+               " stickiness margin, so the configuration would not change."
+               "\n\nRestart Yggdrasil with the same peers anyway?"),
+            QMessageBox::Yes | QMessageBox::No,
+            QMessageBox::No);
+        if (reply != QMessageBox::Yes) {
+            statusLabel->setText(tr("Configured peers kept"));
+            return;
+        }
+    }
+
+    startApplyJob(configPeers);
+}
+
+/**
+ * @brief Get the peers selected in the table, or all peers if none are.
+ */
+QList<PeerData> PeerDiscoveryDialog::collectSelectedPeers() const {
     QList<PeerData> selectedPeers;
     auto selectionModel = peerTable->selectionModel();
 
@@ -407,25 +1003,30 @@ void PeerDiscoveryDialog::onApplyClicked() {
     qDebug() << "\nCurrent peerList state:";
     for (const auto& peer : peerList) {
         qDebug() << "Peer in list:"
-                 << peer.host
+                 << peer.host()
                  << "isPrivate:"
-                 << peer.isPrivate
+                 << peer.isPrivate()
                  << "isValid:"
-                 << peer.isValid
+                 << peer.isValid()
                  << "latency:"
-                 << peer.latency;
+                 << peer.latency();
     }
 
     if (selectionModel->hasSelection()) {
         auto selectedRanges = selectionModel->selectedRows();
         qDebug() << "\nSelected rows:" << selectedRanges.count();
         for (const auto& range : selectedRanges) {
-            if (range.row() < peerList.size()) {
-                const PeerData& peer = peerList[range.row()];
+            // Rows may be sorted differently from peerList, so look the
+            // peer up by its host.
+            QTableWidgetItem* hostItem = peerTable->item(range.row(),
+                                                        HostColumn);
+            int i = hostItem ? peerIndex.value(hostItem->text(), -1) : -1;
+            if (i >= 0) {
+                const PeerData& peer = peerList[i];
                 selectedPeers.append(peer);
-                qDebug() << "Added selected peer:" << peer.host
-                         << "isValid:" << peer.isValid
-                         << "latency:" << peer.latency
+                qDebug() << "Added selected peer:" << peer.host()
+                         << "isValid:" << peer.isValid()
+                         << "latency:" << peer.latency()
                          << "row:" << range.row();
             }
         }
@@ -435,34 +1036,228 @@ void PeerDiscoveryDialog::onApplyClicked() {
                  << "peers";
         selectedPeers = peerList;
         for (const auto& peer : selectedPeers) {
-            qDebug() << "Using peer:" << peer.host
-                     << "isPrivate:" << peer.isPrivate
-                     << "isValid:" << peer.isValid
-                     << "latency:" << peer.latency;
+            qDebug() << "Using peer:" << peer.host()
+                     << "isPrivate:" << peer.isPrivate()
+                     << "isValid:" << peer.isValid()
+                     << "latency:" << peer.latency();
         }
     }
 
-    if (selectedPeers.isEmpty()) {
-        qDebug() << "No peers selected, aborting";
-        QMessageBox::warning(this, tr("Warning"),
-                           tr("No peers selected"));
-        return;
+    return selectedPeers;
+}
+
+/**
+ * @brief Get the number of endpoints of one host to configure, or 0 for no
+ * limit.
+ */
+int PeerDiscoveryDialog::transportsPerHost() const {
+    return settings->value("peer_discovery/transports_per_host",
+                           PeerManager::DEFAULT_TRANSPORTS_PER_HOST).toInt();
+}
+
+/**
+ * @brief Write peers to the configuration with an ApplyConfigJob.
+ * @param peers The peers to select from.
+ */
+void PeerDiscoveryDialog::startApplyJob(const QList<PeerData>& peers) {
+    applyJob = new ApplyConfigJob(peers,
+                                  debugMode,
+                                  "yggdrasil",
+                                  SocketManager::defaultSocketPaths(),
+                                  this);
+    connect(applyJob, &ApplyConfigJob::stageChanged,
+            this, &PeerDiscoveryDialog::onApplyStageChanged);
+    connect(applyJob, &ApplyConfigJob::cancellableChanged,
+            this, &PeerDiscoveryDialog::onApplyCancellableChanged);
+    connect(applyJob, &ApplyConfigJob::finished,
+            this, &PeerDiscoveryDialog::onApplyFinished);
+
+    setApplying(true);
+    applyJob->start();
+}
+
+/**
+ * @brief Enable or disable controls while the configuration is applied.
+ * @param applying Whether an apply job is running.
+ */
+void PeerDiscoveryDialog::setApplying(bool applying) {
+    refreshButton->setEnabled(! applying);
+    testButton->setEnabled(! applying && ! peerList.isEmpty());
+    exportButton->setEnabled(! applying && ! peerList.isEmpty());
+    proxyButton->setEnabled(! applying);
+    privatePeersButton->setEnabled(! applying);
+    lanPeersButton->setEnabled(! applying);
+    profilesButton->setEnabled(! applying);
+    applyButton->setText(applying ? tr("Cancel") : tr("Apply"));
+    applyButton->setEnabled(true);
+    tryButton->setEnabled(! applying);
+    if (! applying) {
+        progressBar->setValue(0);
     }
+}
 
-    qDebug() << "Total peers to apply:" << selectedPeers.count()
-             << "Valid peers:"
-             << std::count_if(selectedPeers.begin(),
-                              selectedPeers.end(),
-                   [](const PeerData& p) { return p.isValid; });
-    if (peerManager->updateConfig(selectedPeers)) {
+/**
+ * @brief Report progress of the apply job.
+ * @param stage Current stage of the job.
+ * @param description Human-readable description of the stage.
+ */
+void PeerDiscoveryDialog::onApplyStageChanged(ApplyConfigJob::Stage stage,
+                                              const QString& description) {
+    progressBar->setValue((stage * 100) / ApplyConfigJob::Finished);
+    statusLabel->setText(description);
+}
+
+/**
+ * @brief Allow canceling the apply job only when it is possible.
+ * @param cancellable Whether the job can be canceled now.
+ */
+void PeerDiscoveryDialog::onApplyCancellableChanged(bool cancellable) {
+    if (applyJob && (applyJob->stage() == ApplyConfigJob::WaitingForPeers)) {
+        applyButton->setText(tr("Skip"));
+    }
+    applyButton->setEnabled(cancellable);
+}
+
+/**
+ * @brief Handle the apply job result.
+ * @param success Whether the configuration was applied.
+ * @param message Result or error message.
+ */
+void PeerDiscoveryDialog::onApplyFinished(bool success,
+                                          const QString& message) {
+    bool canceled = applyJob->wasCanceled();
+    if (success) {
+        PeerManager::storeAppliedPeers(*settings,
+                                       applyJob->configuredPeers());
+    }
+    applyJob->deleteLater();
+    applyJob = nullptr;
+    setApplying(false);
+    statusLabel->setText(message);
+
+    if (canceled) {
+        qDebug() << "Configuration update canceled";
+    } else if (success) {
         qDebug() << "Configuration updated successfully";
-        QMessageBox::information(this, tr("Success"),
-                   tr("Configuration updated successfully"));
+        QMessageBox::information(this, tr("Success"), message);
         accept();
     } else {
-        qDebug() << "Configuration update failed";
+        qDebug() << "Configuration update failed:" << message;
         QMessageBox::critical(this, tr("Error"),
-                            tr("Failed to update configuration"));
+                              tr("Failed to update configuration: %1")
+                              .arg(message));
+    }
+}
+
+/**
+ * @brief Try the selected peers live against the connected ones.
+ */
+void PeerDiscoveryDialog::onTryClicked() {
+    QList<PeerData> candidatePeers = PeerManager::selectConfigPeers(
+        collectSelectedPeers(), PeerManager::MAX_PEERS, nullptr,
+        transportsPerHost());
+    if (candidatePeers.isEmpty()) {
+        QMessageBox::warning(this, tr("Warning"), tr("No peers selected"));
+        return;
+    }
+
+    QStringList targets = OverlayLatencyTest(settings).targets();
+    if (targets.isEmpty()) {
+        QMessageBox::warning(this, tr("Warning"),
+                             tr("No reference targets configured.  Add"
+                                " Yggdrasil addresses with \"Test Overlay"
+                                " Latency...\" in the tray menu first."));
+        return;
+    }
+
+    QStringList uris;
+    for (const PeerData& peer : candidatePeers) {
+        uris << configPeerUri(peer);
+    }
+    int windowMs = settings->value("peer_discovery/experiment_window_s",
+                                   PeerExperiment::DEFAULT_WINDOW_MS / 1000)
+        .toInt() * 1000;
+    int thresholdPercent
+        = settings->value("peer_discovery/experiment_threshold_percent",
+                          PeerExperiment::DEFAULT_THRESHOLD_PERCENT).toInt();
+
+    auto runnable = new PeerExperimentRunnable(uris, targets, windowMs,
+                                               thresholdPercent);
+    connect(runnable, &PeerExperimentRunnable::stageChanged,
+            this, &PeerDiscoveryDialog::onExperimentStageChanged,
+            Qt::QueuedConnection);
+    connect(runnable, &PeerExperimentRunnable::finished,
+            this, &PeerDiscoveryDialog::onExperimentFinished,
+            Qt::QueuedConnection);
+    experimentPeers = candidatePeers;
+    setExperimenting(true);
+    if (! Executor::instance().submit(Executor::Interactive, runnable, this)) {
+        setExperimenting(false);
+    }
+}
+
+/**
+ * @brief Enable or disable controls while an experiment runs.
+ * @param experimenting Whether an experiment is running.
+ */
+void PeerDiscoveryDialog::setExperimenting(bool experimenting) {
+    isExperimenting = experimenting;
+    refreshButton->setEnabled(! experimenting);
+    testButton->setEnabled(! experimenting && ! peerList.isEmpty());
+    applyButton->setEnabled(! experimenting);
+    tryButton->setEnabled(! experimenting);
+    if (! experimenting) {
+        progressBar->setValue(0);
+    }
+}
+
+/**
+ * @brief Report progress of the experiment.
+ * @param stage Current PeerExperiment::Stage.
+ * @param description Human-readable description of the stage.
+ */
+void PeerDiscoveryDialog::onExperimentStageChanged(
+    int stage, const QString& description) {
+    progressBar->setValue((stage * 100) / PeerExperiment::Finished);
+    statusLabel->setText(description);
+}
+
+/**
+ * @brief Show the experiment result and offer to keep a better peer set.
+ * @param outcome The experiment result.
+ */
+void PeerDiscoveryDialog::onExperimentFinished(
+    const PeerExperiment::Outcome& outcome) {
+    setExperimenting(false);
+    statusLabel->setText(outcome.message);
+
+    auto describe = [this](const PeerExperiment::Sample& sample) {
+        if (sample.averageRttUs < 0) {
+            return tr("no replies");
+        }
+        return tr("%1 ms, %2% loss")
+            .arg(sample.averageRttUs / 1000.0, 0, 'f', 1)
+            .arg(sample.lossPercent());
+    };
+    QString details = tr("Current peers: %1\nCandidate peers: %2")
+        .arg(describe(outcome.baseline), describe(outcome.candidate));
+
+    if (outcome.decision == PeerExperiment::Failed) {
+        QMessageBox::warning(this, tr("Experiment"), outcome.message);
+    } else if (outcome.decision == PeerExperiment::RolledBack) {
+        QMessageBox::information(this, tr("Experiment"),
+                                 outcome.message + "\n\n" + details);
+    } else {
+        // The daemon runs with the candidate peers, but the configuration
+        // still lists the previous ones.
+        QMessageBox::StandardButton reply = QMessageBox::question(
+            this, tr("Experiment"),
+            outcome.message + "\n\n" + details + "\n\n"
+            + tr("Write these peers to the configuration?"),
+            QMessageBox::Yes | QMessageBox::No);
+        if (reply == QMessageBox::Yes) {
+            startApplyJob(experimentPeers);
+        }
     }
 }
 
@@ -503,6 +1298,24 @@ void PeerDiscoveryDialog::onProxyConfigClicked() {
     layout->addWidget(new QLabel(tr("Password:"), &dlg));
     layout->addWidget(passEdit);
 
+    QCheckBox* probeCheck = new QCheckBox(
+        tr("Measure peers by connecting through the proxy"), &dlg);
+    layout->addWidget(probeCheck);
+
+    // The password is kept for the session only (see sessionProxyPassword).
+    typeCombo->setCurrentIndex(typeCombo->findData(
+        settings->value("peer_discovery/proxy_type",
+                        QNetworkProxy::NoProxy).toInt()));
+    hostEdit->setText(
+        settings->value("peer_discovery/proxy_host", "").toString());
+    portSpin->setValue(
+        settings->value("peer_discovery/proxy_port", 1080).toInt());
+    userEdit->setText(
+        settings->value("peer_discovery/proxy_user", "").toString());
+    passEdit->setText(sessionProxyPassword);
+    probeCheck->setChecked(
+        settings->value("peer_discovery/proxy_probe", true).toBool());
+
     QDialogButtonBox* buttons
         = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel,
                                &dlg);
@@ -518,19 +1331,63 @@ void PeerDiscoveryDialog::onProxyConfigClicked() {
                      &QDialog::reject);
 
     if (dlg.exec() == QDialog::Accepted) {
-        QNetworkProxy::ProxyType type = static_cast<QNetworkProxy::ProxyType>(
-            typeCombo->currentData().toInt());
-        if (type == QNetworkProxy::NoProxy) {
+        settings->setValue("peer_discovery/proxy_type",
+                           typeCombo->currentData().toInt());
+        settings->setValue("peer_discovery/proxy_host", hostEdit->text());
+        settings->setValue("peer_discovery/proxy_port", portSpin->value());
+        settings->setValue("peer_discovery/proxy_user", userEdit->text());
+        settings->setValue("peer_discovery/proxy_probe",
+                           probeCheck->isChecked());
+        settings->sync();
+        sessionProxyPassword = passEdit->text();
+        applyProxySettings();
+    }
+}
+
+/**
+ * @brief Set up the peer fetching and peer testing proxy from the settings.
+ */
+void PeerDiscoveryDialog::applyProxySettings() {
+    QNetworkProxy::ProxyType type = static_cast<QNetworkProxy::ProxyType>(
+        settings->value("peer_discovery/proxy_type",
+                        QNetworkProxy::NoProxy).toInt());
+    if (type != QNetworkProxy::Socks5Proxy) {
+        setPeerFetchProxy(QNetworkProxy(QNetworkProxy::NoProxy));
+        peerManager->setProbeProxy(QNetworkProxy(QNetworkProxy::NoProxy));
+        return;
+    }
+
+    QString host = settings->value("peer_discovery/proxy_host", "").toString();
+    quint16 port = static_cast<quint16>(
+        settings->value("peer_discovery/proxy_port", 1080).toInt());
+    QString user = settings->value("peer_discovery/proxy_user", "").toString();
+    if ((! user.isEmpty()) && sessionProxyPassword.isEmpty()) {
+        // The password is not stored; an empty one would make every
+        // request through an authenticating proxy fail.
+        bool ok = false;
+        QString password = QInputDialog::getText(
+            this,
+            tr("Proxy password"),
+            tr("Password of %1 for the proxy %2:").arg(user, host),
+            QLineEdit::Password,
+            QString(),
+            &ok);
+        if ((! ok) || password.isEmpty()) {
+            qDebug() << "[PeerDiscoveryDialog::applyProxySettings]"
+                     << "No proxy password, not using the proxy";
             setPeerFetchProxy(QNetworkProxy(QNetworkProxy::NoProxy));
-        } else {
-            QString host = hostEdit->text();
-            quint16 port = static_cast<quint16>(portSpin->value());
-            QString user = userEdit->text();
-            QString pass = passEdit->text();
-            QNetworkProxy proxy(type, host, port, user, pass);
-            setPeerFetchProxy(proxy);
+            peerManager->setProbeProxy(QNetworkProxy(QNetworkProxy::NoProxy));
+            statusLabel->setText(tr("Proxy not used: no password given"));
+            return;
         }
+        sessionProxyPassword = password;
     }
+    QNetworkProxy proxy(type, host, port, user, sessionProxyPassword);
+    setPeerFetchProxy(proxy);
+
+    bool probe = settings->value("peer_discovery/proxy_probe", true).toBool();
+    peerManager->setProbeProxy(
+        probe ? proxy : QNetworkProxy(QNetworkProxy::NoProxy));
 }
 
 /**
@@ -587,13 +1444,635 @@ void PeerDiscoveryDialog::onPrivatePeersClicked() {
                            s);
         settings->sync();
 
-        if (isTesting) {
+        if (isTesting()) {
             stopTesting();
         }
         onRefreshClicked();
     }
 }
 
+/**
+ * @brief Show the probe configuration dialog (uplinks and probe rate).
+ */
+void PeerDiscoveryDialog::onProbeSettingsClicked() {
+    QDialog dlg(this);
+    dlg.setWindowTitle(tr("Configure probing"));
+
+    QVBoxLayout* layout = new QVBoxLayout(&dlg);
+
+    QComboBox* interfaceCombo = new QComboBox(&dlg);
+    interfaceCombo->setEditable(true);
+    interfaceCombo->addItem(tr("Default route"), QString());
+    for (const QString& uplink : PeerManager::availableUplinks()) {
+        interfaceCombo->addItem(uplink, uplink);
+    }
+
+    QString probeInterface
+        = settings->value("peer_discovery/probe_interface", "").toString();
+    int index = interfaceCombo->findData(probeInterface);
+    if (index >= 0) {
+        interfaceCombo->setCurrentIndex(index);
+    } else {
+        // An interface that is down now, or a source address.
+        interfaceCombo->setEditText(probeInterface);
+    }
+
+    QCheckBox* sweepCheck = new QCheckBox(
+        tr("Also measure every peer through all uplinks"), &dlg);
+    sweepCheck->setChecked(
+        settings->value("peer_discovery/sweep_uplinks", false).toBool());
+
+    layout->addWidget(new QLabel(
+        tr("Interface or source address to measure latency from:"), &dlg));
+    layout->addWidget(interfaceCombo);
+    layout->addWidget(sweepCheck);
+
+    QSpinBox* rateSpin = new QSpinBox(&dlg);
+    rateSpin->setRange(0, 10000);
+    rateSpin->setSpecialValueText(tr("Unlimited"));
+    rateSpin->setSuffix(tr(" packets/s"));
+    rateSpin->setValue(settings->value("peer_discovery/probe_rate",
+                                       ProbeScheduler::DEFAULT_RATE_PPS)
+                       .toInt());
+    layout->addWidget(new QLabel(tr("Probe rate limit:"), &dlg));
+    layout->addWidget(rateSpin);
+
+    QSpinBox* windowSpin = new QSpinBox(&dlg);
+    windowSpin->setRange(5, 600);
+    windowSpin->setSuffix(tr(" s"));
+    windowSpin->setValue(
+        settings->value("peer_discovery/experiment_window_s",
+                        PeerExperiment::DEFAULT_WINDOW_MS / 1000).toInt());
+    layout->addWidget(new QLabel(
+        tr("Overlay measurement per peer set when trying peers live:"),
+        &dlg));
+    layout->addWidget(windowSpin);
+
+    QSpinBox* thresholdSpin = new QSpinBox(&dlg);
+    thresholdSpin->setRange(0, 90);
+    thresholdSpin->setSuffix(tr(" %"));
+    thresholdSpin->setValue(
+        settings->value("peer_discovery/experiment_threshold_percent",
+                        PeerExperiment::DEFAULT_THRESHOLD_PERCENT).toInt());
+    layout->addWidget(new QLabel(
+        tr("Keep peers tried live if the overlay gets faster by at least:"),
+        &dlg));
+    layout->addWidget(thresholdSpin);
+
+    QSpinBox* stickinessMsSpin = new QSpinBox(&dlg);
+    stickinessMsSpin->setRange(0, 1000);
+    stickinessMsSpin->setSuffix(tr(" ms"));
+    stickinessMsSpin->setValue(
+        settings->value("peer_discovery/stickiness_ms",
+                        PeerManager::DEFAULT_STICKINESS_US / 1000).toInt());
+    QSpinBox* stickinessPercentSpin = new QSpinBox(&dlg);
+    stickinessPercentSpin->setRange(0, 100);
+    stickinessPercentSpin->setSuffix(tr(" %"));
+    stickinessPercentSpin->setValue(
+        settings->value("peer_discovery/stickiness_percent",
+                        PeerManager::DEFAULT_STICKINESS_PERCENT).toInt());
+    QHBoxLayout* stickinessLayout = new QHBoxLayout();
+    stickinessLayout->addWidget(stickinessMsSpin);
+    stickinessLayout->addWidget(new QLabel(tr("or"), &dlg));
+    stickinessLayout->addWidget(stickinessPercentSpin);
+    stickinessLayout->addStretch();
+    layout->addWidget(new QLabel(
+        tr("Replace a configured peer only with one faster by more than"
+           " (the larger applies):"),
+        &dlg));
+    layout->addLayout(stickinessLayout);
+
+    QSpinBox* transportsSpin = new QSpinBox(&dlg);
+    transportsSpin->setRange(0, 3);
+    transportsSpin->setSpecialValueText(tr("Unlimited"));
+    transportsSpin->setValue(transportsPerHost());
+    transportsSpin->setToolTip(tr("More than one adds redundancy when a"
+                                  " transport is blocked"));
+    layout->addWidget(new QLabel(
+        tr("Fastest endpoints of one host to configure (tls, tcp, quic):"),
+        &dlg));
+    layout->addWidget(transportsSpin);
+
+    QCheckBox* rerankCheck = new QCheckBox(
+        tr("Test the fastest peers again when the network changes"), &dlg);
+    rerankCheck->setChecked(
+        settings->value("peer_discovery/rerank_on_network_change", true)
+            .toBool());
+    layout->addWidget(rerankCheck);
+
+    QLabel* asnLabel = new QLabel(&dlg);
+    auto showAsnDatabase = [this, asnLabel]() {
+        int asnPrefixes = peerManager->asnPrefixCount();
+        asnLabel->setText((asnPrefixes > 0)
+                              ? tr("ASN database: %1 prefixes")
+                                    .arg(asnPrefixes)
+                              : tr("ASN database: none"));
+    };
+    showAsnDatabase();
+    QObject::connect(peerManager, &PeerManager::asnDatabaseChanged,
+                     &dlg, showAsnDatabase);
+    QPushButton* asnButton = new QPushButton(tr("Import..."), &dlg);
+    asnButton->setToolTip(
+        tr("Import a routeviews prefix-to-AS or an iptoasn table"));
+    QHBoxLayout* asnLayout = new QHBoxLayout();
+    asnLayout->addWidget(asnLabel);
+    asnLayout->addStretch();
+    asnLayout->addWidget(asnButton);
+    layout->addLayout(asnLayout);
+    QObject::connect(asnButton, &QPushButton::clicked, &dlg,
+                     [this, &dlg, asnLabel]() {
+        QString dumpPath = QFileDialog::getOpenFileName(
+            &dlg,
+            tr("Import ASN table"),
+            QString(),
+            tr("Prefix tables (*.tsv *.txt *.pfx2as);;All files (*)"));
+        if (dumpPath.isEmpty()) {
+            return;
+        }
+        asnLabel->setText(tr("ASN database: importing..."));
+        peerManager->importAsnDatabase(dumpPath);
+    });
+
+    QDialogButtonBox* buttons
+        = new QDialogButtonBox(QDialogButtonBox::Save | QDialogButtonBox::Cancel,
+                               &dlg);
+    layout->addWidget(buttons);
+
+    QObject::connect(buttons,
+                     &QDialogButtonBox::accepted,
+                     &dlg,
+                     &QDialog::accept);
+    QObject::connect(buttons,
+                     &QDialogButtonBox::rejected,
+                     &dlg,
+                     &QDialog::reject);
+
+    if (dlg.exec() == QDialog::Accepted) {
+        QString text = interfaceCombo->currentText().trimmed();
+        int selected = interfaceCombo->findText(text);
+        QString value = (selected >= 0)
+            ? interfaceCombo->itemData(selected).toString()
+            : text;
+        settings->setValue("peer_discovery/probe_interface", value);
+        settings->setValue("peer_discovery/sweep_uplinks",
+                           sweepCheck->isChecked());
+        settings->setValue("peer_discovery/probe_rate", rateSpin->value());
+        settings->setValue("peer_discovery/experiment_window_s",
+                           windowSpin->value());
+        settings->setValue("peer_discovery/experiment_threshold_percent",
+                           thresholdSpin->value());
+        settings->setValue("peer_discovery/stickiness_ms",
+                           stickinessMsSpin->value());
+        settings->setValue("peer_discovery/stickiness_percent",
+                           stickinessPercentSpin->value());
+        settings->setValue("peer_discovery/transports_per_host",
+                           transportsSpin->value());
+        settings->setValue("peer_discovery/rerank_on_network_change",
+                           rerankCheck->isChecked());
+        settings->sync();
+        applyProbeSettings();
+    }
+}
+
+/**
+ * @brief Show the Yggdrasil nodes found on the LAN and pin them as private
+ * peers.
+ * @details The nodes are the link-local peers of the local daemon, and
+ * those found by their multicast beacons on the interfaces the user
+ * selects while the dialog is open.  Until the user selects any, the
+ * multicast interfaces of the local daemon are used, or all candidate
+ * interfaces if the admin socket is not available.
+ */
+void PeerDiscoveryDialog::onLanPeersClicked() {
+    QDialog dlg(this);
+    dlg.setWindowTitle(tr("LAN peers"));
+
+    QVBoxLayout* layout = new QVBoxLayout(&dlg);
+
+    QListWidget* interfaceList = new QListWidget(&dlg);
+    for (const QString& name : LanDiscovery::candidateInterfaces()) {
+        QListWidgetItem* item = new QListWidgetItem(name, interfaceList);
+        item->setFlags(item->flags() | Qt::ItemIsUserCheckable);
+        item->setCheckState(Qt::Unchecked);
+    }
+    if (interfaceList->count() > 0) {
+        interfaceList->setMaximumHeight(
+            interfaceList->sizeHintForRow(0) * LAN_INTERFACE_ROWS
+            + 2 * interfaceList->frameWidth());
+    }
+
+    QTableWidget* neighbourTable = new QTableWidget(0, 4, &dlg);
+    neighbourTable->setHorizontalHeaderLabels({
+        tr("Interface"),
+        tr("Address"),
+        tr("Latency"),
+        tr("Public key")
+    });
+    neighbourTable->horizontalHeader()->setSectionResizeMode(
+        QHeaderView::ResizeToContents);
+    neighbourTable->horizontalHeader()->setStretchLastSection(true);
+    neighbourTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    neighbourTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    neighbourTable->verticalHeader()->hide();
+
+    QLabel* lanStatusLabel = new QLabel(&dlg);
+
+    QDialogButtonBox* buttons
+        = new QDialogButtonBox(QDialogButtonBox::Close, &dlg);
+    QPushButton* pinButton
+        = buttons->addButton(tr("Add as private peers"),
+                             QDialogButtonBox::ActionRole);
+    pinButton->setEnabled(false);
+
+    layout->addWidget(new QLabel(
+        tr("Listen for Yggdrasil multicast beacons on:"), &dlg));
+    layout->addWidget(interfaceList);
+    layout->addWidget(neighbourTable);
+    layout->addWidget(lanStatusLabel);
+    layout->addWidget(buttons);
+
+    LanDiscovery discovery;
+    discovery.watchDaemon(SocketManager::defaultSocketPaths());
+
+    auto checkedInterfaces = [interfaceList]() {
+        QStringList names;
+        for (int i = 0; i < interfaceList->count(); ++i) {
+            QListWidgetItem* item = interfaceList->item(i);
+            if (item->checkState() == Qt::Checked) {
+                names << item->text();
+            }
+        }
+        return names;
+    };
+    auto checkInterfaces = [interfaceList](const QStringList& names) {
+        QSignalBlocker blocker(interfaceList);
+        for (int i = 0; i < interfaceList->count(); ++i) {
+            QListWidgetItem* item = interfaceList->item(i);
+            item->setCheckState(names.contains(item->text())
+                                    ? Qt::Checked
+                                    : Qt::Unchecked);
+        }
+    };
+    auto startDiscovery = [&discovery, neighbourTable, lanStatusLabel](
+                              const QStringList& names) {
+        neighbourTable->setRowCount(0);
+        if (names.isEmpty()) {
+            // Forget the beacons, keep the peers of the daemon.
+            discovery.start(names);
+            lanStatusLabel->setText(
+                tr("Showing the LAN peers of the local daemon.  Select"
+                   " interfaces to listen for beacons as well."));
+        } else if (discovery.start(names)) {
+            lanStatusLabel->setText(
+                tr("Listening for beacons on %1...")
+                    .arg(names.join(", ")));
+        } else if (discovery.error() == LanDiscovery::PortInUse) {
+            // Linux only shares the port between sockets of one user, and
+            // the daemon usually runs as root.
+            lanStatusLabel->setText(
+                tr("Port %1 is in use by a program that does not share it,"
+                   " such as a Yggdrasil daemon running as another user."
+                   "  Showing the LAN peers of the local daemon only.")
+                    .arg(LanDiscovery::MULTICAST_PORT));
+        } else if (discovery.error() == LanDiscovery::NoInterface) {
+            lanStatusLabel->setText(
+                tr("Cannot listen for beacons on %1.")
+                    .arg(names.join(", ")));
+        } else {
+            lanStatusLabel->setText(
+                tr("Cannot listen for beacons on port %1.")
+                    .arg(LanDiscovery::MULTICAST_PORT));
+        }
+    };
+
+    auto neighbourRow = [neighbourTable](const QString& uri) {
+        for (int row = 0; row < neighbourTable->rowCount(); ++row) {
+            if (neighbourTable->item(row, 0)->data(Qt::UserRole) == uri) {
+                return row;
+            }
+        }
+        return -1;
+    };
+    connect(&discovery, &LanDiscovery::neighbourChanged, &dlg,
+            [this, neighbourTable, neighbourRow](
+                const LanDiscovery::Neighbour& neighbour) {
+        int row = neighbourRow(neighbour.uri);
+        if (row < 0) {
+            row = neighbourTable->rowCount();
+            neighbourTable->insertRow(row);
+            QTableWidgetItem* interfaceItem
+                = new QTableWidgetItem(neighbour.interfaceName);
+            interfaceItem->setData(Qt::UserRole, neighbour.uri);
+            neighbourTable->setItem(row, 0, interfaceItem);
+            QHostAddress address(neighbour.address);
+            address.setScopeId(QString());
+            neighbourTable->setItem(row, 1, new QTableWidgetItem(
+                QString("[%1]:%2").arg(address.toString())
+                                  .arg(neighbour.port)));
+            neighbourTable->setItem(row, 2, new QTableWidgetItem());
+            neighbourTable->setItem(row, 3,
+                                    new QTableWidgetItem(neighbour.publicKey));
+        }
+        QTableWidgetItem* latencyItem = neighbourTable->item(row, 2);
+        latencyItem->setText(
+            (neighbour.rttUs >= 0)
+                ? tr("%1 ms").arg(neighbour.rttUs / 1000.0, 0, 'f', 2)
+                : tr("-"));
+        QStringList privatePeers = settings->value(
+            "peer_discovery/private_peers", "").toString().split(",");
+        neighbourTable->item(row, 0)->setToolTip(
+            privatePeers.contains(neighbour.uri)
+                ? tr("Private peer already")
+                : neighbour.uri);
+    });
+    connect(&discovery, &LanDiscovery::neighbourLost, &dlg,
+            [neighbourTable, neighbourRow](const QString& uri) {
+        int row = neighbourRow(uri);
+        if (row >= 0) {
+            neighbourTable->removeRow(row);
+        }
+    });
+    connect(&discovery, &LanDiscovery::multicastInterfacesRead, &dlg,
+            [this, interfaceList, checkInterfaces, checkedInterfaces,
+             startDiscovery](const QStringList& names) {
+        // The user chose interfaces already.
+        if (settings->contains("peer_discovery/lan_interfaces")) {
+            return;
+        }
+        QStringList selected;
+        for (int i = 0; i < interfaceList->count(); ++i) {
+            QString name = interfaceList->item(i)->text();
+            if (names.isEmpty() || names.contains(name)) {
+                selected << name;
+            }
+        }
+        checkInterfaces(selected);
+        startDiscovery(checkedInterfaces());
+    });
+
+    connect(interfaceList, &QListWidget::itemChanged, &dlg,
+            [this, checkedInterfaces, startDiscovery]() {
+        QStringList names = checkedInterfaces();
+        settings->setValue("peer_discovery/lan_interfaces", names.join(","));
+        startDiscovery(names);
+    });
+    connect(neighbourTable->selectionModel(),
+            &QItemSelectionModel::selectionChanged, &dlg,
+            [neighbourTable, pinButton]() {
+        pinButton->setEnabled(
+            neighbourTable->selectionModel()->hasSelection());
+    });
+
+    bool pinned = false;
+    connect(pinButton, &QPushButton::clicked, &dlg,
+            [this, neighbourTable, lanStatusLabel, &pinned]() {
+        QStringList peers = settings->value(
+            "peer_discovery/private_peers", "").toString().split(",");
+        peers.removeAll(QString());
+        int added = 0;
+        for (const QModelIndex& index
+             : neighbourTable->selectionModel()->selectedRows()) {
+            QString uri = neighbourTable->item(index.row(), 0)
+                              ->data(Qt::UserRole).toString();
+            if (isPeerUriValid(uri) && (! peers.contains(uri))) {
+                peers.append(uri);
+                ++added;
+            }
+        }
+        if (added > 0) {
+            settings->setValue("peer_discovery/private_peers",
+                               peers.join(","));
+            settings->sync();
+            pinned = true;
+        }
+        lanStatusLabel->setText(tr("Added %n private peer(s).", "", added));
+    });
+    QObject::connect(buttons,
+                     &QDialogButtonBox::rejected,
+                     &dlg,
+                     &QDialog::reject);
+
+    if (settings->contains("peer_discovery/lan_interfaces")) {
+        checkInterfaces(settings->value("peer_discovery/lan_interfaces")
+                            .toString().split(","));
+        startDiscovery(checkedInterfaces());
+    } else {
+        lanStatusLabel->setText(tr("Reading the multicast interfaces..."));
+        discovery.readMulticastInterfaces(
+            SocketManager::defaultSocketPaths());
+    }
+
+    dlg.exec();
+    discovery.stop();
+
+    if (pinned) {
+        if (isTesting()) {
+            stopTesting();
+        }
+        onRefreshClicked();
+    }
+}
+
+/**
+ * @brief Show the peer profiles manager.
+ * @details A profile is saved from the peers selected in the table, as they
+ * would be applied, together with their latencies.  It may be bound to the
+ * current network, so that the tray switches to it when the host joins the
+ * network again.
+ */
+void PeerDiscoveryDialog::onProfilesClicked() {
+    QDialog dlg(this);
+    dlg.setWindowTitle(tr("Peer profiles"));
+
+    QVBoxLayout* layout = new QVBoxLayout(&dlg);
+
+    QTableWidget* profileTable = new QTableWidget(0, 4, &dlg);
+    profileTable->setHorizontalHeaderLabels({
+        tr("Name"),
+        tr("Peers"),
+        tr("Network"),
+        tr("Validated")
+    });
+    profileTable->horizontalHeader()->setSectionResizeMode(
+        QHeaderView::ResizeToContents);
+    profileTable->horizontalHeader()->setStretchLastSection(true);
+    profileTable->setSelectionBehavior(QAbstractItemView::SelectRows);
+    profileTable->setSelectionMode(QAbstractItemView::SingleSelection);
+    profileTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    profileTable->verticalHeader()->hide();
+
+    QLineEdit* nameEdit = new QLineEdit(&dlg);
+    nameEdit->setPlaceholderText(tr("Profile name"));
+    QCheckBox* bindCheck = new QCheckBox(
+        tr("Switch to it on the current network"), &dlg);
+    QString fingerprint = peerManager->networkFingerprint();
+    bindCheck->setEnabled(! fingerprint.isEmpty());
+    QPushButton* saveButton = new QPushButton(tr("Save selection"), &dlg);
+    saveButton->setEnabled(false);
+    QHBoxLayout* saveLayout = new QHBoxLayout();
+    saveLayout->addWidget(nameEdit);
+    saveLayout->addWidget(bindCheck);
+    saveLayout->addWidget(saveButton);
+
+    PeerProfiles profiles(settings);
+    QCheckBox* autoSwitchCheck = new QCheckBox(
+        tr("Switch profiles automatically when the network changes"), &dlg);
+    autoSwitchCheck->setChecked(profiles.autoSwitch());
+
+    QDialogButtonBox* buttons
+        = new QDialogButtonBox(QDialogButtonBox::Close, &dlg);
+    QPushButton* deleteButton
+        = buttons->addButton(tr("Delete"), QDialogButtonBox::ActionRole);
+    deleteButton->setEnabled(false);
+
+    layout->addWidget(profileTable);
+    layout->addLayout(saveLayout);
+    layout->addWidget(autoSwitchCheck);
+    layout->addWidget(buttons);
+
+    auto fillTable = [&profiles, profileTable, fingerprint]() {
+        profileTable->setRowCount(0);
+        QString active = profiles.activeProfile();
+        for (const PeerProfiles::Profile& profile : profiles.profiles()) {
+            int row = profileTable->rowCount();
+            profileTable->insertRow(row);
+            QTableWidgetItem* nameItem = new QTableWidgetItem(profile.name);
+            QFont font = nameItem->font();
+            font.setBold(profile.name == active);
+            nameItem->setFont(font);
+            profileTable->setItem(row, 0, nameItem);
+            profileTable->setItem(row, 1, new QTableWidgetItem(
+                tr("%1 of %2 reachable")
+                    .arg(profile.reachableCount())
+                    .arg(profile.peers.size())));
+            QString network;
+            if (profile.network.isEmpty()) {
+                network = tr("-");
+            } else if (profile.network == fingerprint) {
+                network = tr("Current");
+            } else {
+                network = tr("Other");
+            }
+            profileTable->setItem(row, 2, new QTableWidgetItem(network));
+            profileTable->setItem(row, 3, new QTableWidgetItem(
+                (profile.validatedMs > 0)
+                    ? QLocale().toString(
+                          QDateTime::fromMSecsSinceEpoch(profile.validatedMs),
+                          QLocale::ShortFormat)
+                    : tr("Never")));
+        }
+    };
+
+    connect(nameEdit, &QLineEdit::textChanged, &dlg,
+            [saveButton](const QString& text) {
+        saveButton->setEnabled(! text.trimmed().isEmpty());
+    });
+    connect(profileTable->selectionModel(),
+            &QItemSelectionModel::selectionChanged, &dlg,
+            [profileTable, nameEdit, deleteButton]() {
+        QModelIndexList rows = profileTable->selectionModel()->selectedRows();
+        deleteButton->setEnabled(! rows.isEmpty());
+        if (! rows.isEmpty()) {
+            nameEdit->setText(profileTable->item(rows.first().row(), 0)
+                                  ->text());
+        }
+    });
+    connect(saveButton, &QPushButton::clicked, &dlg,
+            [this, &profiles, &dlg, nameEdit, bindCheck, fingerprint,
+             fillTable]() {
+        QList<PeerData> peers = PeerManager::selectConfigPeers(
+            collectSelectedPeers(), PeerManager::MAX_PEERS, nullptr,
+            transportsPerHost());
+        if (peers.isEmpty()) {
+            QMessageBox::warning(&dlg, tr("Warning"),
+                                 tr("No peers selected"));
+            return;
+        }
+        PeerProfiles::Profile profile;
+        profile.name = nameEdit->text().trimmed();
+        PeerProfiles::sortPeers(peers);
+        profile.peers = peers;
+        if (bindCheck->isChecked()) {
+            profile.network = fingerprint;
+        }
+        // Peers tested in this dialog count as validated.
+        if (std::any_of(peers.cbegin(), peers.cend(),
+                        [](const PeerData& peer) {
+                            return peer.latency() >= 0;
+                        })) {
+            profile.validatedMs = QDateTime::currentMSecsSinceEpoch();
+        }
+        qDebug() << "[PeerDiscoveryDialog::onProfilesClicked] Saving"
+                 << profile.name << "with" << peers.size() << "peers";
+        profiles.save(profile);
+        fillTable();
+    });
+    connect(deleteButton, &QPushButton::clicked, &dlg,
+            [&profiles, profileTable, fillTable]() {
+        QModelIndexList rows = profileTable->selectionModel()->selectedRows();
+        if (! rows.isEmpty()) {
+            profiles.remove(profileTable->item(rows.first().row(), 0)
+                                ->text());
+            fillTable();
+        }
+    });
+    connect(autoSwitchCheck, &QCheckBox::toggled, &dlg,
+            [&profiles](bool checked) {
+        profiles.setAutoSwitch(checked);
+    });
+    QObject::connect(buttons,
+                     &QDialogButtonBox::rejected,
+                     &dlg,
+                     &QDialog::reject);
+
+    fillTable();
+    dlg.exec();
+}
+
+/**
+ * @brief Pass the uplink and probe rate settings to the peer manager and show
+ * a latency column for every swept uplink.
+ */
+void PeerDiscoveryDialog::applyProbeSettings() {
+    peerManager->setProbeRate(
+        settings->value("peer_discovery/probe_rate",
+                        ProbeScheduler::DEFAULT_RATE_PPS).toInt());
+
+    QString probeInterface
+        = settings->value("peer_discovery/probe_interface", "").toString();
+    QStringList sweepUplinks;
+    if (settings->value("peer_discovery/sweep_uplinks", false).toBool()) {
+        sweepUplinks = PeerManager::availableUplinks();
+    }
+    qDebug() << "[PeerDiscoveryDialog::applyProbeSettings]"
+             << "Probe interface:" << probeInterface
+             << "sweep:" << sweepUplinks;
+    peerManager->setProbeUplinks(probeInterface, sweepUplinks);
+    setUplinkColumns(sweepUplinks);
+}
+
+/**
+ * @brief Show a latency column for each uplink after the fixed columns.
+ * @param uplinks Names of the uplinks.
+ */
+void PeerDiscoveryDialog::setUplinkColumns(const QStringList& uplinks) {
+    bool wasSortingEnabled = peerTable->isSortingEnabled();
+    peerTable->setSortingEnabled(false);
+
+    uplinkColumns = uplinks;
+    peerTable->setColumnCount(PeerTableColumnCount + uplinks.size());
+    for (int j = 0; j < uplinks.size(); ++j) {
+        int column = PeerTableColumnCount + j;
+        peerTable->setHorizontalHeaderItem(
+            column, new QTableWidgetItem(tr("via %1").arg(uplinks[j])));
+        for (int row = 0; row < peerTable->rowCount(); ++row) {
+            peerTable->setItem(row, column, new LatencyItem());
+        }
+    }
+
+    peerTable->setSortingEnabled(wasSortingEnabled);
+}
+
 /**
  * @brief Handle export button click
  */
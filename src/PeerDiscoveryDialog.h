@@ -4,15 +4,25 @@
 #include <memory>
 #include <QCloseEvent>
 #include <QDialog>
+#include <QFont>
+#include <QHash>
+#include <QItemSelection>
 #include <QLabel>
 #include <QProgressBar>
 #include <QPushButton>
 #include <QTableWidget>
 #include <QTableWidgetItem>
 #include <QTranslator>
+#include <QSet>
 #include <QSettings>
+#include <QVector>
 
+#include "ApplyConfigJob.h"
+#include "LatencyHistory.h"
+#include "PeerExperiment.h"
 #include "PeerManager.h"
+#include "TaskGraph.h"
+#include "UiUpdateCoalescer.h"
 
 /**
  * @brief A special class to handle validity column in the peer table.
@@ -34,18 +44,31 @@ public:
      * is not tested yet.
      * @param isValid Peer validity.
      * @param isTested Whether the peer latency was tested or not.
+     * @param isPredicted Whether the latency is an estimate of an untested
+     * peer.
      */
-    LatencyItem(int latency = -1, bool isValid = false, bool isTested = false)
-        : QTableWidgetItem(latency >= 0 ? QString::number(latency) : QString("-")),
+    LatencyItem(int latency = -1,
+                bool isValid = false,
+                bool isTested = false,
+                bool isPredicted = false)
+        : QTableWidgetItem(latency < 0 ? QString("-")
+                           : isPredicted ? "~" + QString::number(latency)
+                           : QString::number(latency)),
           m_latency(latency),
           m_isValid(isValid),
-          m_isTested(isTested)
+          m_isTested(isTested),
+          m_isPredicted(isPredicted)
     {
         if (m_isTested) {
             QColor backgroundColor
                 = m_isValid ? QColor(220, 255, 220) : QColor(255, 220, 220);
             setData(Qt::BackgroundRole, backgroundColor);
             setData(Qt::ForegroundRole, QColor(0, 0, 0));
+        } else if (m_isPredicted) {
+            QFont italic = font();
+            italic.setItalic(true);
+            setFont(italic);
+            setData(Qt::ForegroundRole, QColor(128, 128, 128));
         }
     }
 
@@ -62,11 +85,13 @@ public:
     int latency() const { return m_latency; }
     bool isValid() const { return m_isValid; }
     bool isTested() const { return m_isTested; }
+    bool isPredicted() const { return m_isPredicted; }
 
 private:
     int m_latency;
     bool m_isValid;
     bool m_isTested;
+    bool m_isPredicted;
 };
 
 /**
@@ -90,6 +115,23 @@ class PeerDiscoveryDialog : public QDialog {
     Q_OBJECT
 
 public:
+    /**
+     * @brief Columns of the peer table.
+     */
+    enum PeerTableColumn {
+        HostColumn,
+        LatencyColumn,
+        StatusColumn,
+        ValidityColumn,
+        HistoryColumn,
+        AsnColumn,
+        PeerTableColumnCount
+    };
+
+    // Number of the fastest peers tested again when the host moves to
+    // another network
+    static constexpr int RERANK_PEERS = 2 * PeerManager::MAX_PEERS;
+
     explicit PeerDiscoveryDialog(std::shared_ptr<QSettings> settings,
                                  bool debugMode = false,
                                  QWidget *parent = nullptr);
@@ -100,18 +142,81 @@ public:
      */
     void setPeerFetchProxy(const QNetworkProxy& proxy);
 
+public slots:
+    void reject() override;
+
 protected:
     void closeEvent(QCloseEvent *event) override;
 
 private slots:
     void onPeersDiscovered(const QList<PeerData>& peers);
     void onPeerTested(const PeerData& peer);
+
+    /**
+     * @brief Pass a resolved peer from the resolve stage to the probe stage.
+     * @param peer The peer with the addresses to probe.
+     * @param resolved Whether its host has an address.
+     */
+    void onPeerResolved(const PeerData& peer, bool resolved);
+
+    /**
+     * @brief Apply the accumulated peer test results to the UI.
+     * @param dirtyPeers Indices in peerList of the peers that changed.
+     * @param resultCount Number of results received since the last flush.
+     */
+    void onUiFlush(const QList<int>& dirtyPeers, int resultCount);
+
     void onError(const QString& message);
     void onRefreshClicked();
     void onTestClicked();
     void onApplyClicked();
     void onExportClicked();
 
+    /**
+     * @brief Report progress of the apply job.
+     * @param stage Current stage of the job.
+     * @param description Human-readable description of the stage.
+     */
+    void onApplyStageChanged(ApplyConfigJob::Stage stage,
+                             const QString& description);
+
+    /**
+     * @brief Allow canceling the apply job only when it is possible.
+     * @param cancellable Whether the job can be canceled now.
+     */
+    void onApplyCancellableChanged(bool cancellable);
+
+    /**
+     * @brief Handle the apply job result.
+     * @param success Whether the configuration was applied.
+     * @param message Result or error message.
+     */
+    void onApplyFinished(bool success, const QString& message);
+
+    /**
+     * @brief Update the UI when the test sweep is done.
+     * @param success Whether all peers were tested.
+     */
+    void onTestGraphFinished(bool success);
+
+    /**
+     * @brief Try the selected peers live against the connected ones.
+     */
+    void onTryClicked();
+
+    /**
+     * @brief Report progress of the experiment.
+     * @param stage Current PeerExperiment::Stage.
+     * @param description Human-readable description of the stage.
+     */
+    void onExperimentStageChanged(int stage, const QString& description);
+
+    /**
+     * @brief Show the experiment result and offer to keep a better peer set.
+     * @param outcome The experiment result.
+     */
+    void onExperimentFinished(const PeerExperiment::Outcome& outcome);
+
     /**
      * @brief Show the proxy configuration dialog
      */
@@ -122,19 +227,107 @@ private slots:
      */
     void onPrivatePeersClicked();
 
+    /**
+     * @brief Show the probe configuration dialog (uplinks and probe rate).
+     */
+    void onProbeSettingsClicked();
+
+    /**
+     * @brief Show the Yggdrasil nodes found on the LAN and pin them as
+     * private peers.
+     */
+    void onLanPeersClicked();
+
+    /**
+     * @brief Show the peer profiles manager, which saves the selected peers
+     * as a profile the tray can switch to.
+     */
+    void onProfilesClicked();
+
+    /**
+     * @brief Test the peers the user selects during a sweep first.
+     * @param selected Newly selected table cells.
+     */
+    void onSelectionChanged(const QItemSelection& selected);
+
+    /**
+     * @brief Test the fastest peers again on the new network.
+     */
+    void onNetworkChanged();
+
+    /**
+     * @brief Report the result of an ASN database import.
+     * @param success Whether the import succeeded.
+     * @param message Result description.
+     */
+    void onAsnDatabaseChanged(bool success, const QString& message);
+
 private:
     void setupUi();
     void setupConnections();
+    void startSweep(const QList<PeerData>& peers);
+    void startTestGraph(const QList<PeerData>& peers);
+    void passTestResult(const PeerData& peer);
     void stopTesting();
+    void finishTesting();
+    bool isTesting() const;
+    int testedPeers() const;
+    void showTestResult(const PeerData& peer);
+    void showPredictions(const QVector<int>& peers);
+    void setApplying(bool applying);
+    void setExperimenting(bool experimenting);
+    QList<PeerData> collectSelectedPeers() const;
+    bool prepareClose();
+    int transportsPerHost() const;
+    void startApplyJob(const QList<PeerData>& peers);
     void resetTableUI();
     void setRowColor(int row, bool isValid, bool isTested);
 
+    /**
+     * @brief Pass the uplink and probe rate settings to the peer manager and
+     * show a latency column for every swept uplink.
+     */
+    void applyProbeSettings();
+
+    /**
+     * @brief Show a latency column for each uplink after the fixed columns.
+     * @param uplinks Names of the uplinks.
+     */
+    void setUplinkColumns(const QStringList& uplinks);
+
+    /**
+     * @brief Set up the peer fetching and peer testing proxy from the
+     * settings.
+     */
+    void applyProxySettings();
+
     std::shared_ptr<QSettings> settings;
 
     PeerManager* peerManager;
+
+    /**
+     * @brief The running apply job, if any.
+     */
+    ApplyConfigJob* applyJob;
+
+    /**
+     * @brief Whether a live peer experiment is running.
+     */
+    bool isExperimenting;
+
+    /**
+     * @brief Peers being tried by the experiment.
+     */
+    QList<PeerData> experimentPeers;
+
     QPushButton* refreshButton;
     QPushButton* testButton;
     QPushButton* applyButton;
+
+    /**
+     * @brief A button that tries the selected peers live.
+     */
+    QPushButton* tryButton;
     QPushButton* exportButton;
     QPushButton* proxyButton;
 
@@ -143,13 +336,99 @@ private:
      */
     QPushButton* privatePeersButton;
 
+    /**
+     * @brief A button that opens the probe configuration.
+     */
+    QPushButton* probeSettingsButton;
+
+    /**
+     * @brief A button that opens the LAN peer discovery.
+     */
+    QPushButton* lanPeersButton;
+
+    /**
+     * @brief A button that opens the peer profiles manager.
+     */
+    QPushButton* profilesButton;
+
     QTableWidget* peerTable;
     QProgressBar* progressBar;
     QLabel* statusLabel;
     QList<PeerData> peerList;
-    int testedPeers;
-    int totalPeers;
-    bool isTesting;
+
+    /**
+     * @brief Index in peerList of each peer host.
+     */
+    QHash<QString, int> peerIndex;
+
+    /**
+     * @brief Host column item of each peer, indexed like peerList.  Used to
+     * find the current table row of a peer regardless of sorting.
+     */
+    QVector<QTableWidgetItem*> hostItems;
+
+    /**
+     * @brief Whether each peer was measured by the last sweep, indexed like
+     * peerList.  Untested peers show an estimate instead.
+     */
+    QVector<bool> measuredPeers;
+
+    /**
+     * @brief Indices in peerList of the peers in each neighbourhood of the
+     * latency predictor.
+     */
+    QHash<QString, QVector<int>> neighbourIndex;
+
+    /**
+     * @brief Latency samples of every tested peer, shown as sparklines.
+     * Kept across test runs and refreshes.
+     */
+    QHash<QString, LatencyHistory> latencyHistory;
+
+    /**
+     * @brief Uplinks shown in the columns after PeerTableColumnCount.
+     */
+    QStringList uplinkColumns;
+
+    /**
+     * @brief Batches peer test results into one UI update per frame.
+     */
+    UiUpdateCoalescer* uiCoalescer;
+
+    /**
+     * @brief The last peer test sweep: a "resolve" stage looks up the hosts
+     * and streams the peers into a "probe" stage that tests them, whose
+     * results stream into a "results" stage that shows them; a "select"
+     * stage then picks the peers to apply.  Null until the current peer
+     * list is tested.
+     */
+    TaskGraph* testGraph;
+    int resolveNode;
+    int probeNode;
+    int resultNode;
+    int selectNode;
+
+    /**
+     * @brief Number of peers tested by the last sweep.
+     */
+    int sweepSize;
+
+    /**
+     * @brief Hosts of the running sweep whose result did not arrive yet.
+     */
+    QSet<QString> sweepPending;
+
+    /**
+     * @brief Hosts of the running sweep that did not resolve, and are not
+     * probed.
+     */
+    QSet<QString> sweepUnresolved;
+
+    /**
+     * @brief Peers the select stage of the last sweep picked to apply.
+     */
+    QList<PeerData> sweepSelection;
+    bool debugMode;
 };
 
 #endif // PEERDISCOVERYDIALOG_H
@@ -0,0 +1,323 @@
+/**
+ * @file PeerExperiment.cpp
+ * @brief Implementation file for the PeerExperiment class.
+ */
+
+#include <algorithm>
+#include <QCoreApplication>
+#include <QDebug>
+#include <QHostAddress>
+#include <QThread>
+
+#include "PeerExperiment.h"
+#include "PeerManager.h"
+#include "SocketManager.h"
+
+// Message context of the outcome texts
+static const char* TR_CONTEXT = "PeerExperiment";
+
+/**
+ * @brief Constructor for PeerExperiment
+ * @param request Sends admin socket requests.
+ * @param measure Measures the reference targets.
+ * @param wait Waits for new peers to connect.
+ */
+PeerExperiment::PeerExperiment(AdminRequest request,
+                               Measurement measure,
+                               Wait wait)
+    : request(request)
+    , measure(measure)
+    , wait(wait)
+    , thresholdPercent(DEFAULT_THRESHOLD_PERCENT) {
+}
+
+/**
+ * @brief Get a human-readable description of a stage.
+ * @param stage The stage to describe.
+ */
+QString PeerExperiment::stageDescription(Stage stage) {
+    switch (stage) {
+    case NotStarted:
+        return QCoreApplication::translate(TR_CONTEXT, "Not started");
+    case MeasuringBaseline:
+        return QCoreApplication::translate(
+            TR_CONTEXT, "Measuring the current peers...");
+    case ApplyingCandidate:
+        return QCoreApplication::translate(
+            TR_CONTEXT, "Switching to the candidate peers...");
+    case MeasuringCandidate:
+        return QCoreApplication::translate(
+            TR_CONTEXT, "Measuring the candidate peers...");
+    case RollingBack:
+        return QCoreApplication::translate(
+            TR_CONTEXT, "Restoring the previous peers...");
+    case Finished:
+        return QCoreApplication::translate(TR_CONTEXT, "Finished");
+    }
+    return QString();
+}
+
+/**
+ * @brief Run the experiment; blocks until done.
+ * @param candidatePeers URIs of the peer set to try.
+ */
+PeerExperiment::Outcome PeerExperiment::run(const QStringList& candidatePeers) {
+    Outcome outcome;
+    outcome.candidatePeers = candidatePeers;
+    outcome.candidatePeers.removeDuplicates();
+    outcome.candidatePeers.sort();
+
+    setStage(MeasuringBaseline);
+    QJsonObject response = request({{"request", "getpeers"}});
+    if (response["status"].toString() != "success") {
+        outcome.message = QCoreApplication::translate(
+            TR_CONTEXT, "The admin socket is not available");
+        setStage(Finished);
+        return outcome;
+    }
+    // Inbound peers cannot be removed, and do not depend on the
+    // configuration anyway.
+    outcome.baselinePeers = SocketManager::outboundPeerUris(response);
+    outcome.baselinePeers.sort();
+
+    // The daemon may report a candidate under another URI than the one
+    // written to the configuration.
+    QStringList add;
+    QStringList remove;
+    for (const QString& uri : outcome.candidatePeers) {
+        if (! containsPeer(outcome.baselinePeers, uri)) {
+            add << uri;
+        }
+    }
+    for (const QString& uri : outcome.baselinePeers) {
+        if (! containsPeer(outcome.candidatePeers, uri)) {
+            remove << uri;
+        }
+    }
+    if (add.isEmpty() && remove.isEmpty()) {
+        outcome.message = QCoreApplication::translate(
+            TR_CONTEXT, "The candidate peers are connected already");
+        setStage(Finished);
+        return outcome;
+    }
+
+    QList<OverlayLatencyTest::TargetResult> results;
+    if (! measure(results)) {
+        outcome.message = QCoreApplication::translate(
+            TR_CONTEXT, "Failed to measure the reference targets");
+        setStage(Finished);
+        return outcome;
+    }
+    outcome.baseline = aggregate(results);
+
+    setStage(ApplyingCandidate);
+    QStringList added;
+    QStringList removed;
+    bool applied = changePeers(add, remove, &added, &removed);
+    if (applied) {
+        wait(SETTLE_MS);
+        setStage(MeasuringCandidate);
+        applied = measure(results);
+        outcome.candidate = aggregate(results);
+    }
+
+    if (applied) {
+        outcome.decision = decide(outcome.baseline,
+                                  outcome.candidate,
+                                  thresholdPercent);
+    }
+    if (outcome.decision == Committed) {
+        outcome.message = QCoreApplication::translate(
+            TR_CONTEXT, "The candidate peers are better and were kept");
+        qDebug() << "[PeerExperiment::run] Committed, average RTT"
+                 << outcome.baseline.averageRttUs << "->"
+                 << outcome.candidate.averageRttUs << "us";
+        setStage(Finished);
+        return outcome;
+    }
+
+    // Restore the baseline: add back what was removed, then remove what
+    // was added, so that the node is never left without peers.
+    setStage(RollingBack);
+    bool restored = changePeers(removed, added, nullptr, nullptr);
+    if (! applied) {
+        outcome.message = QCoreApplication::translate(
+            TR_CONTEXT, "Failed to try the candidate peers");
+    } else {
+        outcome.message = QCoreApplication::translate(
+            TR_CONTEXT, "The candidate peers are not better by %1%,"
+                        " the previous peers were restored")
+            .arg(thresholdPercent);
+    }
+    if (! restored) {
+        outcome.message += "\n" + QCoreApplication::translate(
+            TR_CONTEXT, "Some of the previous peers could not be restored;"
+                        " restart Yggdrasil to reload the configuration");
+    }
+    qDebug() << "[PeerExperiment::run]" << outcome.message;
+    setStage(Finished);
+    return outcome;
+}
+
+/**
+ * @brief Decide whether to keep the candidate.
+ * @param baseline Measurement with the baseline peers.
+ * @param candidate Measurement with the candidate peers.
+ * @param thresholdPercent Minimum RTT improvement, in percent.
+ */
+PeerExperiment::Decision PeerExperiment::decide(const Sample& baseline,
+                                                const Sample& candidate,
+                                                int thresholdPercent) {
+    if (candidate.received == 0) {
+        return RolledBack;
+    }
+    if (baseline.received == 0) {
+        return Committed;
+    }
+    if (candidate.lossPercent()
+        > baseline.lossPercent() + MAX_LOSS_INCREASE_PERCENT) {
+        return RolledBack;
+    }
+
+    qint64 improvement = (baseline.averageRttUs - candidate.averageRttUs)
+        * 100 / std::max<qint64>(1, baseline.averageRttUs);
+    return (improvement >= thresholdPercent) ? Committed : RolledBack;
+}
+
+/**
+ * @brief Combine the results of the targets into one sample.
+ * @param results Results of the reference targets.
+ * @details The round-trip times are weighted by the number of replies.
+ */
+PeerExperiment::Sample PeerExperiment::aggregate(
+    const QList<OverlayLatencyTest::TargetResult>& results) {
+    Sample sample;
+    qint64 totalRttUs = 0;
+    for (const OverlayLatencyTest::TargetResult& result : results) {
+        sample.sent += result.sent;
+        if ((result.received > 0) && (result.averageRttUs >= 0)) {
+            sample.received += result.received;
+            totalRttUs += result.averageRttUs * result.received;
+        }
+    }
+    if (sample.received > 0) {
+        sample.averageRttUs = totalRttUs / sample.received;
+    }
+    return sample;
+}
+
+/**
+ * @brief Add and remove peers through the admin socket.
+ * @param add URIs of the peers to add, added first.
+ * @param remove URIs of the peers to remove.
+ * @param added Receives the peers that were added, or nullptr.
+ * @param removed Receives the peers that were removed, or nullptr.
+ * @return false if a request failed; the changes made before are kept.
+ */
+bool PeerExperiment::changePeers(const QStringList& add,
+                                 const QStringList& remove,
+                                 QStringList* added,
+                                 QStringList* removed) {
+    bool success = true;
+    for (const QString& uri : add) {
+        if (! sendPeerRequest("addpeer", uri)) {
+            // Keep going when restoring, stop when trying the candidate.
+            success = false;
+            if (added) {
+                return false;
+            }
+        } else if (added) {
+            *added << uri;
+        }
+    }
+    for (const QString& uri : remove) {
+        if (! sendPeerRequest("removepeer", uri)) {
+            success = false;
+            if (removed) {
+                return false;
+            }
+        } else if (removed) {
+            *removed << uri;
+        }
+    }
+    return success;
+}
+
+/**
+ * @brief Send an "addpeer" or "removepeer" request.
+ * @param name The request name.
+ * @param uri The peer URI.
+ * @return true if the daemon reported success.
+ */
+bool PeerExperiment::sendPeerRequest(const QString& name,
+                                     const QString& uri) {
+    QJsonObject arguments {{"uri", uri}};
+    QJsonObject response = request({{"request", name},
+                                    {"arguments", arguments}});
+    bool success = (response["status"].toString() == "success");
+    qDebug() << "[PeerExperiment::sendPeerRequest]" << name << uri
+             << (success ? "succeeded" : "failed");
+    return success;
+}
+
+/**
+ * @brief Enter a stage and report it.
+ * @param stage The new stage.
+ */
+void PeerExperiment::setStage(Stage stage) {
+    qDebug() << "[PeerExperiment::setStage]" << stageDescription(stage);
+    if (stageCallback) {
+        stageCallback(stage);
+    }
+}
+
+/**
+ * @brief Constructor for PeerExperimentRunnable
+ * @param candidatePeers URIs of the peer set to try.
+ * @param targets Reference Yggdrasil addresses.
+ * @param windowMs Measurement window per peer set.
+ * @param thresholdPercent Improvement needed to keep the candidate.
+ */
+PeerExperimentRunnable::PeerExperimentRunnable(
+    const QStringList& candidatePeers,
+    const QStringList& targets,
+    int windowMs,
+    int thresholdPercent)
+    : candidatePeers(candidatePeers)
+    , targets(targets)
+    , windowMs(windowMs)
+    , thresholdPercent(thresholdPercent) {
+    qRegisterMetaType<PeerExperiment::Outcome>("PeerExperiment::Outcome");
+    setAutoDelete(true);
+}
+
+/**
+ * @brief Run the experiment against the admin socket.
+ */
+void PeerExperimentRunnable::run() {
+    SocketManager socketManager(SocketManager::defaultSocketPaths());
+    QList<QHostAddress> addresses;
+    for (const QString& target : targets) {
+        addresses << QHostAddress(target);
+    }
+    // Spread the echo requests over the whole window.
+    int echoCount = std::max(1,
+                             windowMs / OverlayLatencyTest::ECHO_INTERVAL_MS);
+
+    PeerExperiment experiment(
+        [&socketManager](const QJsonObject& request) {
+            return socketManager.sendRequest(request);
+        },
+        [&](QList<OverlayLatencyTest::TargetResult>& results) {
+            return OverlayLatencyTest::measure(
+                addresses, echoCount,
+                OverlayLatencyTest::ECHO_INTERVAL_MS, results);
+        },
+        [](int ms) { QThread::msleep(ms); });
+    experiment.setThresholdPercent(thresholdPercent);
+    experiment.setStageCallback([this](PeerExperiment::Stage stage) {
+        emit stageChanged(stage, PeerExperiment::stageDescription(stage));
+    });
+
+    emit finished(experiment.run(candidatePeers));
+}
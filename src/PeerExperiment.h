@@ -0,0 +1,216 @@
+/**
+ * @file PeerExperiment.h
+ * @brief Header file for the PeerExperiment class.
+ *
+ * Tries a candidate peer set live and keeps it only if the overlay improves.
+ */
+
+#ifndef PEEREXPERIMENT_H
+#define PEEREXPERIMENT_H
+
+#include <functional>
+#include <QJsonObject>
+#include <QList>
+#include <QMetaType>
+#include <QObject>
+#include <QRunnable>
+#include <QString>
+#include <QStringList>
+
+#include "OverlayLatencyTest.h"
+
+/**
+ * @class PeerExperiment
+ * @brief A/B experiment between the connected peers and a candidate set.
+ *
+ * @details Changing peers gives no evidence whether the overlay got better.
+ *          The experiment goes through the following stages:
+ *
+ *          1. MeasuringBaseline  - measure the overlay latency and loss to
+ *                                  the reference targets with the peers
+ *                                  that are connected now;
+ *          2. ApplyingCandidate  - add and remove peers through the admin
+ *                                  socket ("addpeer"/"removepeer"), which
+ *                                  changes the running daemon only;
+ *          3. MeasuringCandidate - repeat the same measurement once the new
+ *                                  peers had time to connect;
+ *          4. RollingBack        - restore the baseline peers if the
+ *                                  candidate is not better by the threshold.
+ *
+ *          The candidate is committed when its average round-trip time is
+ *          at least thresholdPercent lower than that of the baseline and it
+ *          does not lose more than MAX_LOSS_INCREASE_PERCENT more requests.
+ *          A committed set is live only; the caller persists it with
+ *          ApplyConfigJob.
+ *
+ *          The admin socket requests, the measurement and the waiting are
+ *          passed in, so that run() blocks and must be called from a worker
+ *          thread.
+ */
+class PeerExperiment {
+public:
+    enum Stage {
+        NotStarted,
+        MeasuringBaseline,
+        ApplyingCandidate,
+        MeasuringCandidate,
+        RollingBack,
+        Finished
+    };
+
+    enum Decision {
+        Committed,  ///< The candidate is better and stays applied
+        RolledBack, ///< The baseline peers were restored
+        Failed      ///< The experiment could not be run
+    };
+
+    /**
+     * @brief Overlay latency and loss measured with one peer set.
+     */
+    struct Sample {
+        int sent = 0;
+        int received = 0;
+        // Average round-trip time over all replies, or -1 without replies
+        qint64 averageRttUs = -1;
+
+        /**
+         * @brief Get the share of lost requests, 0 to 100.
+         */
+        int lossPercent() const {
+            return (sent > 0) ? (sent - received) * 100 / sent : 100;
+        }
+    };
+
+    /**
+     * @brief Result of an experiment.
+     */
+    struct Outcome {
+        Decision decision = Failed;
+        QStringList baselinePeers;
+        QStringList candidatePeers;
+        Sample baseline;
+        Sample candidate;
+        QString message;
+    };
+
+    // Sends an admin socket request and returns the response
+    using AdminRequest = std::function<QJsonObject(const QJsonObject&)>;
+    // Measures the reference targets over the experiment window
+    using Measurement
+        = std::function<bool(QList<OverlayLatencyTest::TargetResult>&)>;
+    // Waits for the given number of milliseconds
+    using Wait = std::function<void(int)>;
+    // Receives the stage the experiment enters
+    using StageCallback = std::function<void(Stage)>;
+
+    // Improvement of the average RTT needed to keep the candidate
+    static constexpr int DEFAULT_THRESHOLD_PERCENT = 10;
+    // Measurement window per peer set
+    static constexpr int DEFAULT_WINDOW_MS = 30000;
+    // Time new peers get to connect before the candidate is measured
+    static constexpr int SETTLE_MS = 5000;
+    // Loss the candidate may add over the baseline and still be kept
+    static constexpr int MAX_LOSS_INCREASE_PERCENT = 5;
+
+    /**
+     * @brief Constructor for PeerExperiment
+     * @param request Sends admin socket requests.
+     * @param measure Measures the reference targets.
+     * @param wait Waits for new peers to connect.
+     */
+    PeerExperiment(AdminRequest request, Measurement measure, Wait wait);
+
+    /**
+     * @brief Set the improvement needed to commit the candidate.
+     * @param percent Minimum RTT improvement over the baseline, in percent.
+     */
+    void setThresholdPercent(int percent) { thresholdPercent = percent; }
+
+    /**
+     * @brief Set a callback for the stages of the experiment.
+     * @param callback Called from the thread running the experiment.
+     */
+    void setStageCallback(StageCallback callback) {
+        stageCallback = callback;
+    }
+
+    /**
+     * @brief Run the experiment; blocks until done.
+     * @param candidatePeers URIs of the peer set to try.
+     */
+    Outcome run(const QStringList& candidatePeers);
+
+    /**
+     * @brief Decide whether to keep the candidate.
+     * @param baseline Measurement with the baseline peers.
+     * @param candidate Measurement with the candidate peers.
+     * @param thresholdPercent Minimum RTT improvement, in percent.
+     */
+    static Decision decide(const Sample& baseline,
+                           const Sample& candidate,
+                           int thresholdPercent);
+
+    /**
+     * @brief Combine the results of the targets into one sample.
+     * @param results Results of the reference targets.
+     */
+    static Sample aggregate(
+        const QList<OverlayLatencyTest::TargetResult>& results);
+
+    /**
+     * @brief Get a human-readable description of a stage.
+     * @param stage The stage to describe.
+     */
+    static QString stageDescription(Stage stage);
+
+private:
+    bool changePeers(const QStringList& add,
+                     const QStringList& remove,
+                     QStringList* added,
+                     QStringList* removed);
+    bool sendPeerRequest(const QString& request, const QString& uri);
+    void setStage(Stage stage);
+
+    AdminRequest request;
+    Measurement measure;
+    Wait wait;
+    StageCallback stageCallback;
+    int thresholdPercent;
+};
+
+Q_DECLARE_METATYPE(PeerExperiment::Outcome)
+
+/**
+ * @class PeerExperimentRunnable
+ * @brief Runs a PeerExperiment against the admin socket on a thread pool.
+ */
+class PeerExperimentRunnable : public QObject, public QRunnable {
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Constructor for PeerExperimentRunnable
+     * @param candidatePeers URIs of the peer set to try.
+     * @param targets Reference Yggdrasil addresses.
+     * @param windowMs Measurement window per peer set.
+     * @param thresholdPercent Improvement needed to keep the candidate.
+     */
+    PeerExperimentRunnable(const QStringList& candidatePeers,
+                           const QStringList& targets,
+                           int windowMs,
+                           int thresholdPercent);
+
+    void run() override;
+
+signals:
+    void stageChanged(int stage, const QString& description);
+    void finished(const PeerExperiment::Outcome& outcome);
+
+private:
+    QStringList candidatePeers;
+    QStringList targets;
+    int windowMs;
+    int thresholdPercent;
+};
+
+#endif // PEEREXPERIMENT_H
@@ -5,24 +5,40 @@
  * Contains implementation of methods for managing Yggdrasil peers.
  */
 
+#include <algorithm>
 #include <memory>
+#include <vector>
+#include <QDateTime>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QFile>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QNetworkInterface>
+#include <QNetworkProxy>
 #include <QProcess>
 #include <QRegularExpression>
 #include <QSettings>
-#include <QTemporaryFile>
+#include <QSslSocket>
+#include <QTcpSocket>
 #include <QTextStream>
-#include <QThreadPool>
+#include <QTimer>
+#include <QUdpSocket>
+#include <QUrl>
+#include <QUrlQuery>
 
+#include "Executor.h"
+#include "IcmpProber.h"
 #include "PeerManager.h"
 
-static const QString SCRIPT_PATH = "/tmp/yggtray-update-peers.sh";
-static const QString POLICY_PATH = "/tmp/org.yggtray.updatepeers.policy";
-
 bool isPeerUriValid(const QString& peerUri) {
+    // Link-local peers on the LAN carry the zone of their interface,
+    // percent-encoded, and may pin the public key of the node.
     static const QRegularExpression re(
-        "^(?:tls|tcp|quic)://(?:\\[[A-Fa-f0-9:.]+\\]|[A-Za-z0-9.-]+):\\d+$"
+        "^(?:tls|tcp|quic)://"
+        "(?:\\[[A-Fa-f0-9:.]+(?:%25[A-Za-z0-9_.-]+)?\\]|[A-Za-z0-9.-]+)"
+        ":\\d+"
+        "(?:\\?(?:sni=[A-Za-z0-9.-]+|key=[A-Fa-f0-9]{64}))?$"
     );
     return re.match(peerUri.trimmed()).hasMatch();
 }
@@ -31,151 +47,743 @@ bool isPeerUriValid(const QString& peerUri) {
  * @brief Constructor for PeerTestRunnable
  * @param peer The peer data to test.
  * @param cancelFlag Pointer to the shared cancellation flag.
+ * @param probeInterface Interface or source address to probe from, or an
+ * empty string for the default route.
+ * @param sweepUplinks Further uplinks to probe in parallel.
+ * @param icmpProber Prober shared with the other tests of the sweep, or
+ * nullptr.
  * @param parent Optional QObject parent.
  */
-PeerTestRunnable::PeerTestRunnable(PeerData peer, QAtomicInt* cancelFlag, QObject *parent)
-    : QObject(parent), QRunnable(), peerData(peer), cancelFlagPtr(cancelFlag) {
+PeerTestRunnable::PeerTestRunnable(PeerData peer,
+                                   QAtomicInt* cancelFlag,
+                                   const QString& probeInterface,
+                                   const QStringList& sweepUplinks,
+                                   const ProbeTimeouts* timeouts,
+                                   std::shared_ptr<const AsnDatabase>
+                                       asnDatabase,
+                                   std::shared_ptr<SharedIcmpProber>
+                                       icmpProber,
+                                   QObject *parent)
+    : QObject(parent)
+    , QRunnable()
+    , peerData(peer)
+    , cancelFlagPtr(cancelFlag)
+    , probeInterface(probeInterface)
+    , sweepUplinks(sweepUplinks)
+    , timeouts(timeouts)
+    , asnDatabase(asnDatabase)
+    , icmpProber(icmpProber) {
     setAutoDelete(true);
 }
 
+/**
+ * @brief Extract the host to ping from a peer URI.
+ * @param peerUri The peer URI.
+ * @return Hostname or IP address without brackets and port.
+ */
+QString pingHost(const QString& peerUri) {
+    QString host = peerUri;
+    if (host.contains("://")) {
+        host = host.split("://").last();
+    }
+    if (host.contains("]:")) { // IPv6 with port
+        // Get content inside [], with the zone decoded
+        host = host.section(']', 0, 0).mid(1).replace("%25", "%");
+    } else if (host.contains(':')) { // IPv4 with port
+        host = host.section(':', 0, 0);
+    }
+    return host;
+}
+
+/**
+ * @brief Identify the host behind a peer URI, whatever its transport.
+ * @param peerUri The peer URI.
+ * @return The lowercase hostname or IP address, with the zone of a
+ * link-local address.
+ * @details A hostname and an address it resolves to count as different
+ * hosts.
+ */
+QString peerHostIdentity(const QString& peerUri) {
+    return pingHost(peerUri.trimmed().section('?', 0, 0)).toLower();
+}
+
+/**
+ * @brief Extract the port from a peer URI.
+ * @param peerUri The peer URI.
+ * @return The port, or -1 if the URI has none.
+ */
+int peerPort(const QString& peerUri) {
+    static const QRegularExpression re(":(\\d+)(?:\\?.*)?$");
+    auto match = re.match(peerUri.trimmed());
+    if (! match.hasMatch()) {
+        return -1;
+    }
+    bool ok;
+    int port = match.captured(1).toInt(&ok);
+    return (ok && (port > 0) && (port <= 65535)) ? port : -1;
+}
+
+/**
+ * @brief Parse the average round-trip time from ping output.
+ * @param output Standard output of a successful ping run.
+ * @return Latency in whole milliseconds (at least 1), or -1 if the output
+ * has no usable round-trip statistics.
+ */
+int parsePingLatency(const QString& output) {
+    static const QRegularExpression rx(
+        "min/avg/max(?:/mdev)? = [\\d.]+/([\\d.]+)/[\\d.]+");
+    auto match = rx.match(output);
+    if (! match.hasMatch()) {
+        return -1;
+    }
+    bool ok;
+    double latency = match.captured(1).toDouble(&ok);
+    if ((! ok) || (latency <= 0.0)) {
+        return -1;
+    }
+    // Round to integer milliseconds with minimum of 1ms
+    return std::max(1, static_cast<int>(latency + 0.5));
+}
+
+/**
+ * @brief A single ping run by PeerTestRunnable.
+ */
+struct PingJob {
+    std::unique_ptr<QProcess> process;
+    QHostAddress target;
+    // Interface or source address to ping from; empty for the default route
+    QString uplink;
+    // Output read so far
+    QByteArray output;
+};
+
+/**
+ * @brief Stop a running ping process.
+ * @param process The ping process.
+ */
+static void stopPing(QProcess& process) {
+    if (process.state() == QProcess::NotRunning) {
+        return;
+    }
+    process.terminate();
+    if (! process.waitForFinished(500)) {
+        qDebug() << "[PeerTestRunnable::run]"
+                 << "Ping terminate failed, killing process for:"
+                 << process.arguments().last();
+        process.kill();
+        process.waitForFinished(100);
+    }
+}
+
+/**
+ * @brief Resolve the addresses to probe for a host.
+ * @param host Hostname or IP address literal.
+ * @return The literal itself, or the first IPv4 and the first IPv6 address
+ * the hostname resolves to.
+ * @details Runs a blocking lookup, so it must be called from a worker thread.
+ */
+QList<QHostAddress> PeerTestRunnable::resolveTargets(const QString& host) {
+    QList<QHostAddress> targets;
+    QHostAddress literal;
+    if (literal.setAddress(host)) {
+        targets << literal;
+        return targets;
+    }
+
+    QHostInfo info = QHostInfo::fromName(host);
+    if (info.error() != QHostInfo::NoError) {
+        qDebug() << "[PeerTestRunnable::resolveTargets] Failed to resolve"
+                 << host << "-" << info.errorString();
+        return targets;
+    }
+    return probeTargets(info.addresses());
+}
+
+/**
+ * @brief Pick the addresses to probe among those of a host.
+ * @param addresses The addresses the host resolved to.
+ * @return The first IPv4 and the first IPv6 address.
+ */
+QList<QHostAddress> PeerTestRunnable::probeTargets(
+    const QList<QHostAddress>& addresses) {
+    QList<QHostAddress> targets;
+    bool haveIPv4 = false;
+    bool haveIPv6 = false;
+    for (const QHostAddress& address : addresses) {
+        if ((address.protocol() == QAbstractSocket::IPv4Protocol)
+            && (! haveIPv4)) {
+            targets << address;
+            haveIPv4 = true;
+        } else if ((address.protocol() == QAbstractSocket::IPv6Protocol)
+                   && (! haveIPv6)) {
+            targets << address;
+            haveIPv6 = true;
+        }
+    }
+    return targets;
+}
+
+/**
+ * @brief Combine the per-family latencies of a peer.
+ * @param peer The peer with the per-family latencies set.
+ * @param dualStack Whether the peer is a hostname with both an IPv4 and an
+ * IPv6 address.
+ * @param addressIPv4 The probed IPv4 address.
+ * @param addressIPv6 The probed IPv6 address.
+ * @details The peer latency is the one of the faster family.  A dual-stack
+ * peer gets a preferred address when only one family works, or when one
+ * family is faster than the other by more than FAMILY_MARGIN_PERCENT.
+ */
+void PeerTestRunnable::applyFamilyResults(PeerData& peer,
+                                          bool dualStack,
+                                          const QString& addressIPv4,
+                                          const QString& addressIPv6) {
+    int v4 = peer.latencyIPv4();
+    int v6 = peer.latencyIPv6();
+    bool useIPv6 = (v6 > 0) && ((v4 <= 0) || (v6 <= v4));
+    int best = useIPv6 ? v6 : v4;
+
+    peer.setLatency(best > 0 ? best : -1);
+    peer.setValid(best > 0);
+    peer.setPreferredAddress(QString());
+
+    if (dualStack && (best > 0)) {
+        int other = useIPv6 ? v4 : v6;
+        if ((other <= 0)
+            || (best * (100 + FAMILY_MARGIN_PERCENT) < other * 100)) {
+            peer.setPreferredAddress(useIPv6 ? addressIPv6 : addressIPv4);
+        }
+    }
+}
+
+/**
+ * @brief Microseconds since a timer was started, at least 1.
+ */
+static qint64 elapsedUs(const QElapsedTimer& timer) {
+    return std::max<qint64>(1, timer.nsecsElapsed() / 1000);
+}
+
+/**
+ * @brief Time the TCP handshake to an endpoint.
+ * @return Microseconds, or -1 if the endpoint did not accept.
+ */
+static qint64 measureTcpHandshake(const QHostAddress& address,
+                                  quint16 port,
+                                  int timeoutMs) {
+    QTcpSocket socket;
+    socket.setProxy(QNetworkProxy::NoProxy);
+    QElapsedTimer timer;
+    timer.start();
+    socket.connectToHost(address, port);
+    if (! socket.waitForConnected(timeoutMs)) {
+        return -1;
+    }
+    qint64 us = elapsedUs(timer);
+    socket.abort();
+    return us;
+}
+
+/**
+ * @brief Time the TCP and TLS handshakes to an endpoint.
+ * @param peerName Name sent as SNI, or an empty string for none.
+ * @return Microseconds, or -1 if the handshake did not complete.
+ * @details Yggdrasil nodes present self-signed certificates, so the
+ * certificate is not verified; only the time counts.
+ */
+static qint64 measureTlsHandshake(const QHostAddress& address,
+                                  quint16 port,
+                                  const QString& peerName,
+                                  int timeoutMs) {
+#ifndef QT_NO_SSL
+    QSslSocket socket;
+    socket.setProxy(QNetworkProxy::NoProxy);
+    socket.setPeerVerifyMode(QSslSocket::VerifyNone);
+    QElapsedTimer timer;
+    timer.start();
+    socket.connectToHostEncrypted(address.toString(), port, peerName);
+    if (! socket.waitForEncrypted(timeoutMs)) {
+        return -1;
+    }
+    qint64 us = elapsedUs(timer);
+    socket.abort();
+    return us;
+#else
+    Q_UNUSED(peerName);
+    return measureTcpHandshake(address, port, timeoutMs);
+#endif
+}
+
+/**
+ * @brief Time a QUIC version negotiation round trip to an endpoint.
+ * @return Microseconds, or -1 if the endpoint did not answer.
+ * @details Sends a long header packet with a reserved version, which a
+ * QUIC server answers with the versions it supports (RFC 9000, section
+ * 6).  Nothing else answers it, so a reply shows that the port speaks QUIC.
+ */
+static qint64 measureQuicHandshake(const QHostAddress& address,
+                                   quint16 port,
+                                   int timeoutMs) {
+    // Long header, version 0x1a2a3a4a of the 0x?a?a?a?a range reserved for
+    // forcing version negotiation, and 8-byte connection IDs
+    static const char header[] = "\xc0\x1a\x2a\x3a\x4a"
+                                 "\x08yggtray!"
+                                 "\x08yggtray?";
+    const int headerSize = static_cast<int>(sizeof(header) - 1);
+    QByteArray packet(PeerTestRunnable::QUIC_PROBE_SIZE, '\0');
+    packet.replace(0, headerSize, header, headerSize);
+
+    QUdpSocket socket;
+    socket.setProxy(QNetworkProxy::NoProxy);
+    socket.connectToHost(address, port);
+    if (! socket.waitForConnected(timeoutMs)) {
+        return -1;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    if (socket.write(packet) != packet.size()) {
+        return -1;
+    }
+    while (timer.elapsed() < timeoutMs) {
+        int remaining = static_cast<int>(timeoutMs - timer.elapsed());
+        if (! socket.waitForReadyRead(std::max(1, remaining))) {
+            return -1;
+        }
+        while (socket.hasPendingDatagrams()) {
+            QByteArray datagram(
+                static_cast<int>(std::max<qint64>(
+                    0, socket.pendingDatagramSize())),
+                '\0');
+            if (socket.readDatagram(datagram.data(), datagram.size()) < 0) {
+                return -1;
+            }
+            if (PeerTestRunnable::isVersionNegotiation(datagram)) {
+                return elapsedUs(timer);
+            }
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Time the transport handshake of a peer endpoint; blocks.
+ * @param peerUri The peer URI.
+ * @param address The address the host of the URI resolved to.
+ * @param timeoutMs Time the handshake may take.
+ * @return Microseconds, or -1 if the endpoint did not answer or its
+ * transport cannot be probed.
+ */
+qint64 PeerTestRunnable::measureTransport(const QString& peerUri,
+                                          const QHostAddress& address,
+                                          int timeoutMs) {
+    int peerPortNumber = peerPort(peerUri);
+    if ((peerPortNumber < 0) || address.isNull()) {
+        return -1;
+    }
+    quint16 port = static_cast<quint16>(peerPortNumber);
+    QUrl url(peerUri.trimmed());
+    QString scheme = url.scheme().toLower();
+    if (scheme == "tcp") {
+        return measureTcpHandshake(address, port, timeoutMs);
+    }
+    if (scheme == "tls") {
+        // Send the SNI the node would get from Yggdrasil: the sni
+        // parameter, or else the hostname of the URI.
+        QString peerName = QUrlQuery(url).queryItemValue("sni");
+        QHostAddress literal;
+        if (peerName.isEmpty() && (! literal.setAddress(url.host()))) {
+            peerName = url.host();
+        }
+        return measureTlsHandshake(address, port, peerName, timeoutMs);
+    }
+    if (scheme == "quic") {
+        return measureQuicHandshake(address, port, timeoutMs);
+    }
+    return -1;
+}
+
+/**
+ * @brief Check whether a datagram is a QUIC version negotiation packet.
+ * @param datagram The datagram.
+ * @details A version negotiation packet has the long header form bit set
+ * and version 0, followed by the connection IDs and at least one version.
+ */
+bool PeerTestRunnable::isVersionNegotiation(const QByteArray& datagram) {
+    if ((datagram.size() < 7) || (! (datagram[0] & 0x80))) {
+        return false;
+    }
+    for (int i = 1; i <= 4; ++i) {
+        if (datagram[i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 /**
  * @brief The main execution method for the runnable task.
- * @details Overrides QRunnable::run(). Performs the ping test.
+ * @details Overrides QRunnable::run(). Pings every address family of the
+ * peer concurrently and records the latency of each of them.  With uplinks
+ * to sweep, every family is pinged through each of them at the same time
+ * as well.  Echo requests are sent from ICMP datagram sockets where the
+ * system allows that, and by the ping command otherwise.
  */
 void PeerTestRunnable::run() {
-    if (cancelFlagPtr && cancelFlagPtr->loadAcquire()) {
+    if (isCancelled()) {
         qDebug() << "[PeerTestRunnable::run] Skipping test for:"
-                 << peerData.host
+                 << peerData.host()
                  << "(cancelled before start)";
         return;
     }
 
     qDebug() << "[PeerTestRunnable::run] Starting test for:"
-             << peerData.host << "on thread" << QThread::currentThreadId();
-
-    QProcess pingProcess;
-    QStringList args;
-    QString hostToPing = peerData.host;
-    if (hostToPing.contains("://")) {
-        hostToPing = hostToPing.split("://").last();
-    }
-    if (hostToPing.contains("]:")) { // IPv6 with port
-        // Get content inside []
-        hostToPing = hostToPing.section(']', 0, 0).mid(1);
-    } else if (hostToPing.contains(':')) { // IPv4 with port
-        hostToPing = hostToPing.section(':', 0, 0);
-    }
-
-    args << "-c" << QString::number(PING_COUNT) << hostToPing;
-
-    qDebug() << "[PeerTestRunnable::run] Running ping command - host:"
-             << hostToPing << "args:" << args;
-    pingProcess.start("ping", args);
-
-    int timeoutRemaining = PING_TIMEOUT_MS;
-
-    // Loop while waiting for the process to finish, checking for cancellation
-    while (!pingProcess.waitForFinished(CHECK_INTERVAL_MS)) {
-        if (cancelFlagPtr && cancelFlagPtr->loadAcquire()) {
-            qDebug() << "[PeerTestRunnable::run] Ping cancelled for:" << peerData.host;
-            if (pingProcess.state() == QProcess::Running) {
-                pingProcess.terminate();
-                if (!pingProcess.waitForFinished(500)) {
-                    qDebug() << "[PeerTestRunnable::run]"
-                             << "Ping terminate failed, killing process for:"
-                             << peerData.host;
-                    pingProcess.kill();
-                    pingProcess.waitForFinished(100);
-                }
-            }
-            return;
-        }
+             << peerData.host() << "on thread" << QThread::currentThreadId();
+
+    peerData.setLatency(-1);
+    peerData.setValid(false);
+    peerData.setLatencyIPv4(-1);
+    peerData.setLatencyIPv6(-1);
+    peerData.setPreferredAddress(QString());
+    peerData.clearUplinkLatencies();
+    peerData.setPreciseLatencyUs(-1);
+    peerData.setLatencySource(PeerData::NotMeasured);
+    peerData.setTransportLatencyUs(-1);
+
+    // Sweeps resolve the hosts ahead of the tests; single tests and peers
+    // without addresses resolve here.
+    QList<QHostAddress> targets;
+    for (const QString& address : peerData.probeAddresses()) {
+        targets << QHostAddress(address);
+    }
+    peerData.setProbeAddresses(QStringList());
+    if (targets.isEmpty()) {
+        targets = resolveTargets(pingHost(peerData.host()));
+    }
+    if (targets.isEmpty()) {
+        qDebug() << "[PeerTestRunnable::run] No address to ping for:"
+                 << peerData.host();
+        emit peerTested(peerData);
+        return;
+    }
 
-        timeoutRemaining -= CHECK_INTERVAL_MS;
-        if (timeoutRemaining <= 0) {
-            qDebug() << "[PeerTestRunnable::run]"
-                     << "Ping timeout after"
-                     << PING_TIMEOUT_MS
-                     << "ms for:" << peerData.host;
-            if (pingProcess.state() == QProcess::Running) {
-                pingProcess.terminate();
-                 if (!pingProcess.waitForFinished(500)) {
-                    qDebug() << "[PeerTestRunnable::run]"
-                             << "Ping terminate failed on timeout, killing process for:"
-                             << peerData.host;
-                    pingProcess.kill();
-                    pingProcess.waitForFinished(100);
-                 }
-            }
-            emit peerTested(peerData);
-            return;
+    // Probe every address family through every uplink at the same time.
+    // The probe interface (or the default route) goes first and determines
+    // the peer latency.
+    QStringList uplinks;
+    uplinks << probeInterface;
+    for (const QString& uplink : sweepUplinks) {
+        if ((! uplink.isEmpty()) && (! uplinks.contains(uplink))) {
+            uplinks << uplink;
         }
     }
 
-    if (cancelFlagPtr && cancelFlagPtr->loadAcquire()) {
+    std::vector<ProbeOutcome> outcomes;
+    ProbeStatus status = probeNative(targets, uplinks, outcomes);
+    if (status == ProbeUnavailable) {
+        outcomes.clear();
+        status = probePingCommand(targets, uplinks, outcomes);
+    }
+    if ((status == ProbeCancelled) || isCancelled()) {
         qDebug() << "[PeerTestRunnable::run]"
-                 << "Test cancelled after ping completion for:"
-                 << peerData.host;
+                 << "Test cancelled for:" << peerData.host();
         return;
     }
 
-    // Process results only if not cancelled and process finished normally
-    if ((pingProcess.exitStatus() == QProcess::NormalExit)
-        && (pingProcess.exitCode() == 0)) {
-        QString output = pingProcess.readAllStandardOutput();
-        QRegularExpression rx("min/avg/max(?:/mdev)? = [\\d.]+/([\\d.]+)/[\\d.]+");
-        auto match = rx.match(output);
-        qDebug() << "[PeerTestRunnable::run] Ping output for:"
-                 << peerData.host << "-" << output.trimmed();
-        if (match.hasMatch()) {
-            bool ok;
-            double latency = match.captured(1).toDouble(&ok);
-            if (ok) {
-                if (latency <= 0.0) {
-                    qDebug() << "[PeerTestRunnable::run]"
-                             << "Invalid zero or negative latency for:"
-                             << peerData.host;
-                    peerData.latency = -1;
-                    peerData.isValid = false;
-                } else {
-                    // Round to integer milliseconds with minimum of 1ms
-                    peerData.latency
-                        = std::max(1, static_cast<int>(latency + 0.5));
-                    peerData.isValid = true;
-                    qDebug() << "[PeerTestRunnable::run] Latency for:"
-                             << peerData.host << "-"
-                             << peerData.latency << "ms";
-                }
-            } else {
-                qDebug() << "[PeerTestRunnable::run]"
-                         << "Failed to parse latency double for:"
-                         << peerData.host;
-                peerData.isValid = false;
-                peerData.latency = -1;
+    QString addressIPv4;
+    QString addressIPv6;
+    const ProbeOutcome* outcomeIPv4 = nullptr;
+    const ProbeOutcome* outcomeIPv6 = nullptr;
+    for (const ProbeOutcome& outcome : outcomes) {
+        if (! outcome.uplink.isEmpty()) {
+            // The latency through an uplink is the one of its faster family.
+            int previous = peerData.uplinkLatency(outcome.uplink);
+            if ((outcome.latency > 0)
+                && ((previous <= 0) || (outcome.latency < previous))) {
+                peerData.setUplinkLatency(outcome.uplink, outcome.latency);
+            } else if (previous <= 0) {
+                peerData.setUplinkLatency(outcome.uplink, -1);
             }
+        }
+
+        if (outcome.uplink != probeInterface) {
+            continue;
+        }
+        if (outcome.target.protocol() == QAbstractSocket::IPv6Protocol) {
+            peerData.setLatencyIPv6(outcome.latency);
+            addressIPv6 = outcome.target.toString();
+            outcomeIPv6 = &outcome;
         } else {
-            qDebug() << "[PeerTestRunnable::run]"
-                     << "No latency match in ping output for:"
-                     << peerData.host;
-            peerData.isValid = false;
+            peerData.setLatencyIPv4(outcome.latency);
+            addressIPv4 = outcome.target.toString();
+            outcomeIPv4 = &outcome;
         }
-    } else {
-            qDebug() << "[PeerTestRunnable::run]"
-                     << "Ping process failed or exited abnormally for:"
-                     << peerData.host
-                     << "ExitCode:" << pingProcess.exitCode()
-                     << "ExitStatus:" << pingProcess.exitStatus();
-         peerData.isValid = false;
+    }
+
+    bool dualStack = (targets.size() > 1);
+    applyFamilyResults(peerData, dualStack, addressIPv4, addressIPv6);
+
+    // Keep the precision and the source of the chosen family's latency.
+    const ProbeOutcome* chosen = nullptr;
+    if (peerData.isValid()) {
+        chosen = (outcomeIPv6 && (outcomeIPv6->latency == peerData.latency()))
+            ? outcomeIPv6 : outcomeIPv4;
+    }
+    if (chosen) {
+        peerData.setPreciseLatencyUs(chosen->latencyUs);
+        peerData.setLatencySource(chosen->source);
+    }
+    if (asnDatabase) {
+        peerData.setAsn(asnDatabase->lookup(
+            chosen ? chosen->target : targets.first()).asn);
+    }
+
+    // The ping only tells how far the host is; the handshake tells the
+    // endpoints of the host apart.
+    if (chosen && (! isCancelled())) {
+        peerData.setTransportLatencyUs(measureTransport(
+            peerData.host(), chosen->target, TRANSPORT_TIMEOUT_MS));
     }
 
     qDebug() << "[PeerTestRunnable::run]"
         << "Emitting peerTested signal - host:"
-        << peerData.host
-        << "isValid:" << peerData.isValid
-        << "latency:" << peerData.latency;
+        << peerData.host()
+        << "isValid:" << peerData.isValid()
+        << "latency:" << peerData.latency()
+        << "us:" << peerData.preciseLatencyUs()
+        << "source:" << peerData.latencySource()
+        << "transport us:" << peerData.transportLatencyUs()
+        << "IPv4:" << peerData.latencyIPv4()
+        << "IPv6:" << peerData.latencyIPv6()
+        << "preferred:" << peerData.preferredAddress();
     emit peerTested(peerData);
 }
 
+/**
+ * @brief Check whether the tests were cancelled.
+ */
+bool PeerTestRunnable::isCancelled() const {
+    return cancelFlagPtr && cancelFlagPtr->loadAcquire();
+}
+
+/**
+ * @brief Check whether the test should be given up.
+ * @param elapsedMs Time since the first echo request.
+ * @param replied Whether any reply arrived yet.
+ * @return true after PING_TIMEOUT_MS, or when no reply arrived within the
+ * adaptive reply deadline.
+ */
+bool PeerTestRunnable::deadlineReached(qint64 elapsedMs, bool replied) const {
+    if (elapsedMs >= PING_TIMEOUT_MS) {
+        qDebug() << "[PeerTestRunnable::run]"
+                 << "Ping timeout after"
+                 << PING_TIMEOUT_MS
+                 << "ms for:" << peerData.host();
+        return true;
+    }
+
+    // Private peers are used whatever their latency, so only the adaptive
+    // timeout applies to them, not the top-K cut-off.
+    if (timeouts && (! replied)) {
+        int deadlineMs = timeouts->replyDeadlineMs(! peerData.isPrivate());
+        if (elapsedMs >= deadlineMs) {
+            qDebug() << "[PeerTestRunnable::run]"
+                     << "No reply within" << deadlineMs
+                     << "ms, giving up on:" << peerData.host();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Probe the targets with ICMP datagram sockets.
+ * @param targets Addresses of the peer.
+ * @param uplinks Uplinks to probe through; an empty string is the default
+ * route.
+ * @param outcomes Receives the latency of every target and uplink.
+ * @return ProbeUnavailable if the sockets cannot be opened or bound.
+ */
+PeerTestRunnable::ProbeStatus PeerTestRunnable::probeNative(
+    const QList<QHostAddress>& targets,
+    const QStringList& uplinks,
+    std::vector<ProbeOutcome>& outcomes) {
+    std::shared_ptr<SharedIcmpProber> prober = icmpProber;
+    if (! prober) {
+        prober.reset(new SharedIcmpProber(PING_COUNT, PING_INTERVAL_MS));
+    }
+    std::vector<int> indices;
+    for (const QString& uplink : uplinks) {
+        for (const QHostAddress& target : targets) {
+            int index = prober->addTarget(target, uplink);
+            if (index < 0) {
+                qDebug() << "[PeerTestRunnable::probeNative]"
+                         << "ICMP sockets unavailable, using ping for:"
+                         << peerData.host();
+                prober->releaseTargets(indices);
+                return ProbeUnavailable;
+            }
+            indices.push_back(index);
+            outcomes.push_back({ target, uplink, -1, -1,
+                                 PeerData::NotMeasured });
+        }
+    }
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    while (! prober->isFinished(indices)) {
+        prober->poll(CHECK_INTERVAL_MS);
+        if (isCancelled()) {
+            prober->releaseTargets(indices);
+            return ProbeCancelled;
+        }
+        std::vector<IcmpProber::Result> progress = prober->results(indices);
+        bool replied = std::any_of(
+            progress.begin(), progress.end(),
+            [](const IcmpProber::Result& result) {
+                return result.received > 0;
+            });
+        if (deadlineReached(elapsed.elapsed(), replied)) {
+            // Targets that did not answer in time count as failed.
+            break;
+        }
+    }
+    // Other tests may still probe through the sockets.
+    std::vector<IcmpProber::Result> results = prober->results(indices);
+    prober->releaseTargets(indices);
+
+    for (size_t i = 0; i < outcomes.size(); ++i) {
+        const IcmpProber::Result& result = results[i];
+        ProbeOutcome& outcome = outcomes[i];
+        if (result.received == 0) {
+            continue;
+        }
+        // Round to integer milliseconds with minimum of 1ms
+        outcome.latency = std::max(
+            1, static_cast<int>((result.averageRttUs + 500) / 1000));
+        outcome.latencyUs = std::max<qint64>(1, result.averageRttUs);
+        switch (result.timestamps) {
+        case IcmpProber::KernelTimestamps:
+            outcome.source = PeerData::KernelTimestamps;
+            break;
+        case IcmpProber::KernelReceiveTimestamps:
+            outcome.source = PeerData::KernelReceiveTimestamps;
+            break;
+        default:
+            outcome.source = PeerData::UserTimestamps;
+            break;
+        }
+        qDebug() << "[PeerTestRunnable::probeNative]"
+                 << outcome.target.toString() << outcome.uplink
+                 << "received" << result.received << "of" << result.sent
+                 << "average" << result.averageRttUs << "us";
+    }
+    return ProbeDone;
+}
+
+/**
+ * @brief Probe the targets with the ping command.
+ * @param targets Addresses of the peer.
+ * @param uplinks Uplinks to probe through; an empty string is the default
+ * route.
+ * @param outcomes Receives the latency of every target and uplink.
+ */
+PeerTestRunnable::ProbeStatus PeerTestRunnable::probePingCommand(
+    const QList<QHostAddress>& targets,
+    const QStringList& uplinks,
+    std::vector<ProbeOutcome>& outcomes) {
+    std::vector<PingJob> pings;
+    for (const QString& uplink : uplinks) {
+        for (const QHostAddress& target : targets) {
+            QStringList args;
+            args << "-c" << QString::number(PING_COUNT);
+            if (! uplink.isEmpty()) {
+                // ping binds to the interface (SO_BINDTODEVICE) or to the
+                // source address given with -I.
+                args << "-I" << uplink;
+            }
+            args << target.toString();
+            qDebug() << "[PeerTestRunnable::run] Running ping command - host:"
+                     << peerData.host() << "args:" << args;
+            PingJob job;
+            job.process.reset(new QProcess());
+            job.target = target;
+            job.uplink = uplink;
+            job.process->start("ping", args);
+            pings.push_back(std::move(job));
+        }
+    }
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+
+    // Loop while waiting for the processes to finish, checking for
+    // cancellation and for the first reply
+    int waitSliceMs = std::max(
+        1, CHECK_INTERVAL_MS / static_cast<int>(pings.size()));
+    bool replied = false;
+    for (;;) {
+        bool running = false;
+        for (auto& ping : pings) {
+            if (ping.process->state() != QProcess::NotRunning) {
+                ping.process->waitForFinished(waitSliceMs);
+                running = running
+                    || (ping.process->state() != QProcess::NotRunning);
+            }
+            ping.output += ping.process->readAllStandardOutput();
+            replied = replied || ping.output.contains("bytes from");
+        }
+        if (! running) {
+            break;
+        }
+
+        if (isCancelled()) {
+            qDebug() << "[PeerTestRunnable::run] Ping cancelled for:"
+                     << peerData.host();
+            for (auto& ping : pings) {
+                stopPing(*ping.process);
+            }
+            return ProbeCancelled;
+        }
+
+        if (deadlineReached(elapsed.elapsed(), replied)) {
+            // Pings that did not answer in time count as failed.
+            for (auto& ping : pings) {
+                stopPing(*ping.process);
+            }
+            break;
+        }
+    }
+
+    for (auto& ping : pings) {
+        QProcess& process = *ping.process;
+        QString target = ping.target.toString();
+        int latency = -1;
+        // Process results only if the process finished normally
+        if ((process.exitStatus() == QProcess::NormalExit)
+            && (process.exitCode() == 0)) {
+            ping.output += process.readAllStandardOutput();
+            QString output = QString::fromLocal8Bit(ping.output);
+            qDebug() << "[PeerTestRunnable::run] Ping output for:"
+                     << target << ping.uplink << "-" << output.trimmed();
+            latency = parsePingLatency(output);
+            if (latency < 0) {
+                qDebug() << "[PeerTestRunnable::run]"
+                         << "No usable latency in ping output for:"
+                         << target << ping.uplink;
+            }
+        } else {
+            qDebug() << "[PeerTestRunnable::run]"
+                     << "Ping process failed or exited abnormally for:"
+                     << target << ping.uplink
+                     << "ExitCode:" << process.exitCode()
+                     << "ExitStatus:" << process.exitStatus();
+        }
+        outcomes.push_back({ ping.target, ping.uplink, latency, -1,
+                             (latency > 0) ? PeerData::PingCommand
+                                           : PeerData::NotMeasured });
+    }
+    return ProbeDone;
+}
+
 /**
  * @brief Exports the given list of peers to a CSV file
  * @param fileName The full path to the CSV file to be created/overwritten
@@ -201,26 +809,26 @@ bool PeerManager::exportPeersToCsv(const QString& fileName,
     for (const PeerData& peer : peerList) {
         QString latencyStr;
         // Determine latency string based solely on PeerData
-        if (peer.latency < -1) {
+        if (peer.latency() < -1) {
             // Assuming latency < -1 might indicate some other failure state,
             // treat as Failed
              latencyStr = "Failed";
-        } else if (peer.latency == -1) {
+        } else if (peer.latency() == -1) {
             // latency == -1 indicates not tested
              latencyStr = "Not Tested";
         } else { // latency >= 0 is a valid measurement
-            latencyStr = QString::number(peer.latency);
+            latencyStr = QString::number(peer.latency());
         }
 
         QString validityStr = "";
         // Determine validity string based solely on PeerData, only if tested
-        if (peer.latency != -1) {
+        if (peer.latency() != -1) {
              // Only show validity if the peer was actually tested (latency is
              // not -1)
-             validityStr = peer.isValid ? "yes" : "no";
+             validityStr = peer.isValid() ? "yes" : "no";
         }
 
-        out << "\"" << peer.host << "\","
+        out << "\"" << peer.host() << "\","
             << "\"" << latencyStr << "\","
             << "\"" << validityStr << "\"\n";
     }
@@ -243,8 +851,17 @@ PeerManager::PeerManager(std::shared_ptr<QSettings> settings,
                          QObject *parent)
     : QObject(parent)
     , networkManager(new QNetworkAccessManager(this))
-    , threadPool(new QThreadPool(this))
+    , socksProber(new Socks5Prober(QNetworkProxy(QNetworkProxy::NoProxy),
+                                   this))
+    , probeThroughProxy(false)
+    , probeScheduler(new ProbeScheduler(this))
+    , probeTimeouts(PeerTestRunnable::PING_TIMEOUT_MS, MAX_PEERS)
+    , icmpProber(new SharedIcmpProber(PeerTestRunnable::PING_COUNT,
+                                      PeerTestRunnable::PING_INTERVAL_MS,
+                                      PeerTestRunnable::PING_SEND_SLOT_MS))
+    , networkMonitor(new NetworkMonitor(this))
     , cancelTestsFlag(0)
+    , resolveGeneration(0)
     , debugMode(debugMode)
     , settings(settings) {
 
@@ -253,11 +870,35 @@ PeerManager::PeerManager(std::shared_ptr<QSettings> settings,
 
     connect(networkManager, &QNetworkAccessManager::finished,
             this, &PeerManager::handleNetworkResponse);
+    connect(socksProber, &Socks5Prober::peerTested,
+            this, &PeerManager::handlePeerTested);
+    connect(probeScheduler, &ProbeScheduler::probeReady,
+            this, &PeerManager::startProbe);
+    connect(networkMonitor, &NetworkMonitor::networkChanged,
+            this, &PeerManager::handleNetworkChanged);
 
-    threadPool->setMaxThreadCount(5);
-    qDebug() << "[PeerManager] Thread pool initialized with max"
-             << threadPool->maxThreadCount()
-             << "threads.";
+    probeScheduler->setMaxInFlight(MAX_CONCURRENT_TESTS);
+    qDebug() << "[PeerManager] Running up to" << MAX_CONCURRENT_TESTS
+             << "tests at a time on the shared executor.";
+
+    if (settings) {
+        probeCache.load(
+            settings->value("peer_discovery/probe_cache").toByteArray());
+        qDebug() << "[PeerManager] Loaded" << probeCache.size()
+                 << "cached probe results.";
+    }
+
+    openAsnDatabase();
+
+    if (! networkMonitor->start()) {
+        qDebug() << "[PeerManager] Network changes are not detected.";
+    }
+    // Results saved on another network are stale on this one.
+    if (! networkMonitor->fingerprint().isEmpty()) {
+        int dropped = probeCache.invalidate(networkMonitor->fingerprint());
+        qDebug() << "[PeerManager] On network" << networkMonitor->fingerprint()
+                 << "- dropped" << dropped << "results of other networks.";
+    }
 }
 
 /**
@@ -265,13 +906,17 @@ PeerManager::PeerManager(std::shared_ptr<QSettings> settings,
  */
 PeerManager::~PeerManager() {
     qDebug() << "[PeerManager::~PeerManager] Cleaning up...";
+    cancelResolution();
     cancelTests();
-    threadPool->clear();
     qDebug() << "[PeerManager::~PeerManager]"
              << "Waiting for active tests to finish...";
-    bool allFinished = threadPool->waitForDone(-1);
+    bool allFinished = Executor::instance().waitForDone(this);
     qDebug() << "[PeerManager::~PeerManager] All tests finished:"
              << allFinished;
+    if (settings) {
+        settings->setValue("peer_discovery/probe_cache",
+            probeCache.save(QDateTime::currentMSecsSinceEpoch()));
+    }
 }
 
 /**
@@ -284,6 +929,27 @@ void PeerManager::setPeerFetchProxy(const QNetworkProxy& proxy) {
     }
 }
 
+/**
+ * @brief Sets the probe packet rate
+ * @param packetsPerSecond Probe packets per second; 0 sends probes as fast
+ * as the concurrency limit allows
+ */
+void PeerManager::setProbeRate(int packetsPerSecond) {
+    probeScheduler->setRate(packetsPerSecond);
+}
+
+/**
+ * @brief Sets the proxy to test peers through
+ * @param proxy A SOCKS5 proxy, or QNetworkProxy::NoProxy to ping peers
+ * directly
+ */
+void PeerManager::setProbeProxy(const QNetworkProxy& proxy) {
+    probeThroughProxy = (proxy.type() == QNetworkProxy::Socks5Proxy);
+    socksProber->setProxy(proxy);
+    qDebug() << "[PeerManager::setProbeProxy] Probing through proxy:"
+             << probeThroughProxy;
+}
+
 /**
  * @brief Fetches peer list from public peers repository
  */
@@ -308,15 +974,390 @@ QString PeerManager::getHostname(const QString& peerUri) const {
  * @param peer The peer to test
  */
 void PeerManager::testPeer(PeerData peer) {
-    PeerTestRunnable* task = new PeerTestRunnable(peer, &cancelTestsFlag);
+    for (const QString& key : LatencyPredictor::neighbourhoods(peer)) {
+        queuedNeighbours[key].append(peer);
+    }
+    probeScheduler->enqueue(peer, probeCost(peer), probePriority(peer));
+}
+
+/**
+ * @brief Resolves the hosts of peers ahead of their tests
+ * @param peers The peers
+ */
+void PeerManager::resolvePeers(const QList<PeerData>& peers) {
+    quint64 generation = resolveGeneration;
+    QList<PeerData> ready;
+    for (const PeerData& peer : peers) {
+        QString host = pingHost(peer.host());
+        QHostAddress literal;
+        // The proxy resolves the hosts it connects to, and literals need no
+        // lookup.
+        if (probeThroughProxy || literal.setAddress(host)) {
+            PeerData resolved = peer;
+            if (! probeThroughProxy) {
+                resolved.setProbeAddresses(QStringList(literal.toString()));
+            }
+            ready.append(resolved);
+            continue;
+        }
+
+        int lookup = QHostInfo::lookupHost(
+            host, this, [this, peer, host, generation](const QHostInfo& info) {
+                hostLookups.remove(info.lookupId());
+                if (generation != resolveGeneration) {
+                    return;
+                }
+                QStringList addresses;
+                if (info.error() == QHostInfo::NoError) {
+                    for (const QHostAddress& address
+                         : PeerTestRunnable::probeTargets(info.addresses())) {
+                        addresses << address.toString();
+                    }
+                }
+                if (addresses.isEmpty()) {
+                    qDebug() << "[PeerManager::resolvePeers] Failed to resolve"
+                             << host << "-" << info.errorString();
+                }
+                PeerData resolved = peer;
+                resolved.setProbeAddresses(addresses);
+                emit peerResolved(resolved, ! addresses.isEmpty());
+            });
+        hostLookups.insert(lookup);
+    }
+
+    if (! ready.isEmpty()) {
+        QTimer::singleShot(0, this, [this, ready, generation]() {
+            for (const PeerData& peer : ready) {
+                if (generation != resolveGeneration) {
+                    return;
+                }
+                emit peerResolved(peer, true);
+            }
+        });
+    }
+}
+
+/**
+ * @brief Drops the host lookups of resolvePeers() that are not done
+ */
+void PeerManager::cancelResolution() {
+    ++resolveGeneration;
+    for (int lookup : hostLookups) {
+        QHostInfo::abortHostLookup(lookup);
+    }
+    hostLookups.clear();
+}
+
+/**
+ * @brief Moves a peer to the front of the probe queue
+ * @param host The peer URI
+ */
+void PeerManager::pinPeer(const QString& host) {
+    pinnedPeers.insert(host);
+    if (probeScheduler->setPriority(host, PIN_PRIORITY)) {
+        qDebug() << "[PeerManager::pinPeer] Probing next:" << host;
+    }
+}
+
+/**
+ * @brief Gets the probe priority of a peer
+ * @param peer The peer to test
+ * @return PIN_PRIORITY for pinned peers, otherwise the priority derived
+ * from the earlier results
+ */
+double PeerManager::probePriority(const PeerData& peer) const {
+    if (pinnedPeers.contains(peer.host())) {
+        return PIN_PRIORITY;
+    }
+    // Without an own result, the neighbours tell more than nothing.
+    if ((! peer.isPrivate()) && (! probeCache.lookup(peer.host(), nullptr))) {
+        LatencyPredictor::Prediction prediction
+            = latencyPredictor.predict(peer);
+        if (prediction.isValid()) {
+            return LatencyPredictor::priority(prediction);
+        }
+    }
+    return probeCache.priority(peer, QDateTime::currentMSecsSinceEpoch());
+}
 
+/**
+ * @brief Re-ranks the queued neighbours of a tested peer
+ * @param peer The tested peer
+ */
+void PeerManager::rerankNeighbours(const PeerData& peer) {
+    for (const QString& key : LatencyPredictor::neighbourhoods(peer)) {
+        auto it = queuedNeighbours.find(key);
+        if (it == queuedNeighbours.end()) {
+            continue;
+        }
+        QList<PeerData>& neighbours = it.value();
+        for (int i = 0; i < neighbours.size();) {
+            const PeerData& neighbour = neighbours[i];
+            // Peers no longer queued are being tested or done.
+            if ((neighbour.host() == peer.host())
+                || (! probeScheduler->setPriority(neighbour.host(),
+                                                  probePriority(neighbour)))) {
+                neighbours.removeAt(i);
+            } else {
+                ++i;
+            }
+        }
+        if (neighbours.isEmpty()) {
+            queuedNeighbours.erase(it);
+        }
+    }
+}
+
+/**
+ * @brief Estimates the latency of a peer from its measured neighbours
+ * @param peer The peer
+ * @return The estimate; not valid if no neighbour has been measured
+ */
+LatencyPredictor::Prediction
+PeerManager::predictLatency(const PeerData& peer) const {
+    return latencyPredictor.predict(peer);
+}
+
+/**
+ * @brief Estimates the number of packets a peer test sends
+ * @param peer The peer to test
+ * @return Number of ICMP echo requests and handshake packets, or of TCP
+ * connections through the proxy
+ */
+int PeerManager::probeCost(const PeerData& peer) const {
+    if (probeThroughProxy) {
+        return Socks5Prober::CONNECT_COUNT;
+    }
+    // Hostnames are pinged over both address families, unless they were
+    // resolved to fewer.
+    QHostAddress literal;
+    int families = literal.setAddress(pingHost(peer.host())) ? 1 : 2;
+    if (! peer.probeAddresses().isEmpty()) {
+        families = peer.probeAddresses().size();
+    }
+    int uplinks = 1;
+    for (const QString& uplink : sweepUplinks) {
+        if ((! uplink.isEmpty()) && (uplink != probeInterface)) {
+            ++uplinks;
+        }
+    }
+    // A reachable endpoint is handshaken with as well.
+    return PeerTestRunnable::PING_COUNT * families * uplinks
+        + PeerTestRunnable::TRANSPORT_PROBE_PACKETS;
+}
+
+/**
+ * @brief Starts a peer test released by the probe scheduler
+ * @param peer The peer to test
+ */
+void PeerManager::startProbe(const PeerData& peer) {
+    if (probeThroughProxy) {
+        qDebug() << "[PeerManager::testPeer] Probing through the proxy:"
+                 << peer.host();
+        socksProber->probe(peer);
+        return;
+    }
+
+    PeerTestRunnable* task = new PeerTestRunnable(peer,
+                                                  &cancelTestsFlag,
+                                                  probeInterface,
+                                                  sweepUplinks,
+                                                  &probeTimeouts,
+                                                  asnDatabase,
+                                                  icmpProber);
+
+    // The test may outlive cancelTests(); its result then belongs to an
+    // earlier generation of the scheduler.
+    quint64 generation = probeScheduler->generation();
     connect(task, &PeerTestRunnable::peerTested,
-            this, &PeerManager::handlePeerTested,
+            this, [this, generation](const PeerData& result) {
+                finishProbe(result, generation);
+            },
             Qt::QueuedConnection);
 
     qDebug() << "[PeerManager::testPeer] Submitting test task for:"
-             << peer.host;
-    threadPool->start(task);
+             << peer.host();
+    if (! Executor::instance().submit(Executor::Normal, task, this)) {
+        // Report the peer untested, so that the sweep still completes.
+        QTimer::singleShot(0, this, [this, peer, generation]() {
+            finishProbe(peer, generation);
+        });
+    }
+}
+
+/**
+ * @brief Sets the uplinks to run the peer tests through
+ * @param probeInterface Interface or source address the peer latency is
+ * measured from, or an empty string for the default route
+ * @param sweepUplinks Further uplinks to measure every peer through
+ */
+void PeerManager::setProbeUplinks(const QString& probeInterface,
+                                  const QStringList& sweepUplinks) {
+    this->probeInterface = probeInterface;
+    this->sweepUplinks = sweepUplinks;
+}
+
+/**
+ * @brief Checks whether an interface address can be used as an uplink
+ * @param address The interface address
+ * @return false for loopback, link-local and Yggdrasil addresses
+ */
+bool PeerManager::isUplinkAddress(const QHostAddress& address) {
+    if (address.isLoopback()) {
+        return false;
+    }
+    if (address.protocol() == QAbstractSocket::IPv4Protocol) {
+        return ! address.isInSubnet(QHostAddress("169.254.0.0"), 16);
+    }
+    if (address.protocol() == QAbstractSocket::IPv6Protocol) {
+        // Link-local addresses and the Yggdrasil network itself
+        return (! address.isInSubnet(QHostAddress("fe80::"), 10))
+            && (! address.isInSubnet(QHostAddress("200::"), 7));
+    }
+    return false;
+}
+
+/**
+ * @brief Lists the network interfaces that can reach the internet
+ * @return Names of the interfaces that are up and have an uplink address
+ */
+QStringList PeerManager::availableUplinks() {
+    QStringList uplinks;
+    for (const QNetworkInterface& iface : QNetworkInterface::allInterfaces()) {
+        QNetworkInterface::InterfaceFlags flags = iface.flags();
+        if ((! (flags & QNetworkInterface::IsUp))
+            || (! (flags & QNetworkInterface::IsRunning))
+            || (flags & QNetworkInterface::IsLoopBack)) {
+            continue;
+        }
+        bool hasUplinkAddress = false;
+        bool hasYggdrasilAddress = false;
+        for (const QNetworkAddressEntry& entry : iface.addressEntries()) {
+            const QHostAddress& ip = entry.ip();
+            hasUplinkAddress = hasUplinkAddress || isUplinkAddress(ip);
+            hasYggdrasilAddress = hasYggdrasilAddress
+                || ip.isInSubnet(QHostAddress("200::"), 7);
+        }
+        // Probing through the Yggdrasil TUN interface makes no sense.
+        if (hasUplinkAddress && (! hasYggdrasilAddress)) {
+            uplinks << iface.name();
+        }
+    }
+    qDebug() << "[PeerManager::availableUplinks] Uplinks:" << uplinks;
+    return uplinks;
+}
+
+/**
+ * @brief Gets the path of the ASN database
+ */
+QString PeerManager::asnDatabasePath() const {
+    if (! settings) {
+        return AsnDatabase::defaultPath();
+    }
+    return settings->value("peer_discovery/asn_database",
+                           AsnDatabase::defaultPath()).toString();
+}
+
+/**
+ * @brief Maps the ASN database, if there is one
+ * @return false if there is no usable database
+ */
+bool PeerManager::openAsnDatabase() {
+    QString path = asnDatabasePath();
+    if (! QFile::exists(path)) {
+        qDebug() << "[PeerManager::openAsnDatabase] No ASN database at"
+                 << path;
+        return false;
+    }
+    auto database = std::make_shared<AsnDatabase>();
+    if (! database->open(path)) {
+        return false;
+    }
+    asnDatabase = database;
+    return true;
+}
+
+/**
+ * @brief Sets the origin AS of a peer with an address literal
+ * @param peer The peer
+ */
+void PeerManager::annotateAsn(PeerData& peer) const {
+    QHostAddress address;
+    if (asnDatabase && address.setAddress(pingHost(peer.host()))) {
+        peer.setAsn(asnDatabase->lookup(address).asn);
+    }
+}
+
+/**
+ * @brief Compiles a prefix-to-AS dump into the ASN database in the
+ * background and switches to it
+ * @param dumpPath Path of the dump
+ */
+void PeerManager::importAsnDatabase(const QString& dumpPath) {
+    QString path = asnDatabasePath();
+    qDebug() << "[PeerManager::importAsnDatabase] Importing" << dumpPath
+             << "into" << path;
+    bool submitted = Executor::instance().submit(
+        Executor::Interactive,
+        [this, dumpPath, path]() {
+            QString message;
+            bool success = AsnDatabase::import(dumpPath, path, &message);
+            QMetaObject::invokeMethod(this, "handleAsnImported",
+                                      Qt::QueuedConnection,
+                                      Q_ARG(bool, success),
+                                      Q_ARG(QString, message));
+        },
+        this);
+    if (! submitted) {
+        emit asnDatabaseChanged(false, tr("Too many tasks are running."));
+    }
+}
+
+/**
+ * @brief Switches to the imported ASN database
+ * @param success Whether the import succeeded
+ * @param message Description of the failure
+ */
+void PeerManager::handleAsnImported(bool success, const QString& message) {
+    if (success && (! openAsnDatabase())) {
+        success = false;
+    }
+    // AS neighbourhoods of the old database no longer apply.
+    latencyPredictor.clear();
+    emit asnDatabaseChanged(success,
+                            success
+                                ? tr("Imported %1 prefixes.")
+                                      .arg(asnPrefixCount())
+                                : message);
+}
+
+/**
+ * @brief Gets the number of prefixes in the ASN database
+ * @return The prefix count, or 0 if there is no database
+ */
+int PeerManager::asnPrefixCount() const {
+    return asnDatabase ? asnDatabase->prefixCount() : 0;
+}
+
+/**
+ * @brief Describes an AS for display
+ * @param asn The AS number
+ * @return E.g. "AS64496 EXAMPLE-NET", or an empty string for 0
+ */
+QString PeerManager::describeAsn(quint32 asn) const {
+    if (asn == 0) {
+        return QString();
+    }
+    return asnDatabase ? asnDatabase->describe(asn)
+                       : QString("AS%1").arg(asn);
+}
+
+/**
+ * @brief Gets the fingerprint of the network the host is on
+ * @return The fingerprint, or an empty string if it is unknown
+ */
+QString PeerManager::networkFingerprint() const {
+    return networkMonitor->fingerprint();
 }
 
 /**
@@ -325,6 +1366,8 @@ void PeerManager::testPeer(PeerData peer) {
 void PeerManager::resetCancellation() {
     qDebug() << "[PeerManager::resetCancellation] Resetting cancellation flag.";
     cancelTestsFlag.storeRelease(0);
+    probeTimeouts.reset();
+    queuedNeighbours.clear();
 }
 
 /**
@@ -334,9 +1377,12 @@ void PeerManager::cancelTests() {
     qDebug() << "[PeerManager::cancelTests]"
              << "Requesting cancellation of all active tests.";
     cancelTestsFlag.storeRelease(1);
-    threadPool->clear();
+    probeScheduler->clear();
+    pinnedPeers.clear();
+    Executor::instance().clear(this);
+    socksProber->cancel();
     qDebug() << "[PeerManager::cancelTests]"
-             << "Cancellation flag set and thread pool queue cleared.";
+             << "Cancellation flag set and queued tests dropped.";
 }
 
 /**
@@ -378,6 +1424,92 @@ bool PeerManager::extractResource(const QString& resourcePath,
     return true;
 }
 
+/**
+ * @brief Build the URI to write into the Yggdrasil config for a peer.
+ * @param peer The peer.
+ * @return The peer URI with the host replaced by the preferred address, if
+ * the peer has one, and the peer URI as is otherwise.
+ * @details TLS and QUIC peers keep the hostname as the SNI, so that the
+ * connection still works with name-based virtual hosting.
+ */
+QString configPeerUri(const PeerData& peer) {
+    if (peer.preferredAddress().isEmpty()) {
+        return peer.host();
+    }
+
+    static const QRegularExpression re(
+        "^(tls|tcp|quic)://([A-Za-z0-9.-]+):(\\d+)$");
+    auto match = re.match(peer.host().trimmed());
+    QHostAddress address;
+    if ((! match.hasMatch())
+        || (! address.setAddress(peer.preferredAddress()))) {
+        return peer.host();
+    }
+
+    QString scheme = match.captured(1);
+    QString host = (address.protocol() == QAbstractSocket::IPv6Protocol)
+        ? QString("[%1]").arg(address.toString())
+        : address.toString();
+    QString uri = QString("%1://%2:%3").arg(scheme, host, match.captured(3));
+    if (scheme != "tcp") {
+        uri += "?sni=" + match.captured(2);
+    }
+    return uri;
+}
+
+/**
+ * @brief Get the names of a peer URI to compare it by.
+ * @param uri The peer URI.
+ * @return "scheme://host:port", and "scheme://sni:port" if the URI has an
+ * "sni" parameter.
+ */
+static QStringList peerKeys(const QString& uri) {
+    QUrl url(uri.trimmed());
+    QString scheme = url.scheme().toLower();
+    QString port = QString::number(url.port());
+    QStringList keys;
+    keys << scheme + "://" + url.host().toLower() + ":" + port;
+    QString sni = QUrlQuery(url).queryItemValue("sni");
+    if (! sni.isEmpty()) {
+        keys << scheme + "://" + sni.toLower() + ":" + port;
+    }
+    return keys;
+}
+
+/**
+ * @brief Check whether two URIs name the same peer.
+ * @param a A peer URI.
+ * @param b Another peer URI.
+ * @details The scheme, host and port are compared, ignoring case and the
+ * other query parameters.  A URI with an IP address and an "sni"
+ * parameter, as configPeerUri() writes it and the daemon reports it, also
+ * matches the URI of the SNI host name.
+ */
+bool isSamePeer(const QString& a, const QString& b) {
+    QStringList keysA = peerKeys(a);
+    for (const QString& key : peerKeys(b)) {
+        if (keysA.contains(key)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Check whether a list holds a URI of the same peer.
+ * @param uris Peer URIs.
+ * @param uri The peer URI to look for.
+ * @see isSamePeer()
+ */
+bool containsPeer(const QStringList& uris, const QString& uri) {
+    for (const QString& other : uris) {
+        if (isSamePeer(other, uri)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 /**
  * @brief Print a peer data into a stream in a format suitable for adding to the
  * Yggdrasil config.
@@ -385,7 +1517,7 @@ bool PeerManager::extractResource(const QString& resourcePath,
  * @param peer A peer data to be printed.
  */
 void formatPeer(QTextStream& stream, const PeerData& peer) {
-    stream << peer.host << "\n";
+    stream << configPeerUri(peer) << "\n";
 }
 
 /**
@@ -401,14 +1533,14 @@ void writePeers(QTextStream& stream, const QList<PeerData>& peers) {
                  peers.end(),
                  std::back_inserter(privatePeers),
                  [](const PeerData& p) {
-                     return p.isPrivate;
+                     return p.isPrivate();
                  });
     publicPeers.reserve(peers.size());
     std::copy_if(peers.begin(),
                  peers.end(),
                  std::back_inserter(publicPeers),
                  [](const PeerData& p) {
-                     return (! p.isPrivate);
+                     return (! p.isPrivate());
                  });
     if (! privatePeers.isEmpty()) {
         stream << "# Private peers:\n";
@@ -423,186 +1555,242 @@ void writePeers(QTextStream& stream, const QList<PeerData>& peers) {
 }
 
 /**
- * @brief Updates Yggdrasil configuration with selected peers
- * @param selectedPeers List of peers to include in configuration
- * @return true if configuration was successfully updated
+ * @brief Check whether a selection is the configured peer set.
+ * @param peers The selected peers.
  */
-bool PeerManager::updateConfig(const QList<PeerData>& selectedPeers) {
-    qDebug() << "[PeerManager::updateConfig] Starting update with"
-             << selectedPeers.count() << "peers";
-
-    // Sort peers by latency (lowest first)
-    QList<PeerData> sortedPeers = selectedPeers;
-    std::sort(sortedPeers.begin(), sortedPeers.end(),
-        [](const PeerData& a, const PeerData& b) {
-            if (a.isPrivate) {
-                if (b.isPrivate) {
-                    if (a.isValid && b.isValid) {
-                        return a.latency < b.latency;
-                    }
-                    return a.isValid > b.isValid;
-                }
-                return true;
-            } else if (b.isPrivate) {
-                return false;
-            }
-            if (a.isValid && b.isValid) {
-                return a.latency < b.latency;
-            }
-            return a.isValid > b.isValid;
-        });
-
-    QList<PeerData> validPeers;
-    validPeers.reserve(sortedPeers.size());
-    std::copy_if(sortedPeers.begin(),
-                 sortedPeers.end(),
-                 std::back_inserter(validPeers),
-                 [](const PeerData& p) {
-                     return isPeerUriValid(p.host)
-                         && (p.isPrivate || p.isValid);
-                 });
-    qDebug() << "[PeerManager::updateConfig] Valid peers in selection:"
-             << validPeers.size();
-    for (const auto& peer : validPeers) {
-        qDebug() << "[PeerManager::updateConfig]"
-                 << "Using peer:"
-                 << peer.host;
-    }
-
-    // Extract update script to /tmp
-    if (!extractResource(":/scripts/update-peers.sh", SCRIPT_PATH)) {
-        qDebug() << "[PeerManager::updateConfig]"
-                 << "Failed to extract update script";
+bool PeerManager::Stickiness::isApplied(const QList<PeerData>& peers) const {
+    if (appliedPeers.isEmpty()) {
         return false;
     }
-
-    if (!extractResource(":/polkit/org.yggtray.updatepeers.policy",
-                         POLICY_PATH)) {
-        // Clean up script if policy extraction fails
-        QFile::remove(SCRIPT_PATH);
-        qDebug() << "[PeerManager::updateConfig]"
-                 << "Failed to extract policy file";
-        return false;
+    QSet<QString> selected;
+    for (const PeerData& peer : peers) {
+        selected.insert(peer.host());
     }
-
-    // Create temporary file with peer list
-    QTemporaryFile peersFile;
-    if (!peersFile.open()) {
-        qDebug() << "[PeerManager::updateConfig]"
-                 << "Failed to create temporary peers file:"
-                 << peersFile.errorString();
-        return false;
+    QSet<QString> configured;
+    for (const QString& host : appliedPeers) {
+        configured.insert(host);
     }
+    return selected == configured;
+}
 
-    // Write peers to temporary file
-    QTextStream stream(&peersFile);
-
-    // First try to write only valid peers
-    if (validPeers.size() > 0) {
-        qDebug() << "[PeerManager::updateConfig] Writing"
-                 << validPeers.size()
-                 << "valid peers to config (up to"
-                 << MAX_PEERS << "will be used)";
-        writePeers(stream, validPeers);
-    } else {
-        // If no valid peers, use all peers as a fallback
-        qDebug() << "[PeerManager::updateConfig]"
-                 << "Warning: No valid peers found, using all peers as fallback";
-        QList<PeerData> fallbackPeers;
-        fallbackPeers.reserve(sortedPeers.size());
-        std::copy_if(sortedPeers.begin(),
-                     sortedPeers.end(),
-                     std::back_inserter(fallbackPeers),
-                     [](const PeerData& p) {
-                         return isPeerUriValid(p.host);
-                     });
-
-        // Use URI-valid peers instead, sorted by latency if available.
-        writePeers(stream, fallbackPeers);
-
-        qDebug() << "[PeerManager::updateConfig] Writing"
-                 << fallbackPeers.count()
-                 << "peers to config (up to" << MAX_PEERS << "will be used)";
-    }
-
-    stream.flush();
-
-    // Debug: Read back file content to verify it's not empty
-    peersFile.seek(0);
-    QString fileContent = QString::fromUtf8(peersFile.readAll());
-    qDebug() << "[PeerManager::updateConfig] Verifying peers file:"
-             << (fileContent.isEmpty() ? "EMPTY!" : "Contains data");
-    peersFile.seek(0);  // Reset position for the script to read
-
-    // Execute update script with elevated privileges
-    QProcess process;
-    QStringList args;
-    if (debugMode) {
-        args << "sh" << SCRIPT_PATH << "--verbose" << peersFile.fileName();
-    } else {
-        args << "sh" << SCRIPT_PATH << peersFile.fileName();
+/**
+ * @brief Selects the peers to be written to the Yggdrasil configuration
+ * @param selectedPeers List of peers selected by the user
+ * @param maxPeers Maximum number of peers to select
+ * @param stickiness Preference for the configured peers, or nullptr
+ * @param transportsPerHost Maximum number of endpoints of one host, or 0
+ * for no limit
+ * @return At most maxPeers peers to write, in the order of preference
+ */
+QList<PeerData> PeerManager::selectConfigPeers(
+    const QList<PeerData>& selectedPeers,
+    int maxPeers,
+    const Stickiness* stickiness,
+    int transportsPerHost) {
+    qDebug() << "[PeerManager::selectConfigPeers] Selecting up to"
+             << maxPeers << "from" << selectedPeers.count() << "peers";
+
+    // Single pass over the candidates: split URI-valid peers into private
+    // ones (always pinned first), usable public ones and the rest, which is
+    // only needed as a fallback.
+    std::vector<int> privateIdx;
+    std::vector<int> publicIdx;
+    std::vector<int> fallbackIdx;
+    publicIdx.reserve(selectedPeers.size());
+    // Configured peers rank as if they were faster by their margin; left
+    // empty without stickiness.
+    std::vector<qint64> marginUs;
+    QSet<QString> applied;
+    if (stickiness && (! stickiness->appliedPeers.isEmpty())) {
+        for (const QString& host : stickiness->appliedPeers) {
+            applied.insert(host);
+        }
+        marginUs.resize(selectedPeers.size(), 0);
     }
-
-    qDebug() << "[PeerManager::updateConfig]"
-             << "Executing update script - command: pkexec" << args;
-    process.start("pkexec", args);
-
-    if (!process.waitForFinished(SCRIPT_TIMEOUT_MS)) {
-        QString errorMsg = "Update script timed out";
-        qDebug() << "[PeerManager::updateConfig] Error:" << errorMsg;
-        QFile::remove(SCRIPT_PATH);
-        QFile::remove(POLICY_PATH);
-        emit error(errorMsg);
-        return false;
+    for (int i = 0; i < selectedPeers.size(); ++i) {
+        const PeerData& p = selectedPeers[i];
+        if (! isPeerUriValid(p.host())) {
+            continue;
+        }
+        if (p.isPrivate()) {
+            privateIdx.push_back(i);
+        } else if (p.isValid()) {
+            publicIdx.push_back(i);
+            if ((! marginUs.empty()) && applied.contains(p.host())) {
+                marginUs[i] = stickiness->marginFor(p.preciseLatencyUs());
+            }
+        } else {
+            fallbackIdx.push_back(i);
+        }
     }
 
-    if (process.exitCode() != 0) {
-        QString stdErr = QString::fromUtf8(process.readAllStandardError());
-        QString stdOut = QString::fromUtf8(process.readAllStandardOutput());
-
-        // Special case: If the output contains "updated successfully" but exit
-        // code is non-zero, consider it a success and ignore the exit code
-        if ((stdOut.contains("updated successfully")
-             || stdErr.contains("updated successfully"))
-            && process.exitCode() == 1) {
-            qDebug() << "[PeerManager::updateConfig]"
-                     << "Script exited with code 1 but reported success,"
-                     << "treating as successful";
-
-            // Clean up temporary files
-            QFile::remove(SCRIPT_PATH);
-            QFile::remove(POLICY_PATH);
-            return true;
+    auto rankUs = [&selectedPeers, &marginUs](int i) {
+        qint64 latencyUs = selectedPeers[i].preciseLatencyUs();
+        return marginUs.empty() ? latencyUs : latencyUs - marginUs[i];
+    };
+
+    // Handshake time, with the margin of a configured endpoint; -1 if the
+    // endpoint was not handshaken with or did not answer.
+    auto transportRankUs = [&selectedPeers, &marginUs](int i) {
+        qint64 latencyUs = selectedPeers[i].transportLatencyUs();
+        if ((latencyUs <= 0) || marginUs.empty()) {
+            return (latencyUs > 0) ? latencyUs : qint64(-1);
         }
-
-        QString errorMsg = "Update script failed with exit code "
-            + QString::number(process.exitCode());
-
-        if (!stdErr.isEmpty()) {
-            errorMsg += ": " + stdErr.trimmed();
-        } else if (!stdOut.isEmpty()) {
-            errorMsg += ": " + stdOut.trimmed();
+        return std::max<qint64>(1, latencyUs - marginUs[i]);
+    };
+
+    // An endpoint that answered the handshake first, then the faster one.
+    auto fasterTransport = [&transportRankUs](int ia, int ib) {
+        qint64 a = transportRankUs(ia);
+        qint64 b = transportRankUs(ib);
+        if ((a > 0) != (b > 0)) {
+            return a > 0;
+        }
+        return a < b;
+    };
+
+    // Valid peers first, then lowest latency; ties go to the faster
+    // transport, then keep the input order.
+    auto better = [&selectedPeers, &rankUs, &fasterTransport](int ia,
+                                                             int ib) {
+        const PeerData& a = selectedPeers[ia];
+        const PeerData& b = selectedPeers[ib];
+        if (a.isValid() != b.isValid()) {
+            return a.isValid();
+        }
+        if (a.isValid() && (rankUs(ia) != rankUs(ib))) {
+            return rankUs(ia) < rankUs(ib);
+        }
+        if (fasterTransport(ia, ib) || fasterTransport(ib, ia)) {
+            return fasterTransport(ia, ib);
+        }
+        return ia < ib;
+    };
+
+    // The endpoints of one host share its ping latency, which only tells
+    // how far the host is; they are told apart by their handshake.
+    auto betterEndpoint = [&better, &fasterTransport](int ia, int ib) {
+        if (fasterTransport(ia, ib) || fasterTransport(ib, ia)) {
+            return fasterTransport(ia, ib);
+        }
+        return better(ia, ib);
+    };
+
+    // Move the best k indices to the front of the vector, sorted.
+    auto topK = [&better](std::vector<int>& idx, int k) {
+        k = std::max(0, std::min(k, static_cast<int>(idx.size())));
+        if (k < static_cast<int>(idx.size())) {
+            std::nth_element(idx.begin(), idx.begin() + k, idx.end(), better);
+        }
+        std::sort(idx.begin(), idx.begin() + k, better);
+        idx.resize(k);
+    };
+
+    // Keep the best endpoints of every host before the cut, so that the
+    // slots of the others go to other hosts.
+    auto consolidate = [&](std::vector<int>& candidates) {
+        QHash<QString, std::vector<int>> kept;
+        for (int i : privateIdx) {
+            kept[peerHostIdentity(selectedPeers[i].host())].push_back(i);
+        }
+        size_t limit = static_cast<size_t>(transportsPerHost);
+        for (int i : candidates) {
+            std::vector<int>& endpoints
+                = kept[peerHostIdentity(selectedPeers[i].host())];
+            if (endpoints.size() < limit) {
+                endpoints.push_back(i);
+                continue;
+            }
+            // Replace the worst public endpoint if this one is better.
+            auto worst = std::max_element(
+                endpoints.begin(), endpoints.end(),
+                [&selectedPeers, &betterEndpoint](int ia, int ib) {
+                    if (selectedPeers[ia].isPrivate()
+                        != selectedPeers[ib].isPrivate()) {
+                        return selectedPeers[ia].isPrivate();
+                    }
+                    return betterEndpoint(ia, ib);
+                });
+            if ((! selectedPeers[*worst].isPrivate())
+                && betterEndpoint(i, *worst)) {
+                *worst = i;
+            }
+        }
+        candidates.clear();
+        for (const std::vector<int>& endpoints : kept) {
+            for (int i : endpoints) {
+                if (! selectedPeers[i].isPrivate()) {
+                    candidates.push_back(i);
+                }
+            }
         }
+        qDebug() << "[PeerManager::selectConfigPeers]" << kept.size()
+                 << "hosts," << (candidates.size() + privateIdx.size())
+                 << "endpoints after consolidation";
+    };
+
+    // If no valid peers, use all URI-valid peers as a fallback
+    bool fallback = privateIdx.empty() && publicIdx.empty();
+    if (fallback) {
+        qDebug() << "[PeerManager::selectConfigPeers]"
+                 << "Warning: No valid peers found, using all peers as fallback";
+    }
+    std::vector<int>& candidates = fallback ? fallbackIdx : publicIdx;
 
-        qDebug() << "[PeerManager::updateConfig] Error:" << errorMsg;
-        QFile::remove(SCRIPT_PATH);
-        QFile::remove(POLICY_PATH);
-        emit error(errorMsg);
-        return false;
+    topK(privateIdx, maxPeers);
+    if (transportsPerHost > 0) {
+        consolidate(candidates);
     }
+    topK(candidates, maxPeers - static_cast<int>(privateIdx.size()));
 
-    // Log the success output
-    QString output
-        = QString::fromUtf8(process.readAllStandardOutput()).trimmed();
-    if (!output.isEmpty()) {
-        qDebug() << "[PeerManager::updateConfig] Script output:"
-                 << output;
+    QList<PeerData> result;
+    result.reserve(static_cast<int>(privateIdx.size() + candidates.size()));
+    for (int i : privateIdx) {
+        result.append(selectedPeers[i]);
+    }
+    for (int i : candidates) {
+        result.append(selectedPeers[i]);
     }
+    qDebug() << "[PeerManager::selectConfigPeers] Selected peers:"
+             << result.size();
+    return result;
+}
 
-    // Clean up temporary files
-    QFile::remove(SCRIPT_PATH);
-    QFile::remove(POLICY_PATH);
-    return true;
+/**
+ * @brief Read the configured peers and the stickiness margins from the
+ * settings.
+ * @param settings The settings.
+ */
+PeerManager::Stickiness PeerManager::loadStickiness(
+    const QSettings& settings) {
+    Stickiness stickiness;
+    stickiness.appliedPeers = settings.value("peer_discovery/applied_peers",
+                                             "").toString().split(",");
+    stickiness.appliedPeers.removeAll(QString());
+    stickiness.marginUs = settings.value("peer_discovery/stickiness_ms",
+                                         DEFAULT_STICKINESS_US / 1000)
+        .toLongLong() * 1000;
+    stickiness.marginPercent
+        = settings.value("peer_discovery/stickiness_percent",
+                         DEFAULT_STICKINESS_PERCENT).toInt();
+    return stickiness;
+}
+
+/**
+ * @brief Remember the peers written to the configuration.
+ * @param settings The settings.
+ * @param peers The written peers.
+ */
+void PeerManager::storeAppliedPeers(QSettings& settings,
+                                    const QList<PeerData>& peers) {
+    QStringList hosts;
+    for (const PeerData& peer : peers) {
+        hosts << peer.host();
+    }
+    qDebug() << "[PeerManager::storeAppliedPeers]" << hosts.size()
+             << "peers";
+    settings.setValue("peer_discovery/applied_peers", hosts.join(","));
+    settings.sync();
 }
 
 /**
@@ -630,10 +1818,7 @@ void PeerManager::handleNetworkResponse(QNetworkReply* reply) {
                      << peerUri;
             continue;
         }
-        PeerData peer;
-        peer.host = peerUri;
-        peer.isPrivate = true;
-        privatePeersList.append(peer);
+        privatePeersList.append(PeerData(peerUri, true));
     }
     if (reply->error() == QNetworkReply::NoError) {
         QString html = QString::fromUtf8(reply->readAll());
@@ -649,9 +1834,7 @@ void PeerManager::handleNetworkResponse(QNetworkReply* reply) {
             QString hostname = getHostname(peerUri);
 
             if (!hostname.isEmpty()) {
-                PeerData peer;
-                peer.host = peerUri;
-                peers.append(peer);
+                peers.append(PeerData(peerUri));
             }
         }
         if (! privatePeersList.isEmpty()) {
@@ -660,6 +1843,9 @@ void PeerManager::handleNetworkResponse(QNetworkReply* reply) {
             privatePeersList += peers;
             peers = privatePeersList;
         }
+        for (PeerData& peer : peers) {
+            annotateAsn(peer);
+        }
         emit peersDiscovered(peers);
     } else {
         emit error(tr("Failed to fetch peers: %1").arg(reply->errorString()));
@@ -669,11 +1855,59 @@ void PeerManager::handleNetworkResponse(QNetworkReply* reply) {
 }
 
 /**
- * @brief Handles the completion of a peer test
+ * @brief Drops the cached results of the previous network
+ * @param fingerprint Fingerprint of the new network
+ * @param previous Fingerprint of the previous network
+ */
+void PeerManager::handleNetworkChanged(const QString& fingerprint,
+                                       const QString& previous) {
+    int dropped = probeCache.invalidate(fingerprint);
+    qDebug() << "[PeerManager::handleNetworkChanged] Moved from" << previous
+             << "to" << fingerprint << "- dropped" << dropped
+             << "cached results.";
+    // Timeouts adapted to the old uplink do not fit the new one, nor do
+    // the neighbourhood latencies.
+    probeTimeouts.reset();
+    latencyPredictor.clear();
+    emit networkChanged(fingerprint);
+}
+
+/**
+ * @brief Handles the completion of a peer test through the proxy
  * @param peer The tested peer with updated latency and validity
  */
 void PeerManager::handlePeerTested(const PeerData& peer) {
-    qDebug() << "[PeerManager::handlePeerTested] Received result for:"
-             << peer.host << "on thread" << QThread::currentThreadId();
+    // Socks5Prober::cancel() drops its probes without reporting them, so
+    // its results always belong to the current generation.
+    finishProbe(peer, probeScheduler->generation());
+}
+
+/**
+ * @brief Records the result of a peer test and reports it
+ * @param peer The tested peer with updated latency and validity
+ * @param generation The scheduler generation the test was released in
+ */
+void PeerManager::finishProbe(const PeerData& peer, quint64 generation) {
+    qDebug() << "[PeerManager::finishProbe] Received result for:"
+             << peer.host() << "on thread" << QThread::currentThreadId();
+    probeScheduler->probeFinished(generation);
+    // A test of a sweep cancelled since, e.g. by a network change, measured
+    // the old network and must not count towards the new sweep.
+    if (generation != probeScheduler->generation()) {
+        qDebug() << "[PeerManager::finishProbe] Dropping the result of an"
+                 << "earlier sweep for:" << peer.host();
+        return;
+    }
+    // Results of cancelled tests say nothing about the peer.
+    if (cancelTestsFlag.loadAcquire() == 0) {
+        probeCache.record(peer, QDateTime::currentMSecsSinceEpoch(),
+                          networkMonitor->fingerprint());
+        latencyPredictor.addResult(peer);
+        rerankNeighbours(peer);
+        // Connection times through the proxy are not ping round trips.
+        if (! probeThroughProxy) {
+            probeTimeouts.addResult(peer.isValid() ? peer.latency() : -1);
+        }
+    }
     emit peerTested(peer);
 }
@@ -1,9 +1,14 @@
 #ifndef PEERMANAGER_H
 #define PEERMANAGER_H
 
+#include <algorithm>
 #include <memory>
+#include <vector>
 #include <QAtomicInt>
+#include <QByteArray>
 #include <QElapsedTimer>
+#include <QHostAddress>
+#include <QHash>
 #include <QList>
 #include <QMutex>
 #include <QNetworkAccessManager>
@@ -11,42 +16,34 @@
 #include <QObject>
 #include <QProcess>
 #include <QRunnable>
+#include <QSet>
 #include <QSettings>
-#include <QThreadPool>
-
-/**
- * @struct PeerData
- * @brief Holds information about a yggdrasil peer
- */
-struct PeerData {
-    QString host;
-    int latency = -1;      // in milliseconds
-    bool isValid = false;
-
-    /**
-     * @brief Whether the peer is private (that is, added by the user) or not.
-     */
-    bool isPrivate = false;
-
-    // Define equality operator based on host
-    bool operator==(const PeerData& other) const {
-        return host == other.host;
-    }
-};
-
-// Register PeerData for use with queued connections
-Q_DECLARE_METATYPE(PeerData)
-Q_DECLARE_METATYPE(QList<PeerData>)
+#include <QStringList>
+
+#include "AsnDatabase.h"
+#include "LatencyPredictor.h"
+#include "NetworkMonitor.h"
+#include "PeerData.h"
+#include "ProbeResultCache.h"
+#include "ProbeScheduler.h"
+#include "ProbeTimeouts.h"
+#include "SharedIcmpProber.h"
+#include "Socks5Prober.h"
 
 // Forward declaration
 class PeerManager;
 
 /**
  * @class PeerTestRunnable
- * @brief Runnable task for testing a single peer's latency using QThreadPool.
+ * @brief Runnable task for testing a single peer's latency on the Executor.
  *
  * @details Encapsulates the logic for pinging a single peer and reporting results.
- *          Designed to be run concurrently by a QThreadPool.
+ *          Hostname peers are resolved and pinged over IPv4 and IPv6 at the
+ *          same time, and the latency of each family is recorded.
+ *          Designed to be run concurrently in the normal lane of the
+ *          Executor; the tests in flight send their echo requests through
+ *          one SharedIcmpProber, so that they share the sockets and the
+ *          batches.
  *          Includes cancellation support via a shared QAtomicInt.
  */
 class PeerTestRunnable : public QObject, public QRunnable {
@@ -58,18 +55,49 @@ public:
     static constexpr int PING_COUNT = 3;
     // Interval to check ping status
     static constexpr int CHECK_INTERVAL_MS = 100;
-    // Total timeout for ping operation
+    // Interval between the echo requests to one address, like ping
+    static constexpr int PING_INTERVAL_MS = 1000;
+    // Send slot the echo requests of concurrent tests are aligned to, so
+    // that they share a batch
+    static constexpr int PING_SEND_SLOT_MS = 100;
+    // Total timeout for ping operation, and the cap of the adaptive
+    // reply timeout
     static constexpr int PING_TIMEOUT_MS = 5000;
+    // How much faster one address family of a dual-stack peer must be to
+    // pin it in the configuration
+    static constexpr int FAMILY_MARGIN_PERCENT = 10;
+    // Time the transport handshake of an endpoint may take
+    static constexpr int TRANSPORT_TIMEOUT_MS = 2000;
+    // Packets the transport handshake sends, counted by the probe rate
+    static constexpr int TRANSPORT_PROBE_PACKETS = 3;
+    // Size of the QUIC probe; servers ignore Initial packets that are
+    // smaller than 1200 bytes (RFC 9000, section 14.1)
+    static constexpr int QUIC_PROBE_SIZE = 1200;
 
     /**
      * @brief Constructor for PeerTestRunnable
      * @param peer The peer data to test.
      * @param cancelFlag Pointer to the shared cancellation flag.
+     * @param probeInterface Interface or source address to probe from, or
+     * an empty string for the default route.
+     * @param sweepUplinks Further uplinks to probe in parallel.
+     * @param timeouts Shared adaptive deadline for the first reply, or
+     * nullptr to wait up to PING_TIMEOUT_MS.
+     * @param asnDatabase Database to look up the origin AS of the probed
+     * address in, or nullptr.
+     * @param icmpProber Prober shared with the other tests of the sweep, or
+     * nullptr to probe through sockets of the test's own.
      * @param parent Optional QObject parent.
      */
-    explicit PeerTestRunnable(PeerData peer,
-                              QAtomicInt* cancelFlag,
-                              QObject *parent = nullptr);
+    explicit PeerTestRunnable(
+        PeerData peer,
+        QAtomicInt* cancelFlag,
+        const QString& probeInterface = QString(),
+        const QStringList& sweepUplinks = QStringList(),
+        const ProbeTimeouts* timeouts = nullptr,
+        std::shared_ptr<const AsnDatabase> asnDatabase = nullptr,
+        std::shared_ptr<SharedIcmpProber> icmpProber = nullptr,
+        QObject *parent = nullptr);
 
     /**
      * @brief The main execution method for the runnable task.
@@ -77,6 +105,55 @@ public:
      */
     void run() override;
 
+    /**
+     * @brief Resolve the addresses to probe for a host.
+     * @param host Hostname or IP address literal.
+     * @return The literal itself, or the first IPv4 and the first IPv6
+     * address the hostname resolves to.
+     */
+    static QList<QHostAddress> resolveTargets(const QString& host);
+
+    /**
+     * @brief Pick the addresses to probe among those of a host.
+     * @param addresses The addresses the host resolved to.
+     * @return The first IPv4 and the first IPv6 address.
+     */
+    static QList<QHostAddress> probeTargets(
+        const QList<QHostAddress>& addresses);
+
+    /**
+     * @brief Combine the per-family latencies of a peer.
+     * @param peer The peer with the per-family latencies set.
+     * @param dualStack Whether both an IPv4 and an IPv6 address were probed.
+     * @param addressIPv4 The probed IPv4 address.
+     * @param addressIPv6 The probed IPv6 address.
+     */
+    static void applyFamilyResults(PeerData& peer,
+                                   bool dualStack,
+                                   const QString& addressIPv4,
+                                   const QString& addressIPv6);
+
+    /**
+     * @brief Time the transport handshake of a peer endpoint; blocks.
+     * @param peerUri The peer URI.
+     * @param address The address the host of the URI resolved to.
+     * @param timeoutMs Time the handshake may take.
+     * @return Microseconds, or -1 if the endpoint did not answer or its
+     * transport cannot be probed.
+     * @details The ICMP probe only tells how far the host is; the endpoints
+     * of one host differ in whether their port answers and in how many
+     * round trips their handshake takes.
+     */
+    static qint64 measureTransport(const QString& peerUri,
+                                   const QHostAddress& address,
+                                   int timeoutMs);
+
+    /**
+     * @brief Check whether a datagram is a QUIC version negotiation packet.
+     * @param datagram The datagram.
+     */
+    static bool isVersionNegotiation(const QByteArray& datagram);
+
 signals:
     /**
      * @brief Emitted when the peer test is complete.
@@ -85,8 +162,37 @@ signals:
     void peerTested(const PeerData& peer);
 
 private:
+    /**
+     * @brief Latency measured to one address through one uplink.
+     */
+    struct ProbeOutcome {
+        QHostAddress target;
+        QString uplink;
+        // Whole milliseconds, or -1 if the address did not answer
+        int latency;
+        // Microseconds, or -1 if not measured more precisely
+        qint64 latencyUs;
+        PeerData::LatencySource source;
+    };
+
+    enum ProbeStatus { ProbeDone, ProbeCancelled, ProbeUnavailable };
+
+    bool isCancelled() const;
+    bool deadlineReached(qint64 elapsedMs, bool replied) const;
+    ProbeStatus probeNative(const QList<QHostAddress>& targets,
+                            const QStringList& uplinks,
+                            std::vector<ProbeOutcome>& outcomes);
+    ProbeStatus probePingCommand(const QList<QHostAddress>& targets,
+                                 const QStringList& uplinks,
+                                 std::vector<ProbeOutcome>& outcomes);
+
     PeerData peerData;
     QAtomicInt* cancelFlagPtr; // Shared cancellation flag
+    QString probeInterface;
+    QStringList sweepUplinks;
+    const ProbeTimeouts* timeouts;
+    std::shared_ptr<const AsnDatabase> asnDatabase;
+    std::shared_ptr<SharedIcmpProber> icmpProber;
 };
 
 
@@ -97,7 +203,7 @@ private:
  * @details This class provides functionality for:
  *          - Discovering peers from public repositories
  *          - Testing peer connection quality
- *          - Updating Yggdrasil configuration with selected peers
+ *          - Selecting peers for the Yggdrasil configuration
  *          - Managing peer testing in a separate thread
  *
  * Thread safety:
@@ -110,10 +216,48 @@ class PeerManager : public QObject {
 
 public:
     // Constants for configuration
-    // Timeout for update script execution
-    static constexpr int SCRIPT_TIMEOUT_MS = 30000;
     // Maximum number of peers to use in config
     static constexpr int MAX_PEERS = 15;
+    // Number of peer tests running at the same time
+    static constexpr int MAX_CONCURRENT_TESTS = 5;
+    // Probe priority of peers pinned by the user, above all other peers
+    static constexpr double PIN_PRIORITY = 3000.0;
+    // Latency advantage a candidate needs over a configured peer to replace
+    // it, in microseconds and in percent of the latency of the configured
+    // peer; the larger of the two applies
+    static constexpr qint64 DEFAULT_STICKINESS_US = 5000;
+    static constexpr int DEFAULT_STICKINESS_PERCENT = 10;
+    // Endpoints of one host written to the configuration; a host that
+    // offers tls://, tcp:// and quic:// would take three slots otherwise
+    static constexpr int DEFAULT_TRANSPORTS_PER_HOST = 1;
+
+    /**
+     * @brief Preference of selectConfigPeers() for the peers in the
+     * configuration.
+     * @details A configured public peer ranks as if it were faster by its
+     * margin, so that re-running a sweep swaps it only for a candidate that
+     * is materially faster, not one that won by a millisecond of jitter.
+     */
+    struct Stickiness {
+        // Hosts of the peers in the configuration
+        QStringList appliedPeers;
+        qint64 marginUs = DEFAULT_STICKINESS_US;
+        int marginPercent = DEFAULT_STICKINESS_PERCENT;
+
+        /**
+         * @brief Get the margin of a configured peer.
+         * @param latencyUs Latency of the peer in microseconds.
+         */
+        qint64 marginFor(qint64 latencyUs) const {
+            return std::max(marginUs, latencyUs * marginPercent / 100);
+        }
+
+        /**
+         * @brief Check whether a selection is the configured peer set.
+         * @param peers The selected peers.
+         */
+        bool isApplied(const QList<PeerData>& peers) const;
+    };
 
 public:
     explicit PeerManager(std::shared_ptr<QSettings> settings,
@@ -127,6 +271,13 @@ public:
      */
     void setPeerFetchProxy(const QNetworkProxy& proxy);
 
+    /**
+     * @brief Sets the proxy to test peers through
+     * @param proxy A SOCKS5 proxy to measure the time to connect to each
+     * peer through it, or QNetworkProxy::NoProxy to ping peers directly
+     */
+    void setProbeProxy(const QNetworkProxy& proxy);
+
     /**
      * @brief Fetches peer list from public peers repository
      */
@@ -142,9 +293,100 @@ public:
     /**
      * @brief Tests peer connection quality asynchronously
      * @param peer The peer to test
+     * @details The test is queued and started when the probe scheduler
+     * allows it.  Pinned and private peers are tested first, then peers by
+     * their earlier results, so that the likely best peers are known early
      */
     void testPeer(PeerData peer);
 
+    /**
+     * @brief Resolves the hosts of peers ahead of their tests
+     * @param peers The peers
+     * @details peerResolved() reports every peer with the addresses to
+     * probe, so that the lookups of a sweep run ahead of the probes instead
+     * of inside the tests.  Peers probed through the proxy are reported
+     * without addresses; the proxy resolves them
+     */
+    void resolvePeers(const QList<PeerData>& peers);
+
+    /**
+     * @brief Drops the host lookups of resolvePeers() that are not done
+     */
+    void cancelResolution();
+
+    /**
+     * @brief Moves a peer to the front of the probe queue
+     * @param host The peer URI
+     * @details Works on peers that are queued already, and on peers queued
+     * later on until the tests are cancelled
+     */
+    void pinPeer(const QString& host);
+
+    /**
+     * @brief Sets the probe packet rate
+     * @param packetsPerSecond Probe packets per second, paced evenly; 0 sends
+     * probes as fast as the concurrency limit allows
+     */
+    void setProbeRate(int packetsPerSecond);
+
+    /**
+     * @brief Sets the uplinks to run the peer tests through
+     * @param probeInterface Interface or source address the peer latency is
+     * measured from, or an empty string for the default route
+     * @param sweepUplinks Further uplinks to measure every peer through, in
+     * parallel, for the per-uplink latencies
+     */
+    void setProbeUplinks(const QString& probeInterface,
+                         const QStringList& sweepUplinks);
+
+    /**
+     * @brief Lists the network interfaces that can reach the internet
+     * @return Names of the interfaces that are up and have an address other
+     * than a loopback, link-local or Yggdrasil (200::/7) one
+     */
+    static QStringList availableUplinks();
+
+    /**
+     * @brief Checks whether an interface address can be used as an uplink
+     * @param address The interface address
+     */
+    static bool isUplinkAddress(const QHostAddress& address);
+
+    /**
+     * @brief Estimates the latency of a peer from its measured neighbours
+     * @param peer The peer
+     * @return The estimate; not valid if no neighbour has been measured
+     */
+    LatencyPredictor::Prediction predictLatency(const PeerData& peer) const;
+
+    /**
+     * @brief Compiles a prefix-to-AS dump into the ASN database in the
+     * background and switches to it
+     * @param dumpPath Path of a routeviews prefix-to-AS or an iptoasn
+     * range-to-AS dump
+     * @details asnDatabaseChanged() reports the result.
+     */
+    void importAsnDatabase(const QString& dumpPath);
+
+    /**
+     * @brief Gets the number of prefixes in the ASN database
+     * @return The prefix count, or 0 if there is no database
+     */
+    int asnPrefixCount() const;
+
+    /**
+     * @brief Describes an AS for display
+     * @param asn The AS number
+     * @return E.g. "AS64496 EXAMPLE-NET", or an empty string for 0
+     */
+    QString describeAsn(quint32 asn) const;
+
+    /**
+     * @brief Gets the fingerprint of the network the host is on
+     * @return The fingerprint, or an empty string if it is unknown
+     */
+    QString networkFingerprint() const;
+
     /**
      * @brief Resets the cancellation flag to allow new tests to run
      */
@@ -163,22 +405,51 @@ public:
      * @details If the resource has .sh extension, the output file
      * will be made executable
      */
-    bool extractResource(const QString& resourcePath,
-                         const QString& outputPath);
+    static bool extractResource(const QString& resourcePath,
+                                const QString& outputPath);
 
     /**
-     * @brief Updates Yggdrasil configuration with selected peers
-     * @param selectedPeers List of peers to include in configuration
-     * @return true if configuration was successfully updated
+     * @brief Selects the peers to be written to the Yggdrasil configuration
+     * @param selectedPeers List of peers selected by the user
+     * @param maxPeers Maximum number of peers to select
+     * @return At most maxPeers peers to write, in the order of preference
      * @details
-     * - Sorts peers by latency (valid peers first, then lowest latency)
-     * - Extracts update script and policy file to temporary location
-     * - Creates temporary file with peer list
-     * - Executes update script with elevated privileges via polkit
-     * - Handles special case where exit code 1 with success message is valid
-     * - Cleans up temporary files regardless of outcome
+     * - Keeps only peers with a valid URI that are private or passed the
+     *   latency test
+     * - Pins private peers first, then picks the top public peers (valid
+     *   peers first, then lowest latency) with a partial selection instead
+     *   of sorting all candidates
+     * - Falls back to all peers with a valid URI if none passed the test
+     * - Prefers the configured public peers by their margin if stickiness
+     *   is given
+     * - Keeps at most transportsPerHost endpoints of one host (see
+     *   peerHostIdentity()), the ones with the fastest transport handshake,
+     *   so that the freed slots go to other hosts; private endpoints of a
+     *   host count against its limit, and the fallback peers are limited
+     *   the same way
+     *
+     * The configuration itself is written by ApplyConfigJob.
      */
-    bool updateConfig(const QList<PeerData>& selectedPeers);
+    static QList<PeerData> selectConfigPeers(
+        const QList<PeerData>& selectedPeers,
+        int maxPeers = MAX_PEERS,
+        const Stickiness* stickiness = nullptr,
+        int transportsPerHost = 0);
+
+    /**
+     * @brief Read the configured peers and the stickiness margins from the
+     * settings.
+     * @param settings The settings.
+     */
+    static Stickiness loadStickiness(const QSettings& settings);
+
+    /**
+     * @brief Remember the peers written to the configuration.
+     * @param settings The settings.
+     * @param peers The written peers.
+     */
+    static void storeAppliedPeers(QSettings& settings,
+                                  const QList<PeerData>& peers);
 
     /**
      * @brief Exports the given list of peers to a CSV file
@@ -192,7 +463,15 @@ public:
 signals:
     void peersDiscovered(const QList<PeerData>& peers);
     void peerTested(const PeerData& peer);
+    // A peer of resolvePeers() was resolved; resolved is false if its host
+    // has no address
+    void peerResolved(const PeerData& peer, bool resolved);
     void error(const QString& message);
+    // The host moved to another network; the cached results of the
+    // previous network were dropped
+    void networkChanged(const QString& fingerprint);
+    // An ASN database import finished
+    void asnDatabaseChanged(bool success, const QString& message);
     // Removed: void requestTestPeer(PeerData peer);
 
 private slots:
@@ -205,23 +484,78 @@ private slots:
     void handleNetworkResponse(QNetworkReply* reply);
 
     /**
-     * @brief Handles the completion of a peer test
+     * @brief Handles the completion of a peer test through the proxy
      * @param peer The tested peer with updated latency and validity
      */
     void handlePeerTested(const PeerData& peer);
 
+    /**
+     * @brief Starts a peer test released by the probe scheduler
+     * @param peer The peer to test
+     */
+    void startProbe(const PeerData& peer);
+
+    /**
+     * @brief Drops the cached results of the previous network
+     * @param fingerprint Fingerprint of the new network
+     * @param previous Fingerprint of the previous network
+     */
+    void handleNetworkChanged(const QString& fingerprint,
+                              const QString& previous);
+
+    /**
+     * @brief Switches to the imported ASN database
+     * @param success Whether the import succeeded
+     * @param message Description of the failure
+     */
+    void handleAsnImported(bool success, const QString& message);
+
 private:
+    QString asnDatabasePath() const;
+    bool openAsnDatabase();
+    void annotateAsn(PeerData& peer) const;
+    int probeCost(const PeerData& peer) const;
+    double probePriority(const PeerData& peer) const;
+    void rerankNeighbours(const PeerData& peer);
+    void finishProbe(const PeerData& peer, quint64 generation);
+
     QNetworkAccessManager* networkManager;
-    QThreadPool* threadPool;
+    Socks5Prober* socksProber;
+    bool probeThroughProxy;
+    ProbeScheduler* probeScheduler;
+    ProbeResultCache probeCache;
+    // Replaced as a whole on import; running tests keep the old one
+    std::shared_ptr<const AsnDatabase> asnDatabase;
+    LatencyPredictor latencyPredictor;
+    // Queued peers by neighbourhood, to re-rank them as neighbours finish
+    QHash<QString, QList<PeerData>> queuedNeighbours;
+    QSet<QString> pinnedPeers;
+    ProbeTimeouts probeTimeouts;
+    // ICMP sockets the tests in flight probe through together
+    std::shared_ptr<SharedIcmpProber> icmpProber;
+    NetworkMonitor* networkMonitor;
     QAtomicInt cancelTestsFlag;
+    // Host lookups of resolvePeers() in progress
+    QSet<int> hostLookups;
+    // Incremented by cancelResolution() to drop the late lookups
+    quint64 resolveGeneration;
     bool debugMode;
     std::shared_ptr<QSettings> settings;
+    QString probeInterface;
+    QStringList sweepUplinks;
 };
 
 
 // Auxiliary procedures.
 
 bool isPeerUriValid(const QString& peerUri);
+QString pingHost(const QString& peerUri);
+int peerPort(const QString& peerUri);
+QString peerHostIdentity(const QString& peerUri);
+int parsePingLatency(const QString& output);
+QString configPeerUri(const PeerData& peer);
+bool isSamePeer(const QString& a, const QString& b);
+bool containsPeer(const QStringList& uris, const QString& uri);
 void formatPeer(QTextStream& stream, const PeerData& peer);
 void writePeers(QTextStream& stream, const QList<PeerData>& peers);
 
@@ -0,0 +1,632 @@
+/**
+ * @file PeerProfiles.cpp
+ * @brief Implementation file for the PeerProfiles and PeerProfileSwitcher
+ * classes.
+ */
+
+#include <algorithm>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QHash>
+
+#include "ApplyConfigJob.h"
+#include "Executor.h"
+#include "PeerManager.h"
+#include "PeerProfiles.h"
+
+constexpr qint64 PeerProfiles::REVALIDATE_AFTER_MS;
+constexpr int PeerProfileSwitcher::VALIDATION_CHECK_MS;
+
+// Version of the serialized format
+static const quint32 PROFILES_FORMAT_VERSION = 1;
+
+static const QString PROFILES_KEY = "peer_discovery/profiles";
+static const QString ACTIVE_PROFILE_KEY = "peer_discovery/active_profile";
+static const QString AUTO_SWITCH_KEY = "peer_discovery/profile_auto_switch";
+
+/**
+ * @brief Get the URIs to connect to: the peers that passed their last
+ * test, or all peers if none did.
+ */
+QStringList PeerProfiles::Profile::uris() const {
+    QStringList reachable;
+    QStringList all;
+    for (const PeerData& peer : peers) {
+        all << peer.host();
+        if (peer.isValid()) {
+            reachable << peer.host();
+        }
+    }
+    return reachable.isEmpty() ? all : reachable;
+}
+
+/**
+ * @brief Get the number of peers that passed their last test.
+ */
+int PeerProfiles::Profile::reachableCount() const {
+    return static_cast<int>(std::count_if(
+        peers.cbegin(), peers.cend(),
+        [](const PeerData& peer) { return peer.isValid(); }));
+}
+
+/**
+ * @brief Constructor for PeerProfiles
+ * @param settings Settings to store the profiles in.
+ */
+PeerProfiles::PeerProfiles(std::shared_ptr<QSettings> settings)
+    : settings(settings) {
+}
+
+/**
+ * @brief Get all profiles, sorted by name.
+ */
+QList<PeerProfiles::Profile> PeerProfiles::profiles() const {
+    QList<Profile> profiles;
+    loadProfiles(settings->value(PROFILES_KEY).toByteArray(), profiles);
+    std::sort(profiles.begin(), profiles.end(),
+              [](const Profile& a, const Profile& b) {
+                  return a.name.compare(b.name, Qt::CaseInsensitive) < 0;
+              });
+    return profiles;
+}
+
+/**
+ * @brief Find a profile by name.
+ * @param name The name.
+ * @param profile Receives the profile.
+ * @return false if there is no such profile.
+ */
+bool PeerProfiles::find(const QString& name, Profile* profile) const {
+    for (const Profile& candidate : profiles()) {
+        if (candidate.name == name) {
+            *profile = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Add a profile or replace the profile of the same name.
+ * @param profile The profile; a profile bound to the same network before
+ * is unbound.
+ */
+void PeerProfiles::save(const Profile& profile) {
+    QList<Profile> kept;
+    for (Profile other : profiles()) {
+        if (other.name == profile.name) {
+            continue;
+        }
+        if ((! profile.network.isEmpty())
+            && (other.network == profile.network)) {
+            other.network.clear();
+        }
+        kept << other;
+    }
+    kept << profile;
+    store(kept);
+}
+
+/**
+ * @brief Delete a profile.
+ * @param name The name.
+ * @return false if there is no such profile.
+ */
+bool PeerProfiles::remove(const QString& name) {
+    QList<Profile> kept = profiles();
+    auto removed = std::remove_if(kept.begin(), kept.end(),
+                                  [&name](const Profile& profile) {
+                                      return profile.name == name;
+                                  });
+    if (removed == kept.end()) {
+        return false;
+    }
+    kept.erase(removed, kept.end());
+    store(kept);
+    if (activeProfile() == name) {
+        setActiveProfile(QString());
+    }
+    return true;
+}
+
+/**
+ * @brief Get the profile bound to a network.
+ * @param fingerprint Fingerprint of the network.
+ * @return The name of the profile, or an empty string.
+ */
+QString PeerProfiles::profileForNetwork(const QString& fingerprint) const {
+    if (fingerprint.isEmpty()) {
+        return QString();
+    }
+    for (const Profile& profile : profiles()) {
+        if (profile.network == fingerprint) {
+            return profile.name;
+        }
+    }
+    return QString();
+}
+
+/**
+ * @brief Get the name of the profile switched to last, or an empty string.
+ */
+QString PeerProfiles::activeProfile() const {
+    return settings->value(ACTIVE_PROFILE_KEY).toString();
+}
+
+void PeerProfiles::setActiveProfile(const QString& name) {
+    settings->setValue(ACTIVE_PROFILE_KEY, name);
+}
+
+/**
+ * @brief Whether to switch to the profile bound to a network when the host
+ * moves to it.
+ */
+bool PeerProfiles::autoSwitch() const {
+    return settings->value(AUTO_SWITCH_KEY, true).toBool();
+}
+
+void PeerProfiles::setAutoSwitch(bool enabled) {
+    settings->setValue(AUTO_SWITCH_KEY, enabled);
+}
+
+/**
+ * @brief Store the results of a validation of a profile.
+ * @param name The name of the profile.
+ * @param results The tested peers; peers of the profile that are not among
+ * them keep their earlier results.
+ * @param nowMs Time of the validation, in milliseconds since the epoch.
+ * @return false if there is no such profile.
+ */
+bool PeerProfiles::recordResults(const QString& name,
+                                 const QList<PeerData>& results,
+                                 qint64 nowMs) {
+    QHash<QString, PeerData> tested;
+    for (const PeerData& peer : results) {
+        tested.insert(peer.host(), peer);
+    }
+
+    QList<Profile> all = profiles();
+    for (Profile& profile : all) {
+        if (profile.name != name) {
+            continue;
+        }
+        for (PeerData& peer : profile.peers) {
+            auto it = tested.constFind(peer.host());
+            if (it != tested.constEnd()) {
+                PeerData result(peer.host(), peer.isPrivate());
+                result.setValid(it->isValid());
+                result.setLatency(it->latency());
+                peer = result;
+            }
+        }
+        sortPeers(profile.peers);
+        profile.validatedMs = nowMs;
+        store(all);
+        return true;
+    }
+    return false;
+}
+
+/**
+ * @brief Check whether a profile is due for validation.
+ * @param profile The profile.
+ * @param nowMs The current time, in milliseconds since the epoch.
+ */
+bool PeerProfiles::needsValidation(const Profile& profile, qint64 nowMs) {
+    return (! profile.peers.isEmpty())
+        && ((profile.validatedMs <= 0)
+            || (nowMs - profile.validatedMs >= REVALIDATE_AFTER_MS));
+}
+
+/**
+ * @brief Order peers fastest first; unreachable and untested peers go last,
+ * in their previous order.
+ * @param peers The peers.
+ */
+void PeerProfiles::sortPeers(QList<PeerData>& peers) {
+    std::stable_sort(peers.begin(), peers.end(),
+                     [](const PeerData& a, const PeerData& b) {
+                         bool aReachable = a.isValid() && (a.latency() >= 0);
+                         bool bReachable = b.isValid() && (b.latency() >= 0);
+                         if (aReachable != bReachable) {
+                             return aReachable;
+                         }
+                         return aReachable && (a.latency() < b.latency());
+                     });
+}
+
+/**
+ * @brief Serialize profiles.
+ * @param profiles The profiles.
+ */
+QByteArray PeerProfiles::saveProfiles(const QList<Profile>& profiles) {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    stream << PROFILES_FORMAT_VERSION
+           << static_cast<quint32>(profiles.size());
+    for (const Profile& profile : profiles) {
+        stream << profile.name << profile.network << profile.validatedMs
+               << static_cast<quint32>(profile.peers.size());
+        for (const PeerData& peer : profile.peers) {
+            stream << peer.host() << peer.isPrivate() << peer.isValid()
+                   << static_cast<qint32>(peer.latency());
+        }
+    }
+    return data;
+}
+
+/**
+ * @brief Deserialize profiles.
+ * @param data Data written by saveProfiles().
+ * @param profiles Receives the profiles.
+ * @return false if the data is malformed; profiles is empty then.
+ */
+bool PeerProfiles::loadProfiles(const QByteArray& data,
+                                QList<Profile>& profiles) {
+    profiles.clear();
+    if (data.isEmpty()) {
+        return true;
+    }
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> version >> count;
+    if ((stream.status() != QDataStream::Ok)
+        || (version != PROFILES_FORMAT_VERSION)) {
+        qDebug() << "[PeerProfiles::loadProfiles] Unsupported profile data";
+        return false;
+    }
+
+    for (quint32 i = 0; (i < count) && (stream.status() == QDataStream::Ok);
+         ++i) {
+        Profile profile;
+        quint32 peerCount = 0;
+        stream >> profile.name >> profile.network >> profile.validatedMs
+               >> peerCount;
+        for (quint32 j = 0;
+             (j < peerCount) && (stream.status() == QDataStream::Ok);
+             ++j) {
+            QString host;
+            bool isPrivate;
+            bool isValid;
+            qint32 latency;
+            stream >> host >> isPrivate >> isValid >> latency;
+            PeerData peer(host, isPrivate);
+            peer.setValid(isValid);
+            peer.setLatency(latency);
+            profile.peers << peer;
+        }
+        profiles << profile;
+    }
+    if (stream.status() != QDataStream::Ok) {
+        qDebug() << "[PeerProfiles::loadProfiles] Truncated profile data";
+        profiles.clear();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Write profiles to the settings.
+ * @param profiles All profiles.
+ */
+void PeerProfiles::store(const QList<Profile>& profiles) {
+    settings->setValue(PROFILES_KEY, saveProfiles(profiles));
+    settings->sync();
+}
+
+/**
+ * @brief Constructor for PeerProfileSwitcher
+ * @param settings Settings the profiles are stored in.
+ * @param socketPaths Yggdrasil admin socket path candidates.
+ * @param parent Optional QObject parent.
+ */
+PeerProfileSwitcher::PeerProfileSwitcher(std::shared_ptr<QSettings> settings,
+                                         const QStringList& socketPaths,
+                                         QObject *parent)
+    : QObject(parent)
+    , store(settings)
+    , settings(settings)
+    , socketPaths(socketPaths)
+    , networkMonitor(new NetworkMonitor(this))
+    , validationTimer(new QTimer(this))
+    , switchUserRequested(false)
+    , validationRemaining(0) {
+    qRegisterMetaType<PeerData>("PeerData");
+    validationTimer->setInterval(VALIDATION_CHECK_MS);
+    connect(validationTimer, &QTimer::timeout,
+            this, &PeerProfileSwitcher::validateDueProfiles);
+    connect(networkMonitor, &NetworkMonitor::networkChanged,
+            this, &PeerProfileSwitcher::onNetworkChanged);
+}
+
+/**
+ * @brief Destructor for PeerProfileSwitcher
+ */
+PeerProfileSwitcher::~PeerProfileSwitcher() {
+    // Switches and peer tests report back to this object.
+    Executor::instance().clear(this);
+    Executor::instance().waitForDone(this);
+}
+
+/**
+ * @brief Watch for network changes and validate profiles periodically.
+ * @details Switches to the profile of the current network right away.
+ */
+void PeerProfileSwitcher::start() {
+    networkMonitor->start();
+    validationTimer->start();
+    onNetworkChanged(networkMonitor->fingerprint());
+}
+
+/**
+ * @brief Switch to a profile in the background; switched() reports the
+ * result.
+ * @param name The name of the profile.
+ * @param userRequested Whether the user asked for the switch; only then
+ * the configuration is written if the admin socket is not available.
+ * @return false if a switch is in progress or there is no such profile.
+ */
+bool PeerProfileSwitcher::switchTo(const QString& name, bool userRequested) {
+    PeerProfiles::Profile profile;
+    if (isSwitching() || (! store.find(name, &profile))) {
+        return false;
+    }
+
+    QStringList uris = profile.uris();
+    QStringList paths = socketPaths;
+    qDebug() << "[PeerProfileSwitcher::switchTo]" << name << uris;
+    switchingProfile = name;
+    switchUserRequested = userRequested;
+    bool submitted = Executor::instance().submit(
+        Executor::Interactive,
+        [this, name, uris, paths]() {
+            SocketManager socketManager(paths);
+            SwitchResult result = switchLive(
+                [&socketManager](const QJsonObject& request) {
+                    return socketManager.sendRequest(request);
+                },
+                uris);
+            QMetaObject::invokeMethod(this, "onLiveSwitchDone",
+                                      Qt::QueuedConnection,
+                                      Q_ARG(QString, name),
+                                      Q_ARG(int, result));
+        },
+        this);
+    if (! submitted) {
+        switchingProfile.clear();
+    }
+    return submitted;
+}
+
+/**
+ * @brief Set the interval between checks for profiles due for validation.
+ * @param ms The interval, or -1 to stop validating.
+ */
+void PeerProfileSwitcher::setValidationInterval(int ms) {
+    if (ms < 0) {
+        validationTimer->stop();
+    } else {
+        validationTimer->start(ms);
+    }
+}
+
+/**
+ * @brief Test the peers of a profile in the background; validated() is
+ * emitted when done.
+ * @param name The name of the profile.
+ * @return false if a validation is in progress or there is no such profile.
+ */
+bool PeerProfileSwitcher::validate(const QString& name) {
+    PeerProfiles::Profile profile;
+    if ((! validatingProfile.isEmpty())
+        || (! store.find(name, &profile))
+        || profile.peers.isEmpty()) {
+        return false;
+    }
+
+    qDebug() << "[PeerProfileSwitcher::validate]" << name;
+    validatingProfile = name;
+    validationResults.clear();
+    validationRemaining = profile.peers.size();
+    QString probeInterface
+        = settings->value("peer_discovery/probe_interface", "").toString();
+    for (const PeerData& peer : profile.peers) {
+        auto runnable = new PeerTestRunnable(peer, nullptr, probeInterface);
+        connect(runnable, &PeerTestRunnable::peerTested,
+                this, &PeerProfileSwitcher::onPeerValidated,
+                Qt::QueuedConnection);
+        if (! Executor::instance().submit(Executor::Background,
+                                          runnable,
+                                          this)) {
+            // Keep the earlier result of the peer.
+            --validationRemaining;
+        }
+    }
+    if (validationRemaining == 0) {
+        validatingProfile.clear();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Switch the running daemon to a peer set through the admin socket;
+ * blocks until done.
+ * @param request Sends admin socket requests.
+ * @param uris URIs of the peers to run with.
+ * @return The result; on SwitchFailed, the connected peers were kept.
+ * @details The new peers are added before the others are removed, so that
+ * the node is not left without peers while it switches.
+ */
+PeerProfileSwitcher::SwitchResult PeerProfileSwitcher::switchLive(
+    const AdminRequest& request,
+    const QStringList& uris) {
+    QJsonObject response = request({{"request", "getpeers"}});
+    if (response["status"].toString() != "success") {
+        return AdminUnavailable;
+    }
+    QStringList current = SocketManager::outboundPeerUris(response);
+
+    auto send = [&request](const QString& name, const QString& uri) {
+        QJsonObject arguments {{"uri", uri}};
+        QJsonObject response = request({{"request", name},
+                                        {"arguments", arguments}});
+        bool success = (response["status"].toString() == "success");
+        qDebug() << "[PeerProfileSwitcher::switchLive]" << name << uri
+                 << (success ? "succeeded" : "failed");
+        return success;
+    };
+
+    // The daemon reports the peers as configPeerUri() wrote them, with the
+    // address of the host and the host name as the SNI.
+    int kept = 0;
+    for (const QString& uri : uris) {
+        if (containsPeer(current, uri) || send("addpeer", uri)) {
+            ++kept;
+        }
+    }
+    if (kept == 0) {
+        return SwitchFailed;
+    }
+    for (const QString& uri : current) {
+        if (! containsPeer(uris, uri)) {
+            send("removepeer", uri);
+        }
+    }
+    return Switched;
+}
+
+/**
+ * @brief Switch to the profile bound to the new network.
+ * @param fingerprint Fingerprint of the new network.
+ */
+void PeerProfileSwitcher::onNetworkChanged(const QString& fingerprint) {
+    if (! store.autoSwitch()) {
+        return;
+    }
+    QString name = store.profileForNetwork(fingerprint);
+    if (name.isEmpty() || (name == store.activeProfile())) {
+        return;
+    }
+    qDebug() << "[PeerProfileSwitcher::onNetworkChanged] Switching to"
+             << name;
+    switchTo(name, false);
+}
+
+/**
+ * @brief Finish a switch, or write the configuration if the admin socket
+ * was not available.
+ * @param name The name of the profile.
+ * @param result The SwitchResult of the live switch.
+ */
+void PeerProfileSwitcher::onLiveSwitchDone(const QString& name, int result) {
+    if (result == Switched) {
+        store.setActiveProfile(name);
+        finishSwitch(name, true, tr("Switched to the peers of %1.").arg(name));
+        PeerProfiles::Profile profile;
+        if (store.find(name, &profile)
+            && PeerProfiles::needsValidation(
+                profile, QDateTime::currentMSecsSinceEpoch())) {
+            validate(name);
+        }
+        return;
+    }
+    if (result == SwitchFailed) {
+        finishSwitch(name, false,
+                     tr("None of the peers of %1 could be added; the"
+                        " current peers were kept.").arg(name));
+        return;
+    }
+
+    PeerProfiles::Profile profile;
+    if ((! switchUserRequested) || (! store.find(name, &profile))) {
+        finishSwitch(name, false,
+                     tr("The Yggdrasil admin socket is not available."));
+        return;
+    }
+    // The daemon is not running, or not reachable: the peers take effect
+    // through the configuration.
+    ApplyConfigJob* job = new ApplyConfigJob(
+        PeerManager::selectConfigPeers(profile.peers),
+        false,
+        "yggdrasil",
+        socketPaths,
+        this);
+    connect(job, &ApplyConfigJob::finished, this,
+            [this, name, job](bool success, const QString& message) {
+        job->deleteLater();
+        if (success) {
+            store.setActiveProfile(name);
+            PeerManager::storeAppliedPeers(*settings,
+                                           job->configuredPeers());
+        }
+        finishSwitch(name, success, message);
+    });
+    job->start();
+}
+
+/**
+ * @brief Collect the result of a peer test of the profile being validated.
+ * @param peer The tested peer.
+ */
+void PeerProfileSwitcher::onPeerValidated(const PeerData& peer) {
+    if (validatingProfile.isEmpty()) {
+        return;
+    }
+    validationResults << peer;
+    if (--validationRemaining > 0) {
+        return;
+    }
+
+    QString name = validatingProfile;
+    validatingProfile.clear();
+    store.recordResults(name,
+                        validationResults,
+                        QDateTime::currentMSecsSinceEpoch());
+    validationResults.clear();
+    qDebug() << "[PeerProfileSwitcher::onPeerValidated] Validated" << name;
+    emit validated(name);
+
+    // Go on with the next profile that is due, unless validation is
+    // deferred.
+    if (validationTimer->isActive()) {
+        validateDueProfiles();
+    }
+}
+
+/**
+ * @brief Validate the first profile due for validation.
+ */
+void PeerProfileSwitcher::validateDueProfiles() {
+    if (! validatingProfile.isEmpty()) {
+        return;
+    }
+    qint64 nowMs = QDateTime::currentMSecsSinceEpoch();
+    for (const PeerProfiles::Profile& profile : store.profiles()) {
+        if (PeerProfiles::needsValidation(profile, nowMs)
+            && validate(profile.name)) {
+            return;
+        }
+    }
+}
+
+/**
+ * @brief Report the result of a switch.
+ * @param name The name of the profile.
+ * @param success Whether the daemon runs with the profile now.
+ * @param message Human-readable result.
+ */
+void PeerProfileSwitcher::finishSwitch(const QString& name,
+                                       bool success,
+                                       const QString& message) {
+    switchingProfile.clear();
+    qDebug() << "[PeerProfileSwitcher::finishSwitch]" << name << success
+             << message;
+    emit switched(name, success, message);
+}
@@ -0,0 +1,318 @@
+/**
+ * @file PeerProfiles.h
+ * @brief Header file for the PeerProfiles and PeerProfileSwitcher classes.
+ *
+ * Named peer sets that can be switched to in seconds, by hand or by network.
+ */
+
+#ifndef PEERPROFILES_H
+#define PEERPROFILES_H
+
+#include <functional>
+#include <memory>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QList>
+#include <QObject>
+#include <QSettings>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+#include "NetworkMonitor.h"
+#include "PeerData.h"
+#include "SocketManager.h"
+
+/**
+ * @class PeerProfiles
+ * @brief Named peer sets with the results of their last validation.
+ *
+ * @details Moving between networks otherwise means running the whole
+ *          discovery and apply cycle again.  A profile keeps a peer set
+ *          chosen on one network, together with the latency each peer had
+ *          when it was last tested, so that switching to it needs no
+ *          discovery at all.  A profile may be bound to the fingerprint of
+ *          a network (see NetworkMonitor); at most one profile is bound to
+ *          a network.
+ *
+ *          Profiles are stored under "peer_discovery/profiles", the name of
+ *          the profile switched to last under
+ *          "peer_discovery/active_profile".
+ */
+class PeerProfiles {
+public:
+    /**
+     * @brief A named peer set.
+     */
+    struct Profile {
+        QString name;
+        // Peers, fastest first, with the results of the last validation
+        QList<PeerData> peers;
+        // Fingerprint of the network to switch to the profile on, or empty
+        QString network;
+        // Time of the last validation, in milliseconds since the epoch, or
+        // 0 if the peers were never tested
+        qint64 validatedMs = 0;
+
+        /**
+         * @brief Get the URIs to connect to: the peers that passed their
+         * last test, or all peers if none did.
+         */
+        QStringList uris() const;
+
+        /**
+         * @brief Get the number of peers that passed their last test.
+         */
+        int reachableCount() const;
+    };
+
+    // Age of the last validation after which a profile is tested again
+    static constexpr qint64 REVALIDATE_AFTER_MS = 6LL * 60 * 60 * 1000;
+
+    /**
+     * @brief Constructor for PeerProfiles
+     * @param settings Settings to store the profiles in.
+     */
+    explicit PeerProfiles(std::shared_ptr<QSettings> settings);
+
+    /**
+     * @brief Get all profiles, sorted by name.
+     */
+    QList<Profile> profiles() const;
+
+    /**
+     * @brief Find a profile by name.
+     * @param name The name.
+     * @param profile Receives the profile.
+     * @return false if there is no such profile.
+     */
+    bool find(const QString& name, Profile* profile) const;
+
+    /**
+     * @brief Add a profile or replace the profile of the same name.
+     * @param profile The profile; a profile bound to the same network
+     * before is unbound.
+     */
+    void save(const Profile& profile);
+
+    /**
+     * @brief Delete a profile.
+     * @param name The name.
+     * @return false if there is no such profile.
+     */
+    bool remove(const QString& name);
+
+    /**
+     * @brief Get the profile bound to a network.
+     * @param fingerprint Fingerprint of the network.
+     * @return The name of the profile, or an empty string.
+     */
+    QString profileForNetwork(const QString& fingerprint) const;
+
+    /**
+     * @brief Get the name of the profile switched to last, or an empty
+     * string.
+     */
+    QString activeProfile() const;
+    void setActiveProfile(const QString& name);
+
+    /**
+     * @brief Whether to switch to the profile bound to a network when the
+     * host moves to it.
+     */
+    bool autoSwitch() const;
+    void setAutoSwitch(bool enabled);
+
+    /**
+     * @brief Store the results of a validation of a profile.
+     * @param name The name of the profile.
+     * @param results The tested peers; peers of the profile that are not
+     * among them keep their earlier results.
+     * @param nowMs Time of the validation, in milliseconds since the epoch.
+     * @return false if there is no such profile.
+     */
+    bool recordResults(const QString& name,
+                       const QList<PeerData>& results,
+                       qint64 nowMs);
+
+    /**
+     * @brief Check whether a profile is due for validation.
+     * @param profile The profile.
+     * @param nowMs The current time, in milliseconds since the epoch.
+     */
+    static bool needsValidation(const Profile& profile, qint64 nowMs);
+
+    /**
+     * @brief Order peers fastest first; unreachable and untested peers go
+     * last, in their previous order.
+     * @param peers The peers.
+     */
+    static void sortPeers(QList<PeerData>& peers);
+
+    /**
+     * @brief Serialize profiles.
+     * @param profiles The profiles.
+     */
+    static QByteArray saveProfiles(const QList<Profile>& profiles);
+
+    /**
+     * @brief Deserialize profiles.
+     * @param data Data written by saveProfiles().
+     * @param profiles Receives the profiles.
+     * @return false if the data is malformed; profiles is empty then.
+     */
+    static bool loadProfiles(const QByteArray& data, QList<Profile>& profiles);
+
+private:
+    void store(const QList<Profile>& profiles);
+
+    std::shared_ptr<QSettings> settings;
+};
+
+/**
+ * @class PeerProfileSwitcher
+ * @brief Switches the running daemon to a profile and keeps the profiles
+ * validated.
+ *
+ * @details A switch takes the fastest path that is available:
+ *
+ *          1. Live - add the peers of the profile that are not connected
+ *             and remove the other peers through the admin socket
+ *             ("addpeer"/"removepeer"), which takes seconds and changes the
+ *             running daemon only;
+ *          2. Configuration - if the admin socket is not available, write
+ *             the peers to the configuration with ApplyConfigJob, which
+ *             may ask for a password.  Only switches the user asked for
+ *             take this path.
+ *
+ *          When the host moves to a network a profile is bound to, and
+ *          automatic switching is enabled, the switcher switches to that
+ *          profile live.  Profiles whose last validation is older than
+ *          PeerProfiles::REVALIDATE_AFTER_MS are tested again in the
+ *          background lane of the Executor, one profile at a time.
+ */
+class PeerProfileSwitcher : public QObject {
+    Q_OBJECT
+
+public:
+    enum SwitchResult {
+        Switched,         ///< The daemon runs with the peers of the profile
+        AdminUnavailable, ///< The admin socket did not answer
+        SwitchFailed      ///< No peer of the profile could be added
+    };
+
+    // Sends an admin socket request and returns the response
+    using AdminRequest = std::function<QJsonObject(const QJsonObject&)>;
+
+    // Interval between checks for profiles due for validation
+    static constexpr int VALIDATION_CHECK_MS = 15 * 60 * 1000;
+
+    /**
+     * @brief Constructor for PeerProfileSwitcher
+     * @param settings Settings the profiles are stored in.
+     * @param socketPaths Yggdrasil admin socket path candidates.
+     * @param parent Optional QObject parent.
+     */
+    explicit PeerProfileSwitcher(
+        std::shared_ptr<QSettings> settings,
+        const QStringList& socketPaths = SocketManager::defaultSocketPaths(),
+        QObject *parent = nullptr);
+
+    /**
+     * @brief Destructor for PeerProfileSwitcher
+     */
+    ~PeerProfileSwitcher();
+
+    /**
+     * @brief Get the profile store.
+     */
+    PeerProfiles& profiles() { return store; }
+
+    /**
+     * @brief Watch for network changes and validate profiles periodically.
+     */
+    void start();
+
+    /**
+     * @brief Switch to a profile in the background; switched() reports the
+     * result.
+     * @param name The name of the profile.
+     * @param userRequested Whether the user asked for the switch; only
+     * then the configuration is written if the admin socket is not
+     * available.
+     * @return false if a switch is in progress or there is no such
+     * profile.
+     */
+    bool switchTo(const QString& name, bool userRequested = true);
+
+    /**
+     * @brief Check whether a switch is in progress.
+     */
+    bool isSwitching() const { return ! switchingProfile.isEmpty(); }
+
+    /**
+     * @brief Set the interval between checks for profiles due for
+     * validation.
+     * @param ms The interval, or -1 to stop validating (for example, on a
+     * metered connection).
+     */
+    void setValidationInterval(int ms);
+
+    /**
+     * @brief Test the peers of a profile in the background; validated() is
+     * emitted when done.
+     * @param name The name of the profile.
+     * @return false if a validation is in progress or there is no such
+     * profile.
+     */
+    bool validate(const QString& name);
+
+    /**
+     * @brief Switch the running daemon to a peer set through the admin
+     * socket; blocks until done.
+     * @param request Sends admin socket requests.
+     * @param uris URIs of the peers to run with.
+     * @return The result; on SwitchFailed, the connected peers were kept.
+     */
+    static SwitchResult switchLive(const AdminRequest& request,
+                                   const QStringList& uris);
+
+signals:
+    /**
+     * @brief Emitted when a switch is done.
+     * @param name The name of the profile.
+     * @param success Whether the daemon runs with the profile now.
+     * @param message Human-readable result.
+     */
+    void switched(const QString& name, bool success, const QString& message);
+
+    /**
+     * @brief Emitted when the peers of a profile were tested.
+     * @param name The name of the profile.
+     */
+    void validated(const QString& name);
+
+private slots:
+    void onNetworkChanged(const QString& fingerprint);
+    void onLiveSwitchDone(const QString& name, int result);
+    void onPeerValidated(const PeerData& peer);
+    void validateDueProfiles();
+
+private:
+    void finishSwitch(const QString& name,
+                      bool success,
+                      const QString& message);
+
+    PeerProfiles store;
+    std::shared_ptr<QSettings> settings;
+    QStringList socketPaths;
+    NetworkMonitor* networkMonitor;
+    QTimer* validationTimer;
+    QString switchingProfile;
+    bool switchUserRequested;
+    QString validatingProfile;
+    QList<PeerData> validationResults;
+    int validationRemaining;
+};
+
+#endif // PEERPROFILES_H
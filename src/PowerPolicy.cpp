@@ -0,0 +1,182 @@
+/**
+ * @file PowerPolicy.cpp
+ * @brief Implementation file for the PowerPolicy class.
+ */
+
+#include <QDBusMessage>
+#include <QDBusPendingCallWatcher>
+#include <QDBusPendingReply>
+#include <QDBusVariant>
+#include <QDebug>
+
+#include "PowerPolicy.h"
+
+constexpr const char* PowerPolicy::UPOWER_SERVICE;
+constexpr const char* PowerPolicy::UPOWER_PATH;
+constexpr const char* PowerPolicy::UPOWER_INTERFACE;
+constexpr const char* PowerPolicy::NM_SERVICE;
+constexpr const char* PowerPolicy::NM_PATH;
+constexpr const char* PowerPolicy::NM_INTERFACE;
+
+// Interface of the standard property getter and change signal
+static const char* PROPERTIES_INTERFACE = "org.freedesktop.DBus.Properties";
+
+/**
+ * @brief Constructor for PowerPolicy
+ * @param bus Bus UPower and NetworkManager are on.
+ * @param parent Optional QObject parent.
+ */
+PowerPolicy::PowerPolicy(const QDBusConnection& bus, QObject *parent)
+    : QObject(parent)
+    , bus(bus) {
+    qRegisterMetaType<PowerPolicy::State>("PowerPolicy::State");
+    if (! this->bus.isConnected()) {
+        qDebug() << "[PowerPolicy] D-Bus is not available,"
+                 << "background work is not throttled";
+        return;
+    }
+
+    this->bus.connect(UPOWER_SERVICE, UPOWER_PATH, PROPERTIES_INTERFACE,
+                      "PropertiesChanged", this,
+                      SLOT(onPropertiesChanged(QString, QVariantMap,
+                                               QStringList)));
+    this->bus.connect(NM_SERVICE, NM_PATH, PROPERTIES_INTERFACE,
+                      "PropertiesChanged", this,
+                      SLOT(onPropertiesChanged(QString, QVariantMap,
+                                               QStringList)));
+    fetchProperty(UPOWER_SERVICE, UPOWER_PATH, UPOWER_INTERFACE, "OnBattery");
+    fetchProperty(NM_SERVICE, NM_PATH, NM_INTERFACE, "Metered");
+}
+
+/**
+ * @brief Decide how to run background work in a state.
+ * @param state The power and network state.
+ * @param usesNetwork Whether the work sends traffic over the uplink.
+ */
+PowerPolicy::Decision PowerPolicy::decide(const State& state,
+                                          bool usesNetwork) {
+    if (usesNetwork && state.metered) {
+        return Defer;
+    }
+    return state.onBattery ? Throttle : Run;
+}
+
+/**
+ * @brief Get the interval to run periodic background work at.
+ * @param baseMs Interval on mains power and an unmetered connection.
+ * @param usesNetwork Whether the work sends traffic over the uplink.
+ * @return The interval, or -1 if the work is deferred.
+ */
+int PowerPolicy::intervalMs(int baseMs, bool usesNetwork) const {
+    switch (decide(usesNetwork)) {
+    case Run:
+        return baseMs;
+    case Throttle:
+        return baseMs * THROTTLE_FACTOR;
+    case Defer:
+        return -1;
+    }
+    return baseMs;
+}
+
+/**
+ * @brief Get a human-readable description of the decision for network
+ * work in a state.
+ * @param state The power and network state.
+ */
+QString PowerPolicy::describe(const State& state) {
+    switch (decide(state, true)) {
+    case Run:
+        return tr("Background checks: normal");
+    case Throttle:
+        return tr("Background checks: reduced (on battery)");
+    case Defer:
+        return tr("Background checks: paused (metered network)");
+    }
+    return QString();
+}
+
+/**
+ * @brief Check whether a NetworkManager Metered value means metered.
+ * @param value NMMetered value.
+ */
+bool PowerPolicy::isMeteredValue(uint value) {
+    // NM_METERED_YES and NM_METERED_GUESS_YES
+    return (value == 1) || (value == 3);
+}
+
+/**
+ * @brief Update the cached state from a PropertiesChanged signal.
+ * @param interface Interface whose properties changed.
+ * @param properties The changed properties and their new values.
+ * @param invalidated Changed properties whose values are not included.
+ */
+void PowerPolicy::onPropertiesChanged(const QString& interface,
+                                      const QVariantMap& properties,
+                                      const QStringList& invalidated) {
+    for (auto it = properties.constBegin();
+         it != properties.constEnd();
+         ++it) {
+        updateState(it.key(), it.value());
+    }
+    if ((interface == UPOWER_INTERFACE) && invalidated.contains("OnBattery")) {
+        fetchProperty(UPOWER_SERVICE, UPOWER_PATH, UPOWER_INTERFACE,
+                      "OnBattery");
+    }
+    if ((interface == NM_INTERFACE) && invalidated.contains("Metered")) {
+        fetchProperty(NM_SERVICE, NM_PATH, NM_INTERFACE, "Metered");
+    }
+}
+
+/**
+ * @brief Read a property asynchronously and update the state with it.
+ * @param service Service name.
+ * @param path Object path.
+ * @param interface Interface of the property.
+ * @param name Property name.
+ */
+void PowerPolicy::fetchProperty(const QString& service,
+                                const QString& path,
+                                const QString& interface,
+                                const QString& name) {
+    QDBusMessage call = QDBusMessage::createMethodCall(
+        service, path, PROPERTIES_INTERFACE, "Get");
+    call << interface << name;
+    auto watcher = new QDBusPendingCallWatcher(bus.asyncCall(call), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished,
+            this, [this, name](QDBusPendingCallWatcher* watcher) {
+                QDBusPendingReply<QDBusVariant> reply = *watcher;
+                watcher->deleteLater();
+                if (reply.isError()) {
+                    qDebug() << "[PowerPolicy::fetchProperty] Failed to read"
+                             << name << "-" << reply.error().message();
+                    return;
+                }
+                updateState(name, reply.value().variant());
+            });
+}
+
+/**
+ * @brief Update the cached state from a property value.
+ * @param name Property name; other properties are ignored.
+ * @param value Property value.
+ */
+void PowerPolicy::updateState(const QString& name, const QVariant& value) {
+    State state = current;
+    if (name == "OnBattery") {
+        state.onBattery = value.toBool();
+    } else if (name == "Metered") {
+        state.metered = isMeteredValue(value.toUInt());
+    } else {
+        return;
+    }
+    if ((state.onBattery == current.onBattery)
+        && (state.metered == current.metered)) {
+        return;
+    }
+
+    current = state;
+    qDebug() << "[PowerPolicy::updateState] On battery:" << current.onBattery
+             << "metered:" << current.metered;
+    emit changed(current);
+}
@@ -0,0 +1,140 @@
+/**
+ * @file PowerPolicy.h
+ * @brief Header file for the PowerPolicy class.
+ *
+ * Throttles and defers background work on battery and on metered networks.
+ */
+
+#ifndef POWERPOLICY_H
+#define POWERPOLICY_H
+
+#include <QDBusConnection>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+/**
+ * @class PowerPolicy
+ * @brief Scheduling policy for background work, from the power and network
+ * state.
+ *
+ * @details Reads whether the machine runs on battery from UPower, and
+ *          whether the primary connection is metered from NetworkManager,
+ *          over D-Bus.  Both are cached and kept up to date through the
+ *          PropertiesChanged signals of the services, so deciding costs no
+ *          bus round trip.
+ *
+ *          Background work that uses the network, such as peer probes and
+ *          fetches, is deferred on a metered connection, and all background
+ *          work runs less often on battery.  Work the user asked for is
+ *          never held back.  When a service is not available, its state
+ *          counts as mains power and an unmetered connection.
+ */
+class PowerPolicy : public QObject {
+    Q_OBJECT
+
+public:
+    enum Decision {
+        Run,      ///< Run at the normal interval
+        Throttle, ///< Run THROTTLE_FACTOR times less often
+        Defer     ///< Do not run until the state changes
+    };
+
+    /**
+     * @brief Power and network state the decisions are based on.
+     */
+    struct State {
+        bool onBattery = false;
+        bool metered = false;
+    };
+
+    // D-Bus names of UPower
+    static constexpr const char* UPOWER_SERVICE = "org.freedesktop.UPower";
+    static constexpr const char* UPOWER_PATH = "/org/freedesktop/UPower";
+    static constexpr const char* UPOWER_INTERFACE = "org.freedesktop.UPower";
+    // D-Bus names of NetworkManager
+    static constexpr const char* NM_SERVICE = "org.freedesktop.NetworkManager";
+    static constexpr const char* NM_PATH = "/org/freedesktop/NetworkManager";
+    static constexpr const char* NM_INTERFACE
+        = "org.freedesktop.NetworkManager";
+    // Throttled background work runs this many times less often
+    static constexpr int THROTTLE_FACTOR = 4;
+
+    /**
+     * @brief Constructor for PowerPolicy
+     * @param bus Bus UPower and NetworkManager are on; the system bus in
+     * the application, a session bus stand-in in the tests.
+     * @param parent Optional QObject parent.
+     */
+    explicit PowerPolicy(const QDBusConnection& bus
+                             = QDBusConnection::systemBus(),
+                         QObject *parent = nullptr);
+
+    /**
+     * @brief Get the cached power and network state.
+     */
+    State state() const { return current; }
+
+    /**
+     * @brief Decide how to run background work in a state.
+     * @param state The power and network state.
+     * @param usesNetwork Whether the work sends traffic over the uplink.
+     */
+    static Decision decide(const State& state, bool usesNetwork);
+
+    /**
+     * @brief Decide how to run background work now.
+     * @param usesNetwork Whether the work sends traffic over the uplink.
+     */
+    Decision decide(bool usesNetwork) const {
+        return decide(current, usesNetwork);
+    }
+
+    /**
+     * @brief Get the interval to run periodic background work at.
+     * @param baseMs Interval on mains power and an unmetered connection.
+     * @param usesNetwork Whether the work sends traffic over the uplink.
+     * @return The interval, or -1 if the work is deferred.
+     */
+    int intervalMs(int baseMs, bool usesNetwork) const;
+
+    /**
+     * @brief Get a human-readable description of the decision for network
+     * work in a state, for the status UI.
+     * @param state The power and network state.
+     */
+    static QString describe(const State& state);
+
+    /**
+     * @brief Check whether a NetworkManager Metered value means metered.
+     * @param value NMMetered value: 1 (yes) or 3 (guessed yes).
+     */
+    static bool isMeteredValue(uint value);
+
+signals:
+    /**
+     * @brief Emitted when the power or network state changed.
+     * @param state The new state.
+     */
+    void changed(const PowerPolicy::State& state);
+
+private slots:
+    void onPropertiesChanged(const QString& interface,
+                             const QVariantMap& properties,
+                             const QStringList& invalidated);
+
+private:
+    void fetchProperty(const QString& service,
+                       const QString& path,
+                       const QString& interface,
+                       const QString& name);
+    void updateState(const QString& name, const QVariant& value);
+
+    QDBusConnection bus;
+    State current;
+};
+
+Q_DECLARE_METATYPE(PowerPolicy::State)
+
+#endif // POWERPOLICY_H
@@ -0,0 +1,171 @@
+/**
+ * @file ProbeResultCache.cpp
+ * @brief Implementation file for the ProbeResultCache class.
+ */
+
+#include <algorithm>
+#include <cmath>
+#include <QDataStream>
+#include <QDebug>
+
+#include "ProbeResultCache.h"
+
+// Definition of the constant that std::min() takes by reference
+constexpr int ProbeResultCache::SLOW_LATENCY_MS;
+
+// Version of the serialized format
+static const quint32 CACHE_FORMAT_VERSION = 2;
+// Version without network fingerprints, still read
+static const quint32 CACHE_FORMAT_VERSION_1 = 1;
+
+/**
+ * @brief Record the result of a peer test.
+ * @param peer The tested peer.
+ * @param nowMs Current time in milliseconds since the epoch.
+ * @param network Fingerprint of the network the peer was tested on.
+ */
+void ProbeResultCache::record(const PeerData& peer,
+                              qint64 nowMs,
+                              const QString& network) {
+    Entry entry;
+    entry.latency = peer.latency();
+    entry.isValid = peer.isValid();
+    entry.timestampMs = nowMs;
+    entry.network = network;
+    entries.insert(peer.host(), entry);
+}
+
+/**
+ * @brief Drop the results measured on another network.
+ * @param network Fingerprint of the current network.
+ * @return Number of dropped results.
+ */
+int ProbeResultCache::invalidate(const QString& network) {
+    int dropped = 0;
+    for (auto it = entries.begin(); it != entries.end();) {
+        const QString& entryNetwork = it.value().network;
+        if ((! entryNetwork.isEmpty()) && (entryNetwork != network)) {
+            it = entries.erase(it);
+            ++dropped;
+        } else {
+            ++it;
+        }
+    }
+    return dropped;
+}
+
+/**
+ * @brief Look up the last result of a peer.
+ * @param host The peer URI.
+ * @param entry Receives the result, if there is one.
+ * @return true if the peer has a cached result.
+ */
+bool ProbeResultCache::lookup(const QString& host, Entry* entry) const {
+    auto it = entries.constFind(host);
+    if (it == entries.constEnd()) {
+        return false;
+    }
+    if (entry) {
+        *entry = it.value();
+    }
+    return true;
+}
+
+/**
+ * @brief Get the probe priority of a peer; higher goes first.
+ * @param peer The peer.
+ * @param nowMs Current time in milliseconds since the epoch.
+ */
+double ProbeResultCache::priority(const PeerData& peer, qint64 nowMs) const {
+    if (peer.isPrivate()) {
+        return PRIVATE_PRIORITY;
+    }
+
+    Entry entry;
+    if (! lookup(peer.host(), &entry)) {
+        return UNKNOWN_PRIORITY;
+    }
+
+    double score = FAILED_PRIORITY;
+    if (entry.isValid && (entry.latency > 0)) {
+        score = SLOW_LATENCY_MS - std::min(entry.latency, SLOW_LATENCY_MS);
+    }
+
+    // Blend towards the unknown priority as the result ages.
+    qint64 age = std::max<qint64>(0, nowMs - entry.timestampMs);
+    double freshness = std::pow(0.5, static_cast<double>(age) / HALF_LIFE_MS);
+    return score * freshness + UNKNOWN_PRIORITY * (1.0 - freshness);
+}
+
+/**
+ * @brief Serialize the results that are younger than MAX_AGE_MS.
+ * @param nowMs Current time in milliseconds since the epoch.
+ */
+QByteArray ProbeResultCache::save(qint64 nowMs) const {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+
+    quint32 count = 0;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        if (nowMs - it.value().timestampMs < MAX_AGE_MS) {
+            ++count;
+        }
+    }
+
+    stream << CACHE_FORMAT_VERSION << count;
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        const Entry& entry = it.value();
+        if (nowMs - entry.timestampMs < MAX_AGE_MS) {
+            stream << it.key()
+                   << static_cast<qint32>(entry.latency)
+                   << entry.isValid
+                   << entry.timestampMs
+                   << entry.network;
+        }
+    }
+    return data;
+}
+
+/**
+ * @brief Replace the cache contents with serialized results.
+ * @param data Data written by save().
+ * @return false if the data is malformed; the cache is empty then.
+ */
+bool ProbeResultCache::load(const QByteArray& data) {
+    entries.clear();
+    if (data.isEmpty()) {
+        return true;
+    }
+
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint32 version = 0;
+    quint32 count = 0;
+    stream >> version >> count;
+    if ((stream.status() != QDataStream::Ok)
+        || ((version != CACHE_FORMAT_VERSION)
+            && (version != CACHE_FORMAT_VERSION_1))) {
+        qDebug() << "[ProbeResultCache::load] Unsupported cache data";
+        return false;
+    }
+
+    entries.reserve(static_cast<int>(std::min<quint32>(count, 100000)));
+    for (quint32 i = 0; i < count; ++i) {
+        QString host;
+        qint32 latency;
+        Entry entry;
+        stream >> host >> latency >> entry.isValid >> entry.timestampMs;
+        if (version != CACHE_FORMAT_VERSION_1) {
+            stream >> entry.network;
+        }
+        if (stream.status() != QDataStream::Ok) {
+            qDebug() << "[ProbeResultCache::load] Truncated cache data";
+            entries.clear();
+            return false;
+        }
+        entry.latency = latency;
+        entries.insert(host, entry);
+    }
+    return true;
+}
@@ -0,0 +1,112 @@
+/**
+ * @file ProbeResultCache.h
+ * @brief Header file for the ProbeResultCache class.
+ *
+ * Remembers earlier peer test results to decide which peers to test first.
+ */
+
+#ifndef PROBERESULTCACHE_H
+#define PROBERESULTCACHE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+
+#include "PeerData.h"
+
+/**
+ * @class ProbeResultCache
+ * @brief Last test result of every peer, with its age.
+ *
+ * @details The cache turns earlier results into a probe priority: peers
+ *          that were fast are tested first, peers that failed last.  The
+ *          older a result is, the less it counts, so that stale results
+ *          drift back to the priority of an unknown peer.  Private peers
+ *          always go before public ones.
+ *
+ *          Each result is tagged with the fingerprint of the network it was
+ *          measured on (see NetworkMonitor), so that the results of another
+ *          network can be dropped when the host moves.
+ */
+class ProbeResultCache {
+public:
+    // Priority of private peers
+    static constexpr double PRIVATE_PRIORITY = 2000.0;
+    // Priority of a peer without a cached result
+    static constexpr double UNKNOWN_PRIORITY = 500.0;
+    // Priority of a peer that failed its last test
+    static constexpr double FAILED_PRIORITY = -500.0;
+    // Latency at or above which a working peer gets no priority at all
+    static constexpr int SLOW_LATENCY_MS = 1000;
+    // Age at which a cached result counts half
+    static constexpr qint64 HALF_LIFE_MS = 24LL * 60 * 60 * 1000;
+    // Age at which a cached result is dropped
+    static constexpr qint64 MAX_AGE_MS = 7 * HALF_LIFE_MS;
+
+    /**
+     * @brief A cached test result.
+     */
+    struct Entry {
+        int latency = -1;
+        bool isValid = false;
+        qint64 timestampMs = 0;
+        // Fingerprint of the network; empty if unknown
+        QString network;
+    };
+
+    /**
+     * @brief Record the result of a peer test.
+     * @param peer The tested peer.
+     * @param nowMs Current time in milliseconds since the epoch.
+     * @param network Fingerprint of the network the peer was tested on.
+     */
+    void record(const PeerData& peer,
+                qint64 nowMs,
+                const QString& network = QString());
+
+    /**
+     * @brief Drop the results measured on another network.
+     * @param network Fingerprint of the current network; results without
+     * a fingerprint are kept.
+     * @return Number of dropped results.
+     */
+    int invalidate(const QString& network);
+
+    /**
+     * @brief Look up the last result of a peer.
+     * @param host The peer URI.
+     * @param entry Receives the result, if there is one.
+     * @return true if the peer has a cached result.
+     */
+    bool lookup(const QString& host, Entry* entry) const;
+
+    /**
+     * @brief Get the probe priority of a peer; higher goes first.
+     * @param peer The peer.
+     * @param nowMs Current time in milliseconds since the epoch.
+     */
+    double priority(const PeerData& peer, qint64 nowMs) const;
+
+    /**
+     * @brief Get the number of cached results.
+     */
+    int size() const { return entries.size(); }
+
+    /**
+     * @brief Serialize the results that are younger than MAX_AGE_MS.
+     * @param nowMs Current time in milliseconds since the epoch.
+     */
+    QByteArray save(qint64 nowMs) const;
+
+    /**
+     * @brief Replace the cache contents with serialized results.
+     * @param data Data written by save().
+     * @return false if the data is malformed; the cache is empty then.
+     */
+    bool load(const QByteArray& data);
+
+private:
+    QHash<QString, Entry> entries;
+};
+
+#endif // PROBERESULTCACHE_H
@@ -0,0 +1,152 @@
+/**
+ * @file ProbeScheduler.cpp
+ * @brief Implementation file for the ProbeScheduler class.
+ */
+
+#include <algorithm>
+#include <QDebug>
+
+#include "ProbeScheduler.h"
+
+/**
+ * @brief Constructor for ProbeScheduler
+ * @param parent Optional QObject parent.
+ */
+ProbeScheduler::ProbeScheduler(QObject *parent)
+    : QObject(parent)
+    , timer(new QTimer(this))
+    , packetsPerSecond(0)
+    , maxInFlight(DEFAULT_MAX_IN_FLIGHT)
+    , inFlight(0)
+    , nextSequence(0)
+    , currentGeneration(0) {
+    clock.start();
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::PreciseTimer);
+    connect(timer, &QTimer::timeout, this, &ProbeScheduler::dispatch);
+    setRate(DEFAULT_RATE_PPS);
+}
+
+/**
+ * @brief Set the probe packet rate.
+ * @param packetsPerSecond Packets per second; 0 disables pacing.
+ */
+void ProbeScheduler::setRate(int packetsPerSecond) {
+    this->packetsPerSecond = std::max(0, packetsPerSecond);
+    bucket.setRate(this->packetsPerSecond,
+                   this->packetsPerSecond * BURST_MS / 1000.0);
+    qDebug() << "[ProbeScheduler::setRate] Rate:" << this->packetsPerSecond
+             << "packets/s";
+}
+
+/**
+ * @brief Set how many released probes may run at the same time.
+ * @param maxInFlight Maximum number of probes in flight.
+ */
+void ProbeScheduler::setMaxInFlight(int maxInFlight) {
+    this->maxInFlight = std::max(1, maxInFlight);
+}
+
+/**
+ * @brief Queue a probe.
+ * @param peer The peer to probe.
+ * @param cost Number of packets the probe sends.
+ * @param priority Probes with a higher priority are released first.
+ */
+void ProbeScheduler::enqueue(const PeerData& peer, int cost, double priority) {
+    quint64 sequence = nextSequence++;
+    pending.insert(peer.host(), { peer, std::max(1, cost), sequence });
+    queue.push({ priority, sequence, peer.host() });
+    if (! timer->isActive()) {
+        dispatch();
+    }
+}
+
+/**
+ * @brief Change the priority of a queued probe.
+ * @param host The URI of the queued peer.
+ * @param priority The new priority.
+ * @return false if no probe is queued for the host.
+ */
+bool ProbeScheduler::setPriority(const QString& host, double priority) {
+    auto it = pending.find(host);
+    if (it == pending.end()) {
+        return false;
+    }
+    // The old heap entry goes stale with the sequence number.
+    it->sequence = nextSequence++;
+    queue.push({ priority, it->sequence, host });
+    if (! timer->isActive()) {
+        dispatch();
+    }
+    return true;
+}
+
+/**
+ * @brief Report that a released probe is done.
+ * @param generation The generation() the probe was released in.
+ */
+void ProbeScheduler::probeFinished(quint64 generation) {
+    // Results of probes released before clear() may still arrive; their
+    // slots were already given back.
+    if (generation != currentGeneration) {
+        return;
+    }
+    if (inFlight > 0) {
+        --inFlight;
+    }
+    if (! timer->isActive()) {
+        dispatch();
+    }
+}
+
+/**
+ * @brief Drop all queued probes and forget the ones in flight.
+ */
+void ProbeScheduler::clear() {
+    qDebug() << "[ProbeScheduler::clear] Dropping" << pending.size()
+             << "queued probes";
+    timer->stop();
+    pending.clear();
+    queue = std::priority_queue<QueueEntry>();
+    inFlight = 0;
+    ++currentGeneration;
+}
+
+/**
+ * @brief Drop stale entries from the top of the heap.
+ */
+void ProbeScheduler::skipStaleEntries() {
+    while (! queue.empty()) {
+        const QueueEntry& top = queue.top();
+        auto it = pending.constFind(top.host);
+        if ((it != pending.constEnd()) && (it->sequence == top.sequence)) {
+            return;
+        }
+        queue.pop();
+    }
+}
+
+/**
+ * @brief Release the probes that may start now and schedule the next check.
+ */
+void ProbeScheduler::dispatch() {
+    skipStaleEntries();
+    while ((! queue.empty()) && (inFlight < maxInFlight)) {
+        qint64 now = clock.elapsed();
+        auto it = pending.find(queue.top().host);
+        int cost = it->cost;
+        if (! bucket.tryTake(cost, now)) {
+            timer->start(static_cast<int>(
+                std::max<qint64>(1, bucket.msUntilAvailable(cost, now))));
+            return;
+        }
+        PeerData peer = it->peer;
+        pending.erase(it);
+        queue.pop();
+        skipStaleEntries();
+        ++inFlight;
+        emit probeReady(peer);
+    }
+    // Otherwise, probeFinished() or enqueue() continues.
+}
@@ -0,0 +1,182 @@
+/**
+ * @file ProbeScheduler.h
+ * @brief Header file for the ProbeScheduler class.
+ *
+ * Paces peer probes to a packet rate and a concurrency limit.
+ */
+
+#ifndef PROBESCHEDULER_H
+#define PROBESCHEDULER_H
+
+#include <functional>
+#include <queue>
+#include <vector>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QObject>
+#include <QTimer>
+
+#include "PeerData.h"
+#include "TokenBucket.h"
+
+/**
+ * @class ProbeScheduler
+ * @brief Releases queued peer probes evenly over time.
+ *
+ * @details Starting a whole sweep at once sends a burst of ICMP echo requests
+ *          or TCP SYNs that home routers and upstream IDS rate-limit, which
+ *          inflates the measured latencies and drops replies.  The scheduler
+ *          holds probes back until a token bucket of probe packets allows
+ *          them, independently of how many probes may run at once.
+ *
+ *          Each probe is queued with its cost, the number of packets it
+ *          sends.  A probe is released through probeReady() when the bucket
+ *          has enough tokens and fewer than the maximum number of probes are
+ *          in flight.  The owner reports the end of every released probe
+ *          with probeFinished(), passing the generation() the probe was
+ *          released in; clear() starts a new generation, so that probes
+ *          still running from before it do not free slots of the next
+ *          sweep.
+ *
+ *          Queued probes are released highest priority first, and in queue
+ *          order among equal priorities.  The priority of a queued probe can
+ *          be changed while the sweep runs; a probe queued again for the same
+ *          host replaces the earlier one.
+ */
+class ProbeScheduler : public QObject {
+    Q_OBJECT
+
+public:
+    // Default probe packet rate
+    static constexpr int DEFAULT_RATE_PPS = 20;
+    // Default number of probes running at the same time
+    static constexpr int DEFAULT_MAX_IN_FLIGHT = 5;
+    // The bucket holds tokens for this long, so that probes are spread
+    // evenly instead of going out in bursts
+    static constexpr int BURST_MS = 100;
+
+    /**
+     * @brief Constructor for ProbeScheduler
+     * @param parent Optional QObject parent.
+     */
+    explicit ProbeScheduler(QObject *parent = nullptr);
+
+    /**
+     * @brief Set the probe packet rate.
+     * @param packetsPerSecond Packets per second; 0 disables pacing.
+     */
+    void setRate(int packetsPerSecond);
+
+    /**
+     * @brief Get the probe packet rate, 0 if pacing is disabled.
+     */
+    int rate() const { return packetsPerSecond; }
+
+    /**
+     * @brief Set how many released probes may run at the same time.
+     * @param maxInFlight Maximum number of probes in flight.
+     */
+    void setMaxInFlight(int maxInFlight);
+
+    /**
+     * @brief Queue a probe.
+     * @param peer The peer to probe.
+     * @param cost Number of packets the probe sends.
+     * @param priority Probes with a higher priority are released first.
+     */
+    void enqueue(const PeerData& peer, int cost, double priority = 0.0);
+
+    /**
+     * @brief Change the priority of a queued probe.
+     * @param host The URI of the queued peer.
+     * @param priority The new priority.
+     * @return false if no probe is queued for the host.
+     */
+    bool setPriority(const QString& host, double priority);
+
+    /**
+     * @brief Report that a released probe is done.
+     * @param generation The generation() the probe was released in.
+     * Probes released before the last clear() are ignored.
+     */
+    void probeFinished(quint64 generation);
+
+    /**
+     * @brief Drop all queued probes and forget the ones in flight.
+     */
+    void clear();
+
+    /**
+     * @brief Get the current generation, bumped by every clear().
+     */
+    quint64 generation() const { return currentGeneration; }
+
+    /**
+     * @brief Get the number of queued probes.
+     */
+    int pendingCount() const { return pending.size(); }
+
+    /**
+     * @brief Get the number of released probes that are not done yet.
+     */
+    int inFlightCount() const { return inFlight; }
+
+signals:
+    /**
+     * @brief Emitted when a probe may start.
+     * @param peer The peer to probe.
+     */
+    void probeReady(const PeerData& peer);
+
+private slots:
+    /**
+     * @brief Release the probes that may start now and schedule the next
+     * check.
+     */
+    void dispatch();
+
+private:
+    /**
+     * @brief A queued probe.
+     */
+    struct PendingProbe {
+        PeerData peer;
+        int cost;
+        quint64 sequence;
+    };
+
+    /**
+     * @brief A heap entry; it is stale once its probe was released,
+     * replaced or given another priority.
+     */
+    struct QueueEntry {
+        double priority;
+        quint64 sequence;
+        QString host;
+
+        bool operator<(const QueueEntry& other) const {
+            if (priority != other.priority) {
+                return priority < other.priority;
+            }
+            return sequence > other.sequence;
+        }
+    };
+
+    /**
+     * @brief Drop stale entries from the top of the heap.
+     */
+    void skipStaleEntries();
+
+    QHash<QString, PendingProbe> pending;
+    std::priority_queue<QueueEntry> queue;
+    quint64 nextSequence;
+    TokenBucket bucket;
+    QElapsedTimer clock;
+    QTimer* timer;
+    int packetsPerSecond;
+    int maxInFlight;
+    int inFlight;
+    quint64 currentGeneration;
+};
+
+#endif // PROBESCHEDULER_H
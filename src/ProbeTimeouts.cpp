@@ -0,0 +1,100 @@
+/**
+ * @file ProbeTimeouts.cpp
+ * @brief Implementation file for the ProbeTimeouts class.
+ */
+
+#include <algorithm>
+#include <QDebug>
+
+#include "ProbeTimeouts.h"
+
+// Definition of the constant that std::max() takes by reference
+constexpr int ProbeTimeouts::MIN_DEADLINE_MS;
+
+/**
+ * @brief Constructs the timeouts of a sweep.
+ * @param maxTimeoutMs Hard cap of the reply timeout.
+ * @param topK Number of peers that make it into the configuration.
+ */
+ProbeTimeouts::ProbeTimeouts(int maxTimeoutMs, int topK)
+    : maxTimeoutMs(maxTimeoutMs)
+    , topK(std::max(1, topK))
+    , timeout(maxTimeoutMs)
+    , cutoff(0) {
+}
+
+/**
+ * @brief Forget the results of the previous sweep.
+ */
+void ProbeTimeouts::reset() {
+    samples.clear();
+    best = std::priority_queue<int>();
+    timeout.storeRelease(maxTimeoutMs);
+    cutoff.storeRelease(0);
+}
+
+/**
+ * @brief Add the result of a peer test.
+ * @param latencyMs Measured latency, or -1 if the peer did not answer.
+ */
+void ProbeTimeouts::addResult(int latencyMs) {
+    if (latencyMs <= 0) {
+        return;
+    }
+
+    samples.append(latencyMs);
+    if (samples.size() >= MIN_SAMPLES) {
+        QVector<int> values = samples;
+        int rtt = percentile(values, PERCENTILE);
+        int adapted = rtt + rtt * TIMEOUT_MARGIN_PERCENT / 100;
+        adapted = std::min(maxTimeoutMs, std::max(MIN_DEADLINE_MS, adapted));
+        if (adapted != timeout.loadAcquire()) {
+            qDebug() << "[ProbeTimeouts::addResult] Reply timeout:"
+                     << adapted << "ms after" << samples.size() << "results";
+        }
+        timeout.storeRelease(adapted);
+    }
+
+    if (static_cast<int>(best.size()) < topK) {
+        best.push(latencyMs);
+    } else if (latencyMs < best.top()) {
+        best.pop();
+        best.push(latencyMs);
+    }
+    if (static_cast<int>(best.size()) == topK) {
+        int kth = best.top();
+        cutoff.storeRelease(kth + kth * CUTOFF_MARGIN_PERCENT / 100);
+    }
+}
+
+/**
+ * @brief Get the time a peer may take to send its first reply.
+ * @param competing Whether the peer competes for the top K.
+ * @return Milliseconds since the start of the test.
+ */
+int ProbeTimeouts::replyDeadlineMs(bool competing) const {
+    int deadline = timeout.loadAcquire();
+    int topKCutoff = cutoff.loadAcquire();
+    if (competing && (topKCutoff > 0)) {
+        deadline = std::min(deadline, topKCutoff);
+    }
+    return std::max(MIN_DEADLINE_MS, deadline);
+}
+
+/**
+ * @brief Get a percentile of a list of values.
+ * @param values The values; reordered.
+ * @param percent The percentile, 0 to 100.
+ * @return The nearest-rank percentile, or -1 if there are no values.
+ */
+int ProbeTimeouts::percentile(QVector<int>& values, int percent) {
+    if (values.isEmpty()) {
+        return -1;
+    }
+    percent = std::min(100, std::max(0, percent));
+    // Nearest rank: the smallest value with at least percent% at or below
+    int rank = (percent * values.size() + 99) / 100;
+    int index = std::max(0, rank - 1);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
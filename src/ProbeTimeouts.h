@@ -0,0 +1,100 @@
+/**
+ * @file ProbeTimeouts.h
+ * @brief Header file for the ProbeTimeouts class.
+ *
+ * Derives the peer test timeouts from the latencies measured so far.
+ */
+
+#ifndef PROBETIMEOUTS_H
+#define PROBETIMEOUTS_H
+
+#include <queue>
+#include <vector>
+#include <QAtomicInt>
+#include <QVector>
+
+/**
+ * @class ProbeTimeouts
+ * @brief Adaptive deadlines for the first reply of a peer test.
+ *
+ * @details Useful peers answer within a few hundred milliseconds, so waiting
+ *          the full hard timeout for every unreachable peer dominates the
+ *          duration of a sweep.  Once enough peers have answered, a peer
+ *          test that got no reply within a high percentile of the measured
+ *          latencies, times a margin, is given up.
+ *
+ *          Once the best topK peers are known, a peer that has not answered
+ *          within the K-th best latency (plus a margin) can no longer make
+ *          it into the configuration, and its test is cut off as well.
+ *
+ *          Results are added from the thread that owns the object; the
+ *          deadlines may be read from any thread.
+ */
+class ProbeTimeouts {
+public:
+    // Number of successful results before the timeout adapts
+    static constexpr int MIN_SAMPLES = 8;
+    // Percentile of the successful latencies the timeout is based on
+    static constexpr int PERCENTILE = 95;
+    // The timeout is the percentile latency plus this margin
+    static constexpr int TIMEOUT_MARGIN_PERCENT = 100;
+    // A peer is cut off once it is this much slower than the K-th best peer
+    static constexpr int CUTOFF_MARGIN_PERCENT = 20;
+    // Lower bound of the deadlines, for process start-up and jitter
+    static constexpr int MIN_DEADLINE_MS = 150;
+
+    /**
+     * @brief Constructs the timeouts of a sweep.
+     * @param maxTimeoutMs Hard cap of the reply timeout.
+     * @param topK Number of peers that make it into the configuration.
+     */
+    ProbeTimeouts(int maxTimeoutMs, int topK);
+
+    /**
+     * @brief Forget the results of the previous sweep.
+     */
+    void reset();
+
+    /**
+     * @brief Add the result of a peer test.
+     * @param latencyMs Measured latency, or -1 if the peer did not answer.
+     */
+    void addResult(int latencyMs);
+
+    /**
+     * @brief Get the time a peer may take to send its first reply.
+     * @param competing Whether the peer competes for the top K; private
+     * peers are used anyway and are not cut off for being slow.
+     * @return Milliseconds since the start of the test.
+     */
+    int replyDeadlineMs(bool competing = true) const;
+
+    /**
+     * @brief Get the current reply timeout, capped by the hard timeout.
+     */
+    int timeoutMs() const { return timeout.loadAcquire(); }
+
+    /**
+     * @brief Get the top-K cut-off, or 0 until K peers have answered.
+     */
+    int cutoffMs() const { return cutoff.loadAcquire(); }
+
+    /**
+     * @brief Get a percentile of a list of values.
+     * @param values The values; reordered.
+     * @param percent The percentile, 0 to 100.
+     * @return The nearest-rank percentile, or -1 if there are no values.
+     */
+    static int percentile(QVector<int>& values, int percent);
+
+private:
+    int maxTimeoutMs;
+    int topK;
+    QVector<int> samples;
+    // Max-heap of the topK lowest latencies
+    std::priority_queue<int> best;
+    QAtomicInt timeout;
+    QAtomicInt cutoff;
+};
+
+#endif // PROBETIMEOUTS_H
@@ -0,0 +1,130 @@
+/**
+ * @file SharedIcmpProber.cpp
+ * @brief Implementation file for the SharedIcmpProber class.
+ */
+
+#include <QMutexLocker>
+
+#include "SharedIcmpProber.h"
+
+/**
+ * @brief Constructs a shared prober.
+ * @param echoCount Number of echo requests per target.
+ * @param intervalMs Interval between the requests to one target.
+ * @param sendSlotMs Length of the send slots the schedules of new targets
+ * start on, or 0 to start them right away.
+ */
+SharedIcmpProber::SharedIcmpProber(int echoCount,
+                                   int intervalMs,
+                                   int sendSlotMs)
+    : echoCount(echoCount)
+    , intervalMs(intervalMs)
+    , sendSlotMs(sendSlotMs)
+    , batching(true)
+    , activeTargets(0)
+    , replacedSyscalls(0)
+    , polls(0) {
+}
+
+/**
+ * @brief Add an address to probe.
+ * @param address The IPv4 or IPv6 address.
+ * @param uplink Interface name or source address to probe from, or an empty
+ * string for the default route.
+ * @return Index of the target, or -1 if no socket could be opened or bound.
+ */
+int SharedIcmpProber::addTarget(const QHostAddress& address,
+                                const QString& uplink) {
+    QMutexLocker locker(&mutex);
+    if (! prober || (activeTargets == 0)) {
+        if (prober) {
+            replacedSyscalls += prober->syscallCount();
+        }
+        prober.reset(new IcmpProber(echoCount, intervalMs));
+        prober->setBatching(batching);
+        prober->setSendSlot(sendSlotMs);
+    }
+    int target = prober->addTarget(address, uplink);
+    if (target >= 0) {
+        ++activeTargets;
+    }
+    return target;
+}
+
+/**
+ * @brief Send the requests that are due and read the replies, unless
+ * another thread did so while this one waited for it.
+ * @param timeoutMs Maximum time to wait for replies.
+ */
+void SharedIcmpProber::poll(int timeoutMs) {
+    int seen = polls.loadAcquire();
+    QMutexLocker locker(&mutex);
+    if (polls.loadAcquire() != seen) {
+        return;
+    }
+    if (prober) {
+        prober->poll(timeoutMs);
+    }
+    polls.fetchAndAddRelease(1);
+}
+
+/**
+ * @brief Check whether the requests to some targets are finished.
+ * @param targets Indices returned by addTarget().
+ */
+bool SharedIcmpProber::isFinished(const std::vector<int>& targets) const {
+    QMutexLocker locker(&mutex);
+    for (int target : targets) {
+        if (! prober->isFinished(target)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Get the results of some targets.
+ * @param targets Indices returned by addTarget().
+ */
+std::vector<IcmpProber::Result> SharedIcmpProber::results(
+    const std::vector<int>& targets) const {
+    QMutexLocker locker(&mutex);
+    std::vector<IcmpProber::Result> results;
+    results.reserve(targets.size());
+    for (int target : targets) {
+        results.push_back(prober->result(target));
+    }
+    return results;
+}
+
+/**
+ * @brief Stop probing some targets; each is released once.
+ * @param targets Indices returned by addTarget().
+ */
+void SharedIcmpProber::releaseTargets(const std::vector<int>& targets) {
+    QMutexLocker locker(&mutex);
+    for (int target : targets) {
+        prober->releaseTarget(target);
+        --activeTargets;
+    }
+}
+
+/**
+ * @brief Choose between batched and per-packet socket I/O.
+ * @param batching Whether to use sendmmsg() and recvmmsg().
+ */
+void SharedIcmpProber::setBatching(bool batching) {
+    QMutexLocker locker(&mutex);
+    this->batching = batching;
+    if (prober) {
+        prober->setBatching(batching);
+    }
+}
+
+/**
+ * @brief Get the number of socket system calls made so far.
+ */
+quint64 SharedIcmpProber::syscallCount() const {
+    QMutexLocker locker(&mutex);
+    return replacedSyscalls + (prober ? prober->syscallCount() : 0);
+}
@@ -0,0 +1,122 @@
+/**
+ * @file SharedIcmpProber.h
+ * @brief Header file for the SharedIcmpProber class.
+ *
+ * Lets the peer tests that run at the same time probe through one set of
+ * ICMP sockets.
+ */
+
+#ifndef SHAREDICMPPROBER_H
+#define SHAREDICMPPROBER_H
+
+#include <memory>
+#include <vector>
+#include <QAtomicInt>
+#include <QHostAddress>
+#include <QMutex>
+#include <QString>
+
+#include "IcmpProber.h"
+
+/**
+ * @class SharedIcmpProber
+ * @brief An IcmpProber that several worker threads probe through.
+ *
+ * @details A prober per peer test sends the requests of one peer with each
+ *          sendmmsg(), so batching only pays off when the tests share the
+ *          sockets.  Each test adds its targets, calls poll() until its
+ *          targets are finished, reads their results and releases them.
+ *          Whichever thread polls reads the replies of all the tests; the
+ *          threads that waited for it meanwhile do not poll again.
+ *
+ *          How many requests share a batch is bounded by the number of
+ *          tests in flight and by how well their schedules line up; the
+ *          send slot aligns the schedules of targets added at about the
+ *          same time.
+ *
+ *          The prober is replaced by a new one when a target is added and
+ *          no other target is active, so that sequence numbers and request
+ *          records do not pile up over many sweeps.  Results must therefore
+ *          be read before the targets are released.
+ *
+ *          All methods are thread-safe.
+ */
+class SharedIcmpProber {
+public:
+    /**
+     * @brief Constructs a shared prober.
+     * @param echoCount Number of echo requests per target.
+     * @param intervalMs Interval between the requests to one target.
+     * @param sendSlotMs Length of the send slots the schedules of new
+     * targets start on, or 0 to start them right away.
+     */
+    SharedIcmpProber(int echoCount, int intervalMs, int sendSlotMs = 0);
+
+    SharedIcmpProber(const SharedIcmpProber&) = delete;
+    SharedIcmpProber& operator=(const SharedIcmpProber&) = delete;
+
+    /**
+     * @brief Add an address to probe.
+     * @param address The IPv4 or IPv6 address.
+     * @param uplink Interface name or source address to probe from, or an
+     * empty string for the default route.
+     * @return Index of the target, or -1 if no socket could be opened or
+     * bound for it.
+     */
+    int addTarget(const QHostAddress& address,
+                  const QString& uplink = QString());
+
+    /**
+     * @brief Send the requests that are due and read the replies, unless
+     * another thread did so while this one waited for it.
+     * @param timeoutMs Maximum time to wait for replies.
+     */
+    void poll(int timeoutMs);
+
+    /**
+     * @brief Check whether the requests to some targets are finished.
+     * @param targets Indices returned by addTarget().
+     */
+    bool isFinished(const std::vector<int>& targets) const;
+
+    /**
+     * @brief Get the results of some targets.
+     * @param targets Indices returned by addTarget().
+     */
+    std::vector<IcmpProber::Result> results(
+        const std::vector<int>& targets) const;
+
+    /**
+     * @brief Stop probing some targets; each is released once.
+     * @param targets Indices returned by addTarget().
+     */
+    void releaseTargets(const std::vector<int>& targets);
+
+    /**
+     * @brief Choose between batched and per-packet socket I/O.
+     * @param batching Whether to use sendmmsg() and recvmmsg(); on by
+     * default.
+     */
+    void setBatching(bool batching);
+
+    /**
+     * @brief Get the number of socket system calls made so far.
+     */
+    quint64 syscallCount() const;
+
+private:
+    int echoCount;
+    int intervalMs;
+    int sendSlotMs;
+    bool batching;
+    mutable QMutex mutex;
+    std::unique_ptr<IcmpProber> prober;
+    // Targets added and not released yet
+    int activeTargets;
+    // System calls of the probers replaced so far
+    quint64 replacedSyscalls;
+    // Number of polls, to tell whether another thread polled meanwhile
+    QAtomicInt polls;
+};
+
+#endif // SHAREDICMPPROBER_H
@@ -7,6 +7,7 @@
 
 #include <QDebug>
 #include <QFile>
+#include <QJsonArray>
 #include <QJsonDocument>
 
 #include "SocketManager.h"
@@ -78,6 +79,118 @@ QString SocketManager::getYggdrasilIP() {
     return "Unknown";
 }
 
+/**
+ * @brief Get the default Yggdrasil admin socket path candidates.
+ * @return A list of socket paths, in the order they should be tried.
+ */
+QStringList SocketManager::defaultSocketPaths() {
+    return {
+        "/var/run/yggdrasil.sock",    // Default path
+        "/var/run/yggdrasil/yggdrasil.sock", // Ubuntu path
+        "/run/yggdrasil.sock",        // Alternate path for some distributions
+        "/tmp/yggdrasil.sock"         // Fallback path
+    };
+}
+
+/**
+ * @brief Counts connected peers in a "getpeers" admin socket response.
+ * @param response The full JSON response of a "getpeers" request.
+ * @return The number of connected peers, or 0 if the response is malformed.
+ */
+int SocketManager::countConnectedPeers(const QJsonObject &response) {
+    QJsonValue peers = response["response"].toObject()["peers"];
+    if (peers.isArray()) {
+        int count = 0;
+        for (const QJsonValue &peer : peers.toArray()) {
+            // Peers without the "up" flag are connected ones.
+            if (peer.toObject()["up"].toBool(true)) {
+                ++count;
+            }
+        }
+        return count;
+    }
+    if (peers.isObject()) {
+        return peers.toObject().count();
+    }
+    return 0;
+}
+
+/**
+ * @brief Lists the connected peers in a "getpeers" admin socket response.
+ * @param response The full JSON response of a "getpeers" request.
+ * @return The peer URIs, or an empty list if the response is malformed.
+ */
+QStringList SocketManager::connectedPeerUris(const QJsonObject &response) {
+    QStringList uris;
+    QJsonValue peers = response["response"].toObject()["peers"];
+    if (peers.isArray()) {
+        for (const QJsonValue &peer : peers.toArray()) {
+            QJsonObject object = peer.toObject();
+            if (object["up"].toBool(true)) {
+                uris << object["remote"].toString();
+            }
+        }
+    } else if (peers.isObject()) {
+        QJsonObject map = peers.toObject();
+        for (auto it = map.constBegin(); it != map.constEnd(); ++it) {
+            uris << it.value().toObject()["remote"].toString(it.key());
+        }
+    }
+    uris.removeAll(QString());
+    return uris;
+}
+
+/**
+ * @brief Lists the peers the node connects to itself in a "getpeers" admin
+ * socket response, whether they are up or not.
+ * @param response The full JSON response of a "getpeers" request.
+ * @return The peer URIs, or an empty list if the response is malformed.
+ */
+QStringList SocketManager::outboundPeerUris(const QJsonObject &response) {
+    QStringList uris;
+    QJsonValue peers = response["response"].toObject()["peers"];
+    if (peers.isArray()) {
+        for (const QJsonValue &peer : peers.toArray()) {
+            QJsonObject object = peer.toObject();
+            if (! object["inbound"].toBool(false)) {
+                uris << object["remote"].toString();
+            }
+        }
+    } else {
+        return connectedPeerUris(response);
+    }
+    uris.removeAll(QString());
+    uris.removeDuplicates();
+    return uris;
+}
+
+/**
+ * @brief Lists the interfaces in a "getmulticastinterfaces" admin socket
+ * response.
+ * @param response The full JSON response of a "getmulticastinterfaces"
+ * request.
+ * @return The interface names, or an empty list if the response is
+ * malformed.
+ */
+QStringList SocketManager::multicastInterfaceNames(
+    const QJsonObject &response) {
+    QStringList names;
+    QJsonValue interfaces
+        = response["response"].toObject()["multicast_interfaces"];
+    if (interfaces.isArray()) {
+        for (const QJsonValue &entry : interfaces.toArray()) {
+            // Older versions list the names only.
+            names << (entry.isObject()
+                          ? entry.toObject()["name"].toString()
+                          : entry.toString());
+        }
+    } else if (interfaces.isObject()) {
+        names = interfaces.toObject().keys();
+    }
+    names.removeAll(QString());
+    return names;
+}
+
 /**
  * @brief Determines the first valid socket path from the list of candidates.
  */
@@ -34,6 +34,62 @@ public:
      */
     QString getYggdrasilIP();
 
+    /**
+     * @brief Get the default Yggdrasil admin socket path candidates.
+     * @return A list of socket paths, in the order they should be tried.
+     */
+    static QStringList defaultSocketPaths();
+
+    /**
+     * @brief Counts connected peers in a "getpeers" admin socket response.
+     *
+     * Handles both the list format of Yggdrasil 0.5 (where each peer has an
+     * "up" flag) and the map format of older versions (where only connected
+     * peers are listed).
+     *
+     * @param response The full JSON response of a "getpeers" request.
+     * @return The number of connected peers, or 0 if the response is
+     * malformed.
+     */
+    static int countConnectedPeers(const QJsonObject &response);
+
+    /**
+     * @brief Lists the connected peers in a "getpeers" admin socket response.
+     *
+     * Takes the "remote" URI of every connected peer, or the map key where
+     * an older version does not report it.
+     *
+     * @param response The full JSON response of a "getpeers" request.
+     * @return The peer URIs, or an empty list if the response is malformed.
+     */
+    static QStringList connectedPeerUris(const QJsonObject &response);
+
+    /**
+     * @brief Lists the peers the node connects to itself in a "getpeers"
+     * admin socket response, whether they are up or not.
+     *
+     * Inbound peers are left out, since they cannot be removed.  Older
+     * versions do not tell the direction, so all their peers are listed.
+     *
+     * @param response The full JSON response of a "getpeers" request.
+     * @return The peer URIs, or an empty list if the response is malformed.
+     */
+    static QStringList outboundPeerUris(const QJsonObject &response);
+
+    /**
+     * @brief Lists the interfaces in a "getmulticastinterfaces" admin
+     * socket response.
+     *
+     * Handles both the list of interface objects of Yggdrasil 0.5 and the
+     * plain list of names of older versions.
+     *
+     * @param response The full JSON response of a "getmulticastinterfaces"
+     * request.
+     * @return The interface names, or an empty list if the response is
+     * malformed.
+     */
+    static QStringList multicastInterfaceNames(const QJsonObject &response);
+
 private:
     QStringList socketPaths;   ///< List of possible socket paths.
     QString activeSocketPath; ///< The active socket path.
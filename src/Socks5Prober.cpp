@@ -0,0 +1,196 @@
+/**
+ * @file Socks5Prober.cpp
+ * @brief Implementation file for the Socks5Prober class.
+ */
+
+#include <algorithm>
+#include <QDebug>
+#include <QtGlobal>
+
+#include "PeerManager.h"
+#include "Socks5Prober.h"
+
+/**
+ * @brief Constructor for Socks5Prober
+ * @param proxy The SOCKS5 proxy to connect through.
+ * @param parent Optional QObject parent.
+ */
+Socks5Prober::Socks5Prober(const QNetworkProxy& proxy, QObject *parent)
+    : QObject(parent)
+    , socksProxy(proxy) {
+    qRegisterMetaType<PeerData>("PeerData");
+}
+
+Socks5Prober::~Socks5Prober() {
+    cancel();
+}
+
+/**
+ * @brief Set the proxy to use for the probes started after the call.
+ * @param proxy The SOCKS5 proxy.
+ */
+void Socks5Prober::setProxy(const QNetworkProxy& proxy) {
+    socksProxy = proxy;
+}
+
+/**
+ * @brief Queue a peer to be probed.
+ * @param peer The peer to probe.
+ */
+void Socks5Prober::probe(const PeerData& peer) {
+    queue.append(peer);
+    startQueued();
+}
+
+/**
+ * @brief Abort all running probes and drop the queued ones.
+ */
+void Socks5Prober::cancel() {
+    qDebug() << "[Socks5Prober::cancel] Canceling" << active.size()
+             << "running and" << queue.size() << "queued probes";
+    queue.clear();
+    for (Probe* probe : active) {
+        releaseSocket(probe);
+        delete probe->timer;
+        delete probe;
+    }
+    active.clear();
+}
+
+/**
+ * @brief Start queued probes while there are free slots.
+ */
+void Socks5Prober::startQueued() {
+    while ((active.size() < MAX_CONCURRENT_PROBES) && (! queue.isEmpty())) {
+        PeerData peer = queue.takeFirst();
+        peer.setLatency(-1);
+        peer.setValid(false);
+        peer.setPreciseLatencyUs(-1);
+        peer.setLatencySource(PeerData::NotMeasured);
+
+        QString host = pingHost(peer.host());
+        int port = peerPort(peer.host());
+        if (peer.host().startsWith("quic://")
+            || (port <= 0)
+            || host.isEmpty()) {
+            // SOCKS5 CONNECT only carries TCP.
+            qDebug() << "[Socks5Prober::startQueued]"
+                     << "Cannot probe through the proxy:" << peer.host();
+            emit peerTested(peer);
+            continue;
+        }
+
+        Probe* probe = new Probe();
+        probe->peer = peer;
+        probe->host = host;
+        probe->port = static_cast<quint16>(port);
+        probe->timer = new QTimer(this);
+        probe->timer->setSingleShot(true);
+        probe->timer->setInterval(CONNECT_TIMEOUT_MS);
+        connect(probe->timer, &QTimer::timeout, this, [this, probe]() {
+            qDebug() << "[Socks5Prober] Connection timeout for:"
+                     << probe->peer.host();
+            finishAttempt(probe, false);
+        });
+        active.append(probe);
+        connectNext(probe);
+    }
+}
+
+/**
+ * @brief Open the next connection to the peer of a probe.
+ * @param probe The probe.
+ */
+void Socks5Prober::connectNext(Probe* probe) {
+    QTcpSocket* socket = new QTcpSocket(this);
+    socket->setProxy(socksProxy);
+    probe->socket = socket;
+
+    connect(socket, &QTcpSocket::connected, this, [this, probe]() {
+        finishAttempt(probe, true);
+    });
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    connect(socket, &QAbstractSocket::errorOccurred,
+#else
+    connect(socket,
+            static_cast<void (QAbstractSocket::*)(
+                QAbstractSocket::SocketError)>(&QAbstractSocket::error),
+#endif
+            this, [this, probe, socket](QAbstractSocket::SocketError) {
+        qDebug() << "[Socks5Prober] Connection failed for:"
+                 << probe->peer.host() << "-" << socket->errorString();
+        finishAttempt(probe, false);
+    });
+
+    probe->timer->start();
+    probe->elapsed.start();
+    socket->connectToHost(probe->host, probe->port);
+}
+
+/**
+ * @brief Stop listening to the socket of a probe and dispose of it.
+ * @param probe The probe.
+ */
+void Socks5Prober::releaseSocket(Probe* probe) {
+    QTcpSocket* socket = probe->socket;
+    if (! socket) {
+        return;
+    }
+    probe->socket = nullptr;
+    disconnect(socket, nullptr, this, nullptr);
+    socket->abort();
+    socket->deleteLater();
+}
+
+/**
+ * @brief Record the result of a connection and continue the probe.
+ * @param probe The probe.
+ * @param connected Whether the proxy connected to the peer.
+ */
+void Socks5Prober::finishAttempt(Probe* probe, bool connected) {
+    if (! probe->socket) {
+        return;
+    }
+    probe->timer->stop();
+    qint64 ms = probe->elapsed.elapsed();
+    releaseSocket(probe);
+
+    ++probe->attempts;
+    if (connected) {
+        ++probe->successes;
+        probe->totalMs += ms;
+    }
+
+    // Do not keep knocking at a peer that the proxy cannot reach.
+    if (connected && (probe->attempts < CONNECT_COUNT)) {
+        connectNext(probe);
+    } else {
+        finishProbe(probe);
+    }
+}
+
+/**
+ * @brief Report the result of a probe and start the next queued one.
+ * @param probe The probe.
+ */
+void Socks5Prober::finishProbe(Probe* probe) {
+    active.removeOne(probe);
+    probe->timer->deleteLater();
+
+    PeerData peer = probe->peer;
+    if (probe->successes > 0) {
+        // Round to integer milliseconds with minimum of 1ms
+        double average = static_cast<double>(probe->totalMs)
+            / probe->successes;
+        peer.setLatency(std::max(1, static_cast<int>(average + 0.5)));
+        peer.setValid(true);
+        peer.setLatencySource(PeerData::ConnectTime);
+    }
+    delete probe;
+
+    qDebug() << "[Socks5Prober::finishProbe] Result for:" << peer.host()
+             << "isValid:" << peer.isValid()
+             << "latency:" << peer.latency();
+    emit peerTested(peer);
+    startQueued();
+}
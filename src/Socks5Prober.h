@@ -0,0 +1,117 @@
+/**
+ * @file Socks5Prober.h
+ * @brief Header file for the Socks5Prober class.
+ *
+ * Measures peer latency as the time to connect through a SOCKS5 proxy.
+ */
+
+#ifndef SOCKS5PROBER_H
+#define SOCKS5PROBER_H
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QNetworkProxy>
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "PeerData.h"
+
+/**
+ * @class Socks5Prober
+ * @brief Probes peers with SOCKS5 CONNECT requests.
+ *
+ * @details Where the only way out is a SOCKS5 proxy, ping cannot reach any
+ *          peer.  Instead, the prober asks the proxy to connect to the TCP
+ *          port of the peer and measures how long it takes until the proxy
+ *          reports the connection as established.  Hostnames are resolved
+ *          by the proxy, just like Yggdrasil would do with a socks:// peer.
+ *
+ *          The prober runs on the event loop of its thread, with at most
+ *          MAX_CONCURRENT_PROBES peers being probed at a time; the rest are
+ *          queued.  QUIC peers cannot be reached through a SOCKS5 CONNECT
+ *          and are reported as invalid.
+ */
+class Socks5Prober : public QObject {
+    Q_OBJECT
+
+public:
+    // Number of connections made to each peer
+    static constexpr int CONNECT_COUNT = 3;
+    // Number of peers probed at the same time
+    static constexpr int MAX_CONCURRENT_PROBES = 5;
+    // Timeout of a single connection
+    static constexpr int CONNECT_TIMEOUT_MS = 5000;
+
+    /**
+     * @brief Constructor for Socks5Prober
+     * @param proxy The SOCKS5 proxy to connect through.
+     * @param parent Optional QObject parent.
+     */
+    explicit Socks5Prober(const QNetworkProxy& proxy,
+                          QObject *parent = nullptr);
+    ~Socks5Prober();
+
+    /**
+     * @brief Set the proxy to use for the probes started after the call.
+     * @param proxy The SOCKS5 proxy.
+     */
+    void setProxy(const QNetworkProxy& proxy);
+
+    /**
+     * @brief Get the proxy the peers are probed through.
+     */
+    QNetworkProxy proxy() const { return socksProxy; }
+
+    /**
+     * @brief Queue a peer to be probed.
+     * @param peer The peer to probe.
+     */
+    void probe(const PeerData& peer);
+
+    /**
+     * @brief Abort all running probes and drop the queued ones.  No results
+     * are reported for them.
+     */
+    void cancel();
+
+    /**
+     * @brief Get the number of peers that are queued or being probed.
+     */
+    int pendingCount() const { return queue.size() + active.size(); }
+
+signals:
+    /**
+     * @brief Emitted when a peer probe is complete.
+     * @param peer The peer with the updated latency and validity.
+     */
+    void peerTested(const PeerData& peer);
+
+private:
+    /**
+     * @brief State of a single peer probe.
+     */
+    struct Probe {
+        PeerData peer;
+        QString host;
+        quint16 port = 0;
+        int attempts = 0;
+        int successes = 0;
+        qint64 totalMs = 0;
+        QTcpSocket* socket = nullptr;
+        QTimer* timer = nullptr;
+        QElapsedTimer elapsed;
+    };
+
+    void startQueued();
+    void connectNext(Probe* probe);
+    void finishAttempt(Probe* probe, bool connected);
+    void finishProbe(Probe* probe);
+    void releaseSocket(Probe* probe);
+
+    QNetworkProxy socksProxy;
+    QList<PeerData> queue;
+    QList<Probe*> active;
+};
+
+#endif // SOCKS5PROBER_H
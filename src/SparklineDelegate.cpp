@@ -0,0 +1,123 @@
+/**
+ * @file SparklineDelegate.cpp
+ * @brief Implementation file for the SparklineDelegate class.
+ */
+
+#include <QApplication>
+#include <QPainter>
+#include <QPointF>
+#include <QStyle>
+
+#include "SparklineDelegate.h"
+
+// Horizontal distance between samples
+static const int SAMPLE_STEP_PX = 4;
+// Padding around the sparkline
+static const int PADDING_PX = 3;
+
+/**
+ * @brief Constructor for SparklineDelegate
+ * @param parent Optional QObject parent.
+ */
+SparklineDelegate::SparklineDelegate(QObject *parent)
+    : QStyledItemDelegate(parent) {
+    qRegisterMetaType<LatencyHistory>("LatencyHistory");
+}
+
+/**
+ * @brief Paint the sparkline of a cell.
+ * @param painter Painter to use.
+ * @param option Style options of the cell.
+ * @param index Index of the cell.
+ */
+void SparklineDelegate::paint(QPainter *painter,
+                              const QStyleOptionViewItem &option,
+                              const QModelIndex &index) const {
+    // Draw background and selection the usual way, without any text.
+    QStyleOptionViewItem opt = option;
+    initStyleOption(&opt, index);
+    opt.text.clear();
+    const QWidget* widget = option.widget;
+    QStyle* style = widget ? widget->style() : QApplication::style();
+    style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, widget);
+
+    QVariant value = index.data(LatencyHistoryRole);
+    if (! value.canConvert<LatencyHistory>()) {
+        return;
+    }
+    LatencyHistory history = value.value<LatencyHistory>();
+    if (history.isEmpty()) {
+        return;
+    }
+
+    QRect area = option.rect.adjusted(PADDING_PX, PADDING_PX,
+                                      -PADDING_PX, -PADDING_PX);
+    if ((area.width() <= 0) || (area.height() <= 0)) {
+        return;
+    }
+
+    int min = 0;
+    int max = 0;
+    bool hasValid = history.range(min, max);
+    int span = qMax(1, max - min);
+    int step = qMin(SAMPLE_STEP_PX,
+                    area.width() / qMax(1, LatencyHistory::CAPACITY - 1));
+    // Align the newest sample to the right edge.
+    int x0 = area.right() - (history.size() - 1) * step;
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing, false);
+
+    QColor lineColor = (option.state & QStyle::State_Selected)
+        ? option.palette.color(QPalette::HighlightedText)
+        : option.palette.color(QPalette::Text);
+    QColor failColor(200, 0, 0);
+
+    QPointF points[LatencyHistory::CAPACITY];
+    int pointCount = 0;
+    for (int i = 0; i < history.size(); ++i) {
+        int sample = history.at(i);
+        int x = x0 + i * step;
+        if (sample < 0) {
+            // Flush the current line segment and mark the failure.
+            if (pointCount > 1) {
+                painter->setPen(lineColor);
+                painter->drawPolyline(points, pointCount);
+            }
+            pointCount = 0;
+            painter->setPen(failColor);
+            painter->drawLine(x, area.bottom() - 2, x, area.bottom());
+            continue;
+        }
+        // Lower latency is drawn higher.
+        double y = area.top()
+            + (double(sample - min) / span) * area.height();
+        points[pointCount++] = QPointF(x, y);
+    }
+    if (hasValid) {
+        painter->setPen(lineColor);
+        if (pointCount > 1) {
+            painter->drawPolyline(points, pointCount);
+        }
+        if ((pointCount > 0) && (history.last() >= 0)) {
+            // Emphasize the newest sample.
+            painter->setBrush(lineColor);
+            painter->drawEllipse(points[pointCount - 1], 1.5, 1.5);
+        }
+    }
+
+    painter->restore();
+}
+
+/**
+ * @brief Get the preferred size of a sparkline cell.
+ * @param option Style options of the cell.
+ * @param index Index of the cell.
+ */
+QSize SparklineDelegate::sizeHint(const QStyleOptionViewItem &option,
+                                  const QModelIndex &index) const {
+    QSize size = QStyledItemDelegate::sizeHint(option, index);
+    int width = (LatencyHistory::CAPACITY - 1) * SAMPLE_STEP_PX
+        + 2 * PADDING_PX;
+    return QSize(qMax(size.width(), width), size.height());
+}
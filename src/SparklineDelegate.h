@@ -0,0 +1,39 @@
+/**
+ * @file SparklineDelegate.h
+ * @brief Header file for the SparklineDelegate class.
+ */
+
+#ifndef SPARKLINEDELEGATE_H
+#define SPARKLINEDELEGATE_H
+
+#include <QStyledItemDelegate>
+
+#include "LatencyHistory.h"
+
+/**
+ * @class SparklineDelegate
+ * @brief Paints the LatencyHistory of a table cell as a sparkline.
+ *
+ * @details The history is read from the LatencyHistoryRole of the index.
+ *          Painting does not allocate and draws without antialiasing, so
+ *          hundreds of visible rows can be repainted at display rate.
+ *          Failed tests are drawn as red ticks at the bottom of the cell.
+ */
+class SparklineDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+
+public:
+    // Item data role holding a LatencyHistory value
+    static constexpr int LatencyHistoryRole = Qt::UserRole + 1;
+
+    explicit SparklineDelegate(QObject *parent = nullptr);
+
+    void paint(QPainter *painter,
+               const QStyleOptionViewItem &option,
+               const QModelIndex &index) const override;
+
+    QSize sizeHint(const QStyleOptionViewItem &option,
+                   const QModelIndex &index) const override;
+};
+
+#endif // SPARKLINEDELEGATE_H
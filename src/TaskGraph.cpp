@@ -0,0 +1,305 @@
+/**
+ * @file TaskGraph.cpp
+ * @brief Implementation file for the TaskGraph class.
+ */
+
+#include <QDebug>
+
+#include "TaskGraph.h"
+
+/**
+ * @brief Constructor for TaskGraph
+ * @param parent Optional QObject parent.
+ */
+TaskGraph::TaskGraph(QObject *parent)
+    : QObject(parent)
+    , started(false)
+    , done(false) {
+}
+
+/**
+ * @brief Add a node.  Only allowed before start().
+ * @param name Name of the stage.
+ * @param handlers Stage callbacks.
+ * @return Index of the node, or -1 if the graph was started.
+ */
+int TaskGraph::addNode(const QString& name, const Handlers& handlers) {
+    if (started) {
+        qDebug() << "[TaskGraph::addNode] Graph already started";
+        return -1;
+    }
+    Node node;
+    node.name = name;
+    node.handlers = handlers;
+    node.state = Pending;
+    node.openInputs = 0;
+    node.startedNs = -1;
+    node.endedNs = -1;
+    node.itemsIn = 0;
+    node.itemsOut = 0;
+    nodes.push_back(node);
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+/**
+ * @brief Stream the items of one node to another.
+ * @param from Producing node.
+ * @param to Consuming node.
+ */
+void TaskGraph::addEdge(int from, int to) {
+    if (started || (from < 0) || (from >= nodeCount())
+        || (to < 0) || (to >= nodeCount()) || (from == to)) {
+        qDebug() << "[TaskGraph::addEdge] Invalid edge" << from << "->" << to;
+        return;
+    }
+    nodes[from].outputs.push_back(to);
+    nodes[to].inputs.push_back(from);
+    ++nodes[to].openInputs;
+}
+
+/**
+ * @brief Start the nodes without inputs.
+ */
+void TaskGraph::start() {
+    if (started) {
+        return;
+    }
+    started = true;
+    clock.start();
+
+    for (int i = 0; i < nodeCount(); ++i) {
+        if (nodes[i].inputs.empty()) {
+            startNode(i);
+            closeInputs(i);
+        }
+    }
+    checkFinished();
+}
+
+/**
+ * @brief Pass an item to the nodes after a node.
+ * @param node The emitting node.
+ * @param item The item.
+ */
+void TaskGraph::emitItem(int node, const QVariant& item) {
+    if ((node < 0) || (node >= nodeCount())
+        || (nodes[node].state != Running)) {
+        return;
+    }
+    ++nodes[node].itemsOut;
+
+    // Handlers may end nodes, but never add any, so indices stay valid.
+    std::vector<int> outputs = nodes[node].outputs;
+    for (int output : outputs) {
+        startNode(output);
+        if (nodes[output].state != Running) {
+            continue;
+        }
+        ++nodes[output].itemsIn;
+        if (nodes[output].handlers.onItem) {
+            nodes[output].handlers.onItem(item);
+        }
+    }
+}
+
+/**
+ * @brief Mark a node as done and close its edges.
+ * @param node The node.
+ */
+void TaskGraph::finishNode(int node) {
+    if ((node < 0) || (node >= nodeCount())
+        || (nodes[node].state != Running)) {
+        return;
+    }
+    endNode(node, Finished);
+
+    std::vector<int> outputs = nodes[node].outputs;
+    for (int output : outputs) {
+        if (--nodes[output].openInputs == 0) {
+            startNode(output);
+            closeInputs(output);
+        }
+    }
+    // A node that is done before its inputs makes them useless.
+    cancelUnusedInputs(node);
+    checkFinished();
+}
+
+/**
+ * @brief Report that a node cannot complete its work.
+ * @param node The node.
+ * @param error Error message.
+ */
+void TaskGraph::failNode(int node, const QString& error) {
+    if ((node < 0) || (node >= nodeCount()) || isDone(node)) {
+        return;
+    }
+    if (this->error.isEmpty()) {
+        this->error = error;
+    }
+    qDebug() << "[TaskGraph::failNode]" << nodes[node].name << "-" << error;
+    endNode(node, Failed);
+
+    std::vector<int> outputs = nodes[node].outputs;
+    for (int output : outputs) {
+        cancelNode(output);
+    }
+    cancelUnusedInputs(node);
+    checkFinished();
+}
+
+/**
+ * @brief Cancel a node and the nodes that depend on it.
+ * @param node The node.
+ */
+void TaskGraph::cancelNode(int node) {
+    if ((node < 0) || (node >= nodeCount()) || isDone(node)) {
+        return;
+    }
+    bool wasRunning = (nodes[node].state == Running);
+    endNode(node, Cancelled);
+    if (wasRunning && nodes[node].handlers.onCancel) {
+        nodes[node].handlers.onCancel();
+    }
+
+    // The nodes after it would never get their complete input.
+    std::vector<int> outputs = nodes[node].outputs;
+    for (int output : outputs) {
+        cancelNode(output);
+    }
+    cancelUnusedInputs(node);
+    checkFinished();
+}
+
+/**
+ * @brief Cancel all nodes that are not done.
+ */
+void TaskGraph::cancel() {
+    if (done) {
+        return;
+    }
+    for (int i = 0; i < nodeCount(); ++i) {
+        cancelNode(i);
+    }
+    // Also report a graph that was never started as done.
+    started = true;
+    checkFinished();
+}
+
+/**
+ * @brief Get the timing and item counts of a node.
+ * @param node The node.
+ */
+TaskGraph::NodeStats TaskGraph::stats(int node) const {
+    NodeStats result;
+    if ((node < 0) || (node >= nodeCount())) {
+        return result;
+    }
+    const Node& n = nodes[node];
+    result.name = n.name;
+    result.state = n.state;
+    result.itemsIn = n.itemsIn;
+    result.itemsOut = n.itemsOut;
+    if (n.startedNs >= 0) {
+        qint64 endNs = (n.endedNs >= 0) ? n.endedNs : clock.nsecsElapsed();
+        result.startedMs = n.startedNs / 1000000;
+        result.elapsedMs = (endNs - n.startedNs) / 1000000;
+    }
+    return result;
+}
+
+/**
+ * @brief Check whether a node is finished, cancelled or failed.
+ * @param node The node.
+ */
+bool TaskGraph::isDone(int node) const {
+    NodeState state = nodes[node].state;
+    return (state != Pending) && (state != Running);
+}
+
+/**
+ * @brief Start a pending node.
+ * @param node The node.
+ */
+void TaskGraph::startNode(int node) {
+    if (nodes[node].state != Pending) {
+        return;
+    }
+    nodes[node].state = Running;
+    nodes[node].startedNs = clock.nsecsElapsed();
+    if (nodes[node].handlers.onStart) {
+        nodes[node].handlers.onStart();
+    }
+}
+
+/**
+ * @brief Tell a running node that no more input will arrive.
+ * @param node The node.
+ */
+void TaskGraph::closeInputs(int node) {
+    if (nodes[node].state != Running) {
+        return;
+    }
+    if (nodes[node].handlers.onInputsClosed) {
+        nodes[node].handlers.onInputsClosed();
+    } else {
+        finishNode(node);
+    }
+}
+
+/**
+ * @brief Record the end of a node and report it.
+ * @param node The node.
+ * @param state Finished, Cancelled or Failed.
+ */
+void TaskGraph::endNode(int node, NodeState state) {
+    nodes[node].state = state;
+    if (nodes[node].startedNs >= 0) {
+        nodes[node].endedNs = clock.nsecsElapsed();
+    }
+
+    NodeStats nodeStats = stats(node);
+    qDebug() << "[TaskGraph::endNode]" << nodeStats.name << state
+             << "after" << nodeStats.elapsedMs << "ms,"
+             << nodeStats.itemsIn << "items in,"
+             << nodeStats.itemsOut << "items out";
+    emit nodeDone(node, nodeStats);
+}
+
+/**
+ * @brief Cancel the inputs of a node that nothing else consumes any more.
+ * @param node The node that is done.
+ */
+void TaskGraph::cancelUnusedInputs(int node) {
+    std::vector<int> inputs = nodes[node].inputs;
+    for (int input : inputs) {
+        if (isDone(input)) {
+            continue;
+        }
+        bool used = false;
+        for (int consumer : nodes[input].outputs) {
+            used = used || (! isDone(consumer));
+        }
+        if (! used) {
+            cancelNode(input);
+        }
+    }
+}
+
+/**
+ * @brief Report the end of the graph once all nodes are done.
+ */
+void TaskGraph::checkFinished() {
+    if ((! started) || done) {
+        return;
+    }
+    bool success = true;
+    for (int i = 0; i < nodeCount(); ++i) {
+        if (! isDone(i)) {
+            return;
+        }
+        success = success && (nodes[i].state == Finished);
+    }
+    done = true;
+    emit finished(success, error);
+}
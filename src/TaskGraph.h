@@ -0,0 +1,202 @@
+/**
+ * @file TaskGraph.h
+ * @brief Header file for the TaskGraph class.
+ *
+ * Runs pipeline stages as nodes of a graph with streaming edges.
+ */
+
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include <functional>
+#include <vector>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QVariant>
+
+/**
+ * @class TaskGraph
+ * @brief Dependency-aware executor for pipeline stages.
+ *
+ * @details Each node is a pipeline stage (e.g. probing peers or showing the
+ *          results), and each edge streams the items a node emits to the
+ *          nodes after it.  A node starts with its first input, so stages
+ *          overlap: a node works on the first items while the nodes before
+ *          it still produce more.  Once all nodes before a node have
+ *          finished, its inputs are closed, and it finishes when its own
+ *          work is done.  Nodes without inputs start with the graph and
+ *          have their inputs closed right away.
+ *
+ *          A node whose output can no longer be used, or whose input can no
+ *          longer be complete, is cancelled: cancelling or failing a node
+ *          cancels every node after it, and every node before it that has
+ *          no other unfinished consumer.  Each node is timed from its start
+ *          to its end, and counts the items it received and emitted.
+ *
+ *          Everything runs on the event loop of the thread the graph lives
+ *          in; asynchronous stages call emitItem() and finishNode() from
+ *          their own slots.  Qt 5 has no QFuture continuations, so the graph
+ *          takes their place for the peer discovery pipeline.
+ */
+class TaskGraph : public QObject {
+    Q_OBJECT
+
+public:
+    enum NodeState {
+        Pending,   ///< Not started yet
+        Running,   ///< Started, inputs may still arrive
+        Finished,  ///< Done
+        Cancelled, ///< Cancelled before it was done
+        Failed     ///< Reported an error
+    };
+    Q_ENUM(NodeState)
+
+    /**
+     * @brief Stage callbacks of a node; all are optional.
+     */
+    struct Handlers {
+        // Called when the node starts
+        std::function<void()> onStart;
+        // Called for every item emitted by a node before it
+        std::function<void(const QVariant&)> onItem;
+        // Called when all nodes before it are finished; finishes the node
+        // if not set
+        std::function<void()> onInputsClosed;
+        // Called when the node is cancelled while it is running
+        std::function<void()> onCancel;
+    };
+
+    /**
+     * @brief Timing and item counts of a node.
+     */
+    struct NodeStats {
+        QString name;
+        NodeState state = Pending;
+        // Time from the start of the graph to the start of the node
+        qint64 startedMs = -1;
+        // Time from the start to the end of the node, or up to now
+        qint64 elapsedMs = 0;
+        int itemsIn = 0;
+        int itemsOut = 0;
+    };
+
+    /**
+     * @brief Constructor for TaskGraph
+     * @param parent Optional QObject parent.
+     */
+    explicit TaskGraph(QObject *parent = nullptr);
+
+    /**
+     * @brief Add a node.  Only allowed before start().
+     * @param name Name of the stage, for the statistics and the log.
+     * @param handlers Stage callbacks.
+     * @return Index of the node, or -1 if the graph was started.
+     */
+    int addNode(const QString& name, const Handlers& handlers);
+
+    /**
+     * @brief Stream the items of one node to another.  Only allowed before
+     * start().
+     * @param from Producing node.
+     * @param to Consuming node.
+     */
+    void addEdge(int from, int to);
+
+    /**
+     * @brief Start the nodes without inputs.
+     */
+    void start();
+
+    /**
+     * @brief Pass an item to the nodes after a node.
+     * @param node The emitting node; ignored unless it is running.
+     * @param item The item.
+     */
+    void emitItem(int node, const QVariant& item);
+
+    /**
+     * @brief Mark a node as done and close its edges.
+     * @param node The node; ignored unless it is running.
+     */
+    void finishNode(int node);
+
+    /**
+     * @brief Report that a node cannot complete its work.
+     * @param node The node; cancels the nodes depending on it.
+     * @param error Error message.
+     */
+    void failNode(int node, const QString& error);
+
+    /**
+     * @brief Cancel a node and the nodes that depend on it.
+     * @param node The node.
+     */
+    void cancelNode(int node);
+
+    /**
+     * @brief Cancel all nodes that are not done.
+     */
+    void cancel();
+
+    /**
+     * @brief Check whether the graph was started and is not done.
+     */
+    bool isRunning() const { return started && (! done); }
+
+    /**
+     * @brief Get the timing and item counts of a node.
+     * @param node The node.
+     */
+    NodeStats stats(int node) const;
+
+    /**
+     * @brief Get the number of nodes.
+     */
+    int nodeCount() const { return static_cast<int>(nodes.size()); }
+
+signals:
+    /**
+     * @brief Emitted when a node is finished, cancelled or failed.
+     * @param node The node.
+     * @param stats Its timing and item counts.
+     */
+    void nodeDone(int node, const TaskGraph::NodeStats& stats);
+
+    /**
+     * @brief Emitted when all nodes are done.
+     * @param success Whether all nodes finished.
+     * @param error Message of the first failed node, if any.
+     */
+    void finished(bool success, const QString& error);
+
+private:
+    struct Node {
+        QString name;
+        Handlers handlers;
+        NodeState state;
+        std::vector<int> inputs;
+        std::vector<int> outputs;
+        int openInputs;
+        qint64 startedNs;
+        qint64 endedNs;
+        int itemsIn;
+        int itemsOut;
+    };
+
+    bool isDone(int node) const;
+    void startNode(int node);
+    void closeInputs(int node);
+    void endNode(int node, NodeState state);
+    void cancelUnusedInputs(int node);
+    void checkFinished();
+
+    std::vector<Node> nodes;
+    QElapsedTimer clock;
+    bool started;
+    bool done;
+    QString error;
+};
+
+#endif // TASKGRAPH_H
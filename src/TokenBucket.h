@@ -0,0 +1,104 @@
+/**
+ * @file TokenBucket.h
+ * @brief Token bucket rate limiter.
+ */
+
+#ifndef TOKENBUCKET_H
+#define TOKENBUCKET_H
+
+#include <algorithm>
+#include <cmath>
+#include <QtGlobal>
+
+/**
+ * @class TokenBucket
+ * @brief Token bucket that paces events to an average rate.
+ *
+ * @details Tokens are added at a fixed rate up to the bucket capacity.  An
+ *          event of cost n may go when at least min(n, capacity) tokens are
+ *          available; the whole cost is then taken, which may leave the
+ *          bucket in debt.  Costly events are thus allowed without a large
+ *          bucket, and the debt delays the following events so that the
+ *          average rate holds.  The caller passes the current time, which
+ *          keeps the bucket deterministic in tests.
+ */
+class TokenBucket {
+public:
+    /**
+     * @brief Constructs a bucket.
+     * @param ratePerSecond Tokens added per second; 0 means no limit.
+     * @param capacity Maximum number of stored tokens.
+     */
+    explicit TokenBucket(double ratePerSecond = 0.0, double capacity = 1.0) {
+        setRate(ratePerSecond, capacity);
+    }
+
+    /**
+     * @brief Changes the rate and the capacity, and fills the bucket.
+     * @param ratePerSecond Tokens added per second; 0 means no limit.
+     * @param capacity Maximum number of stored tokens.
+     */
+    void setRate(double ratePerSecond, double capacity) {
+        rate = std::max(0.0, ratePerSecond);
+        this->capacity = std::max(1.0, capacity);
+        tokens = this->capacity;
+        lastMs = -1;
+    }
+
+    /**
+     * @brief Checks whether the bucket limits the rate at all.
+     */
+    bool isUnlimited() const { return rate <= 0.0; }
+
+    /**
+     * @brief Takes tokens for an event if it may go now.
+     * @param cost Cost of the event.
+     * @param nowMs Current monotonic time in milliseconds.
+     * @return true if the event may go.
+     */
+    bool tryTake(double cost, qint64 nowMs) {
+        if (isUnlimited()) {
+            return true;
+        }
+        refill(nowMs);
+        if (tokens < std::min(cost, capacity)) {
+            return false;
+        }
+        tokens -= cost;
+        return true;
+    }
+
+    /**
+     * @brief Gets the time until an event may go.
+     * @param cost Cost of the event.
+     * @param nowMs Current monotonic time in milliseconds.
+     * @return Milliseconds to wait, 0 if the event may go now.
+     */
+    qint64 msUntilAvailable(double cost, qint64 nowMs) {
+        if (isUnlimited()) {
+            return 0;
+        }
+        refill(nowMs);
+        double missing = std::min(cost, capacity) - tokens;
+        if (missing <= 0.0) {
+            return 0;
+        }
+        return static_cast<qint64>(std::ceil(missing * 1000.0 / rate));
+    }
+
+private:
+    void refill(qint64 nowMs) {
+        if (lastMs >= 0) {
+            tokens = std::min(capacity,
+                              tokens + (nowMs - lastMs) * rate / 1000.0);
+        }
+        lastMs = nowMs;
+    }
+
+    double rate;
+    double capacity;
+    double tokens;
+    qint64 lastMs;
+};
+
+#endif // TOKENBUCKET_H
@@ -0,0 +1,97 @@
+/**
+ * @file UiUpdateCoalescer.cpp
+ * @brief Implementation file for the UiUpdateCoalescer class.
+ */
+
+#include <QGuiApplication>
+#include <QScreen>
+#include <QtGlobal>
+
+#include "UiUpdateCoalescer.h"
+
+// Definitions of the constants that qBound() takes by reference
+constexpr int UiUpdateCoalescer::MIN_FLUSH_RATE_HZ;
+constexpr int UiUpdateCoalescer::MAX_FLUSH_RATE_HZ;
+
+/**
+ * @brief Constructor for UiUpdateCoalescer
+ * @param flushRateHz Desired flush rate.
+ * @param parent Optional QObject parent.
+ */
+UiUpdateCoalescer::UiUpdateCoalescer(int flushRateHz, QObject *parent)
+    : QObject(parent)
+    , timer(new QTimer(this))
+    , changeCount(0)
+    , flushes(0) {
+    qRegisterMetaType<QList<int>>("QList<int>");
+
+    int rate = qBound(MIN_FLUSH_RATE_HZ, flushRateHz, MAX_FLUSH_RATE_HZ);
+    timer->setSingleShot(true);
+    timer->setTimerType(Qt::PreciseTimer);
+    timer->setInterval(1000 / rate);
+    connect(timer, &QTimer::timeout, this, &UiUpdateCoalescer::flushNow);
+}
+
+/**
+ * @brief Get the flush rate that matches the primary screen refresh rate.
+ * @return Flush rate in Hz, clamped to the allowed range.
+ */
+int UiUpdateCoalescer::screenFlushRate() {
+    QScreen* screen = QGuiApplication::primaryScreen();
+    int rate = screen ? qRound(screen->refreshRate()) : MIN_FLUSH_RATE_HZ;
+    return qBound(MIN_FLUSH_RATE_HZ, rate, MAX_FLUSH_RATE_HZ);
+}
+
+/**
+ * @brief Mark a key as changed and schedule a flush.
+ * @param key Caller-defined key.
+ */
+void UiUpdateCoalescer::markDirty(int key) {
+    ++changeCount;
+    if (! dirtySet.contains(key)) {
+        dirtySet.insert(key);
+        dirtyKeys.append(key);
+    }
+    if (! timer->isActive()) {
+        timer->start();
+    }
+}
+
+/**
+ * @brief Emit pending changes immediately, if there are any.
+ */
+void UiUpdateCoalescer::flushNow() {
+    timer->stop();
+    if (changeCount == 0) {
+        return;
+    }
+
+    // Swap the pending state out first so that slots connected to
+    // flushRequested() may safely call markDirty() again.
+    QList<int> keys;
+    keys.swap(dirtyKeys);
+    int count = changeCount;
+    dirtySet.clear();
+    changeCount = 0;
+
+    ++flushes;
+    emit flushRequested(keys, count);
+}
+
+/**
+ * @brief Drop all pending changes without emitting them.
+ */
+void UiUpdateCoalescer::reset() {
+    timer->stop();
+    dirtySet.clear();
+    dirtyKeys.clear();
+    changeCount = 0;
+}
+
+/**
+ * @brief Get the flush interval.
+ * @return Flush interval in milliseconds.
+ */
+int UiUpdateCoalescer::flushIntervalMs() const {
+    return timer->interval();
+}
@@ -0,0 +1,96 @@
+/**
+ * @file UiUpdateCoalescer.h
+ * @brief Header file for the UiUpdateCoalescer class.
+ *
+ * Collects "dirty" keys produced at a high rate and hands them to the GUI
+ * in batches, at most once per display frame.
+ */
+
+#ifndef UIUPDATECOALESCER_H
+#define UIUPDATECOALESCER_H
+
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QTimer>
+
+/**
+ * @class UiUpdateCoalescer
+ * @brief Frame-rate throttled batching of UI updates.
+ *
+ * @details Producers call markDirty() for every change (e.g. for every
+ *          tested peer).  The coalescer remembers the changed keys and the
+ *          number of changes, and emits flushRequested() once per flush
+ *          interval with everything accumulated since the previous flush.
+ *          A single flush therefore replaces hundreds of per-result
+ *          relayouts when results arrive faster than the screen refreshes.
+ */
+class UiUpdateCoalescer : public QObject {
+    Q_OBJECT
+
+public:
+    // Lowest and highest allowed flush rate.
+    static constexpr int MIN_FLUSH_RATE_HZ = 30;
+    static constexpr int MAX_FLUSH_RATE_HZ = 60;
+
+    /**
+     * @brief Constructor for UiUpdateCoalescer
+     * @param flushRateHz Desired flush rate; clamped to
+     * [MIN_FLUSH_RATE_HZ, MAX_FLUSH_RATE_HZ].
+     * @param parent Optional QObject parent.
+     */
+    explicit UiUpdateCoalescer(int flushRateHz = MIN_FLUSH_RATE_HZ,
+                               QObject *parent = nullptr);
+
+    /**
+     * @brief Get the flush rate that matches the primary screen refresh rate.
+     * @return Flush rate in Hz, clamped to the allowed range.
+     */
+    static int screenFlushRate();
+
+    /**
+     * @brief Mark a key as changed and schedule a flush.
+     * @param key Caller-defined key (e.g. an index into a peer list).
+     */
+    void markDirty(int key);
+
+    /**
+     * @brief Emit pending changes immediately, if there are any.
+     */
+    void flushNow();
+
+    /**
+     * @brief Drop all pending changes without emitting them.
+     */
+    void reset();
+
+    /**
+     * @brief Get the flush interval.
+     * @return Flush interval in milliseconds.
+     */
+    int flushIntervalMs() const;
+
+    /**
+     * @brief Get the number of flushes emitted so far.
+     */
+    int flushCount() const { return flushes; }
+
+signals:
+    /**
+     * @brief Emitted once per flush interval when there are pending changes.
+     * @param dirtyKeys Keys marked dirty since the previous flush, in the
+     * order they were first marked.
+     * @param changeCount Total number of markDirty() calls since the
+     * previous flush (a key marked twice is counted twice).
+     */
+    void flushRequested(const QList<int>& dirtyKeys, int changeCount);
+
+private:
+    QTimer* timer;
+    QSet<int> dirtySet;
+    QList<int> dirtyKeys;
+    int changeCount;
+    int flushes;
+};
+
+#endif // UIUPDATECOALESCER_H
@@ -12,6 +12,7 @@
 #include <QApplication>
 #include <QClipboard>
 #include <QIcon>
+#include <QInputDialog>
 #include <QMenu>
 #include <QMessageBox>
 #include <QPixmap>
@@ -24,7 +25,11 @@
 #include <cstdio>
 #include <iostream>
 
+#include "Executor.h"
+#include "OverlayLatencyTest.h"
 #include "PeerDiscoveryDialog.h"
+#include "PeerProfiles.h"
+#include "PowerPolicy.h"
 #include "ProcessRunner.h"
 #include "ServiceManager.h"
 #include "SetupWizard.h"
@@ -32,16 +37,6 @@
 
 using namespace std;
 
-/**
- * @brief Path candidates for the Yggdrasil socket.
- */
-const QStringList POSSIBLE_YGG_SOCKET_PATHS = {
-    "/var/run/yggdrasil.sock",    // Default path
-    "/var/run/yggdrasil/yggdrasil.sock", // Ubuntu path
-    "/run/yggdrasil.sock",        // Alternate path for some distributions
-    "/tmp/yggdrasil.sock"         // Fallback path
-};
-
 /**
  * @brief Icon to display when the Yggdrasil service is running.
  */
@@ -57,6 +52,11 @@ const QString ICON_NOT_RUNNING = ":/icons/yggtray_not_running.png";
  */
 const QString TOOLTIP = "Yggdrasil Tray";
 
+/**
+ * @brief Interval of the status checks on mains power.
+ */
+const int STATUS_INTERVAL_MS = 5000;
+
 /**
  * @class YggdrasilTray
  * @brief Manages the system tray interface for the Yggdrasil service.
@@ -69,11 +69,12 @@ public:
                            bool debugMode = false,
                            QObject *parent = nullptr)
         : QObject(parent)
-        , processRunner()
-        , serviceManager("yggdrasil", &processRunner)
-        , socketManager(POSSIBLE_YGG_SOCKET_PATHS)
         , debugMode(debugMode)
-        , settings(settings) {
+        , powerPolicy()
+        , settings(settings)
+        , overlayTest(settings)
+        , profileSwitcher(settings)
+        , statusPending(false) {
         trayIcon = new QSystemTrayIcon(this);
         trayIcon->setIcon(QIcon(ICON_NOT_RUNNING));
         trayIcon->setToolTip(TOOLTIP);
@@ -90,6 +91,12 @@ public:
         ipAction->setDisabled(true);
         trayMenu->addAction(ipAction);
 
+        // Background work policy menu item
+        policyAction = new QAction(
+            PowerPolicy::describe(powerPolicy.state()), trayMenu);
+        policyAction->setDisabled(true);
+        trayMenu->addAction(policyAction);
+
         trayMenu->addSeparator();
 
         // Toggle Yggdrasil service action
@@ -116,6 +123,30 @@ public:
                 &YggdrasilTray::showPeerManager);
         trayMenu->addAction(managePeersAction);
 
+        // Peer profiles submenu, filled when it is shown
+        profilesMenu = trayMenu->addMenu(tr("Peer Profiles"));
+        connect(profilesMenu,
+                &QMenu::aboutToShow,
+                this,
+                &YggdrasilTray::fillProfilesMenu);
+        connect(&profileSwitcher,
+                &PeerProfileSwitcher::switched,
+                this,
+                &YggdrasilTray::showProfileSwitchResult);
+
+        // Overlay latency test action
+        overlayTestAction = new QAction(tr("Test Overlay Latency..."),
+                                        trayMenu);
+        connect(overlayTestAction,
+                &QAction::triggered,
+                this,
+                &YggdrasilTray::runOverlayTest);
+        trayMenu->addAction(overlayTestAction);
+        connect(&overlayTest,
+                &OverlayLatencyTest::finished,
+                this,
+                &YggdrasilTray::showOverlayTestResult);
+
         trayMenu->addSeparator();
 
         // Quit action
@@ -135,42 +166,117 @@ public:
                 this,
                 &YggdrasilTray::onTrayIconActivated);
 
+        connect(this,
+                &YggdrasilTray::statusChecked,
+                this,
+                &YggdrasilTray::finishStatusCheck,
+                Qt::QueuedConnection);
+        connect(this,
+                &YggdrasilTray::serviceToggled,
+                this,
+                &YggdrasilTray::showToggleResult,
+                Qt::QueuedConnection);
+        connect(this,
+                &YggdrasilTray::ipFetched,
+                this,
+                &YggdrasilTray::copyFetchedIP,
+                Qt::QueuedConnection);
+        connect(this,
+                &YggdrasilTray::overlayPeersFetched,
+                this,
+                &YggdrasilTray::startOverlayTest,
+                Qt::QueuedConnection);
+
         // Periodic update
-        QTimer *timer = new QTimer(this);
-        connect(timer,
+        statusTimer = new QTimer(this);
+        connect(statusTimer,
                 &QTimer::timeout,
                 this,
                 &YggdrasilTray::updateTrayIcon);
-        timer->start(5000);
+        statusTimer->start(STATUS_INTERVAL_MS);
+        connect(&powerPolicy,
+                &PowerPolicy::changed,
+                this,
+                &YggdrasilTray::applyPowerPolicy);
+
+        profileSwitcher.start();
+        profileSwitcher.setValidationInterval(powerPolicy.intervalMs(
+            PeerProfileSwitcher::VALIDATION_CHECK_MS, true));
 
         updateTrayIcon();
     }
 
+    ~YggdrasilTray() {
+        // The tasks of the tray emit its signals.
+        Executor::instance().clear(this);
+        Executor::instance().waitForDone(this);
+    }
+
+signals:
+    // Emitted by the task of checkStatus()
+    void statusChecked(bool running, const QString& ip);
+    // Emitted by the task of toggleYggdrasilService() with the new status
+    void serviceToggled(bool success, bool running, const QString& ip);
+    // Emitted by the task of copyIP()
+    void ipFetched(const QString& ip);
+    // Emitted by the task of runOverlayTest() with the connected peers
+    void overlayPeersFetched(const QStringList& peers);
+
 private slots:
     void toggleYggdrasilService() {
-        bool success;
-        QString action;
-
-        if (serviceManager.isServiceRunning()) {
-            success = serviceManager.stopService();
-            action = "stopped";
-        } else {
-            success = serviceManager.startService();
-            action = "started";
+        // Starting and stopping the service may wait for a password
+        // prompt, so it runs off the GUI thread.  The managers are not
+        // thread-safe, so every task makes its own.
+        toggleAction->setEnabled(false);
+        bool submitted = Executor::instance().submit(
+            Executor::Interactive,
+            [this]() {
+                ProcessRunner processRunner;
+                ServiceManager serviceManager("yggdrasil", &processRunner);
+                SocketManager socketManager(
+                    SocketManager::defaultSocketPaths());
+                bool success = serviceManager.isServiceRunning()
+                    ? serviceManager.stopService()
+                    : serviceManager.startService();
+                emit serviceToggled(success,
+                                    serviceManager.isServiceRunning(),
+                                    socketManager.getYggdrasilIP());
+            },
+            this);
+        if (! submitted) {
+            toggleAction->setEnabled(true);
         }
+    }
 
+    void showToggleResult(bool success, bool running, const QString& ip) {
+        toggleAction->setEnabled(true);
+        showStatus(running, ip);
         if (!success) {
             QMessageBox::critical(
                 nullptr,
                 "Service Toggle",
                 tr("Failed to toggle Yggdrasil service."));
         }
-
-        updateTrayIcon();
     }
 
     void copyIP() {
-        QString ip = socketManager.getYggdrasilIP();
+        // The admin socket may block for seconds.
+        copyIPAction->setEnabled(false);
+        bool submitted = Executor::instance().submit(
+            Executor::Interactive,
+            [this]() {
+                SocketManager socketManager(
+                    SocketManager::defaultSocketPaths());
+                emit ipFetched(socketManager.getYggdrasilIP());
+            },
+            this);
+        if (! submitted) {
+            copyIPAction->setEnabled(true);
+        }
+    }
+
+    void copyFetchedIP(const QString& ip) {
+        copyIPAction->setEnabled(true);
         if (!ip.isEmpty()) {
             QApplication::clipboard()->setText(ip);
             QMessageBox::information(nullptr,
@@ -184,15 +290,30 @@ private slots:
     }
 
     void updateTrayIcon() {
-        QString status = serviceManager.isServiceRunning()
-            ? tr("Running") : tr("Not Running");
-        QString ip = socketManager.getYggdrasilIP();
+        checkStatus(Executor::Background);
+    }
+
+    void finishStatusCheck(bool running, const QString& ip) {
+        statusPending = false;
+        showStatus(running, ip);
+    }
 
+    void showStatus(bool running, const QString& ip) {
+        QString status = running ? tr("Running") : tr("Not Running");
         statusAction->setText(tr("Status: ") + status);
         ipAction->setText("IP: " + ip);
 
-        trayIcon->setIcon(QIcon(status == tr("Running")
-                                ? ICON_RUNNING : ICON_NOT_RUNNING));
+        trayIcon->setIcon(QIcon(running ? ICON_RUNNING : ICON_NOT_RUNNING));
+    }
+
+    void applyPowerPolicy(const PowerPolicy::State& state) {
+        policyAction->setText(PowerPolicy::describe(state));
+        // The status checks stay local, so they are only throttled.
+        statusTimer->setInterval(
+            powerPolicy.intervalMs(STATUS_INTERVAL_MS, false));
+        // Validating profiles probes public peers.
+        profileSwitcher.setValidationInterval(powerPolicy.intervalMs(
+            PeerProfileSwitcher::VALIDATION_CHECK_MS, true));
     }
 
     void onTrayIconActivated(QSystemTrayIcon::ActivationReason reason) {
@@ -207,27 +328,157 @@ private:
     QMenu *trayMenu;
     QAction *statusAction;
     QAction *ipAction;
+    QAction *policyAction;
+    QTimer *statusTimer;
     QAction *toggleAction;
     QAction *copyIPAction;
     QAction *managePeersAction;
-    ProcessRunner processRunner;
-    ServiceManager serviceManager;
-    SocketManager socketManager;
+    QMenu *profilesMenu;
+    QAction *overlayTestAction;
     bool debugMode;
+    PowerPolicy powerPolicy;
 
     std::shared_ptr<QSettings> settings;
+    OverlayLatencyTest overlayTest;
+    PeerProfileSwitcher profileSwitcher;
+    // Whether a status check is queued or running; the toggle reports
+    // its status on its own
+    bool statusPending;
+
+    void checkStatus(Executor::Lane lane) {
+        // systemctl and the admin socket may block for seconds.
+        if (statusPending) {
+            return;
+        }
+        statusPending = Executor::instance().submit(
+            lane,
+            [this]() {
+                ProcessRunner processRunner;
+                ServiceManager serviceManager("yggdrasil", &processRunner);
+                SocketManager socketManager(
+                    SocketManager::defaultSocketPaths());
+                emit statusChecked(serviceManager.isServiceRunning(),
+                                   socketManager.getYggdrasilIP());
+            },
+            this);
+    }
 
 private slots:
     void showPeerManager() {
+        // The dialog applies the configuration and restarts the service
+        // itself (see ApplyConfigJob.)
         PeerDiscoveryDialog dialog(settings, debugMode, nullptr);
         if (dialog.exec() == QDialog::Accepted) {
-            // Restart the service to apply the new configuration
-            if (serviceManager.isServiceRunning()) {
-                serviceManager.stopService();
-                serviceManager.startService();
-            }
+            checkStatus(Executor::Interactive);
+        }
+    }
+
+    void fillProfilesMenu() {
+        profilesMenu->clear();
+        PeerProfiles& profiles = profileSwitcher.profiles();
+        QList<PeerProfiles::Profile> all = profiles.profiles();
+        if (all.isEmpty()) {
+            QAction *emptyAction = profilesMenu->addAction(
+                tr("No profiles (save one in Manage Peers)"));
+            emptyAction->setEnabled(false);
+            return;
+        }
+
+        QString active = profiles.activeProfile();
+        for (const PeerProfiles::Profile& profile : all) {
+            QAction *action = profilesMenu->addAction(
+                tr("%1 (%2 of %3 peers reachable)")
+                    .arg(profile.name)
+                    .arg(profile.reachableCount())
+                    .arg(profile.peers.size()));
+            action->setCheckable(true);
+            action->setChecked(profile.name == active);
+            action->setEnabled(! profileSwitcher.isSwitching());
+            QString name = profile.name;
+            connect(action, &QAction::triggered, this, [this, name]() {
+                profileSwitcher.switchTo(name);
+            });
+        }
+    }
+
+    void showProfileSwitchResult(const QString& name,
+                                 bool success,
+                                 const QString& message) {
+        trayIcon->showMessage(
+            tr("Peer Profile %1").arg(name),
+            message,
+            success ? QSystemTrayIcon::Information
+                    : QSystemTrayIcon::Warning);
+        if (success) {
+            checkStatus(Executor::Interactive);
+        }
+    }
+
+    void runOverlayTest() {
+        bool ok = false;
+        QString text = QInputDialog::getMultiLineText(
+            nullptr,
+            tr("Overlay Latency Test"),
+            tr("Yggdrasil addresses to ping, one per line:"),
+            overlayTest.targets().join('\n'),
+            &ok);
+        if (! ok) {
+            return;
+        }
+
+        QStringList targets = overlayTest.setTargets(text.split('\n'));
+        if (targets.isEmpty()) {
+            QMessageBox::warning(nullptr,
+                                 tr("Overlay Latency Test"),
+                                 tr("No Yggdrasil (200::/7) addresses"
+                                    " given."));
+            return;
+        }
+
+        // The run records the connected peers; asking the admin socket for
+        // them may block for seconds.
+        overlayTestAction->setEnabled(false);
+        bool submitted = Executor::instance().submit(
+            Executor::Interactive,
+            [this]() {
+                SocketManager socketManager(
+                    SocketManager::defaultSocketPaths());
+                QJsonObject peers = socketManager.sendRequest(
+                    {{"request", "getpeers"}});
+                emit overlayPeersFetched(
+                    SocketManager::connectedPeerUris(peers));
+            },
+            this);
+        if (! submitted) {
+            overlayTestAction->setEnabled(true);
         }
     }
+
+    void startOverlayTest(const QStringList& peers) {
+        if (! overlayTest.start(peers)) {
+            overlayTestAction->setEnabled(true);
+        }
+    }
+
+    void showOverlayTestResult(const OverlayLatencyTest::Run& run,
+                               bool success) {
+        overlayTestAction->setEnabled(true);
+        if (! success) {
+            QMessageBox::warning(nullptr,
+                                 tr("Overlay Latency Test"),
+                                 tr("Failed to send echo requests."));
+            return;
+        }
+
+        // The run itself is the last one in the history.
+        QList<OverlayLatencyTest::Run> runs = overlayTest.history();
+        const OverlayLatencyTest::Run* previous = (runs.size() > 1)
+            ? &runs[runs.size() - 2] : nullptr;
+        QMessageBox::information(nullptr,
+                                 tr("Overlay Latency Test"),
+                                 OverlayLatencyTest::describe(run,
+                                                              previous));
+    }
 };
 
 /**
@@ -0,0 +1,43 @@
+/**
+ * @file bench.h
+ * @brief Helpers shared by the yggtray benchmarks.
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <atomic>
+#include <stdio.h>
+#include <time.h>
+
+// Number of global operator new calls, counted by bench_main.cpp.
+extern std::atomic<long> benchAllocations;
+
+/**
+ * @brief Get the CPU time consumed by the calling thread.
+ * @return CPU time in milliseconds.
+ */
+static inline double benchThreadCpuMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/**
+ * @brief Print one benchmark result line.
+ * @param bench Benchmark name.
+ * @param variant Measured variant (e.g. "baseline" or "optimized").
+ * @param metric Metric name.
+ * @param value Metric value.
+ * @param unit Metric unit.
+ */
+static inline void benchReport(const char* bench,
+                               const char* variant,
+                               const char* metric,
+                               double value,
+                               const char* unit) {
+    printf("[%s] %-12s %-28s %14.3f %s\n",
+           bench, variant, metric, value, unit);
+}
+
+#endif // BENCH_H
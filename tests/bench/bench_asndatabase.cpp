@@ -0,0 +1,95 @@
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include <QtCore/QVector>
+#include <QtNetwork/QHostAddress>
+#include <random>
+#include <vector>
+#include "../../src/AsnDatabase.h"
+#include "bench.h"
+
+// Number of prefixes per family, about the size of a full table.
+static const int IPV4_PREFIXES = 1000000;
+static const int IPV6_PREFIXES = 200000;
+
+// Number of lookups measured.
+static const int LOOKUPS = 2000000;
+
+// Compiles a synthetic full table, then reports the time to open the file
+// and the cost of a lookup.
+void bench_asndatabase(void)
+{
+    std::mt19937 random(42);
+    QVector<AsnDatabase::Prefix> prefixes;
+    prefixes.reserve(IPV4_PREFIXES + IPV6_PREFIXES);
+    for (int i = 0; i < IPV4_PREFIXES; ++i) {
+        int length = 8 + static_cast<int>(random() % 17);
+        quint32 address = static_cast<quint32>(random())
+                          & ~(0xffffffffu >> length);
+        quint32 asn = 1 + static_cast<quint32>(random() % 65000);
+        prefixes.append({ QHostAddress(address), length, asn });
+    }
+    for (int i = 0; i < IPV6_PREFIXES; ++i) {
+        Q_IPV6ADDR bytes = {};
+        bytes[0] = 0x20;
+        for (int j = 1; j < 6; ++j) {
+            bytes[j] = static_cast<quint8>(random());
+        }
+        int length = 19 + static_cast<int>(random() % 30);
+        quint32 asn = 1 + static_cast<quint32>(random() % 65000);
+        prefixes.append({ QHostAddress(bytes), length, asn });
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    QByteArray data = AsnDatabase::compile(prefixes, {});
+    benchReport("asndatabase", "compile", "time",
+                timer.nsecsElapsed() / 1e6, "ms");
+    benchReport("asndatabase", "compile", "file size",
+                data.size() / 1048576.0, "MiB");
+
+    QTemporaryDir dir;
+    QString path = dir.filePath("asn.db");
+    QFile file(path);
+    if ((! file.open(QIODevice::WriteOnly)) || (file.write(data) < 0)) {
+        fprintf(stderr, "Cannot write %s\n", qPrintable(path));
+        return;
+    }
+    file.close();
+
+    AsnDatabase database;
+    timer.restart();
+    if (! database.open(path)) {
+        fprintf(stderr, "Cannot open %s\n", qPrintable(path));
+        return;
+    }
+    benchReport("asndatabase", "open", "time",
+                timer.nsecsElapsed() / 1e6, "ms");
+
+    // Random addresses, half of each family, as the raw keys lookup() takes.
+    std::vector<std::pair<quint64, quint64>> keys;
+    keys.reserve(LOOKUPS);
+    for (int i = 0; i < LOOKUPS; ++i) {
+        if (i % 2) {
+            keys.push_back({ 0, 0x0000ffff00000000ULL | random() });
+        } else {
+            keys.push_back({ 0x2000000000000000ULL
+                                 | (quint64(random()) << 16)
+                                 | (random() & 0xffff),
+                             quint64(random()) });
+        }
+    }
+
+    long allocations = benchAllocations.load();
+    quint64 found = 0;
+    timer.restart();
+    for (const auto& key : keys) {
+        found += (database.lookup(key.first, key.second) != 0);
+    }
+    double ns = static_cast<double>(timer.nsecsElapsed()) / LOOKUPS;
+    benchReport("asndatabase", "lookup", "time per lookup", ns, "ns");
+    benchReport("asndatabase", "lookup", "allocations",
+                benchAllocations.load() - allocations, "");
+    benchReport("asndatabase", "lookup", "matched",
+                100.0 * found / LOOKUPS, "%");
+}
@@ -0,0 +1,157 @@
+#include <QtCore/QAtomicInt>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QRunnable>
+#include <QtCore/QThreadPool>
+#include <QtNetwork/QHostAddress>
+#include <vector>
+#include "../../src/IcmpProber.h"
+#include "../../src/PeerManager.h"
+#include "../../src/SharedIcmpProber.h"
+#include "bench.h"
+
+// Number of loopback addresses probed in one sweep.
+static const int TARGET_COUNT = 256;
+// Number of echo requests per address.
+static const int ECHO_COUNT = 3;
+// Number of peers tested one address each in the concurrent sweep.
+static const int PEER_COUNT = 64;
+
+// Probes TARGET_COUNT loopback addresses and reports the system calls and
+// CPU time the sweep took.  Returns false if ICMP sockets are not allowed.
+static bool run(const char* variant, bool batching) {
+    IcmpProber prober(ECHO_COUNT, 0);
+    prober.setBatching(batching);
+    for (int i = 0; i < TARGET_COUNT; ++i) {
+        quint32 address = (127u << 24) | (1u << 16) | static_cast<quint32>(i);
+        if (prober.addTarget(QHostAddress(address)) < 0) {
+            return false;
+        }
+    }
+
+    double cpu = benchThreadCpuMs();
+    int received = 0;
+    while (! prober.isFinished()) {
+        prober.poll(10);
+    }
+    cpu = benchThreadCpuMs() - cpu;
+    for (int i = 0; i < TARGET_COUNT; ++i) {
+        received += prober.result(i).received;
+    }
+
+    double probes = TARGET_COUNT * ECHO_COUNT;
+    benchReport("icmpprober", variant, "syscalls per probe",
+                prober.syscallCount() / probes, "calls");
+    benchReport("icmpprober", variant, "CPU per sweep", cpu, "ms");
+    benchReport("icmpprober", variant, "replies", received, "");
+    return true;
+}
+
+/**
+ * @brief A peer test of the concurrent sweep, probing the way
+ * PeerTestRunnable::probeNative() does.
+ */
+class PeerProbe : public QRunnable {
+public:
+    PeerProbe(SharedIcmpProber* shared,
+              QAtomicInt* nextPeer,
+              QAtomicInt* received,
+              QAtomicInt* ownSyscalls)
+        : shared(shared)
+        , nextPeer(nextPeer)
+        , received(received)
+        , ownSyscalls(ownSyscalls) {
+    }
+
+    void run() override {
+        for (;;) {
+            int peer = nextPeer->fetchAndAddOrdered(1);
+            if (peer >= PEER_COUNT) {
+                return;
+            }
+            quint32 address = (127u << 24) | (2u << 16)
+                | static_cast<quint32>(peer);
+            if (shared) {
+                probeShared(QHostAddress(address));
+            } else {
+                probeOwn(QHostAddress(address));
+            }
+        }
+    }
+
+private:
+    void probeShared(const QHostAddress& address) {
+        std::vector<int> targets(1, shared->addTarget(address));
+        if (targets[0] < 0) {
+            return;
+        }
+        while (! shared->isFinished(targets)) {
+            shared->poll(PeerTestRunnable::CHECK_INTERVAL_MS);
+        }
+        received->fetchAndAddOrdered(shared->results(targets)[0].received);
+        shared->releaseTargets(targets);
+    }
+
+    void probeOwn(const QHostAddress& address) {
+        IcmpProber prober(ECHO_COUNT, PeerTestRunnable::PING_SEND_SLOT_MS);
+        int target = prober.addTarget(address);
+        if (target < 0) {
+            return;
+        }
+        while (! prober.isFinished()) {
+            prober.poll(PeerTestRunnable::CHECK_INTERVAL_MS);
+        }
+        received->fetchAndAddOrdered(prober.result(target).received);
+        ownSyscalls->fetchAndAddOrdered(
+            static_cast<int>(prober.syscallCount()));
+    }
+
+    SharedIcmpProber* shared;
+    QAtomicInt* nextPeer;
+    QAtomicInt* received;
+    QAtomicInt* ownSyscalls;
+};
+
+// Tests PEER_COUNT peers with PeerManager::MAX_CONCURRENT_TESTS tests in
+// flight, each through a prober of its own or all through one shared
+// prober, and reports the system calls per probe.  The requests to one
+// address are a send slot apart so that the shared schedules line up.
+static void runSweep(const char* variant, bool shared) {
+    SharedIcmpProber sharedProber(ECHO_COUNT,
+                                  PeerTestRunnable::PING_SEND_SLOT_MS,
+                                  PeerTestRunnable::PING_SEND_SLOT_MS);
+    QAtomicInt nextPeer(0);
+    QAtomicInt received(0);
+    QAtomicInt ownSyscalls(0);
+    QThreadPool pool;
+    pool.setMaxThreadCount(PeerManager::MAX_CONCURRENT_TESTS);
+
+    QElapsedTimer elapsed;
+    elapsed.start();
+    for (int i = 0; i < PeerManager::MAX_CONCURRENT_TESTS; ++i) {
+        pool.start(new PeerProbe(shared ? &sharedProber : nullptr,
+                                 &nextPeer, &received, &ownSyscalls));
+    }
+    pool.waitForDone();
+
+    double syscalls = shared
+        ? static_cast<double>(sharedProber.syscallCount())
+        : ownSyscalls.loadAcquire();
+    double probes = PEER_COUNT * ECHO_COUNT;
+    benchReport("icmpprober", variant, "syscalls per probe",
+                syscalls / probes, "calls");
+    benchReport("icmpprober", variant, "sweep time",
+                elapsed.elapsed(), "ms");
+    benchReport("icmpprober", variant, "replies",
+                received.loadAcquire(), "");
+}
+
+void bench_icmpprober(void)
+{
+    if (! run("per-packet", false)) {
+        printf("[icmpprober] ICMP datagram sockets not allowed, skipping\n");
+        return;
+    }
+    run("batched", true);
+    runSweep("per-test", false);
+    runSweep("shared", true);
+}
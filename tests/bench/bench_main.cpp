@@ -0,0 +1,94 @@
+#include <QtCore/QByteArray>
+#include <QtWidgets/QApplication>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bench.h"
+
+// Forward declarations from other benchmark files
+extern void bench_peerdiscoverydialog(void);
+extern void bench_selectconfigpeers(void);
+extern void bench_peerdata(void);
+extern void bench_icmpprober(void);
+extern void bench_asndatabase(void);
+
+std::atomic<long> benchAllocations(0);
+
+// Count heap allocations for the benchmarks that report them.  The array
+// and nothrow forms forward to these by default.
+void* operator new(size_t size)
+{
+    benchAllocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (! p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// Debug logging would dominate the measurements, so drop it.
+static void quietMessageHandler(QtMsgType type,
+                                const QMessageLogContext& context,
+                                const QString& message)
+{
+    Q_UNUSED(context);
+    if (type != QtDebugMsg) {
+        fprintf(stderr, "%s\n", message.toLocal8Bit().constData());
+    }
+}
+
+struct Benchmark {
+    const char* name;
+    void (*run)(void);
+};
+
+static const Benchmark BENCHMARKS[] = {
+    { "peerdiscoverydialog", bench_peerdiscoverydialog },
+    { "selectconfigpeers", bench_selectconfigpeers },
+    { "peerdata", bench_peerdata },
+    { "icmpprober", bench_icmpprober },
+    { "asndatabase", bench_asndatabase },
+};
+
+int main(int argc, char* argv[])
+{
+    // Benchmarks must run on headless machines too.
+    if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QApplication app(argc, argv);
+    qInstallMessageHandler(quietMessageHandler);
+
+    // Run only the benchmarks named on the command line, or all of them.
+    int ran = 0;
+    for (const Benchmark& bench : BENCHMARKS) {
+        bool selected = (argc < 2);
+        for (int i = 1; i < argc; ++i) {
+            if (strcmp(argv[i], bench.name) == 0) {
+                selected = true;
+            }
+        }
+        if (selected) {
+            printf("== %s\n", bench.name);
+            bench.run();
+            ++ran;
+        }
+    }
+
+    if (ran == 0) {
+        fprintf(stderr, "No benchmark matched the arguments.\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,143 @@
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QMetaType>
+#include <QtCore/QString>
+#include <algorithm>
+#include "../../src/PeerData.h"
+#include "bench.h"
+
+// Number of peers in the list.
+static const int PEER_COUNT = 5000;
+
+// Number of element copies made of LegacyPeerData.
+static long legacyCopies = 0;
+
+// PeerData as it was before it became implicitly shared.
+struct LegacyPeerData {
+    QString host;
+    int latency = -1;
+    bool isValid = false;
+    bool isPrivate = false;
+
+    LegacyPeerData() = default;
+    LegacyPeerData(const LegacyPeerData& other)
+        : host(other.host)
+        , latency(other.latency)
+        , isValid(other.isValid)
+        , isPrivate(other.isPrivate) {
+        ++legacyCopies;
+    }
+    LegacyPeerData& operator=(const LegacyPeerData& other) {
+        host = other.host;
+        latency = other.latency;
+        isValid = other.isValid;
+        isPrivate = other.isPrivate;
+        ++legacyCopies;
+        return *this;
+    }
+};
+
+Q_DECLARE_METATYPE(LegacyPeerData)
+
+static void setPeer(LegacyPeerData& p, const QString& host, int latency) {
+    p.host = host;
+    p.latency = latency;
+    p.isValid = latency % 3 != 0;
+}
+
+static void setPeer(PeerData& p, const QString& host, int latency) {
+    p.setHost(host);
+    p.setLatency(latency);
+    p.setValid(latency % 3 != 0);
+}
+
+static bool isValid(const LegacyPeerData& p) { return p.isValid; }
+static bool isValid(const PeerData& p) { return p.isValid(); }
+static int latency(const LegacyPeerData& p) { return p.latency; }
+static int latency(const PeerData& p) { return p.latency(); }
+static void setLatency(LegacyPeerData& p, int l) { p.latency = l; }
+static void setLatency(PeerData& p, int l) { p.setLatency(l); }
+
+template <typename T>
+static QList<T> makePeers() {
+    QList<T> peers;
+    peers.reserve(PEER_COUNT);
+    for (int i = 0; i < PEER_COUNT; ++i) {
+        T p;
+        setPeer(p,
+                QString("tls://peer%1.example.net:%2").arg(i).arg(1000 + i),
+                1 + (i * 7919) % 500);
+        peers << p;
+    }
+    return peers;
+}
+
+// Runs one step and reports the time, allocations and legacy copies it took.
+template <typename Fn>
+static void measure(const char* variant, const char* step, Fn fn) {
+    char metric[64];
+    long copies = legacyCopies;
+    long allocations = benchAllocations.load();
+    QElapsedTimer timer;
+    timer.start();
+    fn();
+    double ms = timer.nsecsElapsed() / 1e6;
+
+    snprintf(metric, sizeof(metric), "%s time", step);
+    benchReport("peerdata", variant, metric, ms, "ms");
+    snprintf(metric, sizeof(metric), "%s allocations", step);
+    benchReport("peerdata", variant, metric,
+                benchAllocations.load() - allocations, "");
+    if (legacyCopies != copies) {
+        snprintf(metric, sizeof(metric), "%s copies", step);
+        benchReport("peerdata", variant, metric, legacyCopies - copies, "");
+    }
+}
+
+template <typename T>
+static void run(const char* variant) {
+    int typeId = qMetaTypeId<T>();
+    QList<T> peerList = makePeers<T>();
+
+    // Hand every peer to a runnable and back through a queued signal,
+    // which copies the argument into and out of the event.
+    measure(variant, "hand-off", [&]() {
+        for (const T& peer : peerList) {
+            T runnablePeer = peer;
+            void* queued = QMetaType::create(typeId, &runnablePeer);
+            T received = *static_cast<T*>(queued);
+            QMetaType::destroy(typeId, queued);
+            Q_UNUSED(received);
+        }
+    });
+
+    // Take a snapshot of the list and filter and sort it, as the "Apply"
+    // path does.
+    measure(variant, "filter", [&]() {
+        QList<T> selectedPeers = peerList;
+        QList<T> validPeers;
+        validPeers.reserve(selectedPeers.size());
+        std::copy_if(selectedPeers.begin(), selectedPeers.end(),
+                     std::back_inserter(validPeers),
+                     [](const T& p) { return isValid(p); });
+        std::sort(validPeers.begin(), validPeers.end(),
+                  [](const T& a, const T& b) {
+                      return latency(a) < latency(b);
+                  });
+    });
+
+    // Update one peer in a list shared with a snapshot.
+    measure(variant, "update", [&]() {
+        QList<T> snapshot = peerList;
+        setLatency(peerList[0], 1);
+        Q_UNUSED(snapshot);
+    });
+}
+
+void bench_peerdata(void)
+{
+    qRegisterMetaType<LegacyPeerData>("LegacyPeerData");
+    qRegisterMetaType<PeerData>("PeerData");
+    run<LegacyPeerData>("legacy");
+    run<PeerData>("shared");
+}
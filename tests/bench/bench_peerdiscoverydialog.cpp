@@ -0,0 +1,142 @@
+#include <QtCore/QEventLoop>
+#include <QtCore/QList>
+#include <QtCore/QTimer>
+#include <QtWidgets/QHeaderView>
+#include <QtWidgets/QLabel>
+#include <QtWidgets/QProgressBar>
+#include <QtWidgets/QTableWidget>
+#include <QtWidgets/QVBoxLayout>
+#include <QtWidgets/QWidget>
+#include <functional>
+#include "../../src/PeerDiscoveryDialog.h"
+#include "bench.h"
+
+// Number of synthetic peer test results to deliver.
+static const int RESULT_COUNT = 5000;
+// Results delivered per producer tick, emulating high probe concurrency.
+static const int RESULTS_PER_TICK = 50;
+// Producer tick interval.
+static const int TICK_MS = 5;
+
+static QList<PeerData> makePeers() {
+    QList<PeerData> peers;
+    peers.reserve(RESULT_COUNT);
+    for (int i = 0; i < RESULT_COUNT; ++i) {
+        peers << PeerData(
+            QString("tls://peer%1.example.net:%2").arg(i).arg(1000 + i));
+    }
+    return peers;
+}
+
+// Deliver a synthetic result for each peer in bursts and spin the event loop
+// until all results are delivered and the UI had a chance to catch up.
+// Returns the GUI thread CPU time in milliseconds.
+static double deliverResults(const QList<PeerData>& peers,
+                             const std::function<void(const PeerData&)>& sink) {
+    QEventLoop loop;
+    QTimer producer;
+    int next = 0;
+    producer.setInterval(TICK_MS);
+    QObject::connect(&producer, &QTimer::timeout, [&]() {
+        for (int i = 0; (i < RESULTS_PER_TICK) && (next < peers.size()); ++i) {
+            PeerData result = peers[next];
+            result.setLatency(1 + (next * 7919) % 500);
+            result.setValid((next % 5) != 0);
+            sink(result);
+            ++next;
+        }
+        if (next >= peers.size()) {
+            producer.stop();
+            // Let pending flushes and repaints run before stopping.
+            QTimer::singleShot(100, &loop, &QEventLoop::quit);
+        }
+    });
+
+    double start = benchThreadCpuMs();
+    producer.start();
+    loop.exec();
+    return benchThreadCpuMs() - start;
+}
+
+// The pre-coalescing update path: every result updates the row, the
+// progress bar and the status label, toggling sorting each time.
+static double runPerResultBaseline(const QList<PeerData>& peers) {
+    QWidget window;
+    QVBoxLayout* layout = new QVBoxLayout(&window);
+    QTableWidget* table = new QTableWidget(&window);
+    QProgressBar* progress = new QProgressBar(&window);
+    QLabel* status = new QLabel(&window);
+    layout->addWidget(table);
+    layout->addWidget(progress);
+    layout->addWidget(status);
+    table->setColumnCount(4);
+    table->horizontalHeader()->setSectionResizeMode(
+        QHeaderView::ResizeToContents);
+    table->setRowCount(peers.size());
+    for (int i = 0; i < peers.size(); ++i) {
+        table->setItem(i, 0, new QTableWidgetItem(peers[i].host()));
+        table->setItem(i, 1, new LatencyItem());
+        table->setItem(i, 2, new QTableWidgetItem("-"));
+        table->setItem(i, 3, new QTableWidgetItem("Not Tested"));
+    }
+    table->setSortingEnabled(true);
+    window.show();
+
+    int tested = 0;
+    double cpuMs = deliverResults(peers, [&](const PeerData& peer) {
+        ++tested;
+        progress->setValue((tested * 100) / peers.size());
+        int row = tested - 1;
+        table->setSortingEnabled(false);
+        table->setItem(row, 0, new QTableWidgetItem(peer.host()));
+        table->setItem(row, 1,
+                       new LatencyItem(peer.latency(), peer.isValid(), true));
+        table->setItem(row, 2, new QTableWidgetItem("-"));
+        table->setItem(row, 3, new ValidityItem(peer.isValid()));
+        table->setSortingEnabled(true);
+        status->setText(QString("Testing peers: %1/%2")
+                        .arg(tested).arg(peers.size()));
+    });
+    benchReport("peerdiscoverydialog", "per-result", "ui updates",
+                tested, "");
+    return cpuMs;
+}
+
+// The dialog itself, fed through its peerTested slot.
+static double runCoalesced(const QList<PeerData>& peers) {
+    PeerDiscoveryDialog dialog(nullptr);
+    dialog.show();
+    QMetaObject::invokeMethod(&dialog, "onPeersDiscovered",
+                              Qt::DirectConnection,
+                              Q_ARG(QList<PeerData>, peers));
+    UiUpdateCoalescer* coalescer = dialog.findChild<UiUpdateCoalescer*>();
+
+    double cpuMs = deliverResults(peers, [&](const PeerData& peer) {
+        QMetaObject::invokeMethod(&dialog, "onPeerTested",
+                                  Qt::DirectConnection,
+                                  Q_ARG(PeerData, peer));
+    });
+    if (coalescer) {
+        benchReport("peerdiscoverydialog", "coalesced", "ui updates",
+                    coalescer->flushCount(), "");
+    }
+    return cpuMs;
+}
+
+void bench_peerdiscoverydialog(void)
+{
+    QList<PeerData> peers = makePeers();
+
+    double baselineMs = runPerResultBaseline(peers);
+    benchReport("peerdiscoverydialog", "per-result", "GUI thread CPU",
+                baselineMs, "ms");
+
+    double coalescedMs = runCoalesced(peers);
+    benchReport("peerdiscoverydialog", "coalesced", "GUI thread CPU",
+                coalescedMs, "ms");
+
+    if (coalescedMs > 0.0) {
+        benchReport("peerdiscoverydialog", "coalesced", "speedup",
+                    baselineMs / coalescedMs, "x");
+    }
+}
@@ -0,0 +1,102 @@
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QList>
+#include <QtCore/QTemporaryFile>
+#include <QtCore/QTextStream>
+#include <algorithm>
+#include "../../src/PeerManager.h"
+#include "bench.h"
+
+// Number of candidate peers.
+static const int CANDIDATE_COUNT = 100000;
+// Number of repetitions of each variant.
+static const int REPEAT = 5;
+
+static QList<PeerData> makeCandidates() {
+    QList<PeerData> peers;
+    peers.reserve(CANDIDATE_COUNT);
+    for (int i = 0; i < CANDIDATE_COUNT; ++i) {
+        PeerData p(QString("tls://peer%1.example.net:%2")
+                       .arg(i).arg(1000 + i % 50000));
+        p.setLatency(1 + (i * 7919) % 1000);
+        p.setValid((i % 4) != 0);
+        p.setPrivate(i < 3);
+        peers << p;
+    }
+    return peers;
+}
+
+// The selection path used before top-K: sort all, copy the usable peers
+// and write every one of them, leaving truncation to update-peers.sh.
+static int legacySelectAndWrite(const QList<PeerData>& selectedPeers,
+                                QTextStream& stream) {
+    QList<PeerData> sortedPeers = selectedPeers;
+    std::sort(sortedPeers.begin(), sortedPeers.end(),
+        [](const PeerData& a, const PeerData& b) {
+            if (a.isPrivate()) {
+                if (b.isPrivate()) {
+                    if (a.isValid() && b.isValid()) {
+                        return a.latency() < b.latency();
+                    }
+                    return a.isValid() > b.isValid();
+                }
+                return true;
+            } else if (b.isPrivate()) {
+                return false;
+            }
+            if (a.isValid() && b.isValid()) {
+                return a.latency() < b.latency();
+            }
+            return a.isValid() > b.isValid();
+        });
+
+    QList<PeerData> validPeers;
+    validPeers.reserve(sortedPeers.size());
+    std::copy_if(sortedPeers.begin(),
+                 sortedPeers.end(),
+                 std::back_inserter(validPeers),
+                 [](const PeerData& p) {
+                     return isPeerUriValid(p.host())
+                         && (p.isPrivate() || p.isValid());
+                 });
+    writePeers(stream, validPeers);
+    return validPeers.size();
+}
+
+static int topKSelectAndWrite(const QList<PeerData>& selectedPeers,
+                              QTextStream& stream) {
+    QList<PeerData> peers = PeerManager::selectConfigPeers(selectedPeers);
+    writePeers(stream, peers);
+    return peers.size();
+}
+
+static void run(const char* variant,
+                const QList<PeerData>& candidates,
+                int (*selectAndWrite)(const QList<PeerData>&, QTextStream&)) {
+    double totalMs = 0.0;
+    qint64 bytes = 0;
+    int written = 0;
+    for (int r = 0; r < REPEAT; ++r) {
+        QTemporaryFile file;
+        file.open();
+        QTextStream stream(&file);
+        QElapsedTimer timer;
+        timer.start();
+        written = selectAndWrite(candidates, stream);
+        stream.flush();
+        totalMs += timer.nsecsElapsed() / 1e6;
+        bytes = file.size();
+    }
+    benchReport("selectconfigpeers", variant, "time per apply",
+                totalMs / REPEAT, "ms");
+    benchReport("selectconfigpeers", variant, "peers written",
+                written, "");
+    benchReport("selectconfigpeers", variant, "bytes written",
+                bytes, "B");
+}
+
+void bench_selectconfigpeers(void)
+{
+    QList<PeerData> candidates = makeCandidates();
+    run("legacy", candidates, legacySelectAndWrite);
+    run("top-k", candidates, topKSelectAndWrite);
+}
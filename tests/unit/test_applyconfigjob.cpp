@@ -0,0 +1,81 @@
+#include <check.h>
+#include <QtCore/QList>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+#include "../../src/ApplyConfigJob.h"
+
+static QList<PeerData> makePeers(const QStringList& hosts) {
+    QList<PeerData> peers;
+    for (const QString& host : hosts) {
+        PeerData p;
+        p.setHost(host);
+        p.setLatency(10);
+        p.setValid(true);
+        peers << p;
+    }
+    return peers;
+}
+
+static bool reachedStage(QSignalSpy& spy, ApplyConfigJob::Stage stage) {
+    for (const QList<QVariant>& args : spy) {
+        if (args.at(0).value<ApplyConfigJob::Stage>() == stage) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Canceling right after start must finish the job without ever reaching the
+// privileged stage.
+START_TEST(test_applyconfigjob_cancel_before_privileged_step)
+{
+    printf("[ApplyConfigJob] test_applyconfigjob_cancel_before_privileged_step: Testing cancellation...\n");
+    ApplyConfigJob job(makePeers({ "tls://example.com:1000" }));
+    QSignalSpy stageSpy(&job, &ApplyConfigJob::stageChanged);
+    QSignalSpy finishedSpy(&job, &ApplyConfigJob::finished);
+
+    job.start();
+    ck_assert(job.isCancellable());
+    ck_assert(job.cancel());
+    QTest::qWait(50);
+
+    ck_assert_int_eq(finishedSpy.count(), 1);
+    ck_assert(! finishedSpy.at(0).at(0).toBool());
+    ck_assert(job.wasCanceled());
+    ck_assert_int_eq(job.stage(), ApplyConfigJob::Finished);
+    ck_assert(! reachedStage(stageSpy, ApplyConfigJob::UpdatingConfig));
+    ck_assert(! job.cancel());
+}
+END_TEST
+
+// A selection without a single usable peer must fail during validation.
+START_TEST(test_applyconfigjob_fails_without_valid_peers)
+{
+    printf("[ApplyConfigJob] test_applyconfigjob_fails_without_valid_peers: Testing validation failure...\n");
+    ApplyConfigJob job(makePeers({ "tls://example.com", "invalid" }));
+    QSignalSpy stageSpy(&job, &ApplyConfigJob::stageChanged);
+    QSignalSpy finishedSpy(&job, &ApplyConfigJob::finished);
+
+    job.start();
+    ck_assert(finishedSpy.wait(1000));
+
+    ck_assert(! finishedSpy.at(0).at(0).toBool());
+    ck_assert(! job.wasCanceled());
+    ck_assert(reachedStage(stageSpy, ApplyConfigJob::ValidatingPeerList));
+    ck_assert(! reachedStage(stageSpy, ApplyConfigJob::UpdatingConfig));
+}
+END_TEST
+
+Suite* applyconfigjob_suite(void)
+{
+    Suite* s = suite_create("ApplyConfigJob");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_applyconfigjob_cancel_before_privileged_step);
+    tcase_add_test(tc, test_applyconfigjob_fails_without_valid_peers);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+/* No main here: suite will be registered from the global test runner. */
@@ -0,0 +1,152 @@
+#include <check.h>
+#include <QtCore/QBuffer>
+#include <QtCore/QFile>
+#include <QtCore/QTemporaryDir>
+#include "../../src/AsnDatabase.h"
+
+// Write data to a file in a temporary directory.
+static QString writeFile(const QTemporaryDir& dir,
+                         const QString& name,
+                         const QByteArray& data) {
+    QString path = dir.filePath(name);
+    QFile file(path);
+    ck_assert(file.open(QIODevice::WriteOnly));
+    ck_assert_int_eq(file.write(data), data.size());
+    return path;
+}
+
+// The longest matching prefix wins, for both families.
+START_TEST(test_asndatabase_longest_prefix)
+{
+    printf("[AsnDatabase] test_asndatabase_longest_prefix: Testing lookups...\n");
+    QTemporaryDir dir;
+    ck_assert(dir.isValid());
+    QByteArray dump(
+        "# routeviews prefix-to-AS\n"
+        "192.0.2.0\t24\t64496\n"
+        "192.0.2.128\t25\t64497\n"
+        "198.51.100.0\t22\t64498_64499\n"
+        "2001:db8::\t32\t64500\n"
+        "2001:db8:1::\t48\t64501\n"
+        "not an address\t8\t1\n");
+    QString dumpPath = writeFile(dir, "pfx2as.txt", dump);
+    QString databasePath = dir.filePath("asn.db");
+    QString error;
+    ck_assert(AsnDatabase::import(dumpPath, databasePath, &error));
+
+    AsnDatabase database;
+    ck_assert(! database.isOpen());
+    ck_assert(database.open(databasePath));
+    ck_assert_int_eq(database.prefixCount(), 5);
+
+    AsnDatabase::Match match = database.lookup(QHostAddress("192.0.2.1"));
+    ck_assert_int_eq(match.asn, 64496);
+    ck_assert_str_eq(qPrintable(match.prefix.toString()), "192.0.2.0");
+    ck_assert_int_eq(match.prefixLength, 24);
+    match = database.lookup(QHostAddress("192.0.2.200"));
+    ck_assert_int_eq(match.asn, 64497);
+    ck_assert_int_eq(match.prefixLength, 25);
+    // The first origin of a multi-origin prefix counts.
+    ck_assert_int_eq(database.lookup(QHostAddress("198.51.103.255")).asn,
+                     64498);
+    ck_assert(! database.lookup(QHostAddress("198.51.104.0")).isValid());
+
+    ck_assert_int_eq(database.lookup(QHostAddress("2001:db8:2::1")).asn,
+                     64500);
+    match = database.lookup(QHostAddress("2001:db8:1:ffff::1"));
+    ck_assert_int_eq(match.asn, 64501);
+    ck_assert_str_eq(qPrintable(match.prefix.toString()), "2001:db8:1::");
+    ck_assert_int_eq(match.prefixLength, 48);
+    ck_assert(! database.lookup(QHostAddress("2001:db9::1")).isValid());
+    ck_assert(! database.lookup(QHostAddress()).isValid());
+
+    database.close();
+    ck_assert(! database.isOpen());
+    ck_assert(! database.lookup(QHostAddress("192.0.2.1")).isValid());
+}
+END_TEST
+
+// Ranges are split into prefixes, and AS names are kept.
+START_TEST(test_asndatabase_ranges)
+{
+    printf("[AsnDatabase] test_asndatabase_ranges: Testing range dumps...\n");
+    QByteArray dump(
+        "1.0.0.0\t1.0.0.255\t13335\tUS\tCLOUDFLARENET\n"
+        "1.0.1.0\t1.0.3.255\t0\tNone\tNot routed\n"
+        "203.0.113.5\t203.0.113.20\t64502\tZZ\tEXAMPLE-NET\n"
+        "2001:db8::\t2001:db8:ffff:ffff:ffff:ffff:ffff:ffff\t64503\tZZ\tV6-NET\n");
+    QBuffer buffer(&dump);
+    ck_assert(buffer.open(QIODevice::ReadOnly));
+    QVector<AsnDatabase::Prefix> prefixes;
+    QHash<quint32, QString> names;
+    ck_assert_int_eq(AsnDatabase::parseDump(&buffer, &prefixes, &names), 0);
+    // Not routed ranges have neither prefixes nor names.
+    ck_assert_int_eq(names.size(), 3);
+
+    QTemporaryDir dir;
+    ck_assert(dir.isValid());
+    QString path = writeFile(dir, "asn.db",
+                             AsnDatabase::compile(prefixes, names));
+    AsnDatabase database;
+    ck_assert(database.open(path));
+    ck_assert_int_eq(database.lookup(QHostAddress("1.0.0.1")).asn, 13335);
+    ck_assert(! database.lookup(QHostAddress("1.0.2.1")).isValid());
+    ck_assert(! database.lookup(QHostAddress("203.0.113.4")).isValid());
+    for (int i = 5; i <= 20; ++i) {
+        QHostAddress address(QString("203.0.113.%1").arg(i));
+        ck_assert_int_eq(database.lookup(address).asn, 64502);
+    }
+    ck_assert(! database.lookup(QHostAddress("203.0.113.21")).isValid());
+    AsnDatabase::Match match
+        = database.lookup(QHostAddress("2001:db8:abcd::1"));
+    ck_assert_int_eq(match.asn, 64503);
+    ck_assert_int_eq(match.prefixLength, 32);
+
+    ck_assert_str_eq(qPrintable(database.asName(13335)), "CLOUDFLARENET");
+    ck_assert_str_eq(qPrintable(database.describe(64502)),
+                     "AS64502 EXAMPLE-NET");
+    ck_assert_str_eq(qPrintable(database.describe(64499)), "AS64499");
+    ck_assert(database.describe(0).isEmpty());
+}
+END_TEST
+
+// Files that are not databases, or are cut short, are rejected.
+START_TEST(test_asndatabase_malformed)
+{
+    printf("[AsnDatabase] test_asndatabase_malformed: Testing malformed files...\n");
+    QTemporaryDir dir;
+    ck_assert(dir.isValid());
+    AsnDatabase database;
+    ck_assert(! database.open(dir.filePath("missing.db")));
+    ck_assert(! database.open(writeFile(dir, "garbage.db",
+                                        QByteArray(100, 'x'))));
+
+    QVector<AsnDatabase::Prefix> prefixes;
+    prefixes.append({ QHostAddress("192.0.2.0"), 24, 64496 });
+    QByteArray data = AsnDatabase::compile(prefixes, {});
+    ck_assert(database.open(writeFile(dir, "good.db", data)));
+    ck_assert(! database.open(writeFile(dir, "short.db",
+                                        data.left(data.size() - 1))));
+    ck_assert(! database.isOpen());
+
+    QString error;
+    ck_assert(! AsnDatabase::import(writeFile(dir, "empty.txt", "junk\n"),
+                                    dir.filePath("out.db"),
+                                    &error));
+    ck_assert(! error.isEmpty());
+    ck_assert(! QFile::exists(dir.filePath("out.db")));
+}
+END_TEST
+
+Suite* asndatabase_suite(void)
+{
+    Suite* s = suite_create("AsnDatabase");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_asndatabase_longest_prefix);
+    tcase_add_test(tc, test_asndatabase_ranges);
+    tcase_add_test(tc, test_asndatabase_malformed);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
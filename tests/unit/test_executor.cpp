@@ -0,0 +1,170 @@
+#include <check.h>
+#include <QtCore/QAtomicInt>
+#include <QtCore/QMutex>
+#include <QtCore/QSemaphore>
+#include <QtCore/QStringList>
+#include <QtCore/QThread>
+#include "../../src/Executor.h"
+
+// Owners of the tasks in the tests
+static int blockerOwner;
+static int taskOwner;
+
+// Occupies the thread the normal and background lanes may use, on an
+// executor with two threads, until the gate is released.
+static void blockSharedThread(Executor& executor, QSemaphore& gate) {
+    QSemaphore started;
+    executor.submit(Executor::Normal,
+                    [&gate, &started]() {
+                        started.release();
+                        gate.acquire();
+                    },
+                    &blockerOwner);
+    started.acquire();
+}
+
+START_TEST(test_executor_runs_tasks)
+{
+    printf("[Executor] test_executor_runs_tasks: Testing submitted tasks...\n");
+    Executor executor(4);
+    QAtomicInt count(0);
+    for (int i = 0; i < 50; ++i) {
+        ck_assert(executor.submit(Executor::Normal,
+                                  [&count]() { count.fetchAndAddOrdered(1); },
+                                  &taskOwner));
+    }
+    ck_assert(executor.waitForDone(&taskOwner, 5000));
+    ck_assert_int_eq(count.loadAcquire(), 50);
+
+    Executor::LaneStats stats = executor.stats(Executor::Normal);
+    ck_assert_int_eq(stats.submitted, 50);
+    ck_assert_int_eq(stats.completed, 50);
+    ck_assert_int_eq(stats.running, 0);
+    ck_assert_int_eq(stats.queued, 0);
+}
+END_TEST
+
+// Interactive work starts while sweeps and monitoring occupy the pool.
+START_TEST(test_executor_interactive_reserved)
+{
+    printf("[Executor] test_executor_interactive_reserved: Testing the reserved thread...\n");
+    Executor executor(2);
+    QSemaphore gate;
+    blockSharedThread(executor, gate);
+
+    QAtomicInt backgroundRan(0);
+    executor.submit(Executor::Background,
+                    [&backgroundRan]() { backgroundRan.storeRelease(1); },
+                    &taskOwner);
+    QAtomicInt interactiveRan(0);
+    executor.submit(Executor::Interactive,
+                    [&interactiveRan]() { interactiveRan.storeRelease(1); },
+                    &blockerOwner);
+
+    // The interactive task got the reserved thread.
+    while (executor.stats(Executor::Interactive).completed == 0) {
+        QThread::msleep(1);
+    }
+    ck_assert_int_eq(interactiveRan.loadAcquire(), 1);
+    // The background task waits for the shared thread.
+    ck_assert_int_eq(backgroundRan.loadAcquire(), 0);
+    ck_assert_int_eq(executor.stats(Executor::Background).queued, 1);
+
+    gate.release();
+    ck_assert(executor.waitForDone(&taskOwner, 5000));
+    ck_assert_int_eq(backgroundRan.loadAcquire(), 1);
+}
+END_TEST
+
+// Queued tasks start highest lane first.
+START_TEST(test_executor_lane_order)
+{
+    printf("[Executor] test_executor_lane_order: Testing the lane priorities...\n");
+    Executor executor(2);
+    QSemaphore gate;
+    blockSharedThread(executor, gate);
+
+    QMutex mutex;
+    QStringList order;
+    auto record = [&mutex, &order](const QString& name) {
+        return [&mutex, &order, name]() {
+            QMutexLocker locker(&mutex);
+            order << name;
+        };
+    };
+    executor.submit(Executor::Background, record("background"), &taskOwner);
+    executor.submit(Executor::Normal, record("normal 1"), &taskOwner);
+    executor.submit(Executor::Normal, record("normal 2"), &taskOwner);
+
+    gate.release();
+    ck_assert(executor.waitForDone(&taskOwner, 5000));
+    ck_assert(order == QStringList()
+              << "normal 1" << "normal 2" << "background");
+}
+END_TEST
+
+// A full lane rejects tasks.
+START_TEST(test_executor_bounded_queue)
+{
+    printf("[Executor] test_executor_bounded_queue: Testing the queue limit...\n");
+    Executor executor(2);
+    executor.setQueueLimit(Executor::Background, 2);
+    QSemaphore gate;
+    blockSharedThread(executor, gate);
+
+    QAtomicInt count(0);
+    auto task = [&count]() { count.fetchAndAddOrdered(1); };
+    ck_assert(executor.submit(Executor::Background, task, &taskOwner));
+    ck_assert(executor.submit(Executor::Background, task, &taskOwner));
+    ck_assert(! executor.submit(Executor::Background, task, &taskOwner));
+
+    Executor::LaneStats stats = executor.stats(Executor::Background);
+    ck_assert_int_eq(stats.rejected, 1);
+    ck_assert_int_eq(stats.peakQueued, 2);
+
+    gate.release();
+    ck_assert(executor.waitForDone(&taskOwner, 5000));
+    ck_assert_int_eq(count.loadAcquire(), 2);
+}
+END_TEST
+
+// An owner drops its queued tasks without affecting the others.
+START_TEST(test_executor_clear_owner)
+{
+    printf("[Executor] test_executor_clear_owner: Testing dropping queued tasks...\n");
+    Executor executor(2);
+    QSemaphore gate;
+    blockSharedThread(executor, gate);
+
+    QAtomicInt count(0);
+    auto task = [&count]() { count.fetchAndAddOrdered(1); };
+    for (int i = 0; i < 3; ++i) {
+        executor.submit(Executor::Normal, task, &taskOwner);
+    }
+    ck_assert(! executor.waitForDone(&taskOwner, 10));
+    ck_assert_int_eq(executor.clear(&taskOwner), 3);
+    ck_assert(executor.waitForDone(&taskOwner, 0));
+    ck_assert_int_eq(executor.stats(Executor::Normal).dropped, 3);
+
+    // The blocking task of the other owner still runs.
+    ck_assert(! executor.waitForDone(&blockerOwner, 10));
+    gate.release();
+    ck_assert(executor.waitForDone(&blockerOwner, 5000));
+    ck_assert_int_eq(count.loadAcquire(), 0);
+}
+END_TEST
+
+Suite* executor_suite(void)
+{
+    Suite* s = suite_create("Executor");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_executor_runs_tasks);
+    tcase_add_test(tc, test_executor_interactive_reserved);
+    tcase_add_test(tc, test_executor_lane_order);
+    tcase_add_test(tc, test_executor_bounded_queue);
+    tcase_add_test(tc, test_executor_clear_owner);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
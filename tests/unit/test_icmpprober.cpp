@@ -0,0 +1,175 @@
+#include <check.h>
+#include <vector>
+#include <QtNetwork/QHostAddress>
+#include "../../src/IcmpProber.h"
+#include "../../src/SharedIcmpProber.h"
+
+// Echo requests to the loopback address are all answered.  ICMP datagram
+// sockets need the group of the test in net.ipv4.ping_group_range, so the
+// test is skipped where they are not allowed.
+START_TEST(test_icmpprober_loopback)
+{
+    printf("[IcmpProber] test_icmpprober_loopback: Testing echo requests to 127.0.0.1...\n");
+    IcmpProber prober(3, 10);
+    int target = prober.addTarget(QHostAddress::LocalHost);
+    if (target < 0) {
+        printf("[IcmpProber] ICMP datagram sockets not allowed, skipping\n");
+        return;
+    }
+    ck_assert(! prober.isFinished());
+
+    for (int i = 0; (i < 100) && (! prober.isFinished()); ++i) {
+        prober.poll(10);
+    }
+    ck_assert(prober.isFinished());
+    ck_assert(prober.hasReply());
+
+    IcmpProber::Result result = prober.result(target);
+    ck_assert_int_eq(result.sent, 3);
+    ck_assert_int_eq(result.received, 3);
+    ck_assert(result.averageRttUs >= 0);
+    ck_assert(result.averageRttUs < 1000000);
+    printf("[IcmpProber] RTT %lld us, timestamps %d\n",
+           static_cast<long long>(result.averageRttUs), result.timestamps);
+}
+END_TEST
+
+// Batched I/O gets the same replies with fewer system calls than sending
+// and receiving each packet on its own.
+static bool probeLoopbackRange(bool batching, quint64* syscalls)
+{
+    IcmpProber prober(2, 0);
+    prober.setBatching(batching);
+    for (quint32 i = 1; i <= 32; ++i) {
+        if (prober.addTarget(QHostAddress((127u << 24) | i)) < 0) {
+            return false;
+        }
+    }
+    for (int i = 0; (i < 200) && (! prober.isFinished()); ++i) {
+        prober.poll(10);
+    }
+    ck_assert(prober.isFinished());
+    for (int target = 0; target < 32; ++target) {
+        ck_assert_int_eq(prober.result(target).received, 2);
+    }
+    *syscalls = prober.syscallCount();
+    return true;
+}
+
+START_TEST(test_icmpprober_batching)
+{
+    printf("[IcmpProber] test_icmpprober_batching: Testing batched socket I/O...\n");
+    quint64 perPacket = 0;
+    quint64 batched = 0;
+    if (! probeLoopbackRange(false, &perPacket)) {
+        printf("[IcmpProber] ICMP datagram sockets not allowed, skipping\n");
+        return;
+    }
+    ck_assert(probeLoopbackRange(true, &batched));
+    printf("[IcmpProber] %llu system calls per-packet, %llu batched\n",
+           static_cast<unsigned long long>(perPacket),
+           static_cast<unsigned long long>(batched));
+    ck_assert(batched < perPacket);
+}
+END_TEST
+
+// A target added while another is probed gets its own schedule, and
+// a released target is finished.
+START_TEST(test_icmpprober_staggered_targets)
+{
+    printf("[IcmpProber] test_icmpprober_staggered_targets: Testing targets added mid-run...\n");
+    IcmpProber prober(2, 20);
+    int first = prober.addTarget(QHostAddress::LocalHost);
+    if (first < 0) {
+        printf("[IcmpProber] ICMP datagram sockets not allowed, skipping\n");
+        return;
+    }
+    for (int i = 0; (i < 100) && (prober.result(first).sent < 1); ++i) {
+        prober.poll(10);
+    }
+    int second = prober.addTarget(QHostAddress((127u << 24) | 2u));
+    ck_assert_int_ge(second, 0);
+    ck_assert(! prober.isFinished(second));
+
+    for (int i = 0; (i < 100) && (! prober.isFinished()); ++i) {
+        prober.poll(10);
+    }
+    ck_assert(prober.isFinished(first));
+    ck_assert(prober.isFinished(second));
+    ck_assert_int_eq(prober.result(first).received, 2);
+    ck_assert_int_eq(prober.result(second).received, 2);
+
+    int third = prober.addTarget(QHostAddress::LocalHost);
+    ck_assert(! prober.isFinished(third));
+    prober.releaseTarget(third);
+    ck_assert(prober.isFinished(third));
+    ck_assert(prober.isFinished());
+}
+END_TEST
+
+// Clients of a shared prober see the results of their own targets, and the
+// prober starts over once all targets are released.
+START_TEST(test_icmpprober_shared)
+{
+    printf("[IcmpProber] test_icmpprober_shared: Testing a shared prober...\n");
+    SharedIcmpProber prober(2, 10, 20);
+    std::vector<int> first;
+    std::vector<int> second;
+    first.push_back(prober.addTarget(QHostAddress::LocalHost));
+    if (first[0] < 0) {
+        printf("[IcmpProber] ICMP datagram sockets not allowed, skipping\n");
+        return;
+    }
+    second.push_back(prober.addTarget(QHostAddress((127u << 24) | 2u)));
+    second.push_back(prober.addTarget(QHostAddress((127u << 24) | 3u)));
+    ck_assert_int_eq(second[0], 1);
+
+    for (int i = 0; (i < 100) && (! prober.isFinished(first)); ++i) {
+        prober.poll(10);
+    }
+    ck_assert(prober.isFinished(first));
+    ck_assert_int_eq(prober.results(first)[0].received, 2);
+    prober.releaseTargets(first);
+
+    for (int i = 0; (i < 100) && (! prober.isFinished(second)); ++i) {
+        prober.poll(10);
+    }
+    std::vector<IcmpProber::Result> results = prober.results(second);
+    ck_assert_int_eq(results[0].received, 2);
+    ck_assert_int_eq(results[1].received, 2);
+    prober.releaseTargets(second);
+
+    // Nothing is active any more, so the indices start over.
+    std::vector<int> third;
+    third.push_back(prober.addTarget(QHostAddress::LocalHost));
+    ck_assert_int_eq(third[0], 0);
+    prober.releaseTargets(third);
+    ck_assert(prober.syscallCount() > 0);
+}
+END_TEST
+
+// Addresses without a protocol cannot be probed.
+START_TEST(test_icmpprober_invalid_target)
+{
+    printf("[IcmpProber] test_icmpprober_invalid_target: Testing invalid targets...\n");
+    IcmpProber prober(3, 10);
+    ck_assert_int_eq(prober.addTarget(QHostAddress()), -1);
+    ck_assert(prober.isFinished());
+    ck_assert(! prober.hasReply());
+}
+END_TEST
+
+Suite* icmpprober_suite(void)
+{
+    Suite* s = suite_create("IcmpProber");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_icmpprober_loopback);
+    tcase_add_test(tc, test_icmpprober_batching);
+    tcase_add_test(tc, test_icmpprober_staggered_targets);
+    tcase_add_test(tc, test_icmpprober_shared);
+    tcase_add_test(tc, test_icmpprober_invalid_target);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,212 @@
+#include <check.h>
+#include <cstring>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QJsonArray>
+#include <QtCore/QtEndian>
+#include "../../src/LanDiscovery.h"
+#include "../../src/PeerManager.h"
+
+// Public key used by the test beacons.
+static QByteArray testKey() {
+    QByteArray key;
+    for (int i = 0; i < LanDiscovery::PUBLIC_KEY_SIZE; ++i) {
+        key.append(static_cast<char>(i + 1));
+    }
+    return key;
+}
+
+// Append a big-endian 16-bit value.
+static void appendUint16(QByteArray& data, quint16 value) {
+    uchar bytes[2];
+    qToBigEndian(value, bytes);
+    data.append(reinterpret_cast<const char*>(bytes), 2);
+}
+
+// Bind a socket to the multicast port like another program would.
+static int holdPort(bool reusePort) {
+    int fd = ::socket(AF_INET6, SOCK_DGRAM, 0);
+    ck_assert_int_ge(fd, 0);
+    int on = 1;
+    if (reusePort) {
+        ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+    }
+    sockaddr_in6 address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin6_family = AF_INET6;
+    address.sin6_addr = in6addr_any;
+    address.sin6_port = htons(LanDiscovery::MULTICAST_PORT);
+    if (::bind(fd, reinterpret_cast<sockaddr*>(&address),
+               sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Beacons of 0.5 carry a version header, those of 0.4 the listen address.
+START_TEST(test_landiscovery_parse_beacon)
+{
+    printf("[LanDiscovery] test_landiscovery_parse_beacon: Testing beacons...\n");
+    QByteArray current;
+    appendUint16(current, 0);
+    appendUint16(current, 5);
+    current.append(testKey());
+    appendUint16(current, 40123);
+    appendUint16(current, 4);
+    current.append("hash");
+
+    LanDiscovery::Beacon beacon;
+    ck_assert(LanDiscovery::parseBeacon(current, &beacon));
+    ck_assert(beacon.publicKey == testKey());
+    ck_assert_int_eq(beacon.port, 40123);
+    ck_assert_int_eq(beacon.minorVersion, 5);
+
+    QByteArray legacy = testKey() + "[fe80::1%eth0]:12345";
+    ck_assert(LanDiscovery::parseBeacon(legacy, &beacon));
+    ck_assert(beacon.publicKey == testKey());
+    ck_assert_int_eq(beacon.port, 12345);
+    ck_assert_int_eq(beacon.minorVersion, 4);
+
+    // Cut short, or from an unknown version
+    ck_assert(! LanDiscovery::parseBeacon(current.left(39), &beacon));
+    ck_assert(! LanDiscovery::parseBeacon(current.left(current.size() - 1),
+                                          &beacon));
+    QByteArray future(current);
+    future[1] = 1;
+    ck_assert(! LanDiscovery::parseBeacon(future, &beacon));
+    ck_assert(! LanDiscovery::parseBeacon(testKey() + "garbage", &beacon));
+    ck_assert(! LanDiscovery::parseBeacon(QByteArray(), &beacon));
+}
+END_TEST
+
+// Neighbours become private peers that pin the interface and the key.
+START_TEST(test_landiscovery_peer_uri)
+{
+    printf("[LanDiscovery] test_landiscovery_peer_uri: Testing peer URIs...\n");
+    QHostAddress address("fe80::1:2");
+    address.setScopeId("eth0");
+    QString uri = LanDiscovery::peerUri(address, "eth0", 40123, testKey());
+    ck_assert_str_eq(qPrintable(uri),
+                     "tls://[fe80::1:2%25eth0]:40123?key="
+                     "0102030405060708090a0b0c0d0e0f10"
+                     "1112131415161718191a1b1c1d1e1f20");
+    ck_assert(isPeerUriValid(uri));
+    ck_assert_str_eq(qPrintable(pingHost(uri)), "fe80::1:2%eth0");
+    ck_assert_int_eq(peerPort(uri), 40123);
+}
+END_TEST
+
+// Without an interface to join the group on, nothing is heard.
+START_TEST(test_landiscovery_no_interface)
+{
+    printf("[LanDiscovery] test_landiscovery_no_interface: Testing start...\n");
+    LanDiscovery discovery;
+    ck_assert(! discovery.start({ "yggtray-missing0" }));
+    ck_assert(! discovery.isActive());
+    if (discovery.error() != LanDiscovery::PortInUse) {
+        ck_assert_int_eq(discovery.error(), LanDiscovery::NoInterface);
+    }
+    ck_assert(discovery.neighbours().isEmpty());
+    discovery.stop();
+    ck_assert(! discovery.isActive());
+}
+END_TEST
+
+// The port is shared with a daemon that sets SO_REUSEPORT only, and a
+// program that does not share it is reported.
+START_TEST(test_landiscovery_shared_port)
+{
+    printf("[LanDiscovery] test_landiscovery_shared_port: Testing a held port...\n");
+    int holder = holdPort(true);
+    if (holder < 0) {
+        printf("[LanDiscovery] Port %d in use, skipping\n",
+               LanDiscovery::MULTICAST_PORT);
+        return;
+    }
+    LanDiscovery discovery;
+    // Whether the group can be joined on lo depends on the system.
+    discovery.start({ "lo" });
+    ck_assert_int_ne(discovery.error(), LanDiscovery::PortInUse);
+    ck_assert_int_ne(discovery.error(), LanDiscovery::SocketError);
+    discovery.stop();
+    ::close(holder);
+
+    holder = holdPort(false);
+    if (holder < 0) {
+        printf("[LanDiscovery] Port %d shared by another program, skipping\n",
+               LanDiscovery::MULTICAST_PORT);
+        return;
+    }
+    ck_assert(! discovery.start({ "lo" }));
+    ck_assert_int_eq(discovery.error(), LanDiscovery::PortInUse);
+    ck_assert(! discovery.isActive());
+    ::close(holder);
+}
+END_TEST
+
+// The outbound link-local peers of the daemon are neighbours; inbound and
+// public peers are not.
+START_TEST(test_landiscovery_daemon_neighbours)
+{
+    printf("[LanDiscovery] test_landiscovery_daemon_neighbours: Testing the peers of the daemon...\n");
+    QString key = QString::fromLatin1(testKey().toHex());
+    QJsonArray peers;
+    peers.append(QJsonObject{{"remote", "tls://[fe80::1:2%25eth0]:40123"},
+                             {"up", true}, {"inbound", false},
+                             {"key", key}, {"latency", 1500000}});
+    peers.append(QJsonObject{{"remote", "tls://[fe80::3%eth1]:40124"},
+                             {"up", true}, {"key", key}});
+    peers.append(QJsonObject{{"remote", "tls://[fe80::4%25eth0]:51000"},
+                             {"up", true}, {"inbound", true},
+                             {"key", key}});
+    peers.append(QJsonObject{{"remote", "tls://192.0.2.1:1"},
+                             {"up", true}, {"key", key}});
+    peers.append(QJsonObject{{"remote", "tls://[fe80::5%25eth0]:1"},
+                             {"up", false}, {"key", key}});
+    QJsonObject response{{"status", "success"},
+                         {"response", QJsonObject{{"peers", peers}}}};
+
+    QList<LanDiscovery::Neighbour> found
+        = LanDiscovery::daemonNeighbours(response);
+    ck_assert_int_eq(found.size(), 2);
+    ck_assert(found[0].uri
+              == LanDiscovery::peerUri(QHostAddress("fe80::1:2"), "eth0",
+                                       40123, testKey()));
+    ck_assert_str_eq(qPrintable(found[0].interfaceName), "eth0");
+    ck_assert_int_eq(found[0].rttUs, 1500);
+    ck_assert_str_eq(qPrintable(found[1].interfaceName), "eth1");
+    ck_assert_int_eq(found[1].port, 40124);
+    ck_assert_int_eq(found[1].rttUs, -1);
+
+    // A watched daemon reports them without any beacon.
+    LanDiscovery discovery;
+    discovery.watchDaemon({ "/nonexistent/yggtray-test.sock" });
+    ck_assert(discovery.isWatchingDaemon());
+    emit discovery.daemonPeersRead(response);
+    QCoreApplication::processEvents();
+    ck_assert_int_eq(discovery.neighbours().size(), 2);
+    ck_assert(! discovery.isActive());
+
+    discovery.stop();
+    ck_assert(! discovery.isWatchingDaemon());
+    ck_assert(discovery.neighbours().isEmpty());
+}
+END_TEST
+
+Suite* landiscovery_suite(void)
+{
+    Suite* s = suite_create("LanDiscovery");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_landiscovery_parse_beacon);
+    tcase_add_test(tc, test_landiscovery_peer_uri);
+    tcase_add_test(tc, test_landiscovery_no_interface);
+    tcase_add_test(tc, test_landiscovery_shared_port);
+    tcase_add_test(tc, test_landiscovery_daemon_neighbours);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,68 @@
+#include <check.h>
+#include "../../src/LatencyHistory.h"
+
+START_TEST(test_latencyhistory_empty)
+{
+    LatencyHistory history;
+    int min = 0;
+    int max = 0;
+    ck_assert(history.isEmpty());
+    ck_assert_int_eq(history.size(), 0);
+    ck_assert_int_eq(history.last(), -1);
+    ck_assert(! history.range(min, max));
+}
+END_TEST
+
+// Samples are returned oldest first; failed samples are kept but ignored
+// by range().
+START_TEST(test_latencyhistory_order_and_range)
+{
+    LatencyHistory history;
+    history.add(30);
+    history.add(-1);
+    history.add(10);
+    history.add(20);
+
+    ck_assert_int_eq(history.size(), 4);
+    ck_assert_int_eq(history.at(0), 30);
+    ck_assert_int_eq(history.at(1), -1);
+    ck_assert_int_eq(history.at(2), 10);
+    ck_assert_int_eq(history.at(3), 20);
+    ck_assert_int_eq(history.last(), 20);
+
+    int min = 0;
+    int max = 0;
+    ck_assert(history.range(min, max));
+    ck_assert_int_eq(min, 10);
+    ck_assert_int_eq(max, 30);
+}
+END_TEST
+
+// When full, the oldest samples are overwritten.
+START_TEST(test_latencyhistory_wraps_around)
+{
+    LatencyHistory history;
+    const int total = LatencyHistory::CAPACITY + 5;
+    for (int i = 0; i < total; ++i) {
+        history.add(i);
+    }
+    ck_assert_int_eq(history.size(), LatencyHistory::CAPACITY);
+    ck_assert_int_eq(history.at(0), total - LatencyHistory::CAPACITY);
+    ck_assert_int_eq(history.last(), total - 1);
+}
+END_TEST
+
+Suite* latencyhistory_suite(void)
+{
+    Suite* s = suite_create("LatencyHistory");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_latencyhistory_empty);
+    tcase_add_test(tc, test_latencyhistory_order_and_range);
+    tcase_add_test(tc, test_latencyhistory_wraps_around);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+/* No main here: suite will be registered from the global test runner. */
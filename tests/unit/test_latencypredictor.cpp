@@ -0,0 +1,137 @@
+#include <check.h>
+#include "../../src/LatencyPredictor.h"
+#include "../../src/ProbeResultCache.h"
+
+static PeerData makeResult(const QString& host, int latency) {
+    PeerData peer(host);
+    peer.setValid(latency > 0);
+    peer.setLatency(latency);
+    return peer;
+}
+
+static QStringList neighbourhoods(const QString& host, quint32 asn = 0) {
+    PeerData peer(host);
+    peer.setAsn(asn);
+    return LatencyPredictor::neighbourhoods(peer);
+}
+
+// Addresses fall into their /24 or /48, host names into their domain, and
+// peers with a known origin into their AS.
+START_TEST(test_latencypredictor_neighbourhoods)
+{
+    printf("[LatencyPredictor] test_latencypredictor_neighbourhoods: Testing neighbourhoods...\n");
+    QStringList v4 = neighbourhoods("tcp://192.0.2.17:9001");
+    ck_assert_int_eq(v4.size(), 1);
+    ck_assert(v4 == neighbourhoods("tls://192.0.2.200:443"));
+    ck_assert(v4 != neighbourhoods("tcp://192.0.3.17:9001"));
+
+    QStringList v6 = neighbourhoods("tls://[2001:db8:1:2::1]:443");
+    ck_assert_int_eq(v6.size(), 1);
+    ck_assert(v6 == neighbourhoods("tcp://[2001:db8:1:ffff::9]:9001"));
+    ck_assert(v6 != neighbourhoods("tcp://[2001:db8:2::1]:9001"));
+
+    ck_assert(neighbourhoods("tls://a.Example.org:443")
+              == neighbourhoods("quic://b.example.org:443"));
+    ck_assert(neighbourhoods("tcp://localhost:1").isEmpty());
+
+    QStringList routed = neighbourhoods("tcp://192.0.2.17:9001", 64496);
+    ck_assert_int_eq(routed.size(), 2);
+    ck_assert(routed.first() == v4.first());
+    ck_assert(routed.last()
+              == neighbourhoods("tls://a.example.org:443", 64496).first());
+}
+END_TEST
+
+// The estimate is the median of the measured neighbours, not counting the
+// peer itself.
+START_TEST(test_latencypredictor_predict)
+{
+    printf("[LatencyPredictor] test_latencypredictor_predict: Testing estimates...\n");
+    LatencyPredictor predictor;
+    PeerData untested("tcp://192.0.2.99:1");
+    ck_assert(! predictor.predict(untested).isValid());
+
+    predictor.addResult(makeResult("tcp://192.0.2.1:1", 40));
+    predictor.addResult(makeResult("tcp://192.0.2.2:1", 45));
+    predictor.addResult(makeResult("tcp://192.0.2.3:1", 300));
+    predictor.addResult(makeResult("tcp://198.51.100.1:1", 5));
+
+    LatencyPredictor::Prediction prediction = predictor.predict(untested);
+    ck_assert(prediction.isValid());
+    ck_assert_int_eq(prediction.level, LatencyPredictor::Prefix);
+    ck_assert_int_eq(prediction.samples, 3);
+    ck_assert_int_eq(prediction.latency, 45);
+
+    // A measured peer is estimated from the others only.
+    prediction = predictor.predict(PeerData("tcp://192.0.2.3:1"));
+    ck_assert_int_eq(prediction.samples, 2);
+
+    // A newer result of the same peer replaces the older one.
+    predictor.addResult(makeResult("tcp://192.0.2.3:1", 50));
+    ck_assert_int_eq(predictor.predict(untested).samples, 3);
+    ck_assert_int_eq(predictor.predict(untested).latency, 45);
+
+    predictor.addResult(makeResult("tls://a.example.org:443", 80));
+    prediction = predictor.predict(PeerData("tls://b.example.org:443"));
+    ck_assert_int_eq(prediction.level, LatencyPredictor::Domain);
+    ck_assert_int_eq(prediction.latency, 80);
+
+    // Peers in another prefix of the same AS
+    PeerData routed("tcp://203.0.113.1:1");
+    routed.setAsn(64496);
+    ck_assert(! predictor.predict(routed).isValid());
+    PeerData routedResult = makeResult("tcp://a.example.net:1", 120);
+    routedResult.setAsn(64496);
+    predictor.addResult(routedResult);
+    prediction = predictor.predict(routed);
+    ck_assert_int_eq(prediction.level, LatencyPredictor::Asn);
+    ck_assert_int_eq(prediction.latency, 120);
+
+    predictor.clear();
+    ck_assert(! predictor.predict(untested).isValid());
+}
+END_TEST
+
+// A neighbourhood where most peers failed is estimated unreachable, and the
+// estimates rank between measured and unknown peers.
+START_TEST(test_latencypredictor_priority)
+{
+    printf("[LatencyPredictor] test_latencypredictor_priority: Testing probe priorities...\n");
+    LatencyPredictor predictor;
+    predictor.addResult(makeResult("tcp://192.0.2.1:1", -1));
+    predictor.addResult(makeResult("tcp://192.0.2.2:1", -1));
+    predictor.addResult(makeResult("tcp://192.0.2.3:1", 30));
+    predictor.addResult(makeResult("tcp://198.51.100.1:1", 30));
+
+    LatencyPredictor::Prediction failing
+        = predictor.predict(PeerData("tcp://192.0.2.9:1"));
+    ck_assert(failing.isValid());
+    ck_assert_int_eq(failing.latency, -1);
+    LatencyPredictor::Prediction fast
+        = predictor.predict(PeerData("tcp://198.51.100.9:1"));
+    ck_assert_int_eq(fast.latency, 30);
+
+    ProbeResultCache cache;
+    PeerData measured = makeResult("tcp://203.0.113.1:1", 30);
+    cache.record(measured, 0);
+    double fastPriority = LatencyPredictor::priority(fast);
+    ck_assert(fastPriority > ProbeResultCache::UNKNOWN_PRIORITY);
+    ck_assert(fastPriority < cache.priority(measured, 0));
+    double failingPriority = LatencyPredictor::priority(failing);
+    ck_assert(failingPriority < ProbeResultCache::UNKNOWN_PRIORITY);
+    ck_assert(failingPriority > ProbeResultCache::FAILED_PRIORITY);
+}
+END_TEST
+
+Suite* latencypredictor_suite(void)
+{
+    Suite* s = suite_create("LatencyPredictor");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_latencypredictor_neighbourhoods);
+    tcase_add_test(tc, test_latencypredictor_predict);
+    tcase_add_test(tc, test_latencypredictor_priority);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -5,6 +5,24 @@
 // Forward declarations from other test files
 extern Suite* servicemanager_suite(void);
 extern Suite* peermanager_suite(void);
+extern Suite* uiupdatecoalescer_suite(void);
+extern Suite* applyconfigjob_suite(void);
+extern Suite* socketmanager_suite(void);
+extern Suite* latencyhistory_suite(void);
+extern Suite* socks5prober_suite(void);
+extern Suite* probescheduler_suite(void);
+extern Suite* probetimeouts_suite(void);
+extern Suite* icmpprober_suite(void);
+extern Suite* overlaylatencytest_suite(void);
+extern Suite* peerexperiment_suite(void);
+extern Suite* taskgraph_suite(void);
+extern Suite* executor_suite(void);
+extern Suite* powerpolicy_suite(void);
+extern Suite* networkmonitor_suite(void);
+extern Suite* latencypredictor_suite(void);
+extern Suite* asndatabase_suite(void);
+extern Suite* landiscovery_suite(void);
+extern Suite* peerprofiles_suite(void);
 
 int main(int argc, char* argv[])
 {
@@ -12,6 +30,24 @@ int main(int argc, char* argv[])
     int number_failed = 0;
     SRunner* sr = srunner_create(servicemanager_suite());
     srunner_add_suite(sr, peermanager_suite());
+    srunner_add_suite(sr, uiupdatecoalescer_suite());
+    srunner_add_suite(sr, applyconfigjob_suite());
+    srunner_add_suite(sr, socketmanager_suite());
+    srunner_add_suite(sr, latencyhistory_suite());
+    srunner_add_suite(sr, socks5prober_suite());
+    srunner_add_suite(sr, probescheduler_suite());
+    srunner_add_suite(sr, probetimeouts_suite());
+    srunner_add_suite(sr, icmpprober_suite());
+    srunner_add_suite(sr, overlaylatencytest_suite());
+    srunner_add_suite(sr, peerexperiment_suite());
+    srunner_add_suite(sr, taskgraph_suite());
+    srunner_add_suite(sr, executor_suite());
+    srunner_add_suite(sr, powerpolicy_suite());
+    srunner_add_suite(sr, networkmonitor_suite());
+    srunner_add_suite(sr, latencypredictor_suite());
+    srunner_add_suite(sr, asndatabase_suite());
+    srunner_add_suite(sr, landiscovery_suite());
+    srunner_add_suite(sr, peerprofiles_suite());
 
     srunner_run_all(sr, CK_VERBOSE);
     number_failed = srunner_ntests_failed(sr);
@@ -0,0 +1,120 @@
+#include <check.h>
+#include "../../src/NetworkMonitor.h"
+
+static NetworkMonitor::Route makeRoute(const QString& interfaceName,
+                                       const QString& gateway) {
+    NetworkMonitor::Route route;
+    route.interfaceName = interfaceName;
+    route.gateway = QHostAddress(gateway);
+    return route;
+}
+
+static NetworkMonitor::Address makeAddress(const QString& interfaceName,
+                                           const QString& address,
+                                           int prefixLength,
+                                           bool isGlobal = true) {
+    NetworkMonitor::Address result;
+    result.interfaceName = interfaceName;
+    result.address = QHostAddress(address);
+    result.prefixLength = prefixLength;
+    result.isGlobal = isGlobal;
+    return result;
+}
+
+// The fingerprint depends on the uplinks, the gateways and the prefixes,
+// not on the order or on the host part of the addresses.
+START_TEST(test_networkmonitor_fingerprint)
+{
+    printf("[NetworkMonitor] test_networkmonitor_fingerprint: Testing fingerprints...\n");
+    QList<NetworkMonitor::Route> routes;
+    routes << makeRoute("wlan0", "192.168.1.1")
+           << makeRoute("wlan0", "fe80::1");
+    QList<NetworkMonitor::Address> addresses;
+    addresses << makeAddress("wlan0", "192.168.1.23", 24)
+              << makeAddress("wlan0", "2001:db8:1:2::aaaa", 64)
+              << makeAddress("lo", "127.0.0.1", 8, false)
+              << makeAddress("docker0", "172.17.0.1", 16);
+    QString home = NetworkMonitor::computeFingerprint(routes, addresses);
+    ck_assert_int_eq(home.size(), 16);
+    ck_assert_str_ne(qPrintable(home), NetworkMonitor::OFFLINE);
+
+    // Another order, a new privacy address, and a change on an interface
+    // that is not an uplink.
+    QList<NetworkMonitor::Route> reordered;
+    reordered << routes[1] << routes[0];
+    QList<NetworkMonitor::Address> renewed;
+    renewed << makeAddress("wlan0", "2001:db8:1:2::bbbb", 64)
+            << makeAddress("wlan0", "192.168.1.42", 24)
+            << makeAddress("docker0", "172.18.0.1", 16);
+    ck_assert_str_eq(
+        qPrintable(NetworkMonitor::computeFingerprint(reordered, renewed)),
+        qPrintable(home));
+
+    // The same private gateway on another network with a different prefix
+    QList<NetworkMonitor::Address> elsewhere;
+    elsewhere << makeAddress("wlan0", "192.168.1.23", 24)
+              << makeAddress("wlan0", "2001:db8:9:9::aaaa", 64);
+    ck_assert_str_ne(
+        qPrintable(NetworkMonitor::computeFingerprint(routes, elsewhere)),
+        qPrintable(home));
+
+    // Another gateway
+    QList<NetworkMonitor::Route> otherGateway;
+    otherGateway << makeRoute("wlan0", "192.168.1.254")
+                 << makeRoute("wlan0", "fe80::1");
+    ck_assert_str_ne(
+        qPrintable(NetworkMonitor::computeFingerprint(otherGateway,
+                                                      addresses)),
+        qPrintable(home));
+
+    // Another uplink
+    QList<NetworkMonitor::Route> wired;
+    wired << makeRoute("eth0", "192.168.1.1");
+    ck_assert_str_ne(
+        qPrintable(NetworkMonitor::computeFingerprint(wired, addresses)),
+        qPrintable(home));
+
+    // No default route
+    ck_assert_str_eq(
+        qPrintable(NetworkMonitor::computeFingerprint(
+            QList<NetworkMonitor::Route>(), addresses)),
+        NetworkMonitor::OFFLINE);
+}
+END_TEST
+
+// The kernel state can be read, and the monitor reports it.
+START_TEST(test_networkmonitor_current)
+{
+    printf("[NetworkMonitor] test_networkmonitor_current: Testing the current network...\n");
+#ifdef Q_OS_LINUX
+    QList<NetworkMonitor::Route> routes;
+    QList<NetworkMonitor::Address> addresses;
+    ck_assert(NetworkMonitor::readNetworkState(&routes, &addresses));
+    for (const NetworkMonitor::Route& route : routes) {
+        ck_assert(! route.interfaceName.isEmpty());
+    }
+
+    NetworkMonitor monitor;
+    ck_assert(monitor.start());
+    ck_assert(monitor.isActive());
+    ck_assert_str_eq(qPrintable(monitor.fingerprint()),
+                     qPrintable(NetworkMonitor::currentFingerprint()));
+    monitor.stop();
+    ck_assert(! monitor.isActive());
+#else
+    printf("[NetworkMonitor] Netlink is not available, skipping\n");
+#endif
+}
+END_TEST
+
+Suite* networkmonitor_suite(void)
+{
+    Suite* s = suite_create("NetworkMonitor");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_networkmonitor_fingerprint);
+    tcase_add_test(tc, test_networkmonitor_current);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
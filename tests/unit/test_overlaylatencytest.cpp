@@ -0,0 +1,144 @@
+#include <check.h>
+#include <memory>
+#include <QtCore/QSettings>
+#include <QtCore/QTemporaryDir>
+#include <QtNetwork/QHostAddress>
+#include "../../src/OverlayLatencyTest.h"
+
+// Only addresses in 200::/7 are Yggdrasil addresses.
+START_TEST(test_overlaylatencytest_overlay_address)
+{
+    printf("[OverlayLatencyTest] test_overlaylatencytest_overlay_address: Testing 200::/7 detection...\n");
+    ck_assert(OverlayLatencyTest::isOverlayAddress(QHostAddress("200::1")));
+    ck_assert(OverlayLatencyTest::isOverlayAddress(
+        QHostAddress("300:1234::1")));
+    ck_assert(! OverlayLatencyTest::isOverlayAddress(QHostAddress("::1")));
+    ck_assert(! OverlayLatencyTest::isOverlayAddress(
+        QHostAddress("2001:db8::1")));
+    ck_assert(! OverlayLatencyTest::isOverlayAddress(
+        QHostAddress("127.0.0.1")));
+}
+END_TEST
+
+// Targets other than Yggdrasil addresses are dropped, duplicates merged.
+START_TEST(test_overlaylatencytest_targets)
+{
+    printf("[OverlayLatencyTest] test_overlaylatencytest_targets: Testing the target list...\n");
+    QTemporaryDir tempDir;
+    ck_assert(tempDir.isValid());
+    auto settings = std::make_shared<QSettings>(
+        tempDir.filePath("yggtray.ini"),
+        QSettings::IniFormat
+    );
+
+    OverlayLatencyTest test(settings);
+    QStringList kept = test.setTargets(
+        QStringList() << " 200::1 " << "2001:db8::1" << "junk"
+                      << "0200:0::1" << "" << "301::2");
+    ck_assert_int_eq(kept.size(), 2);
+    ck_assert_str_eq(qPrintable(kept[0]), "200::1");
+    ck_assert_str_eq(qPrintable(kept[1]), "301::2");
+    ck_assert(test.targets() == kept);
+}
+END_TEST
+
+// Runs survive a round trip through the settings format.
+START_TEST(test_overlaylatencytest_save_load)
+{
+    printf("[OverlayLatencyTest] test_overlaylatencytest_save_load: Testing run serialization...\n");
+    OverlayLatencyTest::Run run;
+    run.timestampMs = 1700000000000LL;
+    run.peers << "tls://a.example:1" << "tls://b.example:2";
+    OverlayLatencyTest::TargetResult result;
+    result.address = "200::1";
+    result.sent = 5;
+    result.received = 4;
+    result.averageRttUs = 42500;
+    run.results << result;
+    result.address = "200::2";
+    result.received = 0;
+    result.averageRttUs = -1;
+    run.results << result;
+
+    QList<OverlayLatencyTest::Run> runs;
+    ck_assert(OverlayLatencyTest::loadRuns(
+        OverlayLatencyTest::saveRuns(QList<OverlayLatencyTest::Run>() << run),
+        runs));
+    ck_assert_int_eq(runs.size(), 1);
+    ck_assert(runs[0].timestampMs == run.timestampMs);
+    ck_assert(runs[0].peers == run.peers);
+    ck_assert_int_eq(runs[0].results.size(), 2);
+    ck_assert_int_eq(runs[0].results[0].received, 4);
+    ck_assert_int_eq(runs[0].results[0].lossPercent(), 20);
+    ck_assert_int_eq(runs[0].results[1].lossPercent(), 100);
+    ck_assert(runs[0].averageRttUs() == 42500);
+
+    QByteArray truncated = OverlayLatencyTest::saveRuns(runs);
+    truncated.chop(4);
+    ck_assert(! OverlayLatencyTest::loadRuns(truncated, runs));
+    ck_assert(runs.isEmpty());
+}
+END_TEST
+
+// The loopback address stands in for a Yggdrasil address.  ICMP datagram
+// sockets need the group of the test in net.ipv4.ping_group_range, and the
+// ping command takes over elsewhere; the test is skipped where neither is
+// allowed.
+START_TEST(test_overlaylatencytest_measure_loopback)
+{
+    printf("[OverlayLatencyTest] test_overlaylatencytest_measure_loopback: Testing a run against ::1...\n");
+    QList<OverlayLatencyTest::TargetResult> results;
+    if (! OverlayLatencyTest::measure(QList<QHostAddress>()
+                                          << QHostAddress::LocalHostIPv6,
+                                      3, 10, results)) {
+        printf("[OverlayLatencyTest] Neither ICMP datagram sockets nor ping allowed, skipping\n");
+        return;
+    }
+    ck_assert_int_eq(results.size(), 1);
+    ck_assert_str_eq(qPrintable(results[0].address), "::1");
+    ck_assert_int_eq(results[0].sent, 3);
+    ck_assert_int_eq(results[0].received, 3);
+    ck_assert_int_eq(results[0].lossPercent(), 0);
+    ck_assert(results[0].averageRttUs >= 0);
+}
+END_TEST
+
+// The description compares the run with an earlier one.
+START_TEST(test_overlaylatencytest_describe)
+{
+    printf("[OverlayLatencyTest] test_overlaylatencytest_describe: Testing the run description...\n");
+    OverlayLatencyTest::TargetResult result;
+    result.address = "200::1";
+    result.sent = 5;
+    result.received = 5;
+    result.averageRttUs = 20000;
+
+    OverlayLatencyTest::Run previous;
+    previous.peers << "tls://a.example:1";
+    previous.results << result;
+
+    OverlayLatencyTest::Run run;
+    run.peers << "tls://b.example:1";
+    result.averageRttUs = 10000;
+    run.results << result;
+
+    QString text = OverlayLatencyTest::describe(run, &previous);
+    ck_assert(text.contains("200::1: 10.0 ms, 0% loss"));
+    ck_assert(text.contains("20.0 ms (different peers)"));
+}
+END_TEST
+
+Suite* overlaylatencytest_suite(void)
+{
+    Suite* s = suite_create("OverlayLatencyTest");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_overlaylatencytest_overlay_address);
+    tcase_add_test(tc, test_overlaylatencytest_targets);
+    tcase_add_test(tc, test_overlaylatencytest_save_load);
+    tcase_add_test(tc, test_overlaylatencytest_measure_loopback);
+    tcase_add_test(tc, test_overlaylatencytest_describe);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
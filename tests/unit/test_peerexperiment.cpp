@@ -0,0 +1,223 @@
+#include <check.h>
+#include <QtCore/QJsonArray>
+#include <QtCore/QJsonObject>
+#include <QtCore/QStringList>
+#include "../../src/PeerExperiment.h"
+
+// A daemon that keeps its peers in a list and answers the admin requests
+// the experiment sends.  Inbound peers connected to the daemon themselves
+// and cannot be removed.
+struct FakeDaemon {
+    QStringList peers;
+    QStringList inboundPeers;
+    // URI of a peer that cannot be added
+    QString brokenPeer;
+    int requests = 0;
+
+    QJsonObject handle(const QJsonObject& request) {
+        ++requests;
+        QString name = request["request"].toString();
+        QString uri = request["arguments"].toObject()["uri"].toString();
+        if (name == "getpeers") {
+            QJsonArray list;
+            for (const QString& peer : peers) {
+                list.append(QJsonObject{{"remote", peer}, {"up", true}});
+            }
+            for (const QString& peer : inboundPeers) {
+                list.append(QJsonObject{{"remote", peer}, {"up", true},
+                                        {"inbound", true}});
+            }
+            return {{"status", "success"},
+                    {"response", QJsonObject{{"peers", list}}}};
+        }
+        if ((name == "addpeer") && (uri != brokenPeer)) {
+            peers << uri;
+            return {{"status", "success"}};
+        }
+        if ((name == "removepeer") && peers.removeOne(uri)) {
+            return {{"status", "success"}};
+        }
+        return {{"status", "error"}, {"error", "failed"}};
+    }
+};
+
+// Measures 10 ms through tls://fast and 50 ms otherwise.
+static bool measureDaemon(const FakeDaemon& daemon,
+                          QList<OverlayLatencyTest::TargetResult>& results) {
+    OverlayLatencyTest::TargetResult result;
+    result.address = "200::1";
+    result.sent = 10;
+    result.received = 10;
+    result.averageRttUs = daemon.peers.contains("tls://fast:1")
+        ? 10000 : 50000;
+    results.clear();
+    results << result;
+    return true;
+}
+
+static PeerExperiment makeExperiment(FakeDaemon& daemon) {
+    return PeerExperiment(
+        [&daemon](const QJsonObject& request) {
+            return daemon.handle(request);
+        },
+        [&daemon](QList<OverlayLatencyTest::TargetResult>& results) {
+            return measureDaemon(daemon, results);
+        },
+        [](int) {});
+}
+
+START_TEST(test_peerexperiment_decide)
+{
+    printf("[PeerExperiment] test_peerexperiment_decide: Testing the commit threshold...\n");
+    PeerExperiment::Sample baseline;
+    baseline.sent = 100;
+    baseline.received = 100;
+    baseline.averageRttUs = 100000;
+
+    PeerExperiment::Sample candidate = baseline;
+    candidate.averageRttUs = 89000;
+    ck_assert_int_eq(PeerExperiment::decide(baseline, candidate, 10),
+                     PeerExperiment::Committed);
+    candidate.averageRttUs = 95000;
+    ck_assert_int_eq(PeerExperiment::decide(baseline, candidate, 10),
+                     PeerExperiment::RolledBack);
+
+    // Faster, but losing more requests
+    candidate.averageRttUs = 50000;
+    candidate.received = 90;
+    ck_assert_int_eq(PeerExperiment::decide(baseline, candidate, 10),
+                     PeerExperiment::RolledBack);
+
+    // Anything that replies beats an overlay that does not
+    candidate.received = 10;
+    baseline.received = 0;
+    baseline.averageRttUs = -1;
+    ck_assert_int_eq(PeerExperiment::decide(baseline, candidate, 10),
+                     PeerExperiment::Committed);
+    candidate.received = 0;
+    ck_assert_int_eq(PeerExperiment::decide(baseline, candidate, 10),
+                     PeerExperiment::RolledBack);
+}
+END_TEST
+
+START_TEST(test_peerexperiment_aggregate)
+{
+    printf("[PeerExperiment] test_peerexperiment_aggregate: Testing the combined sample...\n");
+    QList<OverlayLatencyTest::TargetResult> results;
+    OverlayLatencyTest::TargetResult result;
+    result.sent = 4;
+    result.received = 3;
+    result.averageRttUs = 10000;
+    results << result;
+    result.received = 1;
+    result.averageRttUs = 50000;
+    results << result;
+    result.received = 0;
+    result.averageRttUs = -1;
+    results << result;
+
+    PeerExperiment::Sample sample = PeerExperiment::aggregate(results);
+    ck_assert_int_eq(sample.sent, 12);
+    ck_assert_int_eq(sample.received, 4);
+    ck_assert_int_eq(sample.averageRttUs, 20000);
+    ck_assert_int_eq(sample.lossPercent(), 66);
+}
+END_TEST
+
+// A faster candidate stays applied.
+START_TEST(test_peerexperiment_commit)
+{
+    printf("[PeerExperiment] test_peerexperiment_commit: Testing a better candidate...\n");
+    FakeDaemon daemon;
+    daemon.peers << "tls://slow:1" << "tls://other:1";
+    PeerExperiment experiment = makeExperiment(daemon);
+
+    PeerExperiment::Outcome outcome = experiment.run(
+        QStringList() << "tls://fast:1" << "tls://other:1");
+    ck_assert_int_eq(outcome.decision, PeerExperiment::Committed);
+    ck_assert_int_eq(outcome.baseline.averageRttUs, 50000);
+    ck_assert_int_eq(outcome.candidate.averageRttUs, 10000);
+    ck_assert(outcome.baselinePeers
+              == (QStringList() << "tls://other:1" << "tls://slow:1"));
+    daemon.peers.sort();
+    ck_assert(daemon.peers
+              == (QStringList() << "tls://fast:1" << "tls://other:1"));
+}
+END_TEST
+
+// A candidate that is not better is rolled back.
+START_TEST(test_peerexperiment_rollback)
+{
+    printf("[PeerExperiment] test_peerexperiment_rollback: Testing a worse candidate...\n");
+    FakeDaemon daemon;
+    daemon.peers << "tls://fast:1";
+    PeerExperiment experiment = makeExperiment(daemon);
+
+    PeerExperiment::Outcome outcome = experiment.run(
+        QStringList() << "tls://slow:1");
+    ck_assert_int_eq(outcome.decision, PeerExperiment::RolledBack);
+    ck_assert(daemon.peers == QStringList() << "tls://fast:1");
+}
+END_TEST
+
+// Inbound peers are left alone, and a candidate the daemon reports under
+// its host name is neither added again nor removed.
+START_TEST(test_peerexperiment_peer_uris)
+{
+    printf("[PeerExperiment] test_peerexperiment_peer_uris: Testing inbound and rewritten peers...\n");
+    FakeDaemon daemon;
+    daemon.peers << "tls://slow:1" << "tls://other:1";
+    daemon.inboundPeers << "tcp://incoming:1";
+    PeerExperiment experiment = makeExperiment(daemon);
+
+    PeerExperiment::Outcome outcome = experiment.run(
+        QStringList() << "tls://fast:1" << "tls://10.0.0.2:1?sni=other");
+    ck_assert_int_eq(outcome.decision, PeerExperiment::Committed);
+    ck_assert(outcome.baselinePeers
+              == (QStringList() << "tls://other:1" << "tls://slow:1"));
+    daemon.peers.sort();
+    ck_assert(daemon.peers
+              == (QStringList() << "tls://fast:1" << "tls://other:1"));
+    ck_assert(daemon.inboundPeers == QStringList() << "tcp://incoming:1");
+}
+END_TEST
+
+// A failing admin request restores the peers changed so far.
+START_TEST(test_peerexperiment_admin_failure)
+{
+    printf("[PeerExperiment] test_peerexperiment_admin_failure: Testing a failed addpeer...\n");
+    FakeDaemon daemon;
+    daemon.peers << "tls://slow:1";
+    daemon.brokenPeer = "tls://zbroken:1";
+    PeerExperiment experiment = makeExperiment(daemon);
+
+    PeerExperiment::Outcome outcome = experiment.run(
+        QStringList() << "tls://fast:1" << "tls://zbroken:1");
+    ck_assert_int_eq(outcome.decision, PeerExperiment::Failed);
+    ck_assert(daemon.peers == QStringList() << "tls://slow:1");
+
+    // Without the admin socket, nothing is changed at all.
+    PeerExperiment offline(
+        [](const QJsonObject&) { return QJsonObject(); },
+        [](QList<OverlayLatencyTest::TargetResult>&) { return true; },
+        [](int) {});
+    outcome = offline.run(QStringList() << "tls://fast:1");
+    ck_assert_int_eq(outcome.decision, PeerExperiment::Failed);
+}
+END_TEST
+
+Suite* peerexperiment_suite(void)
+{
+    Suite* s = suite_create("PeerExperiment");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_peerexperiment_decide);
+    tcase_add_test(tc, test_peerexperiment_aggregate);
+    tcase_add_test(tc, test_peerexperiment_commit);
+    tcase_add_test(tc, test_peerexperiment_rollback);
+    tcase_add_test(tc, test_peerexperiment_peer_uris);
+    tcase_add_test(tc, test_peerexperiment_admin_failure);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
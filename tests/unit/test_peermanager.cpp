@@ -5,6 +5,7 @@
 #include <QtCore/QSettings>
 #include <QtCore/QTemporaryDir>
 #include <QtCore/QTemporaryFile>
+#include <QtNetwork/QTcpServer>
 #include <QtTest/QSignalSpy>
 #include <QtTest/QtTest>
 #include "../../src/PeerManager.h"
@@ -17,9 +18,9 @@ START_TEST(test_formatPeer) {
     ck_assert(tmpFile.open());
     QTextStream stream(&tmpFile);
     PeerData peer;
-    peer.host = HOST;
-    peer.latency = 10;
-    peer.isValid = true;
+    peer.setHost(HOST);
+    peer.setLatency(10);
+    peer.setValid(true);
     formatPeer(stream, peer);
     stream.flush();
     tmpFile.seek(0);
@@ -41,13 +42,13 @@ START_TEST(test_writePeers) {
     ck_assert(tmpFile.open());
     QTextStream stream(&tmpFile);
     PeerData peer1;
-    peer1.host = HOSTS[0];
-    peer1.latency = 10;
-    peer1.isValid = true;
+    peer1.setHost(HOSTS[0]);
+    peer1.setLatency(10);
+    peer1.setValid(true);
     PeerData peer2;
-    peer2.host = HOSTS[1];
-    peer2.latency = 12;
-    peer2.isValid = true;
+    peer2.setHost(HOSTS[1]);
+    peer2.setLatency(12);
+    peer2.setValid(true);
     QList<PeerData> peers = { peer1, peer2 };
     writePeers(stream, peers);
     stream.flush();
@@ -65,6 +66,8 @@ START_TEST(test_isPeerUriValid_basic) {
     ck_assert(isPeerUriValid("tls://example.com:1000"));
     ck_assert(isPeerUriValid("tcp://192.168.1.1:1234"));
     ck_assert(isPeerUriValid("quic://[2001:db8::1]:1234"));
+    ck_assert(isPeerUriValid("tls://192.0.2.1:1000?sni=example.com"));
+    ck_assert(!isPeerUriValid("tls://192.0.2.1:1000?key=abc"));
     ck_assert(!isPeerUriValid("tls://example.com"));
     ck_assert(!isPeerUriValid("tcp://example.com"));
     ck_assert(!isPeerUriValid(""));
@@ -102,13 +105,13 @@ START_TEST(test_exportPeersToCsv_basic)
     PeerManager mgr(nullptr, false, nullptr);
     QList<PeerData> peers;
     PeerData p1;
-    p1.host = "peer1";
-    p1.latency = 10;
-    p1.isValid = true;
+    p1.setHost("peer1");
+    p1.setLatency(10);
+    p1.setValid(true);
     PeerData p2;
-    p2.host = "peer2";
-    p2.latency = -1;
-    p2.isValid = false;
+    p2.setHost("peer2");
+    p2.setLatency(-1);
+    p2.setValid(false);
     peers << p1 << p2;
 
     QTemporaryFile tmpFile;
@@ -185,8 +188,8 @@ START_TEST(test_peersDiscovered_signal)
     QList<PeerData> peers =
         qvariant_cast<QList<PeerData>>(args.at(0));
     ck_assert_int_eq(peers.size(), 2);
-    ck_assert(peers[0].host.contains("tls://[2001:db8::1]:1234"));
-    ck_assert(peers[1].host.contains("tcp://192.168.1.1:1234"));
+    ck_assert(peers[0].host().contains("tls://[2001:db8::1]:1234"));
+    ck_assert(peers[1].host().contains("tcp://192.168.1.1:1234"));
 
     reply->deleteLater();
 }
@@ -230,11 +233,11 @@ START_TEST(test_peersDiscovered_filters_invalid_private_peers)
     QList<PeerData> peers =
         qvariant_cast<QList<PeerData>>(args.at(0));
     ck_assert_int_eq(peers.size(), 2);
-    ck_assert(peers[0].isPrivate);
-    ck_assert_str_eq(peers[0].host.toUtf8().constData(),
+    ck_assert(peers[0].isPrivate());
+    ck_assert_str_eq(peers[0].host().toUtf8().constData(),
                      "quic://spain.magicum.net:36900");
-    ck_assert(!peers[1].isPrivate);
-    ck_assert_str_eq(peers[1].host.toUtf8().constData(),
+    ck_assert(!peers[1].isPrivate());
+    ck_assert_str_eq(peers[1].host().toUtf8().constData(),
                      "tls://public.example:1234");
 
     reply->deleteLater();
@@ -281,9 +284,9 @@ START_TEST(test_cancelTests_cancels_all)
     QList<PeerData> peers;
     for (int i = 0; i < 10; ++i) {
         PeerData p;
-        p.host = QString("peer%1").arg(i);
-        p.latency = -1;
-        p.isValid = false;
+        p.setHost(QString("peer%1").arg(i));
+        p.setLatency(-1);
+        p.setValid(false);
         peers << p;
     }
 
@@ -362,6 +365,440 @@ START_TEST(test_error_signal_peerlist_unreachable)
 }
 END_TEST
 
+static PeerData makePeer(const QString& host,
+                         int latency,
+                         bool isValid,
+                         bool isPrivate = false) {
+    PeerData p;
+    p.setHost(host);
+    p.setLatency(latency);
+    p.setValid(isValid);
+    p.setPrivate(isPrivate);
+    return p;
+}
+
+// Private peers are pinned first, then the fastest valid public peers; the
+// result never exceeds the requested number of peers.
+START_TEST(test_selectConfigPeers_topK)
+{
+    printf("[PeerManager] test_selectConfigPeers_topK: Testing top-K peer selection...\n");
+    QList<PeerData> peers;
+    for (int i = 0; i < 100; ++i) {
+        // Latencies 100, 99, ... 1 so the best peers are at the end.
+        peers << makePeer(QString("tls://public%1.example:1000").arg(i),
+                          100 - i, true);
+    }
+    peers << makePeer("tls://invalid.example:1000", -1, false);
+    peers << makePeer("tls://bad-uri.example", 1, true);
+    peers << makePeer("tls://private.example:1000", 500, true, true);
+
+    QList<PeerData> selected = PeerManager::selectConfigPeers(peers, 5);
+    ck_assert_int_eq(selected.size(), 5);
+    ck_assert_str_eq(selected[0].host().toUtf8().constData(),
+                     "tls://private.example:1000");
+    ck_assert_int_eq(selected[1].latency(), 1);
+    ck_assert_int_eq(selected[2].latency(), 2);
+    ck_assert_int_eq(selected[3].latency(), 3);
+    ck_assert_int_eq(selected[4].latency(), 4);
+}
+END_TEST
+
+// Peers with the same whole-millisecond latency are ranked by their
+// microsecond latency where it was measured.
+START_TEST(test_selectConfigPeers_precise_latency)
+{
+    printf("[PeerManager] test_selectConfigPeers_precise_latency: Testing sub-millisecond ranking...\n");
+    QList<PeerData> peers;
+    peers << makePeer("tls://slower.example:1000", 5, true);
+    peers << makePeer("tls://faster.example:1000", 5, true);
+    peers << makePeer("tls://plain.example:1000", 5, true);
+    peers[0].setPreciseLatencyUs(5400);
+    peers[1].setPreciseLatencyUs(4600);
+    ck_assert_int_eq(peers[2].preciseLatencyUs(), 5000);
+
+    QList<PeerData> selected = PeerManager::selectConfigPeers(peers);
+    ck_assert_int_eq(selected.size(), 3);
+    ck_assert_str_eq(selected[0].host().toUtf8().constData(),
+                     "tls://faster.example:1000");
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "tls://plain.example:1000");
+    ck_assert_str_eq(selected[2].host().toUtf8().constData(),
+                     "tls://slower.example:1000");
+}
+END_TEST
+
+// Without any valid peer, URI-valid peers are used in their original order.
+START_TEST(test_selectConfigPeers_fallback)
+{
+    printf("[PeerManager] test_selectConfigPeers_fallback: Testing fallback selection...\n");
+    QList<PeerData> peers;
+    peers << makePeer("tls://a.example:1000", -1, false);
+    peers << makePeer("bad-uri", -1, false);
+    peers << makePeer("tls://b.example:1000", -1, false);
+
+    QList<PeerData> selected = PeerManager::selectConfigPeers(peers);
+    ck_assert_int_eq(selected.size(), 2);
+    ck_assert_str_eq(selected[0].host().toUtf8().constData(),
+                     "tls://a.example:1000");
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "tls://b.example:1000");
+}
+END_TEST
+
+// Configured peers are replaced only by peers faster by more than their
+// margin, absolute or relative, whichever is larger.
+START_TEST(test_selectConfigPeers_stickiness)
+{
+    printf("[PeerManager] test_selectConfigPeers_stickiness: Testing selection hysteresis...\n");
+    QTemporaryDir tempDir;
+    ck_assert(tempDir.isValid());
+    QSettings settings(tempDir.filePath("yggtray.ini"), QSettings::IniFormat);
+    PeerManager::storeAppliedPeers(
+        settings,
+        { makePeer("tls://a.example:1000", 20, true),
+          makePeer("tls://b.example:1000", 22, true) });
+    PeerManager::Stickiness stickiness = PeerManager::loadStickiness(settings);
+    ck_assert_int_eq(stickiness.appliedPeers.size(), 2);
+    ck_assert(stickiness.marginUs == PeerManager::DEFAULT_STICKINESS_US);
+    ck_assert_int_eq(stickiness.marginPercent,
+                     PeerManager::DEFAULT_STICKINESS_PERCENT);
+
+    QList<PeerData> peers;
+    peers << makePeer("tls://c.example:1000", 18, true);
+    peers << makePeer("tls://a.example:1000", 20, true);
+    peers << makePeer("tls://b.example:1000", 22, true);
+    QList<PeerData> selected = PeerManager::selectConfigPeers(peers, 2);
+    ck_assert(! stickiness.isApplied(selected));
+    selected = PeerManager::selectConfigPeers(peers, 2, &stickiness);
+    ck_assert_int_eq(selected.size(), 2);
+    ck_assert_str_eq(selected[0].host().toUtf8().constData(),
+                     "tls://a.example:1000");
+    ck_assert(stickiness.isApplied(selected));
+
+    // At 200 ms, 10 % is the larger margin.
+    peers.clear();
+    peers << makePeer("tls://a.example:1000", 200, true);
+    peers << makePeer("tls://b.example:1000", 220, true);
+    peers << makePeer("tls://c.example:1000", 190, true);
+    peers << makePeer("tls://d.example:1000", 205, true);
+    selected = PeerManager::selectConfigPeers(peers, 2, &stickiness);
+    ck_assert_int_eq(selected.size(), 2);
+    ck_assert_str_eq(selected[0].host().toUtf8().constData(),
+                     "tls://a.example:1000");
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "tls://c.example:1000");
+    ck_assert(! stickiness.isApplied(selected));
+
+    // Unreachable configured peers get no margin.
+    peers[0].setValid(false);
+    stickiness.marginUs = 0;
+    stickiness.marginPercent = 0;
+    selected = PeerManager::selectConfigPeers(peers, 2, &stickiness);
+    ck_assert_str_eq(selected[0].host().toUtf8().constData(),
+                     "tls://c.example:1000");
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "tls://d.example:1000");
+}
+END_TEST
+
+// Only the endpoints of a host with the fastest handshake are kept, and the
+// freed slots go to other hosts.
+START_TEST(test_selectConfigPeers_transports)
+{
+    printf("[PeerManager] test_selectConfigPeers_transports: Testing one transport per host...\n");
+    ck_assert_str_eq(
+        peerHostIdentity("quic://Node.Example:1000").toUtf8().constData(),
+        "node.example");
+    ck_assert_str_eq(
+        peerHostIdentity("tls://node.example:2000?sni=node.example")
+            .toUtf8().constData(),
+        "node.example");
+    ck_assert_str_eq(
+        peerHostIdentity("tls://[fe80::1%25eth0]:1").toUtf8().constData(),
+        "fe80::1%eth0");
+
+    // The ping reaches the host, so all its endpoints have its latency;
+    // the quic:// endpoint did not answer the handshake.
+    QList<PeerData> peers;
+    peers << makePeer("tls://node.example:1000", 10, true);
+    peers << makePeer("tcp://node.example:1001", 10, true);
+    peers << makePeer("quic://node.example:1002", 10, true);
+    peers << makePeer("tls://other.example:1000", 20, true);
+    peers << makePeer("tls://third.example:1000", 30, true);
+    peers << makePeer("tcp://pinned.example:1000", 50, true, true);
+    peers << makePeer("tls://pinned.example:1001", 1, true);
+    peers[0].setTransportLatencyUs(30000);
+    peers[1].setTransportLatencyUs(12000);
+
+    QList<PeerData> selected = PeerManager::selectConfigPeers(peers, 4);
+    ck_assert_int_eq(selected.size(), 4);
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "tls://pinned.example:1001");
+    ck_assert_str_eq(selected[2].host().toUtf8().constData(),
+                     "tcp://node.example:1001");
+
+    selected = PeerManager::selectConfigPeers(peers, 4, nullptr, 1);
+    ck_assert_int_eq(selected.size(), 4);
+    ck_assert_str_eq(selected[0].host().toUtf8().constData(),
+                     "tcp://pinned.example:1000");
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "tcp://node.example:1001");
+    ck_assert_str_eq(selected[2].host().toUtf8().constData(),
+                     "tls://other.example:1000");
+    ck_assert_str_eq(selected[3].host().toUtf8().constData(),
+                     "tls://third.example:1000");
+
+    // Two endpoints per host for redundancy.
+    selected = PeerManager::selectConfigPeers(peers, 5, nullptr, 2);
+    ck_assert_int_eq(selected.size(), 5);
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "tls://pinned.example:1001");
+    ck_assert_str_eq(selected[2].host().toUtf8().constData(),
+                     "tcp://node.example:1001");
+    ck_assert_str_eq(selected[3].host().toUtf8().constData(),
+                     "tls://node.example:1000");
+    ck_assert_str_eq(selected[4].host().toUtf8().constData(),
+                     "tls://other.example:1000");
+
+    // A faster handshake wins over the ping latency measured to the host.
+    peers[2].setTransportLatencyUs(8000);
+    peers[2].setLatency(11);
+    selected = PeerManager::selectConfigPeers(peers, 4, nullptr, 1);
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "quic://node.example:1002");
+
+    // The fallback to untested peers keeps one endpoint per host as well.
+    QList<PeerData> untested;
+    untested << makePeer("tls://node.example:1000", -1, false);
+    untested << makePeer("tcp://node.example:1001", -1, false);
+    untested << makePeer("tls://other.example:1000", -1, false);
+    selected = PeerManager::selectConfigPeers(untested, 4, nullptr, 1);
+    ck_assert_int_eq(selected.size(), 2);
+    ck_assert_str_eq(selected[0].host().toUtf8().constData(),
+                     "tls://node.example:1000");
+    ck_assert_str_eq(selected[1].host().toUtf8().constData(),
+                     "tls://other.example:1000");
+}
+END_TEST
+
+// The handshake is timed on the port of the endpoint, and an endpoint that
+// does not answer is not measured.
+START_TEST(test_measureTransport)
+{
+    printf("[PeerManager] test_measureTransport: Testing the transport handshake...\n");
+    ck_assert(PeerTestRunnable::isVersionNegotiation(
+        QByteArray::fromHex("8000000000000000000001")));
+    ck_assert(! PeerTestRunnable::isVersionNegotiation(
+        QByteArray::fromHex("c01a2a3a4a0000")));
+    ck_assert(! PeerTestRunnable::isVersionNegotiation(
+        QByteArray::fromHex("80000000")));
+
+    // The kernel completes the TCP handshake before the server accepts.
+    QTcpServer server;
+    ck_assert(server.listen(QHostAddress::LocalHost));
+    QString uri = QString("tcp://127.0.0.1:%1").arg(server.serverPort());
+    ck_assert(PeerTestRunnable::measureTransport(
+        uri, QHostAddress::LocalHost, 1000) > 0);
+    server.close();
+    ck_assert_int_eq(PeerTestRunnable::measureTransport(
+        uri, QHostAddress::LocalHost, 1000), -1);
+
+    // Nothing answers QUIC on the closed port.
+    uri = QString("quic://127.0.0.1:%1").arg(server.serverPort());
+    ck_assert_int_eq(PeerTestRunnable::measureTransport(
+        uri, QHostAddress::LocalHost, 500), -1);
+    ck_assert_int_eq(PeerTestRunnable::measureTransport(
+        "socks://127.0.0.1:1080/node.example:1", QHostAddress::LocalHost,
+        500), -1);
+}
+END_TEST
+
+// Copies of PeerData share the payload until one of them is modified.
+START_TEST(test_peerData_copy_on_write)
+{
+    printf("[PeerManager] test_peerData_copy_on_write: Testing PeerData sharing...\n");
+    PeerData peer("tls://a.example:1000", true);
+    QList<PeerData> list;
+    list << peer;
+    PeerData copy = list[0];
+    ck_assert(copy.isSharedWith(peer));
+
+    copy.setLatency(42);
+    ck_assert(! copy.isSharedWith(peer));
+    ck_assert_int_eq(copy.latency(), 42);
+    ck_assert_int_eq(peer.latency(), -1);
+    ck_assert_int_eq(list[0].latency(), -1);
+    ck_assert(copy.isPrivate());
+    ck_assert(copy == peer);
+
+    ck_assert(PeerData().isSharedWith(PeerData()));
+}
+END_TEST
+
+// Host extraction and ping output parsing used by the latency probe.
+START_TEST(test_pingHost_and_parsePingLatency)
+{
+    printf("[PeerManager] test_pingHost_and_parsePingLatency: Testing probe helpers...\n");
+    ck_assert_str_eq(pingHost("tls://[2001:db8::1]:1234").toUtf8().constData(),
+                     "2001:db8::1");
+    ck_assert_str_eq(pingHost("tcp://192.0.2.1:1234").toUtf8().constData(),
+                     "192.0.2.1");
+    ck_assert_str_eq(pingHost("quic://example.com:1234").toUtf8().constData(),
+                     "example.com");
+
+    ck_assert_int_eq(parsePingLatency(
+        "rtt min/avg/max/mdev = 10.100/12.400/15.000/1.000 ms"), 12);
+    ck_assert_int_eq(parsePingLatency(
+        "round-trip min/avg/max = 0.100/0.200/0.300 ms"), 1);
+    ck_assert_int_eq(parsePingLatency(
+        "rtt min/avg/max/mdev = 0.000/0.000/0.000/0.000 ms"), -1);
+    ck_assert_int_eq(parsePingLatency("100% packet loss"), -1);
+
+    QList<QHostAddress> targets =
+        PeerTestRunnable::resolveTargets("2001:db8::1");
+    ck_assert_int_eq(targets.size(), 1);
+    ck_assert(targets[0].protocol() == QAbstractSocket::IPv6Protocol);
+}
+END_TEST
+
+// Sweeps resolve the hosts ahead of the tests, one address per family.
+START_TEST(test_resolvePeers)
+{
+    printf("[PeerManager] test_resolvePeers: Testing host resolution ahead of the tests...\n");
+    QList<QHostAddress> addresses;
+    addresses << QHostAddress("2001:db8::1") << QHostAddress("192.0.2.1")
+              << QHostAddress("192.0.2.2") << QHostAddress("2001:db8::2");
+    QList<QHostAddress> targets = PeerTestRunnable::probeTargets(addresses);
+    ck_assert_int_eq(targets.size(), 2);
+    ck_assert(targets[0] == QHostAddress("2001:db8::1"));
+    ck_assert(targets[1] == QHostAddress("192.0.2.1"));
+
+    PeerManager mgr(nullptr, false, nullptr);
+    QSignalSpy spy(&mgr, SIGNAL(peerResolved(PeerData,bool)));
+    QList<PeerData> peers;
+    peers << PeerData("tcp://192.0.2.1:1234")
+          << PeerData("tls://[2001:db8::1]:1234");
+
+    // Cancelled lookups are not reported.
+    mgr.resolvePeers(peers);
+    mgr.cancelResolution();
+    QTest::qWait(50);
+    ck_assert_int_eq(spy.count(), 0);
+
+    mgr.resolvePeers(peers);
+    for (int i = 0; (i < 20) && (spy.count() < 2); ++i) {
+        spy.wait(50);
+    }
+    ck_assert_int_eq(spy.count(), 2);
+    PeerData first = spy.at(0).at(0).value<PeerData>();
+    ck_assert(spy.at(0).at(1).toBool());
+    ck_assert(first.probeAddresses() == QStringList("192.0.2.1"));
+    PeerData second = spy.at(1).at(0).value<PeerData>();
+    ck_assert(second.probeAddresses() == QStringList("2001:db8::1"));
+}
+END_TEST
+
+// The faster family sets the peer latency, and is pinned for dual-stack
+// peers only when it is clearly faster or the other family fails.
+START_TEST(test_applyFamilyResults)
+{
+    printf("[PeerManager] test_applyFamilyResults: Testing family preference...\n");
+    const QString V4 = "192.0.2.1";
+    const QString V6 = "2001:db8::1";
+    PeerData peer("tls://example.com:1000");
+
+    peer.setLatencyIPv4(50);
+    peer.setLatencyIPv6(20);
+    PeerTestRunnable::applyFamilyResults(peer, true, V4, V6);
+    ck_assert(peer.isValid());
+    ck_assert_int_eq(peer.latency(), 20);
+    ck_assert_str_eq(peer.preferredAddress().toUtf8().constData(),
+                     "2001:db8::1");
+
+    // Within the margin: let the resolver choose.
+    peer.setLatencyIPv4(21);
+    PeerTestRunnable::applyFamilyResults(peer, true, V4, V6);
+    ck_assert_int_eq(peer.latency(), 20);
+    ck_assert(peer.preferredAddress().isEmpty());
+
+    // Only IPv4 works.
+    peer.setLatencyIPv4(30);
+    peer.setLatencyIPv6(-1);
+    PeerTestRunnable::applyFamilyResults(peer, true, V4, V6);
+    ck_assert_int_eq(peer.latency(), 30);
+    ck_assert_str_eq(peer.preferredAddress().toUtf8().constData(),
+                     "192.0.2.1");
+
+    // Single-stack peers never get a preferred address.
+    PeerTestRunnable::applyFamilyResults(peer, false, V4, "");
+    ck_assert(peer.preferredAddress().isEmpty());
+
+    // Nothing works.
+    peer.setLatencyIPv4(-1);
+    PeerTestRunnable::applyFamilyResults(peer, true, V4, V6);
+    ck_assert(! peer.isValid());
+    ck_assert_int_eq(peer.latency(), -1);
+    ck_assert(peer.preferredAddress().isEmpty());
+}
+END_TEST
+
+// Peers with a preferred address are written as an IP literal, keeping the
+// hostname as the SNI for TLS and QUIC.
+START_TEST(test_configPeerUri)
+{
+    printf("[PeerManager] test_configPeerUri: Testing config peer URIs...\n");
+    PeerData peer("tls://example.com:1000");
+    ck_assert_str_eq(configPeerUri(peer).toUtf8().constData(),
+                     "tls://example.com:1000");
+
+    peer.setPreferredAddress("2001:db8::1");
+    ck_assert_str_eq(configPeerUri(peer).toUtf8().constData(),
+                     "tls://[2001:db8::1]:1000?sni=example.com");
+    ck_assert(isPeerUriValid(configPeerUri(peer)));
+
+    PeerData tcpPeer("tcp://example.com:1000");
+    tcpPeer.setPreferredAddress("192.0.2.1");
+    ck_assert_str_eq(configPeerUri(tcpPeer).toUtf8().constData(),
+                     "tcp://192.0.2.1:1000");
+
+    // The rewritten URI still names the peer.
+    ck_assert(isSamePeer(configPeerUri(peer), peer.host()));
+    ck_assert(isSamePeer("tls://10.0.0.2:1?sni=Other", "tls://other:1"));
+    ck_assert(isSamePeer("tls://10.0.0.2:1?sni=other", "tls://10.0.0.2:1"));
+    ck_assert(isSamePeer("tcp://[2001:db8::1]:1", "tcp://[2001:DB8::1]:1"));
+    ck_assert(! isSamePeer("tls://other:1", "tcp://other:1"));
+    ck_assert(! isSamePeer("tls://other:1", "tls://other:2"));
+    ck_assert(containsPeer(QStringList() << "tcp://a:1" << "tls://a:1",
+                           "tls://192.0.2.1:1?sni=a"));
+    ck_assert(! containsPeer(QStringList() << "tcp://a:1",
+                             "tls://192.0.2.1:1?sni=a"));
+}
+END_TEST
+
+// Loopback, link-local and Yggdrasil addresses do not make an uplink.
+START_TEST(test_isUplinkAddress)
+{
+    printf("[PeerManager] test_isUplinkAddress: Testing uplink address filter...\n");
+    ck_assert(PeerManager::isUplinkAddress(QHostAddress("192.0.2.10")));
+    ck_assert(PeerManager::isUplinkAddress(QHostAddress("2001:db8::10")));
+    ck_assert(! PeerManager::isUplinkAddress(QHostAddress("127.0.0.1")));
+    ck_assert(! PeerManager::isUplinkAddress(QHostAddress("::1")));
+    ck_assert(! PeerManager::isUplinkAddress(QHostAddress("169.254.1.1")));
+    ck_assert(! PeerManager::isUplinkAddress(QHostAddress("fe80::1")));
+    ck_assert(! PeerManager::isUplinkAddress(QHostAddress("200:1234::1")));
+    ck_assert(! PeerManager::isUplinkAddress(QHostAddress("300:1234::1")));
+
+    PeerData peer("tls://example.com:1000");
+    ck_assert_int_eq(peer.uplinkLatency("eth0"), -1);
+    peer.setUplinkLatency("eth0", 12);
+    peer.setUplinkLatency("wwan0", -1);
+    ck_assert_int_eq(peer.uplinkLatency("eth0"), 12);
+    ck_assert_int_eq(peer.uplinkLatency("wwan0"), -1);
+    peer.clearUplinkLatencies();
+    ck_assert_int_eq(peer.uplinkLatency("eth0"), -1);
+}
+END_TEST
+
 Suite* peermanager_suite(void)
 {
     Suite* s = suite_create("PeerManager");
@@ -378,6 +815,18 @@ Suite* peermanager_suite(void)
     tcase_add_test(tc, test_cancelTests_cancels_all);
     tcase_add_test(tc, test_peersDiscovered_empty_list);
     tcase_add_test(tc, test_error_signal_peerlist_unreachable);
+    tcase_add_test(tc, test_selectConfigPeers_topK);
+    tcase_add_test(tc, test_selectConfigPeers_precise_latency);
+    tcase_add_test(tc, test_selectConfigPeers_fallback);
+    tcase_add_test(tc, test_selectConfigPeers_stickiness);
+    tcase_add_test(tc, test_selectConfigPeers_transports);
+    tcase_add_test(tc, test_measureTransport);
+    tcase_add_test(tc, test_peerData_copy_on_write);
+    tcase_add_test(tc, test_pingHost_and_parsePingLatency);
+    tcase_add_test(tc, test_resolvePeers);
+    tcase_add_test(tc, test_applyFamilyResults);
+    tcase_add_test(tc, test_configPeerUri);
+    tcase_add_test(tc, test_isUplinkAddress);
 
     suite_add_tcase(s, tc);
     return s;
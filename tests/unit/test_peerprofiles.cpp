@@ -0,0 +1,260 @@
+#include <check.h>
+#include <memory>
+#include <QtCore/QJsonArray>
+#include <QtCore/QSettings>
+#include <QtCore/QTemporaryDir>
+#include "../../src/PeerProfiles.h"
+
+// A tested peer.
+static PeerData testedPeer(const QString& host, int latency) {
+    PeerData peer(host);
+    peer.setValid(latency >= 0);
+    peer.setLatency(latency);
+    return peer;
+}
+
+// Profiles survive a round trip through the settings format.
+START_TEST(test_peerprofiles_round_trip)
+{
+    printf("[PeerProfiles] test_peerprofiles_round_trip: Testing the settings format...\n");
+    PeerProfiles::Profile profile;
+    profile.name = "Home";
+    profile.network = "fingerprint";
+    profile.validatedMs = 1234567890123LL;
+    profile.peers << testedPeer("tls://a.example:1", 12)
+                  << PeerData("tls://b.example:1", true);
+
+    QList<PeerProfiles::Profile> loaded;
+    ck_assert(PeerProfiles::loadProfiles(
+        PeerProfiles::saveProfiles({ profile }), loaded));
+    ck_assert_int_eq(loaded.size(), 1);
+    ck_assert_str_eq(qPrintable(loaded[0].name), "Home");
+    ck_assert_str_eq(qPrintable(loaded[0].network), "fingerprint");
+    ck_assert(loaded[0].validatedMs == 1234567890123LL);
+    ck_assert_int_eq(loaded[0].peers.size(), 2);
+    ck_assert(loaded[0].peers[0].isValid());
+    ck_assert_int_eq(loaded[0].peers[0].latency(), 12);
+    ck_assert(loaded[0].peers[1].isPrivate());
+    ck_assert_int_eq(loaded[0].peers[1].latency(), -1);
+
+    ck_assert(PeerProfiles::loadProfiles(QByteArray(), loaded));
+    ck_assert(loaded.isEmpty());
+    QByteArray data = PeerProfiles::saveProfiles({ profile });
+    ck_assert(! PeerProfiles::loadProfiles(data.left(data.size() - 2),
+                                           loaded));
+    ck_assert(loaded.isEmpty());
+    ck_assert(! PeerProfiles::loadProfiles(QByteArray(8, 'x'), loaded));
+}
+END_TEST
+
+// At most one profile is bound to a network.
+START_TEST(test_peerprofiles_network_binding)
+{
+    printf("[PeerProfiles] test_peerprofiles_network_binding: Testing network bindings...\n");
+    QTemporaryDir tempDir;
+    ck_assert(tempDir.isValid());
+    auto settings = std::make_shared<QSettings>(
+        tempDir.filePath("yggtray.ini"),
+        QSettings::IniFormat
+    );
+    PeerProfiles profiles(settings);
+    ck_assert(profiles.profiles().isEmpty());
+    ck_assert(profiles.autoSwitch());
+
+    PeerProfiles::Profile work;
+    work.name = "work";
+    work.network = "office";
+    work.peers << PeerData("tls://a.example:1");
+    profiles.save(work);
+    PeerProfiles::Profile home;
+    home.name = "Home";
+    home.network = "office";
+    home.peers << PeerData("tls://b.example:1");
+    profiles.save(home);
+
+    QList<PeerProfiles::Profile> all = profiles.profiles();
+    ck_assert_int_eq(all.size(), 2);
+    ck_assert_str_eq(qPrintable(all[0].name), "Home");
+    ck_assert_str_eq(qPrintable(profiles.profileForNetwork("office")),
+                     "Home");
+    ck_assert(profiles.profileForNetwork("").isEmpty());
+    PeerProfiles::Profile found;
+    ck_assert(profiles.find("work", &found));
+    ck_assert(found.network.isEmpty());
+    ck_assert(! profiles.find("cafe", &found));
+
+    profiles.setActiveProfile("Home");
+    ck_assert(profiles.remove("Home"));
+    ck_assert(! profiles.remove("Home"));
+    ck_assert(profiles.activeProfile().isEmpty());
+    ck_assert_int_eq(profiles.profiles().size(), 1);
+}
+END_TEST
+
+// Validation results reorder the peers and date the profile.
+START_TEST(test_peerprofiles_record_results)
+{
+    printf("[PeerProfiles] test_peerprofiles_record_results: Testing validation results...\n");
+    QTemporaryDir tempDir;
+    ck_assert(tempDir.isValid());
+    auto settings = std::make_shared<QSettings>(
+        tempDir.filePath("yggtray.ini"),
+        QSettings::IniFormat
+    );
+    PeerProfiles profiles(settings);
+    PeerProfiles::Profile profile;
+    profile.name = "Home";
+    profile.peers << testedPeer("tls://a.example:1", 10)
+                  << PeerData("tls://b.example:1")
+                  << testedPeer("tls://c.example:1", 30);
+    profiles.save(profile);
+    ck_assert(PeerProfiles::needsValidation(profile, 0));
+
+    qint64 nowMs = 1000000000000LL;
+    ck_assert(profiles.recordResults(
+        "Home",
+        { testedPeer("tls://a.example:1", -1),
+          testedPeer("tls://b.example:1", 5) },
+        nowMs));
+    ck_assert(! profiles.recordResults("cafe", {}, nowMs));
+
+    ck_assert(profiles.find("Home", &profile));
+    ck_assert(profile.validatedMs == nowMs);
+    ck_assert_int_eq(profile.peers.size(), 3);
+    ck_assert_str_eq(qPrintable(profile.peers[0].host()),
+                     "tls://b.example:1");
+    ck_assert_str_eq(qPrintable(profile.peers[1].host()),
+                     "tls://c.example:1");
+    ck_assert_str_eq(qPrintable(profile.peers[2].host()),
+                     "tls://a.example:1");
+    ck_assert_int_eq(profile.reachableCount(), 2);
+    ck_assert_int_eq(profile.uris().size(), 2);
+    ck_assert(! profile.uris().contains("tls://a.example:1"));
+
+    ck_assert(! PeerProfiles::needsValidation(profile, nowMs + 1000));
+    ck_assert(PeerProfiles::needsValidation(
+        profile, nowMs + PeerProfiles::REVALIDATE_AFTER_MS));
+
+    // Without reachable peers, all peers are tried.
+    PeerProfiles::Profile untested;
+    untested.peers << PeerData("tls://a.example:1")
+                   << PeerData("tls://b.example:1");
+    ck_assert_int_eq(untested.uris().size(), 2);
+}
+END_TEST
+
+// A fake admin socket with a set of connected peers.
+struct FakeAdmin {
+    bool available = true;
+    QStringList peers;
+    QStringList unreachable;
+    // addpeer and removepeer requests received
+    int changes = 0;
+
+    QJsonObject operator()(const QJsonObject& request) {
+        if (! available) {
+            return QJsonObject();
+        }
+        QString name = request["request"].toString();
+        QString uri = request["arguments"].toObject()["uri"].toString();
+        if ((name == "addpeer") || (name == "removepeer")) {
+            ++changes;
+        }
+        if (name == "getpeers") {
+            QJsonArray list;
+            for (const QString& peer : peers) {
+                list.append(QJsonObject {{"remote", peer}, {"up", true}});
+            }
+            list.append(QJsonObject {{"remote", "tls://[fe80::1%25eth0]:1"},
+                                     {"inbound", true}});
+            return {{"status", "success"},
+                    {"response", QJsonObject {{"peers", list}}}};
+        }
+        if ((name == "addpeer") && (! unreachable.contains(uri))) {
+            peers << uri;
+            return {{"status", "success"}};
+        }
+        if ((name == "removepeer") && peers.removeAll(uri)) {
+            return {{"status", "success"}};
+        }
+        return {{"status", "error"}};
+    }
+};
+
+// A live switch adds the new peers before it removes the old ones, and
+// keeps the old ones if no new peer can be added.
+START_TEST(test_peerprofiles_switch_live)
+{
+    printf("[PeerProfiles] test_peerprofiles_switch_live: Testing live switches...\n");
+    FakeAdmin admin;
+    admin.peers << "tls://old.example:1" << "tls://both.example:1";
+    auto request = [&admin](const QJsonObject& request) {
+        return admin(request);
+    };
+
+    ck_assert_int_eq(
+        PeerProfileSwitcher::switchLive(
+            request, { "tls://both.example:1", "tls://new.example:1" }),
+        PeerProfileSwitcher::Switched);
+    ck_assert_int_eq(admin.peers.size(), 2);
+    ck_assert(admin.peers.contains("tls://both.example:1"));
+    ck_assert(admin.peers.contains("tls://new.example:1"));
+
+    admin.unreachable << "tls://down.example:1";
+    ck_assert_int_eq(
+        PeerProfileSwitcher::switchLive(request, { "tls://down.example:1" }),
+        PeerProfileSwitcher::SwitchFailed);
+    ck_assert_int_eq(admin.peers.size(), 2);
+
+    admin.available = false;
+    ck_assert_int_eq(
+        PeerProfileSwitcher::switchLive(request, { "tls://new.example:1" }),
+        PeerProfileSwitcher::AdminUnavailable);
+}
+END_TEST
+
+// The daemon reports the peers with the address of the host and the host
+// name as the SNI; they still match the URIs of the profile.
+START_TEST(test_peerprofiles_switch_rewritten_uris)
+{
+    printf("[PeerProfiles] test_peerprofiles_switch_rewritten_uris: Testing peers the daemon reports by address...\n");
+    FakeAdmin admin;
+    admin.peers << "tls://192.0.2.1:1?sni=both.example"
+                << "quic://[2001:db8::1]:2?sni=old.example";
+    auto request = [&admin](const QJsonObject& request) {
+        return admin(request);
+    };
+
+    // Switching to the running peers changes nothing.
+    ck_assert_int_eq(
+        PeerProfileSwitcher::switchLive(
+            request, { "tls://both.example:1", "quic://old.example:2" }),
+        PeerProfileSwitcher::Switched);
+    ck_assert_int_eq(admin.changes, 0);
+    ck_assert_int_eq(admin.peers.size(), 2);
+
+    ck_assert_int_eq(
+        PeerProfileSwitcher::switchLive(
+            request, { "tls://both.example:1", "tls://new.example:1" }),
+        PeerProfileSwitcher::Switched);
+    ck_assert_int_eq(admin.changes, 2);
+    ck_assert(admin.peers
+              == (QStringList() << "tls://192.0.2.1:1?sni=both.example"
+                                << "tls://new.example:1"));
+}
+END_TEST
+
+Suite* peerprofiles_suite(void)
+{
+    Suite* s = suite_create("PeerProfiles");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_peerprofiles_round_trip);
+    tcase_add_test(tc, test_peerprofiles_network_binding);
+    tcase_add_test(tc, test_peerprofiles_record_results);
+    tcase_add_test(tc, test_peerprofiles_switch_live);
+    tcase_add_test(tc, test_peerprofiles_switch_rewritten_uris);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
@@ -0,0 +1,139 @@
+#include <check.h>
+#include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusVariant>
+#include <QtDBus/QDBusVirtualObject>
+#include <QtTest/QSignalSpy>
+#include "../../src/PowerPolicy.h"
+
+// Answers the property reads of PowerPolicy in place of UPower or
+// NetworkManager.
+class FakeService : public QDBusVirtualObject {
+public:
+    QVariantMap properties;
+
+    QString introspect(const QString&) const override {
+        return QString();
+    }
+
+    bool handleMessage(const QDBusMessage& message,
+                       const QDBusConnection& connection) override {
+        if ((message.interface() != "org.freedesktop.DBus.Properties")
+            || (message.member() != "Get")) {
+            return false;
+        }
+        QString name = message.arguments().value(1).toString();
+        if (! properties.contains(name)) {
+            connection.send(message.createErrorReply(
+                QDBusError::UnknownProperty, name));
+            return true;
+        }
+        connection.send(message.createReply(
+            QVariant::fromValue(QDBusVariant(properties[name]))));
+        return true;
+    }
+};
+
+START_TEST(test_powerpolicy_decide)
+{
+    printf("[PowerPolicy] test_powerpolicy_decide: Testing the decisions...\n");
+    PowerPolicy::State state;
+    ck_assert_int_eq(PowerPolicy::decide(state, true), PowerPolicy::Run);
+
+    state.onBattery = true;
+    ck_assert_int_eq(PowerPolicy::decide(state, true), PowerPolicy::Throttle);
+    ck_assert_int_eq(PowerPolicy::decide(state, false),
+                     PowerPolicy::Throttle);
+
+    // Metered connections hold back network work only.
+    state.metered = true;
+    ck_assert_int_eq(PowerPolicy::decide(state, true), PowerPolicy::Defer);
+    ck_assert_int_eq(PowerPolicy::decide(state, false),
+                     PowerPolicy::Throttle);
+
+    ck_assert(PowerPolicy::isMeteredValue(1));
+    ck_assert(PowerPolicy::isMeteredValue(3));
+    ck_assert(! PowerPolicy::isMeteredValue(0));
+    ck_assert(! PowerPolicy::isMeteredValue(2));
+    ck_assert(! PowerPolicy::isMeteredValue(4));
+}
+END_TEST
+
+// Without D-Bus, background work runs normally.
+START_TEST(test_powerpolicy_no_bus)
+{
+    printf("[PowerPolicy] test_powerpolicy_no_bus: Testing a missing bus...\n");
+    PowerPolicy policy(QDBusConnection("yggtray-no-such-bus"));
+    ck_assert(! policy.state().onBattery);
+    ck_assert(! policy.state().metered);
+    ck_assert_int_eq(policy.intervalMs(5000, true), 5000);
+}
+END_TEST
+
+// The state is read from the services and follows their change signals.
+START_TEST(test_powerpolicy_standin)
+{
+    printf("[PowerPolicy] test_powerpolicy_standin: Testing a session bus stand-in...\n");
+    if (! QDBusConnection::sessionBus().isConnected()) {
+        printf("[PowerPolicy] No session bus, skipping\n");
+        return;
+    }
+    QDBusConnection standIn = QDBusConnection::connectToBus(
+        QDBusConnection::SessionBus, "yggtray-test-standin");
+    FakeService upower;
+    upower.properties["OnBattery"] = true;
+    FakeService networkManager;
+    networkManager.properties["Metered"] = QVariant::fromValue(uint(2));
+    if ((! standIn.registerService(PowerPolicy::UPOWER_SERVICE))
+        || (! standIn.registerService(PowerPolicy::NM_SERVICE))) {
+        printf("[PowerPolicy] Stand-in names are taken, skipping\n");
+        QDBusConnection::disconnectFromBus("yggtray-test-standin");
+        return;
+    }
+    ck_assert(standIn.registerVirtualObject(PowerPolicy::UPOWER_PATH,
+                                            &upower));
+    ck_assert(standIn.registerVirtualObject(PowerPolicy::NM_PATH,
+                                            &networkManager));
+
+    PowerPolicy policy(QDBusConnection::sessionBus());
+    QSignalSpy spy(&policy, &PowerPolicy::changed);
+    ck_assert(spy.wait(2000));
+    ck_assert(policy.state().onBattery);
+    ck_assert(! policy.state().metered);
+    ck_assert_int_eq(policy.intervalMs(5000, true),
+                     5000 * PowerPolicy::THROTTLE_FACTOR);
+
+    // The connection becomes metered.
+    QDBusMessage signal = QDBusMessage::createSignal(
+        PowerPolicy::NM_PATH,
+        "org.freedesktop.DBus.Properties",
+        "PropertiesChanged");
+    QVariantMap changed;
+    changed["Metered"] = QVariant::fromValue(uint(1));
+    signal << QString(PowerPolicy::NM_INTERFACE) << changed << QStringList();
+    ck_assert(standIn.send(signal));
+    ck_assert(spy.wait(2000));
+    ck_assert(policy.state().metered);
+    ck_assert_int_eq(policy.decide(true), PowerPolicy::Defer);
+    ck_assert_int_eq(policy.intervalMs(5000, true), -1);
+
+    standIn.unregisterObject(PowerPolicy::UPOWER_PATH);
+    standIn.unregisterObject(PowerPolicy::NM_PATH);
+    standIn.unregisterService(PowerPolicy::UPOWER_SERVICE);
+    standIn.unregisterService(PowerPolicy::NM_SERVICE);
+    QDBusConnection::disconnectFromBus("yggtray-test-standin");
+}
+END_TEST
+
+Suite* powerpolicy_suite(void)
+{
+    Suite* s = suite_create("PowerPolicy");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_powerpolicy_decide);
+    tcase_add_test(tc, test_powerpolicy_no_bus);
+    tcase_add_test(tc, test_powerpolicy_standin);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
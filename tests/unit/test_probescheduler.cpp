@@ -0,0 +1,233 @@
+#include <check.h>
+#include <QtCore/QElapsedTimer>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+#include "../../src/ProbeResultCache.h"
+#include "../../src/ProbeScheduler.h"
+#include "../../src/TokenBucket.h"
+
+// The bucket lets a full bucket go at once, then paces to the rate.
+START_TEST(test_tokenbucket_pacing)
+{
+    printf("[ProbeScheduler] test_tokenbucket_pacing: Testing token bucket...\n");
+    TokenBucket bucket(10.0, 2.0); // 10 tokens/s, up to 2 stored
+    ck_assert(bucket.tryTake(1, 0));
+    ck_assert(bucket.tryTake(1, 0));
+    ck_assert(! bucket.tryTake(1, 0));
+    ck_assert_int_eq(bucket.msUntilAvailable(1, 0), 100);
+    ck_assert(! bucket.tryTake(1, 50));
+    ck_assert(bucket.tryTake(1, 100));
+
+    // Tokens do not pile up beyond the capacity.
+    ck_assert(bucket.tryTake(2, 10000));
+    ck_assert(! bucket.tryTake(1, 10000));
+}
+END_TEST
+
+// An event costlier than the capacity goes when the bucket is full, and the
+// debt delays the following events.
+START_TEST(test_tokenbucket_debt)
+{
+    printf("[ProbeScheduler] test_tokenbucket_debt: Testing token bucket debt...\n");
+    TokenBucket bucket(10.0, 1.0);
+    ck_assert(bucket.tryTake(6, 0));
+    ck_assert_int_eq(bucket.msUntilAvailable(1, 0), 600);
+    ck_assert(! bucket.tryTake(1, 500));
+    ck_assert(bucket.tryTake(1, 600));
+
+    TokenBucket unlimited;
+    ck_assert(unlimited.isUnlimited());
+    ck_assert(unlimited.tryTake(1000, 0));
+    ck_assert_int_eq(unlimited.msUntilAvailable(1000, 0), 0);
+}
+END_TEST
+
+// Probes are released evenly at the configured rate.
+START_TEST(test_probescheduler_paces_probes)
+{
+    printf("[ProbeScheduler] test_probescheduler_paces_probes: Testing pacing...\n");
+    ProbeScheduler scheduler;
+    scheduler.setRate(20); // One probe of cost 2 every 100 ms
+    scheduler.setMaxInFlight(100);
+    QSignalSpy spy(&scheduler, &ProbeScheduler::probeReady);
+
+    QElapsedTimer timer;
+    timer.start();
+    for (int i = 0; i < 5; ++i) {
+        scheduler.enqueue(PeerData(QString("tcp://peer%1:1234").arg(i)), 2);
+    }
+    ck_assert_int_eq(spy.count(), 1);
+
+    while ((spy.count() < 5) && (timer.elapsed() < 5000)) {
+        QTest::qWait(10);
+    }
+    ck_assert_int_eq(spy.count(), 5);
+    ck_assert_int_ge(timer.elapsed(), 350);
+    ck_assert_int_eq(scheduler.pendingCount(), 0);
+    ck_assert_int_eq(scheduler.inFlightCount(), 5);
+}
+END_TEST
+
+// The concurrency limit holds probes back regardless of the rate, and
+// clear() drops the queue.  Probes still running from before clear() do not
+// free slots of the next sweep.
+START_TEST(test_probescheduler_max_in_flight)
+{
+    printf("[ProbeScheduler] test_probescheduler_max_in_flight: Testing concurrency limit...\n");
+    ProbeScheduler scheduler;
+    scheduler.setRate(0);
+    scheduler.setMaxInFlight(2);
+    QSignalSpy spy(&scheduler, &ProbeScheduler::probeReady);
+
+    for (int i = 0; i < 4; ++i) {
+        scheduler.enqueue(PeerData(QString("tcp://peer%1:1234").arg(i)), 3);
+    }
+    ck_assert_int_eq(spy.count(), 2);
+    ck_assert_int_eq(scheduler.pendingCount(), 2);
+
+    quint64 oldGeneration = scheduler.generation();
+    scheduler.probeFinished(oldGeneration);
+    ck_assert_int_eq(spy.count(), 3);
+
+    scheduler.clear();
+    ck_assert_int_eq(scheduler.pendingCount(), 0);
+    ck_assert_int_eq(scheduler.inFlightCount(), 0);
+    ck_assert(scheduler.generation() != oldGeneration);
+
+    for (int i = 0; i < 3; ++i) {
+        scheduler.enqueue(PeerData(QString("tcp://next%1:1234").arg(i)), 3);
+    }
+    ck_assert_int_eq(spy.count(), 5);
+    ck_assert_int_eq(scheduler.inFlightCount(), 2);
+
+    // The two probes of the old sweep end late.
+    scheduler.probeFinished(oldGeneration);
+    scheduler.probeFinished(oldGeneration);
+    ck_assert_int_eq(scheduler.inFlightCount(), 2);
+    ck_assert_int_eq(spy.count(), 5);
+
+    scheduler.probeFinished(scheduler.generation());
+    ck_assert_int_eq(scheduler.inFlightCount(), 2);
+    ck_assert_int_eq(spy.count(), 6);
+}
+END_TEST
+
+// Queued probes go out highest priority first, FIFO among equals, and a
+// raised priority moves a probe ahead.
+START_TEST(test_probescheduler_priority)
+{
+    printf("[ProbeScheduler] test_probescheduler_priority: Testing priority order...\n");
+    ProbeScheduler scheduler;
+    scheduler.setRate(0);
+    scheduler.setMaxInFlight(1);
+    QSignalSpy spy(&scheduler, &ProbeScheduler::probeReady);
+
+    scheduler.enqueue(PeerData("tcp://first:1"), 1, 0.0);  // Released at once
+    scheduler.enqueue(PeerData("tcp://low:1"), 1, 1.0);
+    scheduler.enqueue(PeerData("tcp://high:1"), 1, 5.0);
+    scheduler.enqueue(PeerData("tcp://equal:1"), 1, 5.0);
+    scheduler.enqueue(PeerData("tcp://pinned:1"), 1, 0.0);
+    ck_assert(scheduler.setPriority("tcp://pinned:1", 10.0));
+    ck_assert(! scheduler.setPriority("tcp://unknown:1", 10.0));
+    ck_assert_int_eq(scheduler.pendingCount(), 4);
+
+    for (int i = 0; i < 4; ++i) {
+        scheduler.probeFinished(scheduler.generation());
+    }
+    ck_assert_int_eq(spy.count(), 5);
+    const char* expected[] = { "tcp://first:1", "tcp://pinned:1",
+                               "tcp://high:1", "tcp://equal:1",
+                               "tcp://low:1" };
+    for (int i = 0; i < 5; ++i) {
+        ck_assert_str_eq(qPrintable(spy.at(i).at(0).value<PeerData>().host()),
+                         expected[i]);
+    }
+    ck_assert_int_eq(scheduler.pendingCount(), 0);
+}
+END_TEST
+
+// Fast peers rank above unknown ones, failed peers below, and the ranking
+// fades with the age of the result.
+START_TEST(test_proberesultcache_priority)
+{
+    printf("[ProbeScheduler] test_proberesultcache_priority: Testing cached priorities...\n");
+    ProbeResultCache cache;
+    PeerData fast("tcp://fast:1");
+    fast.setValid(true);
+    fast.setLatency(20);
+    PeerData failed("tcp://failed:1");
+    PeerData unknown("tcp://unknown:1");
+    PeerData privatePeer("tcp://private:1", true);
+    cache.record(fast, 0);
+    cache.record(failed, 0);
+
+    double fastNow = cache.priority(fast, 0);
+    ck_assert(fastNow > cache.priority(unknown, 0));
+    ck_assert(cache.priority(failed, 0) < cache.priority(unknown, 0));
+    ck_assert(cache.priority(privatePeer, 0) > fastNow);
+
+    double fastLater = cache.priority(fast, ProbeResultCache::HALF_LIFE_MS);
+    ck_assert(fastLater < fastNow);
+    ck_assert(fastLater > ProbeResultCache::UNKNOWN_PRIORITY);
+
+    // Results survive a round trip, except expired ones.
+    ProbeResultCache loaded;
+    ck_assert(loaded.load(cache.save(0)));
+    ck_assert_int_eq(loaded.size(), 2);
+    ProbeResultCache::Entry entry;
+    ck_assert(loaded.lookup("tcp://fast:1", &entry));
+    ck_assert_int_eq(entry.latency, 20);
+    ck_assert(entry.isValid);
+    ck_assert(loaded.load(cache.save(ProbeResultCache::MAX_AGE_MS)));
+    ck_assert_int_eq(loaded.size(), 0);
+    ck_assert(! loaded.load(QByteArray("garbage")));
+}
+END_TEST
+
+// Results of another network are dropped; results of an unknown network
+// are kept.
+START_TEST(test_proberesultcache_invalidate)
+{
+    printf("[ProbeScheduler] test_proberesultcache_invalidate: Testing network changes...\n");
+    ProbeResultCache cache;
+    PeerData home("tcp://home:1");
+    home.setValid(true);
+    home.setLatency(20);
+    PeerData office("tcp://office:1");
+    PeerData unknown("tcp://unknown:1");
+    cache.record(home, 0, "home");
+    cache.record(office, 0, "office");
+    cache.record(unknown, 0);
+
+    // The network survives a round trip.
+    ProbeResultCache loaded;
+    ck_assert(loaded.load(cache.save(0)));
+    ProbeResultCache::Entry entry;
+    ck_assert(loaded.lookup("tcp://home:1", &entry));
+    ck_assert_str_eq(qPrintable(entry.network), "home");
+
+    ck_assert_int_eq(loaded.invalidate("home"), 1);
+    ck_assert_int_eq(loaded.size(), 2);
+    ck_assert(loaded.lookup("tcp://home:1", nullptr));
+    ck_assert(loaded.lookup("tcp://unknown:1", nullptr));
+    ck_assert(! loaded.lookup("tcp://office:1", nullptr));
+    ck_assert_int_eq(loaded.invalidate("home"), 0);
+}
+END_TEST
+
+Suite* probescheduler_suite(void)
+{
+    Suite* s = suite_create("ProbeScheduler");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_tokenbucket_pacing);
+    tcase_add_test(tc, test_tokenbucket_debt);
+    tcase_add_test(tc, test_probescheduler_paces_probes);
+    tcase_add_test(tc, test_probescheduler_max_in_flight);
+    tcase_add_test(tc, test_probescheduler_priority);
+    tcase_add_test(tc, test_proberesultcache_priority);
+    tcase_add_test(tc, test_proberesultcache_invalidate);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
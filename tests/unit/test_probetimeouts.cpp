@@ -0,0 +1,90 @@
+#include <check.h>
+#include <QtCore/QVector>
+#include "../../src/ProbeTimeouts.h"
+
+// Nearest-rank percentiles.
+START_TEST(test_probetimeouts_percentile)
+{
+    printf("[ProbeTimeouts] test_probetimeouts_percentile: Testing percentiles...\n");
+    QVector<int> values;
+    ck_assert_int_eq(ProbeTimeouts::percentile(values, 95), -1);
+    for (int i = 100; i >= 1; --i) {
+        values.append(i);
+    }
+    ck_assert_int_eq(ProbeTimeouts::percentile(values, 95), 95);
+    ck_assert_int_eq(ProbeTimeouts::percentile(values, 50), 50);
+    ck_assert_int_eq(ProbeTimeouts::percentile(values, 100), 100);
+    ck_assert_int_eq(ProbeTimeouts::percentile(values, 0), 1);
+}
+END_TEST
+
+// The reply timeout follows the measured latencies once there are enough
+// of them, within the bounds, and failures do not count.
+START_TEST(test_probetimeouts_adaptive_timeout)
+{
+    printf("[ProbeTimeouts] test_probetimeouts_adaptive_timeout: Testing adaptive timeout...\n");
+    ProbeTimeouts timeouts(5000, 100);
+    ck_assert_int_eq(timeouts.replyDeadlineMs(), 5000);
+
+    for (int i = 0; i < ProbeTimeouts::MIN_SAMPLES - 1; ++i) {
+        timeouts.addResult(100);
+        timeouts.addResult(-1);
+    }
+    ck_assert_int_eq(timeouts.timeoutMs(), 5000);
+    timeouts.addResult(200);
+    // 95th percentile of seven 100 ms and one 200 ms, plus 100%
+    ck_assert_int_eq(timeouts.timeoutMs(), 400);
+    ck_assert_int_eq(timeouts.replyDeadlineMs(), 400);
+
+    for (int i = 0; i < 100; ++i) {
+        timeouts.addResult(3000);
+    }
+    ck_assert_int_eq(timeouts.timeoutMs(), 5000);
+
+    ProbeTimeouts fast(5000, 100);
+    for (int i = 0; i < ProbeTimeouts::MIN_SAMPLES; ++i) {
+        fast.addResult(1);
+    }
+    ck_assert_int_eq(fast.replyDeadlineMs(), ProbeTimeouts::MIN_DEADLINE_MS);
+
+    timeouts.reset();
+    ck_assert_int_eq(timeouts.timeoutMs(), 5000);
+}
+END_TEST
+
+// Once K peers answered, peers slower than the K-th best are cut off,
+// except peers that do not compete for the top K.
+START_TEST(test_probetimeouts_topk_cutoff)
+{
+    printf("[ProbeTimeouts] test_probetimeouts_topk_cutoff: Testing top-K cut-off...\n");
+    ProbeTimeouts timeouts(5000, 3);
+    timeouts.addResult(1000);
+    timeouts.addResult(900);
+    ck_assert_int_eq(timeouts.cutoffMs(), 0);
+    timeouts.addResult(800);
+    ck_assert_int_eq(timeouts.cutoffMs(), 1200);
+    timeouts.addResult(500);
+    ck_assert_int_eq(timeouts.cutoffMs(), 1080);
+    timeouts.addResult(2000);
+    ck_assert_int_eq(timeouts.cutoffMs(), 1080);
+
+    ck_assert_int_eq(timeouts.replyDeadlineMs(true), 1080);
+    ck_assert_int_eq(timeouts.replyDeadlineMs(false), 5000);
+
+    timeouts.reset();
+    ck_assert_int_eq(timeouts.cutoffMs(), 0);
+}
+END_TEST
+
+Suite* probetimeouts_suite(void)
+{
+    Suite* s = suite_create("ProbeTimeouts");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_probetimeouts_percentile);
+    tcase_add_test(tc, test_probetimeouts_adaptive_timeout);
+    tcase_add_test(tc, test_probetimeouts_topk_cutoff);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
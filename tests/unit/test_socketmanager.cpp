@@ -0,0 +1,137 @@
+#include <check.h>
+#include <QtCore/QJsonDocument>
+#include <QtCore/QJsonObject>
+#include "../../src/SocketManager.h"
+
+static QJsonObject parse(const char* json) {
+    return QJsonDocument::fromJson(QByteArray(json)).object();
+}
+
+// Yggdrasil 0.5 returns a list of peers with an "up" flag.
+START_TEST(test_countConnectedPeers_list)
+{
+    QJsonObject response = parse(
+        "{\"status\":\"success\",\"response\":{\"peers\":["
+        "{\"remote\":\"tls://a.example:1\",\"up\":true},"
+        "{\"remote\":\"tls://b.example:1\",\"up\":false},"
+        "{\"remote\":\"tls://c.example:1\",\"up\":true}"
+        "]}}");
+    ck_assert_int_eq(SocketManager::countConnectedPeers(response), 2);
+}
+END_TEST
+
+// Older versions return a map of connected peers keyed by address.
+START_TEST(test_countConnectedPeers_map)
+{
+    QJsonObject response = parse(
+        "{\"status\":\"success\",\"response\":{\"peers\":{"
+        "\"200::1\":{\"port\":1},"
+        "\"200::2\":{\"port\":2}"
+        "}}}");
+    ck_assert_int_eq(SocketManager::countConnectedPeers(response), 2);
+}
+END_TEST
+
+START_TEST(test_countConnectedPeers_malformed)
+{
+    ck_assert_int_eq(SocketManager::countConnectedPeers(QJsonObject()), 0);
+    ck_assert_int_eq(
+        SocketManager::countConnectedPeers(
+            parse("{\"status\":\"error\",\"error\":\"unknown\"}")),
+        0);
+}
+END_TEST
+
+// Only connected peers are listed, by their remote URI.
+START_TEST(test_connectedPeerUris)
+{
+    QJsonObject list = parse(
+        "{\"status\":\"success\",\"response\":{\"peers\":["
+        "{\"remote\":\"tls://a.example:1\",\"up\":true},"
+        "{\"remote\":\"tls://b.example:1\",\"up\":false}"
+        "]}}");
+    QStringList uris = SocketManager::connectedPeerUris(list);
+    ck_assert_int_eq(uris.size(), 1);
+    ck_assert_str_eq(qPrintable(uris[0]), "tls://a.example:1");
+
+    QJsonObject map = parse(
+        "{\"status\":\"success\",\"response\":{\"peers\":{"
+        "\"200::1\":{\"remote\":\"tcp://b.example:2\"},"
+        "\"200::2\":{\"port\":2}"
+        "}}}");
+    uris = SocketManager::connectedPeerUris(map);
+    ck_assert_int_eq(uris.size(), 2);
+    ck_assert(uris.contains("tcp://b.example:2"));
+    ck_assert(uris.contains("200::2"));
+
+    ck_assert(SocketManager::connectedPeerUris(QJsonObject()).isEmpty());
+}
+END_TEST
+
+// Peers that are down are listed too, inbound peers are not.
+START_TEST(test_outboundPeerUris)
+{
+    QJsonObject list = parse(
+        "{\"status\":\"success\",\"response\":{\"peers\":["
+        "{\"remote\":\"tls://a.example:1\",\"up\":true},"
+        "{\"remote\":\"tls://b.example:1\",\"up\":false},"
+        "{\"remote\":\"tls://[fe80::1%25eth0]:2\",\"up\":true,"
+        "\"inbound\":true}"
+        "]}}");
+    QStringList uris = SocketManager::outboundPeerUris(list);
+    ck_assert_int_eq(uris.size(), 2);
+    ck_assert(uris.contains("tls://a.example:1"));
+    ck_assert(uris.contains("tls://b.example:1"));
+
+    QJsonObject map = parse(
+        "{\"status\":\"success\",\"response\":{\"peers\":{"
+        "\"200::1\":{\"remote\":\"tcp://b.example:2\"}"
+        "}}}");
+    uris = SocketManager::outboundPeerUris(map);
+    ck_assert_int_eq(uris.size(), 1);
+    ck_assert(SocketManager::outboundPeerUris(QJsonObject()).isEmpty());
+}
+END_TEST
+
+// Yggdrasil 0.5 describes every multicast interface, older versions list
+// the names.
+START_TEST(test_multicastInterfaceNames)
+{
+    QJsonObject objects = parse(
+        "{\"status\":\"success\",\"response\":{\"multicast_interfaces\":["
+        "{\"name\":\"eth0\",\"address\":\"fe80::1\",\"beacon\":true},"
+        "{\"name\":\"wlan0\",\"address\":\"fe80::2\",\"beacon\":true}"
+        "]}}");
+    QStringList names = SocketManager::multicastInterfaceNames(objects);
+    ck_assert_int_eq(names.size(), 2);
+    ck_assert_str_eq(qPrintable(names[0]), "eth0");
+    ck_assert_str_eq(qPrintable(names[1]), "wlan0");
+
+    QJsonObject plain = parse(
+        "{\"status\":\"success\",\"response\":{\"multicast_interfaces\":["
+        "\"eth0\"]}}");
+    names = SocketManager::multicastInterfaceNames(plain);
+    ck_assert_int_eq(names.size(), 1);
+    ck_assert_str_eq(qPrintable(names[0]), "eth0");
+
+    ck_assert(SocketManager::multicastInterfaceNames(QJsonObject()).isEmpty());
+}
+END_TEST
+
+Suite* socketmanager_suite(void)
+{
+    Suite* s = suite_create("SocketManager");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_countConnectedPeers_list);
+    tcase_add_test(tc, test_countConnectedPeers_map);
+    tcase_add_test(tc, test_countConnectedPeers_malformed);
+    tcase_add_test(tc, test_connectedPeerUris);
+    tcase_add_test(tc, test_outboundPeerUris);
+    tcase_add_test(tc, test_multicastInterfaceNames);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+/* No main here: suite will be registered from the global test runner. */
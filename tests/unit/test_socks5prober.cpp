@@ -0,0 +1,175 @@
+#include <check.h>
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QList>
+#include <QtCore/QStringList>
+#include <QtNetwork/QHostAddress>
+#include <QtNetwork/QTcpServer>
+#include <QtNetwork/QTcpSocket>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+#include "../../src/Socks5Prober.h"
+
+// Port that the fake proxy refuses to connect to.
+static const quint16 REFUSED_PORT = 2;
+
+/**
+ * @brief Minimal SOCKS5 server without authentication.  CONNECT requests
+ * succeed without connecting anywhere, except to REFUSED_PORT.
+ */
+class FakeSocks5Server {
+public:
+    FakeSocks5Server() {
+        server.listen(QHostAddress::LocalHost);
+        QObject::connect(&server, &QTcpServer::newConnection, [this]() {
+            while (server.hasPendingConnections()) {
+                QTcpSocket* client = server.nextPendingConnection();
+                QObject::connect(client, &QTcpSocket::readyRead,
+                                 [this, client]() { serve(client); });
+            }
+        });
+    }
+
+    quint16 port() const { return server.serverPort(); }
+
+    // "host:port" of every CONNECT request
+    QStringList requests;
+
+private:
+    void serve(QTcpSocket* client) {
+        QByteArray& buffer = buffers[client];
+        buffer += client->readAll();
+
+        if (! greeted.contains(client)) {
+            if ((buffer.size() < 2) || (buffer.size() < 2 + buffer[1])) {
+                return;
+            }
+            buffer.remove(0, 2 + buffer[1]);
+            greeted << client;
+            client->write(QByteArray::fromHex("0500"));
+        }
+
+        if (buffer.size() < 5) {
+            return;
+        }
+        int addressLength = 0;
+        int offset = 4;
+        switch (buffer[3]) {
+        case 1: addressLength = 4; break;
+        case 4: addressLength = 16; break;
+        case 3:
+            addressLength = static_cast<quint8>(buffer[4]);
+            offset = 5;
+            break;
+        default: client->abort(); return;
+        }
+        if (buffer.size() < offset + addressLength + 2) {
+            return;
+        }
+        QString host = (buffer[3] == 3)
+            ? QString::fromLatin1(buffer.mid(offset, addressLength))
+            : QString("ip");
+        int portOffset = offset + addressLength;
+        quint16 port = (static_cast<quint8>(buffer[portOffset]) << 8)
+            | static_cast<quint8>(buffer[portOffset + 1]);
+        requests << QString("%1:%2").arg(host).arg(port);
+
+        QByteArray reply = QByteArray::fromHex("0500000100000000" "0000");
+        if (port == REFUSED_PORT) {
+            reply[1] = 5; // Connection refused
+        }
+        client->write(reply);
+        buffer.clear();
+    }
+
+    QTcpServer server;
+    QHash<QTcpSocket*, QByteArray> buffers;
+    QList<QTcpSocket*> greeted;
+};
+
+static QNetworkProxy proxyFor(const FakeSocks5Server& server) {
+    return QNetworkProxy(QNetworkProxy::Socks5Proxy,
+                         "127.0.0.1",
+                         server.port());
+}
+
+// A peer the proxy can connect to gets a latency from CONNECT_COUNT
+// connections, with the hostname resolved by the proxy.
+START_TEST(test_socks5prober_measures_connect_time)
+{
+    printf("[Socks5Prober] test_socks5prober_measures_connect_time: Testing probe through proxy...\n");
+    FakeSocks5Server server;
+    Socks5Prober prober(proxyFor(server));
+    QSignalSpy spy(&prober, &Socks5Prober::peerTested);
+
+    prober.probe(PeerData("tls://peer.example:1234"));
+    ck_assert(spy.wait(5000));
+
+    PeerData peer = spy.at(0).at(0).value<PeerData>();
+    ck_assert(peer.isValid());
+    ck_assert_int_ge(peer.latency(), 1);
+    ck_assert_int_eq(server.requests.size(), Socks5Prober::CONNECT_COUNT);
+    ck_assert_str_eq(server.requests[0].toUtf8().constData(),
+                     "peer.example:1234");
+    ck_assert_int_eq(prober.pendingCount(), 0);
+}
+END_TEST
+
+// A refused CONNECT marks the peer invalid without retrying, and QUIC peers
+// are not probed at all.
+START_TEST(test_socks5prober_unreachable_peers)
+{
+    printf("[Socks5Prober] test_socks5prober_unreachable_peers: Testing unreachable peers...\n");
+    FakeSocks5Server server;
+    Socks5Prober prober(proxyFor(server));
+    QSignalSpy spy(&prober, &Socks5Prober::peerTested);
+
+    prober.probe(
+        PeerData(QString("tcp://peer.example:%1").arg(REFUSED_PORT)));
+    prober.probe(PeerData("quic://peer.example:1234"));
+    ck_assert_int_eq(spy.count(), 1); // QUIC is rejected right away
+    ck_assert(spy.wait(5000));
+
+    ck_assert_int_eq(spy.count(), 2);
+    for (const QList<QVariant>& args : spy) {
+        PeerData peer = args.at(0).value<PeerData>();
+        ck_assert(! peer.isValid());
+        ck_assert_int_eq(peer.latency(), -1);
+    }
+    ck_assert_int_eq(server.requests.size(), 1);
+}
+END_TEST
+
+// Only MAX_CONCURRENT_PROBES peers are probed at a time, and cancel() drops
+// everything without reporting results.
+START_TEST(test_socks5prober_cancel)
+{
+    printf("[Socks5Prober] test_socks5prober_cancel: Testing cancellation...\n");
+    FakeSocks5Server server;
+    Socks5Prober prober(proxyFor(server));
+    QSignalSpy spy(&prober, &Socks5Prober::peerTested);
+
+    for (int i = 0; i < 2 * Socks5Prober::MAX_CONCURRENT_PROBES; ++i) {
+        prober.probe(PeerData(QString("tcp://peer%1.example:1234").arg(i)));
+    }
+    ck_assert_int_eq(prober.pendingCount(),
+                     2 * Socks5Prober::MAX_CONCURRENT_PROBES);
+    prober.cancel();
+    ck_assert_int_eq(prober.pendingCount(), 0);
+    QTest::qWait(200);
+    ck_assert_int_eq(spy.count(), 0);
+}
+END_TEST
+
+Suite* socks5prober_suite(void)
+{
+    Suite* s = suite_create("Socks5Prober");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_socks5prober_measures_connect_time);
+    tcase_add_test(tc, test_socks5prober_unreachable_peers);
+    tcase_add_test(tc, test_socks5prober_cancel);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
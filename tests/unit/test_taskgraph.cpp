@@ -0,0 +1,188 @@
+#include <check.h>
+#include <QtCore/QVariant>
+#include "../../src/TaskGraph.h"
+
+// Items stream through the stages, and the graph finishes with its last
+// node.
+START_TEST(test_taskgraph_streaming)
+{
+    printf("[TaskGraph] test_taskgraph_streaming: Testing a three-stage pipeline...\n");
+    TaskGraph graph;
+    int source = -1;
+    int twice = -1;
+    int sum = 0;
+
+    TaskGraph::Handlers produce;
+    produce.onStart = [&]() {
+        for (int i = 1; i <= 3; ++i) {
+            graph.emitItem(source, i);
+        }
+    };
+    source = graph.addNode("source", produce);
+
+    TaskGraph::Handlers doubler;
+    doubler.onItem = [&](const QVariant& item) {
+        graph.emitItem(twice, item.toInt() * 2);
+    };
+    twice = graph.addNode("twice", doubler);
+
+    TaskGraph::Handlers add;
+    add.onItem = [&](const QVariant& item) { sum += item.toInt(); };
+    int sink = graph.addNode("sum", add);
+
+    graph.addEdge(source, twice);
+    graph.addEdge(twice, sink);
+
+    int finished = 0;
+    bool succeeded = false;
+    QObject::connect(&graph, &TaskGraph::finished,
+                     [&](bool success, const QString&) {
+                         ++finished;
+                         succeeded = success;
+                     });
+    graph.start();
+
+    ck_assert_int_eq(sum, 12);
+    ck_assert_int_eq(finished, 1);
+    ck_assert(succeeded);
+    ck_assert(! graph.isRunning());
+    ck_assert_int_eq(graph.stats(twice).itemsIn, 3);
+    ck_assert_int_eq(graph.stats(twice).itemsOut, 3);
+    ck_assert_int_eq(graph.stats(sink).state, TaskGraph::Finished);
+}
+END_TEST
+
+// A stage starts with its first item, before the stage before it is done.
+START_TEST(test_taskgraph_overlap)
+{
+    printf("[TaskGraph] test_taskgraph_overlap: Testing overlapping stages...\n");
+    TaskGraph graph;
+    TaskGraph::Handlers asyncStage;
+    // Waits for finishNode() instead of finishing with its inputs
+    asyncStage.onInputsClosed = []() {};
+    int probe = graph.addNode("probe", asyncStage);
+    int results = graph.addNode("results", TaskGraph::Handlers());
+    graph.addEdge(probe, results);
+
+    graph.start();
+    ck_assert(graph.isRunning());
+    ck_assert_int_eq(graph.stats(results).state, TaskGraph::Pending);
+
+    graph.emitItem(probe, 1);
+    ck_assert_int_eq(graph.stats(results).state, TaskGraph::Running);
+    ck_assert_int_eq(graph.stats(probe).state, TaskGraph::Running);
+
+    graph.finishNode(probe);
+    ck_assert_int_eq(graph.stats(results).state, TaskGraph::Finished);
+    ck_assert(! graph.isRunning());
+}
+END_TEST
+
+// Cancelling the graph cancels the running stages.
+START_TEST(test_taskgraph_cancel)
+{
+    printf("[TaskGraph] test_taskgraph_cancel: Testing cancellation...\n");
+    TaskGraph graph;
+    bool probeCancelled = false;
+    TaskGraph::Handlers probe;
+    probe.onInputsClosed = []() {};
+    probe.onCancel = [&]() { probeCancelled = true; };
+    int probeNode = graph.addNode("probe", probe);
+    int resultNode = graph.addNode("results", TaskGraph::Handlers());
+    graph.addEdge(probeNode, resultNode);
+
+    bool succeeded = true;
+    QObject::connect(&graph, &TaskGraph::finished,
+                     [&](bool success, const QString&) {
+                         succeeded = success;
+                     });
+    graph.start();
+    graph.cancel();
+
+    ck_assert(probeCancelled);
+    ck_assert(! succeeded);
+    ck_assert_int_eq(graph.stats(probeNode).state, TaskGraph::Cancelled);
+    ck_assert_int_eq(graph.stats(resultNode).state, TaskGraph::Cancelled);
+
+    // Items after the cancellation go nowhere.
+    graph.emitItem(probeNode, 1);
+    ck_assert_int_eq(graph.stats(resultNode).itemsIn, 0);
+}
+END_TEST
+
+// A failing stage cancels the stages after it, and the stages before it
+// that nothing else consumes.
+START_TEST(test_taskgraph_failure)
+{
+    printf("[TaskGraph] test_taskgraph_failure: Testing failure propagation...\n");
+    TaskGraph graph;
+    TaskGraph::Handlers waiting;
+    waiting.onInputsClosed = []() {};
+    bool fetchCancelled = false;
+    TaskGraph::Handlers fetch = waiting;
+    fetch.onCancel = [&]() { fetchCancelled = true; };
+
+    int fetchNode = graph.addNode("fetch", fetch);
+    int resolveNode = graph.addNode("resolve", waiting);
+    int probeNode = graph.addNode("probe", waiting);
+    graph.addEdge(fetchNode, resolveNode);
+    graph.addEdge(resolveNode, probeNode);
+
+    QString error;
+    QObject::connect(&graph, &TaskGraph::finished,
+                     [&](bool, const QString& message) { error = message; });
+    graph.start();
+    graph.emitItem(fetchNode, 1);
+    graph.failNode(resolveNode, "resolver failed");
+
+    ck_assert(fetchCancelled);
+    ck_assert_int_eq(graph.stats(resolveNode).state, TaskGraph::Failed);
+    ck_assert_int_eq(graph.stats(probeNode).state, TaskGraph::Cancelled);
+    ck_assert_str_eq(qPrintable(error), "resolver failed");
+}
+END_TEST
+
+// A stage with two inputs waits for both to finish.
+START_TEST(test_taskgraph_join)
+{
+    printf("[TaskGraph] test_taskgraph_join: Testing a stage with two inputs...\n");
+    TaskGraph graph;
+    TaskGraph::Handlers waiting;
+    waiting.onInputsClosed = []() {};
+    int slow = graph.addNode("slow", waiting);
+    int fast = graph.addNode("fast", TaskGraph::Handlers());
+    int closed = 0;
+    TaskGraph::Handlers join;
+    int joinNode = -1;
+    join.onInputsClosed = [&]() {
+        ++closed;
+        graph.finishNode(joinNode);
+    };
+    joinNode = graph.addNode("join", join);
+    graph.addEdge(slow, joinNode);
+    graph.addEdge(fast, joinNode);
+
+    graph.start();
+    ck_assert_int_eq(graph.stats(fast).state, TaskGraph::Finished);
+    ck_assert_int_eq(closed, 0);
+    graph.finishNode(slow);
+    ck_assert_int_eq(closed, 1);
+    ck_assert(! graph.isRunning());
+    ck_assert(graph.stats(joinNode).elapsedMs >= 0);
+}
+END_TEST
+
+Suite* taskgraph_suite(void)
+{
+    Suite* s = suite_create("TaskGraph");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_taskgraph_streaming);
+    tcase_add_test(tc, test_taskgraph_overlap);
+    tcase_add_test(tc, test_taskgraph_cancel);
+    tcase_add_test(tc, test_taskgraph_failure);
+    tcase_add_test(tc, test_taskgraph_join);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
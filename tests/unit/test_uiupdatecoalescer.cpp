@@ -0,0 +1,83 @@
+#include <check.h>
+#include <QtCore/QList>
+#include <QtTest/QSignalSpy>
+#include <QtTest/QtTest>
+#include "../../src/UiUpdateCoalescer.h"
+
+// Many changes within one frame must produce a single flush with
+// de-duplicated keys in first-marked order.
+START_TEST(test_coalescer_batches_changes)
+{
+    printf("[UiUpdateCoalescer] test_coalescer_batches_changes: Testing that changes are batched...\n");
+    UiUpdateCoalescer coalescer(60);
+    QSignalSpy spy(&coalescer,
+                   SIGNAL(flushRequested(QList<int>, int)));
+
+    for (int i = 0; i < 100; ++i) {
+        coalescer.markDirty(i % 10);
+    }
+    ck_assert_int_eq(spy.count(), 0);
+
+    QTest::qWait(coalescer.flushIntervalMs() * 4);
+
+    ck_assert_int_eq(spy.count(), 1);
+    QList<QVariant> args = spy.takeFirst();
+    QList<int> keys = qvariant_cast<QList<int>>(args.at(0));
+    ck_assert_int_eq(keys.size(), 10);
+    for (int i = 0; i < 10; ++i) {
+        ck_assert_int_eq(keys[i], i);
+    }
+    ck_assert_int_eq(args.at(1).toInt(), 100);
+    ck_assert_int_eq(coalescer.flushCount(), 1);
+}
+END_TEST
+
+// The flush rate is clamped to the 30-60 Hz range.
+START_TEST(test_coalescer_rate_is_clamped)
+{
+    printf("[UiUpdateCoalescer] test_coalescer_rate_is_clamped: Testing flush rate limits...\n");
+    UiUpdateCoalescer slow(1);
+    UiUpdateCoalescer fast(1000);
+    ck_assert_int_eq(slow.flushIntervalMs(),
+                     1000 / UiUpdateCoalescer::MIN_FLUSH_RATE_HZ);
+    ck_assert_int_eq(fast.flushIntervalMs(),
+                     1000 / UiUpdateCoalescer::MAX_FLUSH_RATE_HZ);
+}
+END_TEST
+
+// flushNow() emits pending changes synchronously; reset() drops them.
+START_TEST(test_coalescer_flush_now_and_reset)
+{
+    printf("[UiUpdateCoalescer] test_coalescer_flush_now_and_reset: Testing flushNow and reset...\n");
+    UiUpdateCoalescer coalescer;
+    QSignalSpy spy(&coalescer,
+                   SIGNAL(flushRequested(QList<int>, int)));
+
+    coalescer.flushNow();
+    ck_assert_int_eq(spy.count(), 0);
+
+    coalescer.markDirty(3);
+    coalescer.flushNow();
+    ck_assert_int_eq(spy.count(), 1);
+
+    coalescer.markDirty(4);
+    coalescer.reset();
+    QTest::qWait(coalescer.flushIntervalMs() * 4);
+    ck_assert_int_eq(spy.count(), 1);
+}
+END_TEST
+
+Suite* uiupdatecoalescer_suite(void)
+{
+    Suite* s = suite_create("UiUpdateCoalescer");
+    TCase* tc = tcase_create("Core");
+
+    tcase_add_test(tc, test_coalescer_batches_changes);
+    tcase_add_test(tc, test_coalescer_rate_is_clamped);
+    tcase_add_test(tc, test_coalescer_flush_now_and_reset);
+
+    suite_add_tcase(s, tc);
+    return s;
+}
+
+/* No main here: suite will be registered from the global test runner. */